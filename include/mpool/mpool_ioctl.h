@@ -88,11 +88,17 @@ typedef uuid_t uuid_le;
  *	mpool activate to write back the mpool metadata to the latest version
  *	used by the binary activating the mpool.
  * @MP_FLAGS_RESIZE: Resize mpool
+ * @MP_FLAGS_LAZY_LOAD: complete the activate once MDC0 is loaded and load
+ *	the other MDCs in the background, or on demand on first lookup.
+ *	Object allocation waits until all MDCs are loaded. If that load fails,
+ *	the mpool stays active but its status is MPOOL_STAT_FAULTED, the cause
+ *	is logged, and object allocation fails until it is activated again.
  */
 enum mp_mgmt_flags {
 	MP_FLAGS_FORCE,
 	MP_FLAGS_PERMIT_META_CONV,
 	MP_FLAGS_RESIZE,
+	MP_FLAGS_LAZY_LOAD,
 };
 
 /**
@@ -133,6 +139,7 @@ enum mp_media_classp {
  * @pdp_mclassp: enum mp_media_classp
  * @pdp_status:  enum pd_status
  * @pdp_state:   enum pd_state_omf
+ * @pdp_index:   index of the drive in the mpool, see struct mpioc_devprops
  * @pdp_total:   raw capacity of drive
  * @pdp_avail:   available capacity (total - bad zones) of drive
  * @pdp_spare:   spare capacity of drive
@@ -146,7 +153,8 @@ struct mp_devprops {
 	uint8_t    pdp_mclassp;
 	uint8_t    pdp_status;
 	uint8_t    pdp_state;
-	uint8_t    pdp_rsvd1[5];
+	uint8_t    pdp_index;
+	uint8_t    pdp_rsvd1[4];
 	uint64_t   pdp_total;
 	uint64_t   pdp_avail;
 	uint64_t   pdp_spare;
@@ -157,6 +165,64 @@ struct mp_devprops {
 	uint64_t   pdp_rsvd2;
 };
 
+#define MP_FRAG_NBKT    32
+
+/**
+ * struct mp_devfrag - free space fragmentation of a drive
+ * @pdf_mclassp: enum mp_media_classp
+ * @pdf_rgnc:    number of space map regions
+ * @pdf_zonesz:  zone size in bytes
+ * @pdf_free:    free zones in the space map
+ * @pdf_extc:    number of free extents
+ * @pdf_extmax:  largest free extent, in zones
+ * @pdf_hist:    pdf_hist[i] is the number of free extents of 2^i to
+ *               2^(i+1) - 1 zones
+ *
+ * An allocation of more than pdf_extmax zones, or less if it must be
+ * aligned, fails with ENOSPC whatever the free space.
+ */
+struct mp_devfrag {
+	uint8_t    pdf_mclassp;
+	uint8_t    pdf_rsvd1[3];
+	uint32_t   pdf_rgnc;
+	uint64_t   pdf_zonesz;
+	uint64_t   pdf_free;
+	uint64_t   pdf_extc;
+	uint64_t   pdf_extmax;
+	uint32_t   pdf_hist[MP_FRAG_NBKT];
+};
+
+/**
+ * struct mp_devdiscard - discard scheduler stats of a drive
+ * @pdd_mclassp:  enum mp_media_classp
+ * @pdd_qranges:  ranges queued for discard
+ * @pdd_qzones:   zones queued for discard
+ * @pdd_enqueued: ranges of deleted mblocks queued since activation
+ * @pdd_merged:   ranges merged into an adjacent queued range
+ * @pdd_issued:   discards issued
+ * @pdd_zones:    zones discarded
+ * @pdd_deferred: scheduler runs deferred by foreground I/O
+ * @pdd_errors:   discards that failed
+ * @pdd_rsvzones: erased zones in reserve for mlog allocations
+ * @pdd_rsvhits:  mlog allocations served from the reserve
+ * @pdd_rsvmisses: mlog allocations that missed the reserve
+ */
+struct mp_devdiscard {
+	uint8_t    pdd_mclassp;
+	uint8_t    pdd_rsvd1[7];
+	uint64_t   pdd_qranges;
+	uint64_t   pdd_qzones;
+	uint64_t   pdd_enqueued;
+	uint64_t   pdd_merged;
+	uint64_t   pdd_issued;
+	uint64_t   pdd_zones;
+	uint64_t   pdd_deferred;
+	uint64_t   pdd_errors;
+	uint64_t   pdd_rsvzones;
+	uint64_t   pdd_rsvhits;
+	uint64_t   pdd_rsvmisses;
+};
+
 /**
  * struct mp_params -
  * @mp_poolid:          UUID of mpool
@@ -171,6 +237,8 @@ struct mp_devprops {
  * @mp_ra_pages_max:    max VMA map readahead pages
  * @mp_vma_size_max:    max VMA map size (log2)
  * @mp_mblocksz:        mblock size by media class (MiB)
+ * @mp_smapbitmap:      media classes, as 1 << enum mp_media_classp, whose
+ *                      space maps use bitmaps, applied at activation
  * @mp_utype:           user-defined type
  * @mp_label:           user specified label
  * @mp_name:            mpool name (2x for planned expansion)
@@ -192,7 +260,7 @@ struct mpool_params {
 	uint16_t    mp_mdc0cap;
 	uint16_t    mp_mdcncap;
 	uint16_t    mp_mdcnum;
-	uint16_t    mp_rsvd1;
+	uint16_t    mp_smapbitmap;
 	uint32_t    mp_rsvd2;
 	uint64_t    mp_rsvd3;
 	uint64_t    mp_rsvd4;
@@ -584,12 +652,52 @@ struct mpioc_prop {
 	uint64_t                    pr_rsvd2;
 };
 
+/**
+ * struct mpioc_devprops - get the properties of a drive
+ * @dpr_cmn:
+ * @dpr_pdname:   drive name, or empty to select the drive by index
+ * @dpr_devprops: out, in: dpr_devprops.pdp_index if dpr_pdname is empty
+ *
+ * With an empty dpr_pdname, the drive name is returned in dpr_pdname, and
+ * ENOENT once pdp_index is past the last drive. Stepping pdp_index from 0
+ * enumerates every drive of the mpool, which the drive list of struct
+ * mpool_xprops can't hold once a media class has several drives.
+ */
 struct mpioc_devprops {
 	struct mpioc_cmn       dpr_cmn;         /* Must be first field! */
 	char                   dpr_pdname[PD_NAMESZ_MAX];
 	struct mp_devprops     dpr_devprops;
 };
 
+/**
+ * struct mpioc_devfrag - get the free space fragmentation of a drive
+ * @dfr_cmn:
+ * @dfr_pdname:  drive name, or empty to select all drives of a media class
+ * @dfr_devfrag: out, in: dfr_devfrag.pdf_mclassp if dfr_pdname is empty
+ *
+ * For a media class, the counts are summed over its drives and pdf_extmax
+ * is the largest free extent of any of them.
+ */
+struct mpioc_devfrag {
+	struct mpioc_cmn       dfr_cmn;         /* Must be first field! */
+	char                   dfr_pdname[PD_NAMESZ_MAX];
+	struct mp_devfrag      dfr_devfrag;
+};
+
+/**
+ * struct mpioc_devdiscard - get the discard scheduler stats of a drive
+ * @dds_cmn:
+ * @dds_pdname:     drive name, or empty to select all drives of a media class
+ * @dds_devdiscard: out, in: dds_devdiscard.pdd_mclassp if dds_pdname is empty
+ *
+ * For a media class, the stats are summed over its drives.
+ */
+struct mpioc_devdiscard {
+	struct mpioc_cmn       dds_cmn;         /* Must be first field! */
+	char                   dds_pdname[PD_NAMESZ_MAX];
+	struct mp_devdiscard   dds_devdiscard;
+};
+
 /**
  * struct mpioc_mblock:
  * @mb_cmn:
@@ -618,6 +726,27 @@ struct mpioc_mblock_id {
 	uint64_t            mi_objid;
 };
 
+/**
+ * struct mpioc_mblock_txn - commit and delete a set of mblocks as one unit
+ * @mt_cmn:  common ioctl header
+ * @mt_cmtc: number of objids in mt_cmtv
+ * @mt_delc: number of objids in mt_delv
+ * @mt_cmtv: objids of the uncommitted mblocks to commit
+ * @mt_delv: objids of the committed mblocks to delete
+ *
+ * All the mblocks must belong to the same MDC, and there can be at most
+ * MPIOC_MB_TXN_MAX of them.
+ */
+struct mpioc_mblock_txn {
+	struct mpioc_cmn    mt_cmn;     /* Must be first field! */
+	uint32_t            mt_cmtc;
+	uint32_t            mt_delc;
+	uint64_t __user    *mt_cmtv;
+	uint64_t __user    *mt_delv;
+};
+
+#define MPIOC_MB_TXN_MAX        (1024)
+
 #define MPIOC_KIOV_MAX          (1024)
 
 struct mpioc_mblock_rw {
@@ -664,6 +793,34 @@ struct mpioc_mlog_io {
 	uint64_t                mi_rsvd2;
 };
 
+/**
+ * struct mpioc_mlog_wait - wait for the end of an mlog to advance
+ * @mw_objid: mlog object ID
+ * @mw_gen:   mlog generation the cursor refers to, 0 for the current one
+ * @mw_off:   reader cursor (bytes); wait until the mlog end is beyond it
+ * @mw_seq:   in: last write sequence returned (0 to ignore), out: current
+ * @mw_end:   out: current mlog end (bytes)
+ * @mw_tmo:   timeout in msecs, 0 to fail with EAGAIN instead of blocking;
+ *            with mw_efd, lifetime of the notification (0 for no limit)
+ * @mw_efd:   eventfd to signal once instead of blocking, -1 for none
+ *
+ * An mlog keeps one pending notification per eventfd, re-arming replaces it,
+ * and fails with EBUSY once MLOG_WNOTIFY_MAX eventfds are pending on it.
+ *
+ * Writers that frame their own log blocks rewrite the last page of the
+ * mlog, so followers of such mlogs should wait on mw_seq.
+ */
+struct mpioc_mlog_wait {
+	struct mpioc_cmn    mw_cmn;     /* Must be first field! */
+	uint64_t            mw_objid;
+	uint64_t            mw_gen;
+	uint64_t            mw_off;
+	uint64_t            mw_seq;
+	uint64_t            mw_end;
+	uint32_t            mw_tmo;
+	int32_t             mw_efd;
+};
+
 /**
  * struct mpioc_vma
  * @map_cmn:
@@ -710,11 +867,15 @@ union mpioc_union {
 	struct mpioc_list           mpu_list;
 	struct mpioc_prop           mpu_prop;
 	struct mpioc_devprops       mpu_devprops;
+	struct mpioc_devfrag        mpu_devfrag;
+	struct mpioc_devdiscard     mpu_devdiscard;
 	struct mpioc_mlog           mpu_mlog;
 	struct mpioc_mlog_id        mpu_mlog_id;
 	struct mpioc_mlog_io        mpu_mlog_io;
+	struct mpioc_mlog_wait      mpu_mlog_wait;
 	struct mpioc_mblock         mpu_mblock;
 	struct mpioc_mblock_id      mpu_mblock_id;
+	struct mpioc_mblock_txn     mpu_mblock_txn;
 	struct mpioc_mblock_rw      mpu_mblock_rw;
 	struct mpioc_vma            mpu_vma;
 	struct mpioc_test           mpu_test;
@@ -739,6 +900,8 @@ union mpioc_union {
 #define MPIOC_PROP_GET          _IOWR(MPIOC_MAGIC, 20, struct mpioc_list)
 #define MPIOC_PROP_SET          _IOWR(MPIOC_MAGIC, 21, struct mpioc_list)
 #define MPIOC_DEVPROPS_GET      _IOWR(MPIOC_MAGIC, 22, struct mpioc_devprops)
+#define MPIOC_DEVFRAG_GET       _IOWR(MPIOC_MAGIC, 23, struct mpioc_devfrag)
+#define MPIOC_DEVDISCARD_GET    _IOWR(MPIOC_MAGIC, 24, struct mpioc_devdiscard)
 
 #define MPIOC_MLOG_ALLOC        _IOWR(MPIOC_MAGIC, 30, struct mpioc_mlog)
 #define MPIOC_MLOG_REALLOC      _IOWR(MPIOC_MAGIC, 31, struct mpioc_mlog)
@@ -754,6 +917,7 @@ union mpioc_union {
 #define MPIOC_MLOG_WRITE        _IOWR(MPIOC_MAGIC, 41, struct mpioc_mlog_io)
 #define MPIOC_MLOG_PROPS        _IOWR(MPIOC_MAGIC, 42, struct mpioc_mlog)
 #define MPIOC_MLOG_ERASE        _IOWR(MPIOC_MAGIC, 43, struct mpioc_mlog_id)
+#define MPIOC_MLOG_WAIT         _IOWR(MPIOC_MAGIC, 44, struct mpioc_mlog_wait)
 
 #define MPIOC_MB_ALLOC          _IOWR(MPIOC_MAGIC, 50, struct mpioc_mblock)
 #define MPIOC_MB_PROPS          _IOWR(MPIOC_MAGIC, 51, struct mpioc_mblock)
@@ -764,6 +928,8 @@ union mpioc_union {
 				      struct mpioc_mblock_id)
 #define MPIOC_MB_DELETE         _IOWR(MPIOC_MAGIC, 54,			\
 				      struct mpioc_mblock_id)
+#define MPIOC_MB_TXN            _IOWR(MPIOC_MAGIC, 55,			\
+				      struct mpioc_mblock_txn)
 
 #define MPIOC_MB_FIND_GET       _IOWR(MPIOC_MAGIC, 56, struct mpioc_mblock)
 #define MPIOC_MB_GET            _IOWR(MPIOC_MAGIC, 57, struct mpioc_mblock)
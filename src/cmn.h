@@ -72,11 +72,14 @@ int uuid_to_idx_insert(struct rb_root *root, struct uuid_to_idx_rb *data);
  * @utu_node:
  * @utu_key:
  * @utu_value:
+ * @utu_max:   largest utu_value in the subtree; only maintained for the
+ *             space maps, which use the smap augmented tree helpers
  */
 struct u64_to_u64_rb {
 	struct rb_node  utu_node;
 	u64             utu_key;
 	u64             utu_value;
+	u64             utu_max;
 };
 
 /**
@@ -0,0 +1,769 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+/*
+ * Discard scheduler module.
+ *
+ * Merges the zone ranges of deleted mblocks and discards them in the
+ * background, within a bandwidth and IOPS budget. Also keeps a reserve of
+ * erased zones for mlog allocations, replenished while the drive is idle.
+ */
+
+#include <linux/jiffies.h>
+#include <linux/wait.h>
+
+#include "mpcore_defs.h"
+
+static void dsched_run(struct work_struct *work);
+
+void dsched_init(struct mpool_descriptor *mp, u16 pdh)
+{
+	struct dsched *ds = &mp->pds_pdv[pdh].pdi_dsched;
+
+	spin_lock_init(&ds->ds_lock);
+	ds->ds_root = RB_ROOT;
+	INIT_DELAYED_WORK(&ds->ds_dwork, dsched_run);
+	ds->ds_mp = mp;
+	ds->ds_pdh = pdh;
+	ds->ds_rsvroot = RB_ROOT;
+	ds->ds_rsvunit = 1;
+	ds->ds_fglast = 0;
+	ds->ds_fgtime = jiffies;
+}
+
+static ulong dsched_period(struct mpool_descriptor *mp)
+{
+	return msecs_to_jiffies(max_t(u64, mp->pds_params.mp_dschedperiod, 1));
+}
+
+/**
+ * dsched_tree_insert() - insert a range in a tree of ranges
+ * @root:
+ * @zoneaddr:
+ * @zonecnt:
+ * @new:      node for the range, set to NULL if linked in the tree
+ * @old:      set to the node to free if the range joined two others
+ *
+ * The range is merged with the ranges right before and after it if they
+ * are adjacent.
+ *
+ * Return: number of ranges the new range was merged with
+ */
+static int
+dsched_tree_insert(
+	struct rb_root         *root,
+	u64                     zoneaddr,
+	u64                     zonecnt,
+	struct u64_to_u64_rb  **new,
+	struct u64_to_u64_rb  **old)
+{
+	struct u64_to_u64_rb   *prev = NULL, *next = NULL;
+	struct rb_node        **link, *parent = NULL;
+
+	*old = NULL;
+
+	/* Find the ranges right before and right after the new one. */
+	link = &root->rb_node;
+	while (*link) {
+		struct u64_to_u64_rb *elem;
+
+		parent = *link;
+		elem = rb_entry(parent, struct u64_to_u64_rb, utu_node);
+
+		if (zoneaddr < elem->utu_key) {
+			next = elem;
+			link = &parent->rb_left;
+		} else {
+			prev = elem;
+			link = &parent->rb_right;
+		}
+	}
+
+	if (prev && prev->utu_key + prev->utu_value == zoneaddr) {
+		prev->utu_value += zonecnt;
+
+		if (next && zoneaddr + zonecnt == next->utu_key) {
+			prev->utu_value += next->utu_value;
+			rb_erase(&next->utu_node, root);
+			*old = next;
+			return 2;
+		}
+
+		return 1;
+	}
+
+	if (next && zoneaddr + zonecnt == next->utu_key) {
+		/* Extending next downward keeps the tree ordered. */
+		next->utu_key = zoneaddr;
+		next->utu_value += zonecnt;
+		return 1;
+	}
+
+	(*new)->utu_key = zoneaddr;
+	(*new)->utu_value = zonecnt;
+	rb_link_node(&(*new)->utu_node, parent, link);
+	rb_insert_color(&(*new)->utu_node, root);
+	*new = NULL;
+
+	return 0;
+}
+
+/**
+ * dsched_free_zones() - return a range of zones to the smap
+ * @ds:
+ * @zoneaddr:
+ * @zonecnt:
+ */
+static void dsched_free_zones(struct dsched *ds, u64 zoneaddr, u64 zonecnt)
+{
+	struct mpool_descriptor    *mp = ds->ds_mp;
+	struct mpool_dev_info      *pd = &mp->pds_pdv[ds->ds_pdh];
+	merr_t                      err;
+	u64                         cnt;
+
+	/* smap_free() takes at most U16_MAX zones at a time. */
+	for (; zonecnt > 0; zonecnt -= cnt, zoneaddr += cnt) {
+		cnt = min_t(u64, zonecnt, U16_MAX);
+
+		err = smap_free(mp, ds->ds_pdh, zoneaddr, cnt);
+		if (err)
+			mp_pr_err("mpool %s, releasing drive %s zones %lu-%lu failed",
+				  err, mp->pds_name, pd->pdi_name,
+				  (ulong)zoneaddr, (ulong)(zoneaddr + cnt - 1));
+	}
+}
+
+/**
+ * dsched_free_tree() - return all the ranges of a tree to the smap
+ * @ds:
+ * @root: tree detached from ds
+ */
+static void dsched_free_tree(struct dsched *ds, struct rb_root *root)
+{
+	struct u64_to_u64_rb   *elem;
+	struct rb_node         *node;
+
+	while ((node = rb_first(root))) {
+		elem = rb_entry(node, struct u64_to_u64_rb, utu_node);
+		rb_erase(node, root);
+
+		dsched_free_zones(ds, elem->utu_key, elem->utu_value);
+		kmem_cache_free(u64_to_u64_rb_cache, elem);
+	}
+}
+
+merr_t
+dsched_enqueue(
+	struct mpool_descriptor    *mp,
+	u16                         pdh,
+	u64                         zoneaddr,
+	u32                         zonecnt)
+{
+	struct dsched          *ds = &mp->pds_pdv[pdh].pdi_dsched;
+	struct u64_to_u64_rb   *new, *old;
+	int                     merged;
+
+	new = kmem_cache_alloc(u64_to_u64_rb_cache, GFP_KERNEL);
+	if (!new)
+		return merr(ENOMEM);
+
+	spin_lock(&ds->ds_lock);
+	if (ds->ds_stopped) {
+		spin_unlock(&ds->ds_lock);
+		kmem_cache_free(u64_to_u64_rb_cache, new);
+		return merr(ESHUTDOWN);
+	}
+
+	merged = dsched_tree_insert(&ds->ds_root, zoneaddr, zonecnt,
+				    &new, &old);
+
+	ds->ds_enqueued++;
+	ds->ds_merged += merged;
+	ds->ds_qranges += 1 - merged;
+	ds->ds_qzones += zonecnt;
+
+	/*
+	 * A no-op if the scheduler is already queued, so ranges deleted
+	 * within a period have a chance to merge before they're issued.
+	 */
+	queue_delayed_work(mp->pds_erase_wq, &ds->ds_dwork, dsched_period(mp));
+	spin_unlock(&ds->ds_lock);
+
+	if (new)
+		kmem_cache_free(u64_to_u64_rb_cache, new);
+	if (old)
+		kmem_cache_free(u64_to_u64_rb_cache, old);
+
+	return 0;
+}
+
+/**
+ * dsched_discard() - discard a range and return its zones to the smap
+ * @ds:
+ * @zoneaddr:
+ * @zonecnt:
+ */
+static void dsched_discard(struct dsched *ds, u64 zoneaddr, u32 zonecnt)
+{
+	struct mpool_descriptor    *mp = ds->ds_mp;
+	struct mpool_dev_info      *pd = &mp->pds_pdv[ds->ds_pdh];
+	struct ecio_err_report      erpt;
+	merr_t                      err;
+
+	erpt_init(&erpt);
+
+	if (mpool_pd_status_get(pd) == PD_STAT_UNAVAIL) {
+		err = merr(EIO);
+	} else {
+		err = pd_bio_erase(pd, zoneaddr, zonecnt, 0);
+
+		/* As ecio_mblock_erase() does. */
+		ecio_pd_status_update(mp, ds->ds_pdh, &erpt);
+	}
+
+	spin_lock(&ds->ds_lock);
+	ds->ds_issued++;
+	ds->ds_zones += zonecnt;
+	if (err)
+		ds->ds_errors++;
+	spin_unlock(&ds->ds_lock);
+
+	/* Discard is advisory, the zones are freed whether or not it failed. */
+	dsched_free_zones(ds, zoneaddr, zonecnt);
+
+	/* Let the allocators waiting for the zones retry. */
+	atomic_sub(zonecnt, &pd->pdi_erasing);
+	atomic_inc(&mp->pds_erasegen);
+	wake_up_all(&mp->pds_erasewq);
+}
+
+/**
+ * dsched_issue() - discard the first queued range, up to maxzones zones
+ * @ds:
+ * @maxzones:
+ *
+ * Ranges are issued in zone address order, the remainder of a range larger
+ * than maxzones stays queued.
+ *
+ * Return: number of zones discarded, 0 if the queue is empty
+ */
+static u32 dsched_issue(struct dsched *ds, u64 maxzones)
+{
+	struct u64_to_u64_rb   *elem;
+	struct rb_node         *node;
+	u64                     zoneaddr;
+	u32                     zonecnt;
+
+	spin_lock(&ds->ds_lock);
+	node = rb_first(&ds->ds_root);
+	if (!node) {
+		spin_unlock(&ds->ds_lock);
+		return 0;
+	}
+
+	elem = rb_entry(node, struct u64_to_u64_rb, utu_node);
+	zoneaddr = elem->utu_key;
+	zonecnt = min_t(u64, min(elem->utu_value, maxzones), U32_MAX);
+
+	if (zonecnt == elem->utu_value) {
+		rb_erase(&elem->utu_node, &ds->ds_root);
+		ds->ds_qranges--;
+	} else {
+		elem->utu_key += zonecnt;
+		elem->utu_value -= zonecnt;
+		elem = NULL;
+	}
+	ds->ds_qzones -= zonecnt;
+	spin_unlock(&ds->ds_lock);
+
+	if (elem)
+		kmem_cache_free(u64_to_u64_rb_cache, elem);
+
+	dsched_discard(ds, zoneaddr, zonecnt);
+
+	return zonecnt;
+}
+
+/**
+ * dsched_busy() - sample the foreground I/O rate of the drive
+ * @ds:
+ *
+ * Return: true if the rate is above mp_dschedfgiops
+ */
+static bool dsched_busy(struct dsched *ds)
+{
+	struct mpool_descriptor    *mp = ds->ds_mp;
+	ulong                       now = jiffies;
+	u64                         fgio, rate;
+	u32                         ms;
+
+	/* Sampled from the drive's I/O counts, the I/O path isn't touched. */
+	fgio = pd_io_issued(&mp->pds_pdv[ds->ds_pdh]);
+	ms = max_t(u32, jiffies_to_msecs(now - ds->ds_fgtime), 1);
+	rate = (fgio - ds->ds_fglast) * MSEC_PER_SEC / ms;
+
+	ds->ds_fglast = fgio;
+	ds->ds_fgtime = now;
+
+	return mp->pds_params.mp_dschedfgiops &&
+		rate >= mp->pds_params.mp_dschedfgiops;
+}
+
+/**
+ * dsched_defer() - check whether discards should wait for foreground I/O
+ * @ds:
+ * @busy: the drive is busy with foreground I/O
+ *
+ * Discards are deferred while the drive is busy, but for no longer than
+ * mp_dscheddefer ms at a time so that the queue still drains under a
+ * sustained load.
+ */
+static bool dsched_defer(struct dsched *ds, bool busy)
+{
+	struct mpool_descriptor    *mp = ds->ds_mp;
+	ulong                       now = jiffies;
+
+	if (!busy) {
+		ds->ds_defer = 0;
+		return false;
+	}
+
+	if (!ds->ds_defer) {
+		ds->ds_defer = now +
+			msecs_to_jiffies(mp->pds_params.mp_dscheddefer);
+	} else if (time_after_eq(now, ds->ds_defer)) {
+		ds->ds_defer = 0;
+		return false;
+	}
+
+	spin_lock(&ds->ds_lock);
+	ds->ds_deferred++;
+	spin_unlock(&ds->ds_lock);
+
+	return true;
+}
+
+/**
+ * dsched_rsv_target() - size of the erased zone reserve of the drive
+ * @ds:
+ *
+ * Return: target number of zones in the reserve, 0 if it has none
+ */
+static u64 dsched_rsv_target(struct dsched *ds)
+{
+	struct mpool_dev_info  *pd = &ds->ds_mp->pds_pdv[ds->ds_pdh];
+	struct mc_smap_parms    mcsp;
+
+	if (mc_smap_parms_get(ds->ds_mp, pd->pdi_mclass, &mcsp))
+		return 0;
+
+	return mcsp.mcsp_rsvzones;
+}
+
+/**
+ * dsched_rsv_fill() - add an erased range to the reserve
+ * @ds:
+ * @target: target number of zones in the reserve
+ *
+ * Allocates ds_rsvunit zones, the size of the largest mlog that could not be
+ * served from the reserve, and erases them as ecio_mlog_erase() would.
+ *
+ * Return: number of zones added, 0 if the reserve is full or on error
+ */
+static u64 dsched_rsv_fill(struct dsched *ds, u64 target)
+{
+	struct mpool_descriptor    *mp = ds->ds_mp;
+	struct mpool_dev_info      *pd = &mp->pds_pdv[ds->ds_pdh];
+	struct u64_to_u64_rb       *new, *old;
+	struct mc_smap_parms        mcsp;
+	u64                         zoneaddr, zonecnt, align;
+	merr_t                      err;
+	int                         merged;
+
+	spin_lock(&ds->ds_lock);
+	zonecnt = ds->ds_rsvunit;
+	if (ds->ds_rsvfail || ds->ds_rsvzones >= target)
+		zonecnt = 0;
+	spin_unlock(&ds->ds_lock);
+
+	if (!zonecnt || mpool_pd_status_get(pd) == PD_STAT_UNAVAIL)
+		return 0;
+
+	err = mc_smap_parms_get(mp, pd->pdi_mclass, &mcsp);
+	if (ev(err))
+		return 0;
+
+	new = kmem_cache_alloc(u64_to_u64_rb_cache, GFP_KERNEL);
+	if (!new)
+		return 0;
+
+	/* Same alignment as pmd_layout_alloc() would use for the mlog. */
+	align = roundup_pow_of_two(min_t(u64, zonecnt, mcsp.mcsp_align));
+
+	down_read(&mp->pds_pdvlock);
+	err = smap_alloc(mp, ds->ds_pdh, zonecnt, SMAP_SPC_USABLE_ONLY,
+			 &zoneaddr, align);
+	up_read(&mp->pds_pdvlock);
+
+	if (!err) {
+		err = pd_bio_erase(pd, zoneaddr, zonecnt,
+				   PD_ERASE_READS_ERASED);
+		if (err)
+			dsched_free_zones(ds, zoneaddr, zonecnt);
+	}
+
+	if (err) {
+		/* Don't retry until the next mlog allocation. */
+		spin_lock(&ds->ds_lock);
+		ds->ds_rsvfail = true;
+		spin_unlock(&ds->ds_lock);
+
+		kmem_cache_free(u64_to_u64_rb_cache, new);
+		return 0;
+	}
+
+	spin_lock(&ds->ds_lock);
+	merged = dsched_tree_insert(&ds->ds_rsvroot, zoneaddr, zonecnt,
+				    &new, &old);
+	ds->ds_rsvranges += 1 - merged;
+	ds->ds_rsvzones += zonecnt;
+	spin_unlock(&ds->ds_lock);
+
+	if (new)
+		kmem_cache_free(u64_to_u64_rb_cache, new);
+	if (old)
+		kmem_cache_free(u64_to_u64_rb_cache, old);
+
+	return zonecnt;
+}
+
+/**
+ * dsched_rsv_evict() - make room in the reserve for a range of zonecnt zones
+ * @ds:
+ * @zonecnt: new ds_rsvunit
+ * @target:  target number of zones in the reserve
+ * @stale:   tree to which the evicted ranges are moved
+ *
+ * Ranges too small for zonecnt zones are moved to @stale until a range of
+ * zonecnt zones fits in the reserve. The ranges large enough are kept.
+ */
+static void
+dsched_rsv_evict(
+	struct dsched      *ds,
+	u64                 zonecnt,
+	u64                 target,
+	struct rb_root     *stale)
+{
+	struct u64_to_u64_rb   *elem;
+	struct rb_node         *node, *next, *tail = NULL;
+
+	for (node = rb_first(&ds->ds_rsvroot); node; node = next) {
+		if (ds->ds_rsvzones + zonecnt <= target)
+			break;
+
+		next = rb_next(node);
+		elem = rb_entry(node, struct u64_to_u64_rb, utu_node);
+		if (elem->utu_value >= zonecnt)
+			continue;
+
+		rb_erase(node, &ds->ds_rsvroot);
+		ds->ds_rsvranges--;
+		ds->ds_rsvzones -= elem->utu_value;
+
+		rb_link_node(node, tail, tail ? &tail->rb_right :
+			     &stale->rb_node);
+		rb_insert_color(node, stale);
+		tail = node;
+	}
+}
+
+merr_t
+dsched_rsv_get(
+	struct mpool_descriptor    *mp,
+	u16                         pdh,
+	u64                         zonecnt,
+	u64                        *zoneaddr)
+{
+	struct dsched          *ds = &mp->pds_pdv[pdh].pdi_dsched;
+	struct mpool_dev_info  *pd = &mp->pds_pdv[pdh];
+	struct u64_to_u64_rb   *elem = NULL, *new, *old = NULL;
+	struct rb_root          stale = RB_ROOT;
+	struct mc_smap_parms    mcsp;
+	struct rb_node         *node;
+	bool                    hit = false;
+	u64                     align, addr = 0, end = 0;
+	int                     merged;
+
+	if (mc_smap_parms_get(mp, pd->pdi_mclass, &mcsp) ||
+	    !mcsp.mcsp_rsvzones)
+		return merr(ENOENT);
+
+	/* Same alignment as pmd_layout_alloc() would use for the mlog. */
+	align = roundup_pow_of_two(min_t(u64, zonecnt, mcsp.mcsp_align));
+
+	/* For the remainder of a range split in two. */
+	new = kmem_cache_alloc(u64_to_u64_rb_cache, GFP_KERNEL);
+
+	spin_lock(&ds->ds_lock);
+	if (ds->ds_stopped) {
+		spin_unlock(&ds->ds_lock);
+		if (new)
+			kmem_cache_free(u64_to_u64_rb_cache, new);
+		return merr(ENOENT);
+	}
+
+	/*
+	 * Smaller mlogs are carved from larger ranges, at the alignment they
+	 * would get from the smap, so that mixed mlog sizes share a reserve.
+	 */
+	for (node = rb_first(&ds->ds_rsvroot); node; node = rb_next(node)) {
+		elem = rb_entry(node, struct u64_to_u64_rb, utu_node);
+		addr = ALIGN(elem->utu_key, align);
+		end = elem->utu_key + elem->utu_value;
+
+		if (addr + zonecnt > end)
+			continue;
+
+		/* Splitting the range in two needs a node. */
+		if (addr > elem->utu_key && addr + zonecnt < end && !new)
+			continue;
+
+		hit = true;
+		break;
+	}
+
+	if (hit) {
+		*zoneaddr = addr;
+
+		if (addr > elem->utu_key) {
+			/* Keep the head in elem and the tail in a new node. */
+			elem->utu_value = addr - elem->utu_key;
+			addr += zonecnt;
+			if (addr < end) {
+				merged = dsched_tree_insert(&ds->ds_rsvroot,
+							    addr, end - addr,
+							    &new, &old);
+				ds->ds_rsvranges += 1 - merged;
+			}
+			elem = NULL;
+		} else if (addr + zonecnt < end) {
+			elem->utu_key += zonecnt;
+			elem->utu_value -= zonecnt;
+			elem = NULL;
+		} else {
+			rb_erase(&elem->utu_node, &ds->ds_rsvroot);
+			ds->ds_rsvranges--;
+		}
+		ds->ds_rsvzones -= zonecnt;
+		ds->ds_rsvhits++;
+	} else {
+		/*
+		 * No range is large enough for this mlog size. The reserve
+		 * is refilled with ranges of this size, from which smaller
+		 * mlogs are carved too, evicting only the ranges that are
+		 * too small for it if the reserve is full.
+		 */
+		if (zonecnt > ds->ds_rsvunit &&
+		    zonecnt <= mcsp.mcsp_rsvzones) {
+			ds->ds_rsvunit = zonecnt;
+			dsched_rsv_evict(ds, zonecnt, mcsp.mcsp_rsvzones,
+					 &stale);
+		}
+		ds->ds_rsvmisses++;
+		elem = NULL;
+	}
+	ds->ds_rsvfail = false;
+
+	queue_delayed_work(mp->pds_erase_wq, &ds->ds_dwork, dsched_period(mp));
+	spin_unlock(&ds->ds_lock);
+
+	if (elem)
+		kmem_cache_free(u64_to_u64_rb_cache, elem);
+	if (new)
+		kmem_cache_free(u64_to_u64_rb_cache, new);
+	if (old)
+		kmem_cache_free(u64_to_u64_rb_cache, old);
+
+	dsched_free_tree(ds, &stale);
+
+	return hit ? 0 : merr(ENOENT);
+}
+
+bool dsched_rsv_release(struct mpool_descriptor *mp, u16 pdh)
+{
+	struct dsched  *ds = &mp->pds_pdv[pdh].pdi_dsched;
+	struct rb_root  root;
+
+	spin_lock(&ds->ds_lock);
+	root = ds->ds_rsvroot;
+	ds->ds_rsvroot = RB_ROOT;
+	ds->ds_rsvranges = 0;
+	ds->ds_rsvzones = 0;
+	ds->ds_rsvfail = true;
+	spin_unlock(&ds->ds_lock);
+
+	if (RB_EMPTY_ROOT(&root))
+		return false;
+
+	dsched_free_tree(ds, &root);
+
+	return true;
+}
+
+static void dsched_run(struct work_struct *work)
+{
+	struct mpool_descriptor    *mp;
+	struct mpool_dev_info      *pd;
+	struct dsched              *ds;
+	u64                         zonesz, zones, ios, target;
+	u64                         mbps, iops, period;
+	bool                        urgent, busy, drained = false;
+	u64                         cnt;
+
+	ds = container_of(work, struct dsched, ds_dwork.work);
+	mp = ds->ds_mp;
+	pd = &mp->pds_pdv[ds->ds_pdh];
+
+	spin_lock(&ds->ds_lock);
+	urgent = ds->ds_kicked;
+	ds->ds_kicked = false;
+	spin_unlock(&ds->ds_lock);
+
+	/*
+	 * Allocators waiting for the queued zones bypass the budget, as do
+	 * drives without discard support on which the erase is a no-op.
+	 */
+	urgent = urgent || waitqueue_active(&mp->pds_erasewq) ||
+		 !(pd->pdi_cmdopt & PD_CMD_DISCARD);
+
+	busy = dsched_busy(ds);
+	target = dsched_rsv_target(ds);
+
+	zones = U64_MAX;
+	ios = U64_MAX;
+
+	if (!urgent) {
+		if (dsched_defer(ds, busy))
+			goto requeue;
+
+		mbps = mp->pds_params.mp_dschedmbps;
+		iops = mp->pds_params.mp_dschediops;
+		period = max_t(u64, mp->pds_params.mp_dschedperiod, 1);
+		zonesz = (u64)pd->pdi_zonepg << PAGE_SHIFT;
+
+		if (mbps)
+			zones = max_t(u64, 1, ((mbps << 20) * period /
+					       MSEC_PER_SEC) / zonesz);
+		if (iops)
+			ios = max_t(u64, 1, iops * period / MSEC_PER_SEC);
+	}
+
+	for (; ios > 0 && zones > 0; ios--) {
+		cnt = dsched_issue(ds, zones);
+		if (!cnt) {
+			drained = true;
+			break;
+		}
+
+		zones -= cnt;
+	}
+
+	/*
+	 * The reserve is replenished out of what is left of the budget once
+	 * the queue is drained, and only while the drive is idle.
+	 */
+	if (drained && !busy && !urgent) {
+		for (; ios > 0 && zones > 0; ios--) {
+			cnt = dsched_rsv_fill(ds, target);
+			if (!cnt)
+				break;
+
+			zones -= min(cnt, zones);
+		}
+	}
+
+requeue:
+	spin_lock(&ds->ds_lock);
+	if (!ds->ds_stopped &&
+	    (!RB_EMPTY_ROOT(&ds->ds_root) ||
+	     (!ds->ds_rsvfail && ds->ds_rsvzones < target)))
+		queue_delayed_work(mp->pds_erase_wq, &ds->ds_dwork,
+				   dsched_period(mp));
+	spin_unlock(&ds->ds_lock);
+}
+
+void dsched_kick(struct mpool_descriptor *mp, u16 pdh)
+{
+	struct dsched *ds = &mp->pds_pdv[pdh].pdi_dsched;
+
+	spin_lock(&ds->ds_lock);
+	if (!ds->ds_stopped && !RB_EMPTY_ROOT(&ds->ds_root)) {
+		ds->ds_kicked = true;
+		mod_delayed_work(mp->pds_erase_wq, &ds->ds_dwork, 0);
+	}
+	spin_unlock(&ds->ds_lock);
+}
+
+void dsched_mpool_start(struct mpool_descriptor *mp)
+{
+	struct dsched  *ds;
+	int             i;
+
+	for (i = 0; i < mp->pds_pdvcnt; i++) {
+		ds = &mp->pds_pdv[i].pdi_dsched;
+
+		if (!dsched_rsv_target(ds))
+			continue;
+
+		spin_lock(&ds->ds_lock);
+		if (!ds->ds_stopped)
+			queue_delayed_work(mp->pds_erase_wq, &ds->ds_dwork,
+					   dsched_period(mp));
+		spin_unlock(&ds->ds_lock);
+	}
+}
+
+void dsched_mpool_stop(struct mpool_descriptor *mp)
+{
+	struct dsched  *ds;
+	int             i;
+
+	for (i = 0; i < mp->pds_pdvcnt; i++) {
+		ds = &mp->pds_pdv[i].pdi_dsched;
+
+		spin_lock(&ds->ds_lock);
+		ds->ds_stopped = true;
+		spin_unlock(&ds->ds_lock);
+
+		cancel_delayed_work_sync(&ds->ds_dwork);
+
+		while (dsched_issue(ds, U64_MAX))
+			;
+
+		dsched_rsv_release(mp, i);
+	}
+}
+
+void
+dsched_drive_stats(
+	struct mpool_descriptor    *mp,
+	u16                         pdh,
+	struct mp_devdiscard       *stats)
+{
+	struct dsched *ds = &mp->pds_pdv[pdh].pdi_dsched;
+
+	spin_lock(&ds->ds_lock);
+	stats->pdd_qranges = ds->ds_qranges;
+	stats->pdd_qzones = ds->ds_qzones;
+	stats->pdd_enqueued = ds->ds_enqueued;
+	stats->pdd_merged = ds->ds_merged;
+	stats->pdd_issued = ds->ds_issued;
+	stats->pdd_zones = ds->ds_zones;
+	stats->pdd_deferred = ds->ds_deferred;
+	stats->pdd_errors = ds->ds_errors;
+	stats->pdd_rsvzones = ds->ds_rsvzones;
+	stats->pdd_rsvhits = ds->ds_rsvhits;
+	stats->pdd_rsvmisses = ds->ds_rsvmisses;
+	spin_unlock(&ds->ds_lock);
+}
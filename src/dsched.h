@@ -0,0 +1,192 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (C) 2015-2020 Micron Technology, Inc.  All rights reserved.
+ */
+
+#ifndef MPOOL_DSCHED_PRIV_H
+#define MPOOL_DSCHED_PRIV_H
+
+#include <linux/rbtree.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+
+/* Forward Decls */
+struct mp_devdiscard;
+struct mpool_descriptor;
+
+/*
+ * Discard scheduler.
+ *
+ * The zones of deleted mblocks are queued to a per-drive discard scheduler
+ * instead of being erased one object at a time. Adjacent ranges are merged
+ * as they are queued, and a delayed work on mperasewq issues the merged
+ * ranges within a bandwidth and IOPS budget, deferring them while the drive
+ * is busy with foreground I/O. The zones of a range go back to the space
+ * map once its discard completes.
+ *
+ * The same work keeps a reserve of erased zones per drive, sized by media
+ * class, from which mlogs are allocated first so that they need not be
+ * erased inline. The reserve is replenished once the discard queue is
+ * drained and the drive is idle, and is released on ENOSPC.
+ */
+
+/**
+ * struct dsched - per-drive discard scheduler
+ * @ds_lock:     protects the queue and the stats
+ * @ds_root:     queued ranges, node: struct u64_to_u64_rb, zone address
+ *               (utu_key) to zone count (utu_value)
+ * @ds_dwork:    issues the queued ranges
+ * @ds_mp:       mpool of the drive
+ * @ds_pdh:      drive number within the mpool_descriptor
+ * @ds_stopped:  set once the scheduler is stopped, ranges are then erased
+ *               synchronously by the caller
+ * @ds_kicked:   an allocator is waiting for the queued zones
+ * @ds_fglast:   foreground reads and writes issued to the drive as of the
+ *               last run of the scheduler, see pd_io_issued()
+ * @ds_fgtime:   jiffies of the last run of the scheduler
+ * @ds_defer:    jiffies until which discards may be deferred, or 0
+ * @ds_rsvroot:  erased ranges in reserve for mlogs, same node type as
+ *               ds_root
+ * @ds_rsvunit:  zones per range added to the reserve, only grows
+ * @ds_rsvfail:  the reserve could not be replenished, or was released;
+ *               set until the next mlog allocation
+ * @ds_rsvranges: ranges in the reserve
+ * @ds_rsvzones: zones in the reserve
+ * @ds_rsvhits:  mlog allocations served from the reserve
+ * @ds_rsvmisses: mlog allocations that missed the reserve
+ * @ds_qranges:  ranges in the queue
+ * @ds_qzones:   zones in the queue
+ * @ds_enqueued: ranges queued since activation
+ * @ds_merged:   ranges merged into a queued range
+ * @ds_issued:   discards issued
+ * @ds_zones:    zones discarded
+ * @ds_deferred: scheduler runs deferred by foreground I/O
+ * @ds_errors:   discards that failed
+ */
+struct dsched {
+	spinlock_t              ds_lock;
+	struct rb_root          ds_root;
+	struct delayed_work     ds_dwork;
+	struct mpool_descriptor *ds_mp;
+	u16                     ds_pdh;
+	bool                    ds_stopped;
+	bool                    ds_kicked;
+	u64                     ds_fglast;
+	ulong                   ds_fgtime;
+	ulong                   ds_defer;
+	struct rb_root          ds_rsvroot;
+	u64                     ds_rsvunit;
+	bool                    ds_rsvfail;
+	u64                     ds_rsvranges;
+	u64                     ds_rsvzones;
+	u64                     ds_rsvhits;
+	u64                     ds_rsvmisses;
+	u64                     ds_qranges;
+	u64                     ds_qzones;
+	u64                     ds_enqueued;
+	u64                     ds_merged;
+	u64                     ds_issued;
+	u64                     ds_zones;
+	u64                     ds_deferred;
+	u64                     ds_errors;
+};
+
+/**
+ * dsched_init() - initialize the discard scheduler of a drive
+ * @mp:  struct mpool_descriptor *
+ * @pdh: drive number within the mpool_descriptor
+ */
+void dsched_init(struct mpool_descriptor *mp, u16 pdh);
+
+/**
+ * dsched_enqueue() - queue a range of zones for discard
+ * @mp:       struct mpool_descriptor *
+ * @pdh:      drive number within the mpool_descriptor
+ * @zoneaddr: first zone of the range
+ * @zonecnt:  number of zones in the range
+ *
+ * The zones must be accounted in pdi_erasing; they are freed to the space
+ * map, and pdi_erasing is decremented, once the range is discarded.
+ *
+ * Return: 0 if the range was queued, merr_t otherwise in which case the
+ * caller must erase and free the zones itself.
+ */
+merr_t
+dsched_enqueue(
+	struct mpool_descriptor    *mp,
+	u16                         pdh,
+	u64                         zoneaddr,
+	u32                         zonecnt);
+
+/**
+ * dsched_kick() - run the discard scheduler of a drive now
+ * @mp:  struct mpool_descriptor *
+ * @pdh: drive number within the mpool_descriptor
+ *
+ * Called by allocators waiting for queued zones.
+ */
+void dsched_kick(struct mpool_descriptor *mp, u16 pdh);
+
+/**
+ * dsched_rsv_get() - allocate erased zones from the reserve of a drive
+ * @mp:       struct mpool_descriptor *
+ * @pdh:      drive number within the mpool_descriptor
+ * @zonecnt:  number of zones to allocate
+ * @zoneaddr: set to the first zone allocated
+ *
+ * The zones are carved from the first range of the reserve in which they fit
+ * at the alignment pmd_layout_alloc() would use. On a miss the reserve is
+ * refilled with ranges of @zonecnt zones, if that is larger than the ranges
+ * it was filled with so far.
+ *
+ * Return: 0 if the zones were allocated, merr_t otherwise in which case
+ * the caller must allocate them from the smap and erase them.
+ */
+merr_t
+dsched_rsv_get(
+	struct mpool_descriptor    *mp,
+	u16                         pdh,
+	u64                         zonecnt,
+	u64                        *zoneaddr);
+
+/**
+ * dsched_rsv_release() - return the reserve of a drive to the smap
+ * @mp:  struct mpool_descriptor *
+ * @pdh: drive number within the mpool_descriptor
+ *
+ * Called when an allocation fails with ENOSPC. The reserve is not
+ * replenished until the next mlog allocation.
+ *
+ * Return: true if zones were released
+ */
+bool dsched_rsv_release(struct mpool_descriptor *mp, u16 pdh);
+
+/**
+ * dsched_mpool_start() - start filling the erased zone reserves
+ * @mp: struct mpool_descriptor *
+ */
+void dsched_mpool_start(struct mpool_descriptor *mp);
+
+/**
+ * dsched_mpool_stop() - stop the discard schedulers of an mpool
+ * @mp: struct mpool_descriptor *
+ *
+ * Discards all queued ranges and frees their zones, and releases the
+ * erased zone reserves. Must be called before the space maps and mperasewq
+ * are torn down, and once no more erases are pending on mperasewq.
+ */
+void dsched_mpool_stop(struct mpool_descriptor *mp);
+
+/**
+ * dsched_drive_stats() - Report the discard scheduler stats of a drive
+ * @mp:    struct mpool_descriptor *
+ * @pdh:   drive number within the mpool_descriptor
+ * @stats: struct mp_devdiscard *, structure to fill in
+ */
+void
+dsched_drive_stats(
+	struct mpool_descriptor    *mp,
+	u16                         pdh,
+	struct mp_devdiscard       *stats);
+
+#endif
@@ -217,7 +217,7 @@ ecio_mbrw_argcheck(
 	return 0;
 }
 
-static void
+void
 ecio_pd_status_update(
 	struct mpool_descriptor    *mp,
 	uint                        pdh,
@@ -297,7 +297,8 @@ ecio_mblock_write(
  * Read mblock starting at byte offset boff;
  * and transparently handles media failures if possible; boff and read length
  * must be OS page multiples;
- * caller MUST hold pmd_obj_*lock() on layout.
+ * caller MUST hold pmd_obj_*lock() on layout, or, for a committed mblock,
+ * a ref taken with pmd_obj_get() for the duration of the read.
  *
  * Returns: 0 if successful, merr_t otherwise
  */
@@ -444,6 +445,9 @@ ecio_mlog_read(
 /*
  * Erase mlog; caller MUST hold pmd_obj_wrlock() on layout.
  *
+ * The first erase of an mlog allocated from an erased zone reserve is
+ * skipped.
+ *
  * Returns: 0 if successful, merr_t if error
  */
 merr_t
@@ -462,6 +466,11 @@ ecio_mlog_erase(
 	if (ev(err))
 		return err;
 
+	if (layout->eld_state & ECIO_LYT_ERASED) {
+		layout->eld_state &= ~ECIO_LYT_ERASED;
+		return 0;
+	}
+
 	/* PD_ERASE_READS_ERASED: need to read from the erased blocks */
 	flags |= PD_ERASE_READS_ERASED;
 
@@ -561,6 +570,10 @@ ecio_layout_alloc(
 		}
 		layout->eld_mlo->mlo_layout = layout;
 		mpool_uuid_copy(&layout->eld_uuid, uuid);
+		init_waitqueue_head(&layout->eld_mlo->mlo_wq);
+		spin_lock_init(&layout->eld_mlo->mlo_wlock);
+		INIT_LIST_HEAD(&layout->eld_mlo->mlo_wnotify);
+		layout->eld_mlo->mlo_wnotifyc = 0;
 	}
 
 	layout->eld_objid     = objid;
@@ -568,7 +581,7 @@ ecio_layout_alloc(
 	layout->eld_mblen     = mblen;
 	layout->eld_state     = ECIO_LYT_NONE;
 	layout->eld_rwlock    = rwl;
-	layout->eld_refcnt    = 1;
+	atomic_long_set(&layout->eld_refcnt, 1);
 	layout->eld_ld.ol_zcnt = zcnt;
 	layout->eld_magic     = objid;
 
@@ -583,8 +596,19 @@ ecio_layout_alloc(
 	return layout;
 }
 
+static void ecio_layout_free_rcu(struct rcu_head *rh)
+{
+	struct ecio_layout_descriptor  *layout;
+
+	layout = container_of(rh, struct ecio_layout_descriptor, eld_rcu);
+	kmem_cache_free(ecio_layout_desc_cache, layout);
+}
+
 /*
  * Deallocate all memory associated with object layout.
+ *
+ * The descriptor itself is freed after an RCU grace period because lockless
+ * lookups in the per-MDC object index may still be dereferencing it.
  */
 void ecio_layout_free(struct ecio_layout_descriptor *layout)
 {
@@ -596,7 +620,7 @@ void ecio_layout_free(struct ecio_layout_descriptor *layout)
 	WARN(layout->eld_magic != layout->eld_objid,
 	     "%s: %px, magic %lx, objid %lx, refcnt %ld",
 	     __func__, layout, layout->eld_magic,
-	     (ulong)layout->eld_objid, layout->eld_refcnt);
+	     (ulong)layout->eld_objid, ecio_layout_refcnt(layout));
 
 	assert(layout->eld_magic == layout->eld_objid);
 
@@ -612,10 +636,11 @@ void ecio_layout_free(struct ecio_layout_descriptor *layout)
 	 */
 	if (pmd_objid_type(layout->eld_objid) == OMF_OBJ_MLOG) {
 		assert(mlo != NULL);
+		mlog_wait_release(layout);
 		kmem_cache_free(ecio_layout_mlo_cache, mlo);
 	}
 
-	kmem_cache_free(ecio_layout_desc_cache, layout);
+	call_rcu(&layout->eld_rcu, ecio_layout_free_rcu);
 }
 
 inline u32
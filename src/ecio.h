@@ -11,6 +11,14 @@
 #ifndef MPOOL_ECIO_PRIV_H
 #define MPOOL_ECIO_PRIV_H
 
+#include <linux/version.h>
+#include <linux/rcupdate.h>
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 4, 0)
+#include <linux/rhashtable.h>
+#define ECIO_HAVE_RHASHTABLE
+#endif
+
 #include "pd.h"
 
 struct mlog_stat;
@@ -26,11 +34,13 @@ struct ecio_layout_descriptor;
  * ECIO_LYT_NONE:      no flags set
  * ECIO_LYT_COMMITTED: object is committed to media
  * ECIO_LYT_REMOVED:   object logically removed (aborted or deleted)
+ * ECIO_LYT_ERASED:    zones allocated already erased, from an mlog reserve
  */
 enum ecio_layout_state {
 	ECIO_LYT_NONE       = 0,
 	ECIO_LYT_COMMITTED  = 1,
 	ECIO_LYT_REMOVED    = 2,
+	ECIO_LYT_ERASED     = 4,
 };
 
 /*
@@ -41,12 +51,24 @@ enum ecio_layout_state {
  * @mlo_layout:  back pointer to the layout
  * @mlo_nodeoml: links this mlog in the mpool open mlogs tree
  * @mlo_uuid:    unique ID per mlog
+ * @mlo_wend:    mlog end (bytes) as of the last append, flush or write
+ * @mlo_wseq:    bumped each time mlo_wend is published
+ * @mlo_wq:      tail followers waiting for mlo_wend to advance
+ * @mlo_wlock:   protects mlo_wnotify and mlo_wnotifyc
+ * @mlo_wnotify: one-shot eventfd notifications, list of mlog_wnotify
+ * @mlo_wnotifyc: number of entries on mlo_wnotify
  */
 struct ecio_layout_mlo {
 	struct mlog_stat              *mlo_lstat;
 	struct ecio_layout_descriptor *mlo_layout;
 	struct rb_node                 mlo_nodeoml;
 	struct mpool_uuid              mlo_uuid;
+	u64                            mlo_wend;
+	u64                            mlo_wseq;
+	wait_queue_head_t              mlo_wq;
+	spinlock_t                     mlo_wlock;
+	struct list_head               mlo_wnotify;
+	u32                            mlo_wnotifyc;
 };
 
 /*
@@ -55,7 +77,8 @@ struct ecio_layout_mlo {
  * LOCKING:
  * + objid: constant; no locking required
  * + lstat: lstat and *lstat are protected by pmd_obj_*lock()
- * + refcnt and isdel: protected by mmi_reflock of object's MDC
+ * + refcnt: atomic, including the ECIO_REF_DEAD bit
+ * + hnode: protected by the per-MDC object index (rhashtable)
  * + all other fields: see notes
  */
 
@@ -77,34 +100,57 @@ struct ecio_layout_mlo {
  *   further details.
  *
  * @eld_nodemdc: for both ucobj and obj rbtrees, obj. only in one tree
+ * @eld_hnode:   for the per-MDC object index, covers both trees
  * @eld_objid:   object id associated with layout
  * @eld_rwlock:  implements pmd_obj_*lock() for this layout
  * @eld_mblen:   Amount of data written in the mblock in bytes (0 for mlogs)
- * @eld_isdel:   true if object is logically deleted
  * @eld_state:   enum ecio_layout_state
  * @eld_flags:   enum mlog_open_flags for mlogs
  * @eld_mlo:     info. specific to an mlog, NULL for mblocks.
  * @eld_gen:     object generation
- * @eld_refcnt:  user ref count from alloc/get/put
+ * @eld_refcnt:  user ref count from alloc/get/put, with ECIO_REF_DEAD set
+ *               once the object is logically deleted
  * @eld_ld:
+ * @eld_rcu:     defers the free of the layout past index lookups
  */
 struct ecio_layout_descriptor {
 	struct rb_node                  eld_nodemdc;
+#ifdef ECIO_HAVE_RHASHTABLE
+	struct rhash_head               eld_hnode;
+#endif
 	u64                             eld_objid;
 	struct rw_semaphore            *eld_rwlock;
 	u32                             eld_mblen;
-	bool                            eld_isdel;
 	u8                              eld_state;
 	u8                              eld_flags;
 
 	struct ecio_layout_mlo         *eld_mlo;
 	u64                             eld_gen;
 
-	long                            eld_refcnt;
+	atomic_long_t                   eld_refcnt;
 	struct omf_layout_descriptor    eld_ld;
 	uintptr_t                       eld_magic;
+	struct rcu_head                 eld_rcu;
 };
 
+/*
+ * ECIO_REF_DEAD - eld_refcnt flag for a logically deleted object
+ *
+ * Set, with the count cleared, by abort and delete in a single cmpxchg so
+ * that gets and puts racing with them fail without taking a lock.
+ */
+#define ECIO_REF_DEAD   (1L << (BITS_PER_LONG - 2))
+
+static inline long ecio_layout_refcnt(struct ecio_layout_descriptor *layout)
+{
+	return atomic_long_read(&layout->eld_refcnt) & ~ECIO_REF_DEAD;
+}
+
+static inline bool ecio_layout_isdel(struct ecio_layout_descriptor *layout)
+{
+	return atomic_long_read(&layout->eld_refcnt) & ECIO_REF_DEAD;
+}
+
 /* Shortcuts */
 #define eld_lstat   eld_mlo->mlo_lstat
 #define eld_pcs     eld_mlo->mlo_pcs
@@ -208,6 +254,19 @@ ecio_mblock_read(
 	u64                             boff,
 	struct ecio_err_report         *erpt);
 
+/**
+ * ecio_pd_status_update() - update the status of a drive after an I/O
+ *
+ * @mp:   struct mpool_descriptor *
+ * @pdh:  drive number within the mpool_descriptor
+ * @erpt: struct ecio_err_report * of the I/O
+ */
+void
+ecio_pd_status_update(
+	struct mpool_descriptor    *mp,
+	uint                        pdh,
+	struct ecio_err_report     *erpt);
+
 /**
  * ecio_mblock_erase() - erase an mblock
  *
@@ -169,6 +169,30 @@ mblock_is_committed(struct mpool_descriptor *mp, struct mblock_descriptor *mbh);
 merr_t
 mblock_delete(struct mpool_descriptor *mp, struct mblock_descriptor *mbh);
 
+/**
+ * mblock_txn() -
+ * @mp:
+ * @cmtv: uncommitted mblocks to commit
+ * @cmtc: number of mblocks in cmtv
+ * @delv: committed mblocks to delete
+ * @delc: number of mblocks in delv
+ *
+ * Commit and delete a set of mblocks as one unit: after a crash either all
+ * or none of the commits and deletes took effect. The mblocks must all
+ * belong to the same MDC. If successful the handles in delv are invalid.
+ *
+ * Return: %0 if successful, merr_t otherwise...
+ * EXDEV if the mblocks don't all belong to the same MDC
+ * E2BIG if the set is too large to be logged atomically
+ */
+merr_t
+mblock_txn(
+	struct mpool_descriptor    *mp,
+	struct mblock_descriptor  **cmtv,
+	u32                         cmtc,
+	struct mblock_descriptor  **delv,
+	u32                         delc);
+
 /**
  * mblock_write() -
  * @mp:
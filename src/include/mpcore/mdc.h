@@ -17,6 +17,7 @@
 
 struct mpool_descriptor;
 struct mlog_descriptor;
+struct mlog_rec;
 
 /**
  * struct mp_mdc: MDC handle
@@ -225,6 +226,23 @@ mp_mdc_append(
 	ssize_t         len,
 	bool            sync);
 
+/**
+ * mp_mdc_append_batch() - append a batch of records to MDC
+ * @mdc:      MDC handle
+ * @recv:     records to append; mr_off is set on return
+ * @recc:     number of records
+ * @flags:    enum mlog_append_flags
+ *
+ * The records are packed under a single acquisition of the MDC and, with
+ * MLOG_AF_SYNC, made durable with a single flush.
+ */
+uint64_t
+mp_mdc_append_batch(
+	struct mp_mdc      *mdc,
+	struct mlog_rec    *recv,
+	u32                 recc,
+	u32                 flags);
+
 /**
  * mp_mdc_cstart() - Initiate MDC compaction
  * @mdc:      MDC handle
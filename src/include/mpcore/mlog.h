@@ -21,6 +21,7 @@
 struct mpool_descriptor;
 struct mlog_descriptor;
 struct mpool_obj_layout;
+struct eventfd_ctx;
 
 /*
  * mlog API functions
@@ -146,9 +147,64 @@ mlog_append_datav(
 	u64                         buflen,
 	int                         sync);
 
+/**
+ * struct mlog_rec - one record of an mlog_append_batch() call
+ * @mr_iov: iovec holding the record data
+ * @mr_len: record length in bytes
+ * @mr_off: output, log byte offset of the record; U64_MAX if not appended
+ */
+struct mlog_rec {
+	struct iovec   *mr_iov;
+	u64             mr_len;
+	u64             mr_off;
+};
+
+/**
+ * enum mlog_append_flags - mlog_append_batch() flags
+ * @MLOG_AF_SYNC:   return only once the batch is on media
+ * @MLOG_AF_ATOMIC: append the batch to a single flush set flagged atomic in
+ *	its log block headers along with its no. of log blocks; mlog_open()
+ *	drops such a flush set if some of its log blocks are missing, so that
+ *	either all or none of the batch is recovered after a crash
+ */
+enum mlog_append_flags {
+	MLOG_AF_SYNC   = 0x1,
+	MLOG_AF_ATOMIC = 0x2,
+};
+
+merr_t
+mlog_append_batch(
+	struct mpool_descriptor    *mp,
+	struct mlog_descriptor     *mlh,
+	struct mlog_rec            *recv,
+	u32                         recc,
+	u32                         flags);
+
+/**
+ * enum mlog_read_flags - read iterator modes
+ * @MLOG_RD_DURABLE: return only records that have been flushed to media.
+ *	Without it, records still sitting in the append buffer are returned
+ *	too, served directly from memory and without forcing a flush.
+ */
+enum mlog_read_flags {
+	MLOG_RD_DURABLE = 0x1,
+};
+
 merr_t
 mlog_read_data_init(struct mpool_descriptor *mp, struct mlog_descriptor *mlh);
 
+/**
+ * mlog_read_data_init_flags() - mlog_read_data_init() with a read mode
+ * @mp:
+ * @mlh:
+ * @flags: enum mlog_read_flags
+ */
+merr_t
+mlog_read_data_init_flags(
+	struct mpool_descriptor    *mp,
+	struct mlog_descriptor     *mlh,
+	u32                         flags);
+
 /**
  * mlog_read_data_next()
  * @mp:
@@ -157,6 +213,9 @@ mlog_read_data_init(struct mpool_descriptor *mp, struct mlog_descriptor *mlh);
  * @buflen:
  * @rdlen:
  *
+ * Unless the iterator was set up with MLOG_RD_DURABLE, records appended but
+ * not yet flushed are returned from the append buffer.
+ *
  * Returns:
  *   If merr_errno(return value) is EOVERFLOW, then "buf" is too small to
  *   hold the read data. Can be retried with a bigger receive buffer whose
@@ -170,6 +229,23 @@ mlog_read_data_next(
 	u64                         buflen,
 	u64                        *rdlen);
 
+/**
+ * mlog_seek_read_data_next() - skip seek bytes of data records, then read
+ *	the next data record
+ * @mp:
+ * @mlh:
+ * @seek:   data bytes to skip, a sum of whole data record lengths
+ * @buf:
+ * @buflen:
+ * @rdlen:
+ *
+ * Like mlog_read_data_seek(), the skip starts from the in-memory sparse
+ * record index, so its cost doesn't grow with the distance skipped.
+ *
+ * Returns:
+ *   merr_t with errno ERANGE if the log ends before seek bytes, with the
+ *   bytes skipped in rdlen
+ */
 merr_t
 mlog_seek_read_data_next(
 	struct mpool_descriptor    *mp,
@@ -179,6 +255,52 @@ mlog_seek_read_data_next(
 	u64                         buflen,
 	u64                        *rdlen);
 
+/**
+ * mlog_read_data_seek() - position the read iterator at a data record
+ * @mp:
+ * @mlh:
+ * @recno: data record number (0-based) to be returned by the next
+ *	mlog_read_data_next()
+ *
+ * Uses the in-memory sparse record index to start the scan close to recno,
+ * so the cost is bounded by the index sampling interval rather than by recno.
+ *
+ * Returns:
+ *   0 on success; merr_t with errno ERANGE if the log holds fewer than
+ *   recno data records
+ */
+merr_t
+mlog_read_data_seek(
+	struct mpool_descriptor    *mp,
+	struct mlog_descriptor     *mlh,
+	u64                         recno);
+
+/**
+ * mlog_wait_data() - wait for the end of an mlog to advance
+ * @mp:
+ * @mlh:
+ * @gen:   mlog generation the cursor refers to, 0 for the current one
+ * @off:   reader cursor (bytes); wait until the mlog end is beyond it
+ * @tmo:   timeout in msecs, 0 to return EAGAIN instead of blocking
+ * @efd:   if not NULL, arm a one-shot eventfd notification and return
+ * @seq:   in: last write sequence seen (0 to ignore), out: current one
+ * @end:   current mlog end (output)
+ *
+ * Returns:
+ *   0 on success; merr_t with errno ESTALE if the mlog was erased,
+ *   ETIMEDOUT, EAGAIN or EINTR otherwise
+ */
+merr_t
+mlog_wait_data(
+	struct mpool_descriptor    *mp,
+	struct mlog_descriptor     *mlh,
+	u64                         gen,
+	u64                         off,
+	u32                         tmo,
+	struct eventfd_ctx         *efd,
+	u64                        *seq,
+	u64                        *end);
+
 merr_t
 mlog_get_props(
 	struct mpool_descriptor    *mp,
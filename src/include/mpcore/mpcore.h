@@ -39,7 +39,9 @@ struct mp_obj_descriptor; /* for any mpool object: mblock, mlog, etc... */
 #define PD_SECTORMASK(_pd_prop) \
 	((uint64_t)(1 << PD_SECTORSZ(&pd->pdi_prop)) - 1)
 
-#define MPOOL_DRIVES_MAX           MP_MED_NUMBER
+/* Drives per media class, the ordinal of a drive in its class fits 4 bits */
+#define MPOOL_MC_DRIVES_MAX        8
+#define MPOOL_DRIVES_MAX           (MP_MED_NUMBER * MPOOL_MC_DRIVES_MAX)
 
 /**
  * enum mpool_status -
@@ -449,10 +451,12 @@ mpool_get_xprops(struct mpool_descriptor *mp, struct mpool_xprops *xprops);
  * @pdname:
  * @dprop:
  *
- * Fill in dprop for active drive with name pdname
+ * Fill in dprop for active drive with name pdname. If pdname is empty, fill
+ * in dprop for the drive at index dprop->pdp_index instead, and copy its
+ * name to pdname, which must hold PD_NAMESZ_MAX bytes.
  *
  * Return: %0 if success, merr_t otherwise...
- * -ENOENT if device with specified name cannot be found
+ * -ENOENT if device with specified name or index cannot be found
  */
 merr_t
 mpool_get_devprops_by_name(
@@ -460,6 +464,36 @@ mpool_get_devprops_by_name(
 	char                       *pdname,
 	struct mp_devprops         *dprop);
 
+/**
+ * mpool_get_devfrag() - get the free space fragmentation of a drive
+ * @mp:
+ * @pdname: drive name, or empty to sum over the drives of frag->pdf_mclassp
+ * @frag:
+ *
+ * Return: %0 if success, merr_t otherwise...
+ * -ENOENT if the drive or media class cannot be found
+ */
+merr_t
+mpool_get_devfrag(
+	struct mpool_descriptor    *mp,
+	const char                 *pdname,
+	struct mp_devfrag          *frag);
+
+/**
+ * mpool_get_devdiscard() - get the discard scheduler stats of a drive
+ * @mp:
+ * @pdname: drive name, or empty to sum over the drives of stats->pdd_mclassp
+ * @stats:
+ *
+ * Return: %0 if success, merr_t otherwise...
+ * -ENOENT if the drive or media class cannot be found
+ */
+merr_t
+mpool_get_devdiscard(
+	struct mpool_descriptor    *mp,
+	const char                 *pdname,
+	struct mp_devdiscard       *stats);
+
 /**
  * mpool_get_usage() -
  * @mp:
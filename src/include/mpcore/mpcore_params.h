@@ -15,15 +15,26 @@
 
 /*
  * Space map allocation zones per drive; bounds number of concurrent obj
- * allocs
+ * allocs. The default grows with the number of CPUs, up to the max.
  */
 #define MPOOL_SMAP_RGNCNT_DEFAULT 4
+#define MPOOL_SMAP_RGNCNT_MAX    16
+
+/*
+ * Space map allocations start from the region of the allocating CPU.
+ */
+#define MPOOL_SMAP_CPURGN_DEFAULT       1
 
 /*
  * Space map alignment in number of zones.
  */
 #define MPOOL_SMAP_ZONEALIGN_DEFAULT    1
 
+/*
+ * Media classes (bitmask of 1 << mp_media_classp) using bitmap space maps.
+ */
+#define MPOOL_SMAP_BITMAP_DEFAULT       0
+
 /*
  * Number of concurent jobs for loading user MDC 1~N
  */
@@ -37,7 +48,25 @@
 #define MPOOL_PCO_NBNOALLOC              2
 #define MPOOL_PCO_PERIOD                 5
 #define MPOOL_PCO_FILLBIAS	      1000
+#define MPOOL_PCO_JOBS                   2
+#define MPOOL_PCO_BUDGET         (64 << 20)
 #define MPOOL_PD_USAGE_PERIOD        60000
+
+/*
+ * Defaults for the background discard of deleted mblocks.
+ */
+#define MPOOL_DSCHED_PERIOD             10
+#define MPOOL_DSCHED_MBPS             1024
+#define MPOOL_DSCHED_IOPS              256
+#define MPOOL_DSCHED_FGIOPS           5000
+#define MPOOL_DSCHED_DEFER            1000
+
+/*
+ * Erased zones kept in reserve for mlog allocations, on the drives of the
+ * media classes in the bitmask (1 << mp_media_classp).
+ */
+#define MPOOL_MLOG_RSV_ZONES             8
+#define MPOOL_MLOG_RSV_MCLASS         0x03
 #define MPOOL_CREATE_MDC_PCTFULL  (MPOOL_PCO_PCTFULL - MPOOL_PCO_PCTGARBAGE)
 #define MPOOL_CREATE_MDC_PCTGRBG   MPOOL_PCO_PCTGARBAGE
 
@@ -50,6 +79,13 @@
  * @mp_mdcnnum: Number of MDCs, *ONLY* for testing purpose
  * @mp_smaprgnc:
  * @mp_smapalign:
+ * @mp_smapcpurgn: if set, each CPU allocates from its own home region of
+ *	the space maps and only moves to the other regions when it is full,
+ *	else the starting region is rotated on each allocation.
+ * @mp_smapbitmap: bitmask of the media classes, as 1 << mp_media_classp,
+ *	whose drives use a bitmap instead of an extent tree per space map
+ *	region. Suited to classes where nearly all allocations are one zone.
+ *	Taken from mpool_params.mp_smapbitmap at create and activate.
  * @mp_spare:
  * @mp_objloadjobs: number of concurrent MDC loading jobs
  *
@@ -69,12 +105,30 @@
  *	This bias favors object allocation from less filled MDCs (in term
  *	of number of committed objects).
  *	The bigger the number, the less bias.
+ * @mp_pcojobs: max number of MDCs pre-compacted in parallel.
+ * @mp_pcobudget: In bytes. Max amount of live MDC records being rewritten
+ *	by the running pre-compactions. A single pre-compaction can always
+ *	run, whatever its size.
  * @mp_crtmdcpctfull: percent full threshold across all MDCs in combination
  *      with crtmdcpctgrbg percent is used as a trigger to create new MDCs
  * @mp_crtmdcpctgrbg: percent garbage threshold in combination with
  *      @crtmdcpctfull percent is used as a trigger to create new MDCs
  * @mp_mpusageperiod: period at which a background thread check mpool space
  * usage, in milliseconds
+ *
+ * The below parameters starting with "dsched" are used by the per-drive
+ * discard scheduler of deleted mblocks
+ * @mp_dschedperiod: In milliseconds. Period at which the queued ranges
+ *	are issued; ranges deleted within a period may merge.
+ * @mp_dschedmbps: In MiB/s. Discard bandwidth budget, 0 for no limit.
+ * @mp_dschediops: Discards per second budget, 0 for no limit.
+ * @mp_dschedfgiops: Foreground reads and writes per second on a drive
+ *	above which its discards are deferred, 0 to never defer.
+ * @mp_dscheddefer: In milliseconds. Max time discards are deferred.
+ * @mp_mlogrsv: number of erased zones kept in reserve per drive for mlog
+ *	allocations, replenished while the drive is idle.
+ * @mp_mlogrsvmclass: bitmask of the media classes, as 1 << mp_media_classp,
+ *	whose drives keep an mlog reserve.
  */
 struct mpcore_params {
 	u64    mp_mdcnum;
@@ -82,6 +136,8 @@ struct mpcore_params {
 	u64    mp_mdcncap;
 	u64    mp_smaprgnc;
 	u64    mp_smapalign;
+	u64    mp_smapbitmap;
+	u64    mp_smapcpurgn;
 	u64    mp_spare;
 	u64    mp_objloadjobs;
 	u64    mp_pcopctfull;
@@ -89,9 +145,18 @@ struct mpcore_params {
 	u64    mp_pconbnoalloc;
 	u64    mp_pcoperiod;
 	u64    mp_pcofillbias;
+	u64    mp_pcojobs;
+	u64    mp_pcobudget;
 	u64    mp_crtmdcpctfull;
 	u64    mp_crtmdcpctgrbg;
 	u64    mp_mpusageperiod;
+	u64    mp_dschedperiod;
+	u64    mp_dschedmbps;
+	u64    mp_dschediops;
+	u64    mp_dschedfgiops;
+	u64    mp_dscheddefer;
+	u64    mp_mlogrsv;
+	u64    mp_mlogrsvmclass;
 };
 
 /**
@@ -285,7 +285,8 @@ void mpool_mod_exit(void)
 	if (atomic_dec_return(&mpool_mod_refcnt) > 0)
 		return;
 
-	/* Destroy the slab caches. */
+	/* Destroy the slab caches, layouts are freed via call_rcu(). */
+	rcu_barrier();
 	kmem_cache_destroy(ecio_layout_desc_cache);
 	ecio_layout_desc_cache = NULL;
 	kmem_cache_destroy(ecio_layout_mlo_cache);
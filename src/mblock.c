@@ -62,7 +62,7 @@ mblock2layout(struct mblock_descriptor *mbh)
 	WARN(layout->eld_magic != layout->eld_objid,
 	     "%s: %px, magic %lx, objid %lx, refcnt %ld",
 	     __func__, layout, layout->eld_magic,
-	     (ulong)layout->eld_objid, layout->eld_refcnt);
+	     (ulong)layout->eld_objid, ecio_layout_refcnt(layout));
 
 	assert(layout->eld_magic == layout->eld_objid);
 #endif
@@ -189,10 +189,9 @@ mblock_get(
 	if (ev(!layout))
 		return merr(EINVAL);
 
-	/* A read lock is sufficient here because pmd_obj_rdlock will take
-	 * the mmi_reflock mutex while it increments the refcount; we just
-	 * need to prevent the layout from being deleted while we grab the
-	 * ref
+	/* A read lock is sufficient here because pmd_obj_get() increments
+	 * the refcount atomically; we just need to prevent the layout from
+	 * being deleted while we grab the ref
 	 */
 	pmd_obj_rdlock(mp, layout);
 
@@ -336,6 +335,40 @@ merr_t mblock_delete(struct mpool_descriptor *mp, struct mblock_descriptor *mbh)
 	return pmd_obj_delete(mp, layout);
 }
 
+merr_t
+mblock_txn(
+	struct mpool_descriptor    *mp,
+	struct mblock_descriptor  **cmtv,
+	u32                         cmtc,
+	struct mblock_descriptor  **delv,
+	u32                         delc)
+{
+	struct ecio_layout_descriptor  *layout;
+	merr_t                          err;
+	u32                             i;
+
+	if ((cmtc && !cmtv) || (delc && !delv))
+		return merr(EINVAL);
+
+	/* mblock handles are layouts; validate them before the cast below */
+	for (i = 0; i < cmtc + delc; i++) {
+		layout = mblock2layout(i < cmtc ? cmtv[i] : delv[i - cmtc]);
+		if (ev(!layout)) {
+			mp_pr_layout_not_found(mp, i < cmtc ?
+					       cmtv[i] : delv[i - cmtc]);
+			return merr(EINVAL);
+		}
+	}
+
+	err = pmd_obj_txn(mp, (struct ecio_layout_descriptor **)cmtv, cmtc,
+			  (struct ecio_layout_descriptor **)delv, delc);
+	if (ev(err))
+		mp_pr_rl("mpool %s, mblock txn of %u commits %u deletes failed",
+			 err, mp->pds_name, cmtc, delc);
+
+	return err;
+}
+
 merr_t
 mblock_write(
 	struct mpool_descriptor    *mp,
@@ -393,6 +426,32 @@ mblock_read(
 		return merr(EINVAL);
 	}
 
+	/*
+	 * A committed mblock is immutable, so it is read without the layout
+	 * rw lock. That lock comes from a shared pool and would otherwise
+	 * bounce between readers of unrelated mblocks. The read holds its own
+	 * ref on the layout instead, so that a delete racing with it, even one
+	 * on the caller's ref, fails with EBUSY rather than freeing the layout.
+	 * A read of an mblock already deleted fails with ENOENT.
+	 */
+	if (READ_ONCE(layout->eld_state) == ECIO_LYT_COMMITTED) {
+		err = pmd_obj_get(mp, layout);
+		if (ev(err)) {
+			err = merr(ENOENT);
+			mp_pr_rl("mpool %s, mblock 0x%lx deleted",
+				 err, mp->pds_name, (ulong)layout->eld_objid);
+			return err;
+		}
+
+		smp_rmb(); /* pairs with smp_wmb() in pmd_obj_commit_done() */
+
+		err = ecio_mblock_read(mp, layout, iov, iovcnt, boff, &erpt);
+
+		pmd_obj_put(mp, layout);
+
+		return err;
+	}
+
 	/*
 	 * read lock the mblock layout; mblock reads can proceed
 	 * concurrently; Taking the layout rw lock in read protects
@@ -19,6 +19,7 @@ mc_init_class(
 {
 	memcpy(&(mc->mc_parms), mc_parms, sizeof(*mc_parms));
 	mc->mc_uacnt = 0;
+	mc->mc_pdcnt = 0;
 	mc->mc_sparms = *mcsp;
 }
 
@@ -95,14 +96,40 @@ mc_set_spzone(
 	return 0;
 }
 
+u8 mc_ord_next(struct mpool_descriptor *mp, enum mp_media_classp mclass)
+{
+	struct media_class *mc;
+
+	ulong   used = 0;
+	int     i;
+
+	if (!mclassp_valid(mclass))
+		return 0;
+
+	mc = &mp->pds_mc[mclass];
+	if (mc->mc_pdmc < 0)
+		return 0;
+
+	for (i = 0; i < mc->mc_pdcnt; i++)
+		used |= 1ul << mp->pds_pdv[mc->mc_pdv[i]].pdi_mcord;
+
+	return ffz(used);
+}
+
 static void
 mc_smap_parms_get_internal(
 	struct mpool_descriptor    *mp,
+	enum mp_media_classp        mclass,
 	struct mc_smap_parms       *mcsp)
 {
 	mcsp->mcsp_spzone = mp->pds_params.mp_spare;
 	mcsp->mcsp_rgnc   = mp->pds_params.mp_smaprgnc;
 	mcsp->mcsp_align = mp->pds_params.mp_smapalign;
+	mcsp->mcsp_bitmap = !!(mp->pds_params.mp_smapbitmap & (1ul << mclass));
+
+	mcsp->mcsp_rsvzones = 0;
+	if (mp->pds_params.mp_mlogrsvmclass & (1ul << mclass))
+		mcsp->mcsp_rsvzones = mp->pds_params.mp_mlogrsv;
 }
 
 merr_t
@@ -120,7 +147,7 @@ mc_smap_parms_get(
 	if (mc->mc_pdmc >= 0)
 		*mcsp = mc->mc_sparms;
 	else
-		mc_smap_parms_get_internal(mp, mcsp);
+		mc_smap_parms_get_internal(mp, mclass, mcsp);
 
 	return 0;
 }
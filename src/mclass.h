@@ -35,28 +35,42 @@ struct mc_parms {
  * @mcsp_spzone: percent spare zones for drives.
  * @mcsp_rgnc: no. of space map zones for drives in each media class
  * @mcsp_align: space map zone alignment for drives in each media class
+ * @mcsp_bitmap: space map regions are bitmaps rather than extent trees
+ * @mcsp_rsvzones: erased zones kept in reserve for mlog allocations
  */
 struct mc_smap_parms {
 	u8		mcsp_spzone;
 	u8		mcsp_rgnc;
 	u8		mcsp_align;
+	u8		mcsp_bitmap;
+	u32		mcsp_rsvzones;
 };
 
 /**
  * struct media_class - define a media class
  * @mc_parms:  define a media class, content differ for each media class
  * @mc_sparms: space map params for this media class
- * @mc_pdmc:   active pdv entries grouped by media class array
+ * @mc_pdmc:   first drive added to the media class, -1 if the class is empty
  * @mc_uacnt:  UNAVAIL status drive count in each media class
+ * @mc_pdcnt:  number of drives in the media class
+ * @mc_pdv:    drives of the media class, in the order they were added
+ *
+ * A media class spans up to MPOOL_MC_DRIVES_MAX drives with the same
+ * mc_parms. Each drive has an ordinal within its class, persisted with the
+ * drive parameters, which identifies the drive of an object in its MDC
+ * records.
  *
  * Locking:
- *    Protected by mp.pds_pdvlock.
+ *    Protected by mp.pds_pdvlock. Drives are never removed from a media
+ *    class, so mc_pdv[x], x < mc_pdcnt, doesn't change once set.
  */
 struct media_class {
 	struct mc_parms        mc_parms;
 	struct mc_smap_parms   mc_sparms;
 	s8                     mc_pdmc;
 	u8                     mc_uacnt;
+	u8                     mc_pdcnt;
+	u16                    mc_pdv[MPOOL_MC_DRIVES_MAX];
 };
 
 /**
@@ -138,6 +152,15 @@ static inline bool mclassp_valid(enum mp_media_classp mclass)
 	return (mclass >= 0 && mclass < MP_MED_NUMBER);
 };
 
+/**
+ * mc_ord_next() - get the ordinal of a new drive in a media class.
+ * @mp:
+ * @mclass:
+ *
+ * Return: the lowest ordinal not used by a drive of the media class.
+ */
+u8 mc_ord_next(struct mpool_descriptor *mp, enum mp_media_classp mclass);
+
 /**
  * mc_smap_parms_get() - get space map params for the specified mclass.
  * @mp:
@@ -783,6 +783,34 @@ uint64_t mp_mdc_append(struct mp_mdc *mdc, void *data, ssize_t len, bool sync)
 	return err;
 }
 
+uint64_t
+mp_mdc_append_batch(
+	struct mp_mdc      *mdc,
+	struct mlog_rec    *recv,
+	u32                 recc,
+	u32                 flags)
+{
+	merr_t err;
+	bool   rw = true;
+
+	if (!mdc || (recc && !recv))
+		return merr(EINVAL);
+
+	err = mdc_acquire(mdc, rw);
+	if (ev(err))
+		return err;
+
+	err = mlog_append_batch(mdc->mdc_mp, mdc->mdc_alogh, recv, recc, flags);
+	if (err)
+		mp_pr_rl("mpool %s, mdc %p batch append failed, mlog %p, recc %u flags 0x%x",
+			 err, mdc->mdc_mpname, mdc,
+			 mdc->mdc_alogh, recc, flags);
+
+	mdc_release(mdc, rw);
+
+	return err;
+}
+
 uint64_t mp_mdc_usage(struct mp_mdc *mdc, size_t *usage)
 {
 	merr_t err;
@@ -5,6 +5,7 @@
 
 #include <linux/mm.h>
 #include <linux/log2.h>
+#include <linux/eventfd.h>
 #include <asm/page.h>
 
 #include <mpcore/mdc.h>
@@ -243,10 +244,9 @@ mlog_get(
 		return merr(EINVAL);
 
 	/*
-	 * A read lock is sufficient here because pmd_obj_rdlock will take
-	 * the mmi_reflock mutex while it increments the refcount; we just
-	 * need to prevent the layout from being deleted while we grab the
-	 * ref
+	 * A read lock is sufficient here because pmd_obj_get() increments
+	 * the refcount atomically; we just need to prevent the layout from
+	 * being deleted while we grab the ref
 	 */
 	pmd_obj_rdlock(mp, layout);
 
@@ -465,6 +465,232 @@ mlog_extract_fsetparms(
 		*nseclpg = MLOG_NSECLPG(lstat);
 }
 
+/**
+ * mlog_ridx_add() - Sample a record start into the sparse record index.
+ *
+ * @lstat: mlog stat
+ * @soff:  LB offset of the log block holding the record descriptor
+ * @roff:  offset of the record descriptor in log block soff
+ *
+ * An entry is added only if the last entry is at least MLOG_NSECMB log
+ * blocks behind soff, so that positioning at an entry followed by a forward
+ * scan never needs more than one read buffer fill to reach the next entry.
+ */
+static void mlog_ridx_add(struct mlog_stat *lstat, off_t soff, u16 roff)
+{
+	struct mlog_ridx_ent *rie;
+
+	if (!lstat->lst_ridx || lstat->lst_ridxcnt >= lstat->lst_ridxmax)
+		return;
+
+	if (lstat->lst_ridxcnt > 0) {
+		rie = &lstat->lst_ridx[lstat->lst_ridxcnt - 1];
+		if (soff < rie->rie_soff + MLOG_NSECMB(lstat))
+			return;
+	}
+
+	rie = &lstat->lst_ridx[lstat->lst_ridxcnt++];
+
+	rie->rie_recno = lstat->lst_nrec;
+	rie->rie_dlen  = lstat->lst_dlen;
+	rie->rie_soff  = soff;
+	rie->rie_roff  = roff;
+}
+
+/**
+ * mlog_ridx_trim() - Drop sparse index entries beyond the append offset.
+ *
+ * @lstat: mlog stat
+ *
+ * Called after a failed CFS flush rewinds the append offset, so that the
+ * index never references records that didn't make it to media.
+ */
+static void mlog_ridx_trim(struct mlog_stat *lstat)
+{
+	struct mlog_ridx_ent *rie;
+
+	while (lstat->lst_ridxcnt > 0) {
+		rie = &lstat->lst_ridx[lstat->lst_ridxcnt - 1];
+
+		if (rie->rie_soff < lstat->lst_wsoff ||
+		    (rie->rie_soff == lstat->lst_wsoff &&
+		     rie->rie_roff < lstat->lst_aoff))
+			break;
+
+		--lstat->lst_ridxcnt;
+	}
+}
+
+/**
+ * mlog_ridx_find() - Find the last sparse index entry at or before recno.
+ *
+ * @lstat: mlog stat
+ * @recno: data record number (0-based)
+ *
+ * Returns: index entry, or NULL if recno precedes the first entry
+ */
+static struct mlog_ridx_ent *
+mlog_ridx_find(struct mlog_stat *lstat, u64 recno)
+{
+	struct mlog_ridx_ent *rie = NULL;
+	u32                   lo, hi, mid;
+
+	lo = 0;
+	hi = lstat->lst_ridxcnt;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+
+		if (lstat->lst_ridx[mid].rie_recno <= recno) {
+			rie = &lstat->lst_ridx[mid];
+			lo  = mid + 1;
+		} else {
+			hi  = mid;
+		}
+	}
+
+	return rie;
+}
+
+/**
+ * mlog_ridx_find_dlen() - Find the last sparse index entry preceded by
+ * fewer than dlen data bytes.
+ *
+ * @lstat: mlog stat
+ * @dlen:  data bytes from the start of the log
+ *
+ * Returns: index entry, or NULL if the first entry is already preceded by
+ * dlen data bytes
+ */
+static struct mlog_ridx_ent *
+mlog_ridx_find_dlen(struct mlog_stat *lstat, u64 dlen)
+{
+	struct mlog_ridx_ent *rie = NULL;
+	u32                   lo, hi, mid;
+
+	lo = 0;
+	hi = lstat->lst_ridxcnt;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+
+		if (lstat->lst_ridx[mid].rie_dlen < dlen) {
+			rie = &lstat->lst_ridx[mid];
+			lo  = mid + 1;
+		} else {
+			hi  = mid;
+		}
+	}
+
+	return rie;
+}
+
+/**
+ * mlog_wait_done() - Tail-follow wait condition.
+ *
+ * @layout: mlog layout
+ * @gen:    generation the reader cursor refers to
+ * @off:    reader cursor
+ * @seq:    last mlo_wseq seen by the reader, 0 to ignore
+ *
+ * The sequence lets clients that frame their own log blocks (and hence
+ * rewrite the last, partially filled, page) detect progress that doesn't
+ * move the end past a page-granular cursor.
+ */
+static inline bool
+mlog_wait_done(
+	struct ecio_layout_descriptor  *layout,
+	u64                             gen,
+	u64                             off,
+	u64                             seq)
+{
+	struct ecio_layout_mlo *mlo = layout->eld_mlo;
+
+	return READ_ONCE(layout->eld_gen) != gen ||
+		READ_ONCE(mlo->mlo_wend) > off ||
+		(seq && READ_ONCE(mlo->mlo_wseq) != seq);
+}
+
+/**
+ * mlog_wnotify_run() - Signal and drop the eventfd notifications whose
+ * wait condition now holds, and drop those that expired.
+ *
+ * @layout: mlog layout
+ */
+static void mlog_wnotify_run(struct ecio_layout_descriptor *layout)
+{
+	struct ecio_layout_mlo *mlo = layout->eld_mlo;
+	struct mlog_wnotify    *mwn, *next;
+	ulong                   now = jiffies;
+	LIST_HEAD(done);
+	LIST_HEAD(expired);
+
+	if (list_empty_careful(&mlo->mlo_wnotify))
+		return;
+
+	spin_lock(&mlo->mlo_wlock);
+	list_for_each_entry_safe(mwn, next, &mlo->mlo_wnotify, mwn_link) {
+		if (mlog_wait_done(layout, mwn->mwn_gen, mwn->mwn_off,
+				   mwn->mwn_seq))
+			list_move_tail(&mwn->mwn_link, &done);
+		else if (mwn->mwn_expire && time_after_eq(now, mwn->mwn_expire))
+			list_move_tail(&mwn->mwn_link, &expired);
+		else
+			continue;
+
+		--mlo->mlo_wnotifyc;
+	}
+	spin_unlock(&mlo->mlo_wlock);
+
+	list_for_each_entry_safe(mwn, next, &done, mwn_link) {
+		eventfd_signal(mwn->mwn_efd, 1);
+		eventfd_ctx_put(mwn->mwn_efd);
+		kfree(mwn);
+	}
+
+	/* The waiters of these timed out. */
+	list_for_each_entry_safe(mwn, next, &expired, mwn_link) {
+		eventfd_ctx_put(mwn->mwn_efd);
+		kfree(mwn);
+	}
+}
+
+/**
+ * mlog_wake() - Publish a new mlog end and wake tail followers.
+ *
+ * @layout: mlog layout
+ * @end:    new mlog end in bytes, 0 after an erase
+ *
+ * Caller must hold the layout write lock (or guarantee serialization).
+ */
+static void mlog_wake(struct ecio_layout_descriptor *layout, u64 end)
+{
+	struct ecio_layout_mlo *mlo = layout->eld_mlo;
+
+	WRITE_ONCE(mlo->mlo_wend, end);
+	WRITE_ONCE(mlo->mlo_wseq, mlo->mlo_wseq + 1);
+
+	wake_up_interruptible_all(&mlo->mlo_wq);
+	mlog_wnotify_run(layout);
+}
+
+/**
+ * See mlog.h.
+ */
+void mlog_wait_release(struct ecio_layout_descriptor *layout)
+{
+	struct ecio_layout_mlo *mlo = layout->eld_mlo;
+	struct mlog_wnotify    *mwn, *next;
+
+	list_for_each_entry_safe(mwn, next, &mlo->mlo_wnotify, mwn_link) {
+		list_del(&mwn->mwn_link);
+		eventfd_signal(mwn->mwn_efd, 1);
+		eventfd_ctx_put(mwn->mwn_efd);
+		kfree(mwn);
+	}
+	mlo->mlo_wnotifyc = 0;
+}
+
 /**
  * mlog_stat_free()
  *
@@ -484,6 +710,7 @@ static void mlog_stat_free(struct ecio_layout_descriptor *layout)
 	mlog_free_rbuf(lstat, 0, MLOG_NLPGMB(lstat) - 1);
 	mlog_free_abuf(lstat, 0, MLOG_NLPGMB(lstat) - 1);
 
+	kfree(lstat->lst_ridx);
 	kfree(lstat);
 	layout->eld_lstat = NULL;
 }
@@ -628,6 +855,9 @@ mlog_logrecs_validate(
 					  err, *midrec, (ulong)recnum);
 				return err;
 			}
+			mlog_ridx_add(lstat, lstat->lst_wsoff, recoff);
+			++lstat->lst_nrec;
+			lstat->lst_dlen += lrd.olr_tlen;
 			*midrec = 0;
 		} else if (lrd.olr_rtype == OMF_LOGREC_DATAFIRST) {
 			if (*midrec && recnum) {
@@ -637,6 +867,7 @@ mlog_logrecs_validate(
 					  err, *midrec, (ulong)recnum);
 				return err;
 			}
+			mlog_ridx_add(lstat, lstat->lst_wsoff, recoff);
 			*midrec = 1;
 		} else if (lrd.olr_rtype == OMF_LOGREC_DATAMID) {
 			if (!*midrec) {
@@ -660,6 +891,8 @@ mlog_logrecs_validate(
 					  err, *midrec, (ulong)recnum);
 				return err;
 			}
+			++lstat->lst_nrec;
+			lstat->lst_dlen += lrd.olr_tlen;
 			*midrec = 0;
 		} else {
 			/* unknown rtype; logging error */
@@ -696,6 +929,7 @@ mlog_read_iter_init(
 	lri->lri_valid  = 1;
 	lri->lri_rbidx  = 0;
 	lri->lri_sidx   = 0;
+	lri->lri_dlen   = 0;
 
 	lstat->lst_rsoff  = -1;
 	lstat->lst_rseoff = -1;
@@ -720,9 +954,15 @@ mlog_stat_init_common(
 	lstat->lst_cfssoff = OMF_LOGBLOCK_HDR_PACKLEN;
 	lstat->lst_aoff    = OMF_LOGBLOCK_HDR_PACKLEN;
 	lstat->lst_abdirty = false;
+	lstat->lst_cfsatomic = false;
 	lstat->lst_wsoff   = 0;
 	lstat->lst_cstart  = 0;
 	lstat->lst_cend    = 0;
+	lstat->lst_nrec    = 0;
+	lstat->lst_cfsnrec = 0;
+	lstat->lst_dlen    = 0;
+	lstat->lst_cfsdlen = 0;
+	lstat->lst_ridxcnt = 0;
 
 	lri = &lstat->lst_citr;
 	mlog_read_iter_init(layout, lstat, lri);
@@ -843,16 +1083,32 @@ mlog_rw_raw(
 {
 	struct ecio_layout_descriptor  *layout;
 	merr_t err;
+	u64    wend = 0;
 
 	layout = mlog2layout(mlh);
 	if (!layout)
 		return merr(EINVAL);
 
+	if (rw == MPOOL_OP_WRITE) {
+		int i;
+
+		for (i = 0, wend = boff; i < iovcnt; i++)
+			wend += iov[i].iov_len;
+	}
+
 	pmd_obj_wrlock(mp, layout);
 
 	err = mlog_rw_internal(mp, mlh, iov, iovcnt, boff, rw);
 	ev(err);
 
+	/*
+	 * Mlogs not open in the kernel are framed by the client, so the
+	 * furthest write is the end. Kernel mlogs publish a precise end
+	 * from the append path instead.
+	 */
+	if (!err && rw == MPOOL_OP_WRITE && !layout->eld_lstat)
+		mlog_wake(layout, max(wend, layout->eld_mlo->mlo_wend));
+
 	pmd_obj_wrunlock(mp, layout);
 
 	return err;
@@ -936,6 +1192,16 @@ mlog_stat_init(
 	lstat->lst_mfp  = mfp;
 	lstat->lst_csem = csem;
 
+	/*
+	 * The sparse record index is only an accelerator for seeks, so an
+	 * allocation failure here is not fatal.
+	 */
+	lstat->lst_ridxmax = mfp.mfp_totsec / mfp.mfp_nsecmb + 1;
+	lstat->lst_ridx = kcalloc(lstat->lst_ridxmax, sizeof(*lstat->lst_ridx),
+				  GFP_KERNEL);
+	if (!lstat->lst_ridx)
+		lstat->lst_ridxmax = 0;
+
 	mlog_stat_init_common(layout, lstat);
 
 	layout->eld_lstat  = lstat;
@@ -1047,6 +1313,102 @@ mlog_setup_buf(
 	return 0;
 }
 
+/**
+ * struct mlog_fsreplay - last flush set found while validating an mlog
+ * @fsr_pfsetid: flush set ID of the log block preceding it
+ * @fsr_cfsetid: its flush set ID
+ * @fsr_fsblks:  no. of log blocks its flush wrote
+ * @fsr_nblks:   no. of its log blocks validated
+ * @fsr_flags:   enum logblock_flags_omf values
+ * @fsr_wsoff:   LB offset of its first log block
+ * @fsr_nrec:    lst_nrec ahead of its first log block
+ * @fsr_dlen:    lst_dlen ahead of its first log block
+ * @fsr_ridxcnt: lst_ridxcnt ahead of its first log block
+ * @fsr_cstart:  lst_cstart ahead of its first log block
+ * @fsr_cend:    lst_cend ahead of its first log block
+ */
+struct mlog_fsreplay {
+	u32     fsr_pfsetid;
+	u32     fsr_cfsetid;
+	u16     fsr_fsblks;
+	u16     fsr_nblks;
+	u8      fsr_flags;
+	off_t   fsr_wsoff;
+	u64     fsr_nrec;
+	u64     fsr_dlen;
+	u32     fsr_ridxcnt;
+	u8      fsr_cstart;
+	u8      fsr_cend;
+};
+
+/**
+ * mlog_fsreplay_start() - Note the state ahead of the first log block of a
+ * flush set, in case the flush set has to be dropped.
+ *
+ * @lstat: mlog_stat
+ * @lbh:   header of the first log block of the flush set
+ * @fsr:   flush set replay state (output)
+ */
+static void
+mlog_fsreplay_start(
+	struct mlog_stat           *lstat,
+	struct omf_logblock_header *lbh,
+	struct mlog_fsreplay       *fsr)
+{
+	fsr->fsr_pfsetid = lbh->olh_pfsetid;
+	fsr->fsr_cfsetid = lbh->olh_cfsetid;
+	fsr->fsr_fsblks  = lbh->olh_fsblks;
+	fsr->fsr_nblks   = 0;
+	fsr->fsr_flags   = lbh->olh_flags;
+	fsr->fsr_wsoff   = lstat->lst_wsoff;
+	fsr->fsr_nrec    = lstat->lst_nrec;
+	fsr->fsr_dlen    = lstat->lst_dlen;
+	fsr->fsr_ridxcnt = lstat->lst_ridxcnt;
+	fsr->fsr_cstart  = lstat->lst_cstart;
+	fsr->fsr_cend    = lstat->lst_cend;
+}
+
+/**
+ * mlog_fsreplay_fini() - Drop the last flush set of the log if it is an
+ * atomic one that didn't make it to media in full.
+ *
+ * @mp:      mpool descriptor
+ * @layout:  layout descriptor
+ * @fsr:     flush set replay state
+ * @pfsetid: flush set ID preceding the LEOL (output)
+ *
+ * Only the last flush set can be incomplete: a flush starts once the
+ * previous one has completed, and a flush that failed is written again
+ * as a new flush set chained to the one preceding it.
+ */
+static void
+mlog_fsreplay_fini(
+	struct mpool_descriptor       *mp,
+	struct ecio_layout_descriptor *layout,
+	struct mlog_fsreplay          *fsr,
+	u32                           *pfsetid)
+{
+	struct mlog_stat *lstat = layout->eld_lstat;
+
+	if (!(fsr->fsr_flags & OMF_LOGBLOCK_F_ATOMIC) ||
+	    fsr->fsr_nblks >= fsr->fsr_fsblks)
+		return;
+
+	mp_pr_warn("mpool %s, mlog 0x%lx, dropping incomplete atomic flush set %u, %u/%u log blocks, %lu records",
+		   mp->pds_name, (ulong)layout->eld_objid,
+		   fsr->fsr_cfsetid, fsr->fsr_nblks, fsr->fsr_fsblks,
+		   (ulong)(lstat->lst_nrec - fsr->fsr_nrec));
+
+	lstat->lst_wsoff   = fsr->fsr_wsoff;
+	lstat->lst_nrec    = fsr->fsr_nrec;
+	lstat->lst_dlen    = fsr->fsr_dlen;
+	lstat->lst_ridxcnt = fsr->fsr_ridxcnt;
+	lstat->lst_cstart  = fsr->fsr_cstart;
+	lstat->lst_cend    = fsr->fsr_cend;
+
+	*pfsetid = fsr->fsr_pfsetid;
+}
+
 static inline void
 max_cfsetid(
 	struct omf_logblock_header    *lbh,
@@ -1070,6 +1432,7 @@ max_cfsetid(
  * @leol_found: true, if LEOL found. false, if LEOL not found/log full (output)
  * @fsetidmax:  maximum flush set ID found in the log (output)
  * @pfsetid:    previous flush set ID, if LEOL found (output)
+ * @fsr:        state of the last flush set validated (output)
  */
 static merr_t
 mlog_logpage_validate(
@@ -1080,7 +1443,8 @@ mlog_logpage_validate(
 	int                       *midrec,
 	bool                      *leol_found,
 	u32                       *fsetidmax,
-	u32                       *pfsetid)
+	u32                       *pfsetid,
+	struct mlog_fsreplay      *fsr)
 {
 	merr_t                         err = 0;
 	char                          *rbuf;
@@ -1138,6 +1502,10 @@ mlog_logpage_validate(
 
 		*fsetidmax = lbh.olh_cfsetid;
 
+		/* The first log block of a flush set chains to another one. */
+		if (lbh.olh_pfsetid != lbh.olh_cfsetid)
+			mlog_fsreplay_start(lstat, &lbh, fsr);
+
 		/* Validate the log block at lbidx. */
 		err = mlog_logrecs_validate(mlh, lstat, midrec, rbidx, lbidx);
 		if (err) {
@@ -1147,6 +1515,7 @@ mlog_logpage_validate(
 			return err;
 		}
 
+		++fsr->fsr_nblks;
 		++lstat->lst_wsoff;
 		rbuf += sectsz;
 	}
@@ -1342,7 +1711,8 @@ mlog_read_and_validate(
 	bool                          *lempty,
 	struct ecio_err_report        *erpt)
 {
-	struct mlog_stat  *lstat;
+	struct mlog_stat      *lstat;
+	struct mlog_fsreplay   fsr = { };
 
 	merr_t err         = 0;
 	off_t  leol_off    = 0;
@@ -1396,7 +1766,8 @@ mlog_read_and_validate(
 			/* Validate the log block(s) in the log page @rbidx. */
 			err = mlog_logpage_validate(layout2mlog(layout),
 					lstat, rbidx, nseclpg, &midrec,
-					&leol_found, &fsetidmax, &pfsetid);
+					&leol_found, &fsetidmax, &pfsetid,
+					&fsr);
 			if (err) {
 				mp_pr_err("mpool %s, mlog 0x%lx rbuf validate failed, leol: %d, fsetidmax: %u, pfsetid: %u",
 					  err, mp->pds_name,
@@ -1452,11 +1823,15 @@ mlog_read_and_validate(
 	if (!leol_found)
 		pfsetid = fsetidmax;
 
+	mlog_fsreplay_fini(mp, layout, &fsr, &pfsetid);
+
 	if (pfsetid != 0)
 		*lempty = false;
 
 	lstat->lst_pfsetid = pfsetid;
 	lstat->lst_cfsetid = fsetidmax + 1;
+	lstat->lst_cfsnrec = lstat->lst_nrec;
+	lstat->lst_cfsdlen = lstat->lst_dlen;
 
 exit:
 	lstat->lst_rsoff = -1;
@@ -1581,6 +1956,9 @@ mlog_open(
 	objid_to_layout_insert_oml(&mp->pds_oml, layout);
 	mutex_unlock(&mp->pds_omlock);
 
+	WRITE_ONCE(layout->eld_mlo->mlo_wend,
+		   (u64)lstat->lst_wsoff * MLOG_SECSZ(lstat) + lstat->lst_aoff);
+
 	pmd_obj_wrunlock(mp, layout);
 
 	return err;
@@ -1669,6 +2047,9 @@ mlog_alloc_abufpg(
  * block header in all log blocks in the append buffer.
  *
  * @layout: object layout
+ *
+ * Each header also records how many log blocks the flush writes, so that
+ * replay can tell whether an atomic flush set made it to media in full.
  */
 static merr_t mlog_logblocks_hdrpack(struct ecio_layout_descriptor *layout)
 {
@@ -1693,7 +2074,13 @@ static merr_t mlog_logblocks_hdrpack(struct ecio_layout_descriptor *layout)
 	pfsetid = lstat->lst_pfsetid;
 	cfsetid = lstat->lst_cfsetid;
 
-	lbh.olh_vers = OMF_LOGBLOCK_VERS;
+	start = 0;
+	if (FORCE_4KA(lstat))
+		start = (lstat->lst_cfssoff >> ilog2(sectsz));
+
+	lbh.olh_vers   = OMF_LOGBLOCK_VERS;
+	lbh.olh_fsblks = lstat->lst_wsoff - (lstat->lst_asoff + start) + 1;
+	lbh.olh_flags  = lstat->lst_cfsatomic ? OMF_LOGBLOCK_F_ATOMIC : 0;
 
 	for (idx = 0; idx <= abidx; idx++) {
 		start = 0;
@@ -1989,6 +2376,36 @@ exit2:
 	lstat->lst_abuf[0] = abuf;
 }
 
+/**
+ * mlog_logblocks_discard() - Drop the records appended to the CFS, the same
+ * way a failed CFS flush does.
+ *
+ * @mp:     mpool descriptor
+ * @layout: layout descriptor
+ */
+static void
+mlog_logblocks_discard(
+	struct mpool_descriptor       *mp,
+	struct ecio_layout_descriptor *layout)
+{
+	struct mlog_stat *lstat = layout->eld_lstat;
+
+	/* Free all log pages except the first one. */
+	mlog_free_abuf(lstat, 1, lstat->lst_abidx);
+
+	if (FORCE_4KA(lstat))
+		mlog_flush_posthdlr_4ka(mp, layout, false);
+	else
+		mlog_flush_posthdlr(mp, layout, false);
+
+	lstat->lst_cfsatomic = false;
+
+	/* Records appended since the last good flush are gone. */
+	lstat->lst_nrec = lstat->lst_cfsnrec;
+	lstat->lst_dlen = lstat->lst_cfsdlen;
+	mlog_ridx_trim(lstat);
+}
+
 /**
  * mlog_logblocks_flush() - Flush CFS and handle both successful and
  * failed flush.
@@ -2006,9 +2423,6 @@ mlog_logblocks_flush(
 	struct mlog_stat          *lstat;
 
 	merr_t err;
-	bool   fsucc = true;
-	int    start;
-	int    end;
 	u16    abidx;
 
 	lstat  = (struct mlog_stat *)layout->eld_lstat;
@@ -2028,31 +2442,31 @@ mlog_logblocks_flush(
 	}
 
 	if (err) {
-		/* If flush failed, free all log pages except the first one. */
-		start = 1;
-		end   = abidx;
-		fsucc = false;
-	} else {
-		/* If flush succeeded, free all log pages except the last one.*/
-		start = 0;
-		end   = abidx - 1;
-
-		/*
-		 * Inform pre-compaction of the size of the active mlog and
-		 * how much is used.
-		 */
-		pmd_precompact_alsz(mp, layout->eld_objid,
-			lstat->lst_wsoff * MLOG_SECSZ(lstat),
-			lstat->lst_mfp.mfp_totsec * MLOG_SECSZ(lstat));
+		mlog_logblocks_discard(mp, layout);
+		return err;
 	}
-	mlog_free_abuf(lstat, start, end);
+
+	/*
+	 * Inform pre-compaction of the size of the active mlog and
+	 * how much is used.
+	 */
+	pmd_precompact_alsz(mp, layout->eld_objid,
+		lstat->lst_wsoff * MLOG_SECSZ(lstat),
+		lstat->lst_mfp.mfp_totsec * MLOG_SECSZ(lstat));
+
+	/* If flush succeeded, free all log pages except the last one.*/
+	mlog_free_abuf(lstat, 0, abidx - 1);
 
 	if (FORCE_4KA(lstat))
-		mlog_flush_posthdlr_4ka(mp, layout, fsucc);
+		mlog_flush_posthdlr_4ka(mp, layout, true);
 	else
-		mlog_flush_posthdlr(mp, layout, fsucc);
+		mlog_flush_posthdlr(mp, layout, true);
 
-	return err;
+	lstat->lst_cfsatomic = false;
+	lstat->lst_cfsnrec   = lstat->lst_nrec;
+	lstat->lst_cfsdlen   = lstat->lst_dlen;
+
+	return 0;
 }
 
 /**
@@ -2330,6 +2744,9 @@ mlog_erase(
 		mlog_stat_init_common(layout, lstat);
 	}
 
+	/* Followers of the previous generation get ESTALE. */
+	mlog_wake(layout, 0);
+
 	pmd_obj_wrunlock(mp, layout);
 
 	return err;
@@ -2624,6 +3041,7 @@ memcpy_from_iov(struct iovec *iov, char *buf, size_t buflen, int *nextidx)
  * @buflen:   length of the user buffer
  * @sync:     if true, then we do not return until data is on media
  * @skip_ser: client guarantees serialization
+ * @roff:     if non-NULL, set to the log byte offset of the record
  *
  * Returns: 0 on sucess; merr_t otherwise
  * One of the possible errno values in merr_t:
@@ -2636,7 +3054,8 @@ mlog_append_data_internal(
 	struct iovec            *iov,
 	u64                      buflen,
 	int                      sync,
-	bool                     skip_ser)
+	bool                     skip_ser,
+	u64                     *roff)
 {
 	struct ecio_layout_descriptor *layout = mlog2layout(mlh);
 	struct mlog_stat              *lstat = NULL;
@@ -2682,6 +3101,10 @@ mlog_append_data_internal(
 		if (ev(err))
 			return err;
 
+		if (roff && bufoff == 0 && dfirst)
+			*roff = (u64)lstat->lst_wsoff * sectsz +
+				lstat->lst_aoff;
+
 		abidx  = lstat->lst_abidx;
 		abuf   = lstat->lst_abuf[abidx];
 		asidx  = lstat->lst_wsoff - ((nseclpg * abidx) +
@@ -2720,6 +3143,15 @@ mlog_append_data_internal(
 
 		lstat->lst_abdirty = true;
 
+		if (lrd.olr_rtype == OMF_LOGREC_DATAFULL ||
+		    lrd.olr_rtype == OMF_LOGREC_DATAFIRST)
+			mlog_ridx_add(lstat, lstat->lst_wsoff, aoff);
+		if (lrd.olr_rtype == OMF_LOGREC_DATAFULL ||
+		    lrd.olr_rtype == OMF_LOGREC_DATALAST) {
+			++lstat->lst_nrec;
+			lstat->lst_dlen += lrd.olr_tlen;
+		}
+
 		aoff = aoff + OMF_LOGREC_DESC_PACKLEN;
 		if (lrd.olr_rlen) {
 			memcpy_from_iov(iov, &abuf[lpgoff + aoff],
@@ -2757,15 +3189,134 @@ mlog_append_data_internal(
 }
 
 /**
- * mlog_append_datav():
+ * mlog_append_cfsroom() - data bytes that can still be appended to the CFS
+ * @lstat:
+ *
+ * Like mlog_append_dmax(), but bounded by the end of the append buffer
+ * rather than by the end of the mlog.
+ */
+static u64 mlog_append_cfsroom(struct mlog_stat *lstat)
+{
+	off_t  asoff;
+	u64    lbmax;
+	u64    room;
+	u16    sectsz;
+
+	sectsz = MLOG_SECSZ(lstat);
+	asoff  = lstat->lst_asoff >= 0 ? lstat->lst_asoff : lstat->lst_wsoff;
+	lbmax  = sectsz - OMF_LOGBLOCK_HDR_PACKLEN - OMF_LOGREC_DESC_PACKLEN;
+
+	room = (asoff + MLOG_NLPGMB(lstat) * MLOG_NSECLPG(lstat) - 1 -
+		lstat->lst_wsoff) * lbmax;
+
+	if (sectsz - lstat->lst_aoff >= OMF_LOGREC_DESC_PACKLEN)
+		room += sectsz - lstat->lst_aoff - OMF_LOGREC_DESC_PACKLEN;
+
+	return room;
+}
+
+/**
+ * mlog_append_atomic_prep() - make sure a batch lands in a single flush set
+ * @mp:
+ * @layout:
+ * @recv:
+ * @recc:
+ * @skip_ser:
+ *
+ * The batch gets a CFS of its own, marked atomic: replay drops it unless all
+ * the log blocks its flush wrote are found, and mlog_append_batch() discards
+ * it if an append fails. So any record appended ahead of the batch is first
+ * flushed, and the CFS must not start in the middle of a log block whose
+ * records ahead of it belong to a flush set already on media: the current
+ * log block is closed by that flush so the batch starts with a new one. The
+ * space needed is over-estimated by one descriptor per record and two per
+ * log block spanned.
+ */
+static merr_t
+mlog_append_atomic_prep(
+	struct mpool_descriptor        *mp,
+	struct ecio_layout_descriptor  *layout,
+	struct mlog_rec                *recv,
+	u32                             recc,
+	bool                            skip_ser)
+{
+	struct mlog_stat  *lstat = layout->eld_lstat;
+
+	merr_t err;
+	s64    dmax;
+	u64    need = 0;
+	u64    lbmax;
+	u32    i;
+	u16    sectsz;
+	bool   shared;
+
+	for (i = 0; i < recc; i++)
+		need += recv[i].mr_len + OMF_LOGREC_DESC_PACKLEN;
+
+	sectsz = MLOG_SECSZ(lstat);
+	lbmax  = sectsz - OMF_LOGBLOCK_HDR_PACKLEN - OMF_LOGREC_DESC_PACKLEN;
+	need  += (need / lbmax + 1) * 2 * OMF_LOGREC_DESC_PACKLEN;
+
+	dmax = mlog_append_dmax(mp, layout);
+	if (dmax < 0 || need > dmax)
+		return merr(EFBIG);
+
+	/* Does the CFS start in a log block shared with the previous one? */
+	shared = (lstat->lst_cfssoff & (sectsz - 1)) !=
+		OMF_LOGBLOCK_HDR_PACKLEN;
+
+	if (lstat->lst_abdirty || shared) {
+		/*
+		 * Close the current log block, the flush post handler then
+		 * starts the next CFS with a new one.
+		 */
+		lstat->lst_aoff = sectsz;
+
+		err = mlog_logblocks_flush(mp, layout, skip_ser);
+		lstat->lst_abdirty = false;
+		if (ev(err))
+			return err;
+	}
+
+	if (need > mlog_append_cfsroom(lstat))
+		return merr(E2BIG);
+
+	lstat->lst_cfsatomic = true;
+
+	return 0;
+}
+
+/**
+ * mlog_append_batch() - append a batch of data records to an mlog
+ * @mp:    mpool descriptor
+ * @mlh:   mlog descriptor
+ * @recv:  records to append, in order
+ * @recc:  number of records in recv
+ * @flags: enum mlog_append_flags
+ *
+ * The object lock is taken and the mlog state validated once for the whole
+ * batch; the records are then packed back to back into the append buffer.
+ * The append buffer is only flushed mid-batch when a flush set fills up,
+ * which MLOG_AF_ATOMIC rules out, and after the last record if
+ * MLOG_AF_SYNC is set.
+ * On return, mr_off of each appended record holds the log byte offset of its
+ * first descriptor. On error the records preceding the failed one remain
+ * appended, unless MLOG_AF_ATOMIC is set, and mr_off of the records not
+ * appended is set to U64_MAX.
+ *
+ * Returns: 0 on success; merr_t otherwise
+ * One of the possible errno values in merr_t:
+ * EFBIG - if no room in log for the next record, or for the whole batch
+ *         with MLOG_AF_ATOMIC
+ * E2BIG - if the batch doesn't fit in a flush set with MLOG_AF_ATOMIC
  */
 merr_t
-mlog_append_datav(
+mlog_append_batch(
 	struct mpool_descriptor *mp,
 	struct mlog_descriptor  *mlh,
-	struct iovec            *iov,
-	u64                      buflen,
-	int                      sync)
+	struct mlog_rec         *recv,
+	u32                      recc,
+	u32                      flags)
 {
 	struct ecio_layout_descriptor *layout = mlog2layout(mlh);
 	struct mlog_stat              *lstat = NULL;
@@ -2773,10 +3324,14 @@ mlog_append_datav(
 	merr_t err   = 0;
 	s64    dmax  = 0;
 	bool   skip_ser  = false;
+	u32    i;
 
-	if (!layout)
+	if (!layout || (recc && !recv))
 		return merr(EINVAL);
 
+	for (i = 0; i < recc; i++)
+		recv[i].mr_off = U64_MAX;
+
 	if (layout->eld_flags & MLOG_OF_SKIP_SER)
 		skip_ser = true;
 
@@ -2794,47 +3349,86 @@ mlog_append_datav(
 		mp_pr_err("mpool %s, mlog 0x%lx, inconsistent state %u %u",
 			  err, mp->pds_name, (ulong)layout->eld_objid,
 			  lstat->lst_csem, lstat->lst_cstart);
-	} else {
+	} else if (flags & MLOG_AF_ATOMIC) {
+		err = mlog_append_atomic_prep(mp, layout, recv, recc, skip_ser);
+	}
+
+	if (ev(err)) {
+		if (!skip_ser)
+			pmd_obj_wrunlock(mp, layout);
+		return err;
+	}
+
+	for (i = 0; i < recc; i++) {
+		struct mlog_rec *rec = &recv[i];
+
 		dmax = mlog_append_dmax(mp, layout);
-		if (dmax < 0 || buflen > dmax) {
+		if (dmax < 0 || rec->mr_len > dmax) {
 			err = merr(EFBIG);
 			mp_pr_debug("mpool %s, mlog 0x%lx mlog full %ld",
 				    err, mp->pds_name,
 				    (ulong)layout->eld_objid, (long)dmax);
-
-			/* Flush whatever we can. */
-			if (lstat->lst_abdirty) {
-				(void)mlog_logblocks_flush(mp, layout,
-						skip_ser);
-				lstat->lst_abdirty = false;
-			}
+			break;
 		}
-	}
 
-	if (ev(err)) {
-		if (!skip_ser)
-			pmd_obj_wrunlock(mp, layout);
-		return err;
+		err = mlog_append_data_internal(mp, mlh, rec->mr_iov,
+						rec->mr_len,
+						(flags & MLOG_AF_SYNC) &&
+						i == recc - 1,
+						skip_ser, &rec->mr_off);
+		if (ev(err)) {
+			rec->mr_off = U64_MAX;
+			mp_pr_err("mpool %s, mlog 0x%lx append failed, rec %u/%u",
+				  err, mp->pds_name, (ulong)layout->eld_objid,
+				  i, recc);
+			break;
+		}
 	}
 
-	err = mlog_append_data_internal(mp, mlh, iov, buflen, sync, skip_ser);
-	if (ev(err)) {
-		mp_pr_err("mpool %s, mlog 0x%lx append failed",
-			  err, mp->pds_name, (ulong)layout->eld_objid);
+	if (err && (flags & MLOG_AF_ATOMIC)) {
+		/* None of an atomic batch may reach the media. */
+		if (lstat->lst_abdirty)
+			mlog_logblocks_discard(mp, layout);
+		lstat->lst_abdirty = false;
+		lstat->lst_cfsatomic = false;
 
+		while (i > 0)
+			recv[--i].mr_off = U64_MAX;
+	} else if (err && lstat->lst_abdirty) {
 		/* Flush whatever we can. */
-		if (lstat->lst_abdirty) {
-			(void)mlog_logblocks_flush(mp, layout, skip_ser);
-			lstat->lst_abdirty = false;
-		}
+		(void)mlog_logblocks_flush(mp, layout, skip_ser);
+		lstat->lst_abdirty = false;
 	}
 
+	if (i > 0)
+		mlog_wake(layout, (u64)lstat->lst_wsoff * MLOG_SECSZ(lstat) +
+			  lstat->lst_aoff);
+
 	if (!skip_ser)
 		pmd_obj_wrunlock(mp, layout);
 
 	return err;
 }
 
+/**
+ * mlog_append_datav():
+ */
+merr_t
+mlog_append_datav(
+	struct mpool_descriptor *mp,
+	struct mlog_descriptor  *mlh,
+	struct iovec            *iov,
+	u64                      buflen,
+	int                      sync)
+{
+	struct mlog_rec rec;
+
+	rec.mr_iov = iov;
+	rec.mr_len = buflen;
+
+	return mlog_append_batch(mp, mlh, &rec, 1, sync ? MLOG_AF_SYNC : 0);
+}
+
 /**
  * mlog_append_data()
  */
@@ -2864,6 +3458,23 @@ mlog_append_data(
  */
 merr_t
 mlog_read_data_init(struct mpool_descriptor *mp, struct mlog_descriptor *mlh)
+{
+	return mlog_read_data_init_flags(mp, mlh, 0);
+}
+
+/**
+ * mlog_read_data_init_flags()
+ *
+ * Same as mlog_read_data_init(), with the read mode selected by flags
+ * (enum mlog_read_flags).
+ *
+ * Returns: 0 on success; merr_t otherwise
+ */
+merr_t
+mlog_read_data_init_flags(
+	struct mpool_descriptor *mp,
+	struct mlog_descriptor  *mlh,
+	u32                      flags)
 {
 	merr_t                         err = 0;
 	struct ecio_layout_descriptor *layout = mlog2layout(mlh);
@@ -2883,6 +3494,7 @@ mlog_read_data_init(struct mpool_descriptor *mp, struct mlog_descriptor *mlh)
 		lri = &lstat->lst_citr;
 
 		mlog_read_iter_init(layout, lstat, lri);
+		lri->lri_durable = !!(flags & MLOG_RD_DURABLE);
 	}
 
 	pmd_obj_wrunlock(mp, layout);
@@ -2922,6 +3534,8 @@ mlog_logblocks_load_media(
 	/*
 	 * The read and append buffer must never overlap. So, the read buffer
 	 * can only hold sector offsets in the range [0, lstat->lst_asoff - 1].
+	 * Log blocks at or beyond lst_asoff, flushed or not, are served from
+	 * the append buffer by mlog_logblock_load().
 	 */
 	if (lstat->lst_asoff < 0)
 		remsec = lstat->lst_wsoff;
@@ -3187,6 +3801,37 @@ out:
 	return err;
 }
 
+/**
+ * mlog_read_iter_eod() - Check if a durable read iterator is at or beyond
+ * the end of the flushed data.
+ *
+ * @lstat: mlog stat
+ * @lri:   read iterator
+ *
+ * The flushed data ends where the current flush set starts, i.e., at byte
+ * lst_cfssoff of the append buffer page starting at lst_asoff. If nothing
+ * was appended since open (lst_asoff < 0) the whole log is durable.
+ */
+static bool
+mlog_read_iter_eod(struct mlog_stat *lstat, struct mlog_read_iter *lri)
+{
+	off_t  dsoff;
+	u16    droff;
+	u16    roff;
+	u16    sectsz;
+
+	if (lstat->lst_asoff < 0)
+		return false;
+
+	sectsz = MLOG_SECSZ(lstat);
+	dsoff  = lstat->lst_asoff + lstat->lst_cfssoff / sectsz;
+	droff  = lstat->lst_cfssoff % sectsz;
+	roff   = lri->lri_roff ? lri->lri_roff : OMF_LOGBLOCK_HDR_PACKLEN;
+
+	return lri->lri_soff > dsoff ||
+		(lri->lri_soff == dsoff && roff >= droff);
+}
+
 /**
  * mlog_read_data_next_impl()
  * @mp:
@@ -3220,6 +3865,8 @@ mlog_read_data_next_impl(
 	u32                            sectsz = 0;
 	struct mlog_read_iter         *lri = NULL;
 	bool                           skip_ser = false;
+	off_t                          rsoff = 0;
+	u16                            rroff = 0;
 
 	layout = mlog2layout(mlh);
 	if (!layout)
@@ -3335,6 +3982,27 @@ mlog_read_data_next_impl(
 			}
 		}
 
+		if (lri->lri_durable && mlog_read_iter_eod(lstat, lri)) {
+			/*
+			 * Hit the end of flushed data; rewind a partially
+			 * read record so it's returned whole once flushed.
+			 */
+			if (midrec) {
+				if (lri->lri_soff != rsoff) {
+					lstat->lst_rsoff  = -1;
+					lstat->lst_rseoff = -1;
+				}
+				lri->lri_soff = rsoff;
+				lri->lri_roff = rroff;
+			}
+			if (!skip_ser)
+				pmd_obj_wrunlock(mp, layout);
+			if (rdlen)
+				*rdlen = 0;
+
+			return 0;
+		}
+
 		/* parse next record in log block */
 		omf_logrec_desc_unpack_letoh(&lrd, &inbuf[lri->lri_roff]);
 
@@ -3363,6 +4031,8 @@ mlog_read_data_next_impl(
 				 */
 				bufoff = 0;
 				midrec = 1;
+				rsoff  = lri->lri_soff;
+				rroff  = lri->lri_roff;
 			} else if (lrd.olr_rtype == OMF_LOGREC_DATAMID ||
 				   lrd.olr_rtype == OMF_LOGREC_DATALAST) {
 				if (!midrec) {
@@ -3405,9 +4075,12 @@ mlog_read_data_next_impl(
 			lri->lri_roff = lri->lri_roff + lrd.olr_rlen;
 			bufoff = bufoff + lrd.olr_rlen;
 
-			if (lrd.olr_rtype == OMF_LOGREC_DATAFULL ||
-			    lrd.olr_rtype == OMF_LOGREC_DATALAST)
-				break;
+			if (lrd.olr_rtype == OMF_LOGREC_DATAFIRST ||
+			    lrd.olr_rtype == OMF_LOGREC_DATAMID)
+				continue;
+
+			lri->lri_dlen += lrd.olr_tlen;
+			break;
 		} else {
 			/*
 			 * non data record; just skip unless midrec which
@@ -3468,18 +4141,111 @@ mlog_read_data_next(
 	return mlog_read_data_next_impl(mp, mlh, false, buf, buflen, rdlen);
 }
 
+/**
+ * mlog_read_data_skip() - Move the read iterator forward by whole data
+ * records totalling seek bytes.
+ *
+ * @mp:
+ * @mlh:
+ * @seek:  data bytes to skip
+ * @rdlen: data bytes skipped (output)
+ *
+ * The sparse record index places the iterator at the last sampled record
+ * start ahead of the target, if that is beyond the iterator, and the
+ * remaining records are skipped by reading forward. A record that would
+ * go past the target is not skipped.
+ */
+static merr_t
+mlog_read_data_skip(
+	struct mpool_descriptor *mp,
+	struct mlog_descriptor  *mlh,
+	u64                      seek,
+	u64                     *rdlen)
+{
+	struct ecio_layout_descriptor *layout;
+	struct mlog_ridx_ent          *rie;
+	struct mlog_stat              *lstat;
+	struct mlog_read_iter         *lri = NULL;
+
+	merr_t err = 0;
+	u64    start = 0, target = 0, len;
+	off_t  soff;
+	u16    roff;
+	bool   skip_ser = false;
+
+	layout = mlog2layout(mlh);
+	if (!layout)
+		return merr(EINVAL);
+
+	if (layout->eld_flags & MLOG_OF_SKIP_SER)
+		skip_ser = true;
+
+	if (!skip_ser)
+		pmd_obj_wrlock(mp, layout);
+
+	lstat = layout->eld_lstat;
+	if (!lstat || !lstat->lst_citr.lri_valid) {
+		err = merr(EINVAL);
+	} else {
+		lri    = &lstat->lst_citr;
+		start  = lri->lri_dlen;
+		target = start + seek;
+
+		rie = mlog_ridx_find_dlen(lstat, target);
+		if (rie && (rie->rie_soff > lri->lri_soff ||
+			    (rie->rie_soff == lri->lri_soff &&
+			     rie->rie_roff > lri->lri_roff))) {
+			/* Also invalidates the read buffer range. */
+			lstat->lst_rsoff  = -1;
+			lstat->lst_rseoff = -1;
+
+			lri->lri_soff = rie->rie_soff;
+			lri->lri_roff = rie->rie_roff;
+			lri->lri_dlen = rie->rie_dlen;
+		}
+	}
+
+	if (!skip_ser)
+		pmd_obj_wrunlock(mp, layout);
+
+	if (ev(err))
+		return err;
+
+	while (lri->lri_dlen < target) {
+		soff = lri->lri_soff;
+		roff = lri->lri_roff;
+
+		err = mlog_read_data_next_impl(mp, mlh, true, NULL,
+					       target - lri->lri_dlen, &len);
+		if (ev(err))
+			return err;
+
+		/* End of the log */
+		if (lri->lri_soff == soff && lri->lri_roff == roff)
+			break;
+	}
+
+	*rdlen = lri->lri_dlen - start;
+
+	return 0;
+}
+
 /**
  * mlog_seek_read_data_next()
  *
  * Read next data record into buffer buf of length buflen bytes after skipping
- * bytes as required; log must open; skips non-data records (markers).
+ * seek bytes of whole data records; log must open; skips non-data records
+ * (markers). The skip starts from the closest sparse record index entry,
+ * see mlog_read_data_skip().
  *
  * Iterator lri must be re-init if returns any error except ENOMEM
  * in merr_t
  *
  * Returns:
  *   0 on success; merr_t with the following errno values on failure:
- *   EOVERFLOW if buflen is insufficient to hold data record; can retry
+ *   EOVERFLOW if buflen is insufficient to hold data record, or if the
+ *   record at the seek target would extend past it; can retry
+ *   ERANGE if the log ends before seek bytes, bytes skipped in rdlen
  *   errno otherwise
  *
  *   Bytes read on success in the ouput param rdlen (can be 0 if appended a
@@ -3500,8 +4266,7 @@ mlog_seek_read_data_next(
 		u64 skip;
 
 		skip = 0;
-		err = mlog_read_data_next_impl(mp, mlh, true, NULL,
-					       seek, &skip);
+		err = mlog_read_data_skip(mp, mlh, seek, &skip);
 		if (ev(err))
 			return err;
 
@@ -3521,6 +4286,202 @@ mlog_seek_read_data_next(
 	return mlog_read_data_next_impl(mp, mlh, false, buf, buflen, rdlen);
 }
 
+/**
+ * mlog_read_data_seek()
+ *
+ * Reset the read iterator and position it at data record recno; log must be
+ * open. The sparse record index places the iterator at the closest sampled
+ * record start at or before recno, and the remaining records are skipped by
+ * reading forward.
+ *
+ * Iterator lri must be re-init if returns any error
+ *
+ * Returns:
+ *   0 on success; merr_t with the following errno values on failure:
+ *   ERANGE if recno is beyond the last data record
+ *   errno otherwise
+ */
+merr_t
+mlog_read_data_seek(
+	struct mpool_descriptor *mp,
+	struct mlog_descriptor  *mlh,
+	u64                      recno)
+{
+	struct ecio_layout_descriptor *layout;
+	struct mlog_ridx_ent          *rie;
+	struct mlog_stat              *lstat;
+	struct mlog_read_iter         *lri;
+
+	merr_t err = 0;
+	u64    skip = 0;
+	u64    rdlen;
+	bool   skip_ser = false;
+
+	layout = mlog2layout(mlh);
+	if (!layout)
+		return merr(EINVAL);
+
+	if (layout->eld_flags & MLOG_OF_SKIP_SER)
+		skip_ser = true;
+
+	if (!skip_ser)
+		pmd_obj_wrlock(mp, layout);
+
+	lstat = layout->eld_lstat;
+	if (!lstat) {
+		err = merr(ENOENT);
+	} else if (recno > lstat->lst_nrec) {
+		err = merr(ERANGE);
+	} else {
+		lri = &lstat->lst_citr;
+
+		/* Also invalidates the read buffer range (lst_rsoff). */
+		mlog_read_iter_init(layout, lstat, lri);
+
+		rie = mlog_ridx_find(lstat, recno);
+		if (rie) {
+			lri->lri_soff = rie->rie_soff;
+			lri->lri_roff = rie->rie_roff;
+			lri->lri_dlen = rie->rie_dlen;
+			skip          = rie->rie_recno;
+		}
+	}
+
+	if (!skip_ser)
+		pmd_obj_wrunlock(mp, layout);
+
+	if (ev(err))
+		return err;
+
+	while (skip < recno) {
+		err = mlog_read_data_next_impl(mp, mlh, true, NULL, U64_MAX,
+					       &rdlen);
+		if (ev(err))
+			return err;
+
+		++skip;
+	}
+
+	return 0;
+}
+
+/**
+ * mlog_wait_data()
+ *
+ * Wait for the end of the mlog to advance beyond a reader cursor. Appends
+ * (including non-durable ones still in the append buffer), flushes and raw
+ * writes advance the end; an erase wakes all followers.
+ *
+ * If efd is not NULL, a one-shot notification is armed instead of blocking,
+ * and the eventfd is signalled once the condition is met (immediately if it
+ * already holds). The caller's reference on efd is not consumed. Arming an
+ * eventfd that already has a notification pending on the mlog replaces it.
+ * If tmo is not 0 the notification is dropped unsignalled once tmo msecs
+ * elapse, as the waiter has then timed out.
+ *
+ * Returns:
+ *   0 on success, with the current mlog end in *end and the current write
+ *   sequence in *seq; merr_t with the following errno values on failure:
+ *   ESTALE if the mlog was erased since gen
+ *   ETIMEDOUT if tmo msecs elapsed without the end advancing
+ *   EAGAIN if tmo is 0 and the end hasn't advanced
+ *   EINTR if interrupted by a signal
+ *   EBUSY if MLOG_WNOTIFY_MAX notifications are already pending on the mlog
+ */
+merr_t
+mlog_wait_data(
+	struct mpool_descriptor *mp,
+	struct mlog_descriptor  *mlh,
+	u64                      gen,
+	u64                      off,
+	u32                      tmo,
+	struct eventfd_ctx      *efd,
+	u64                     *seq,
+	u64                     *end)
+{
+	struct ecio_layout_descriptor *layout;
+	struct ecio_layout_mlo        *mlo;
+	struct mlog_wnotify           *mwn, *cur;
+	merr_t                         err = 0;
+	long                           rc;
+
+	layout = mlog2layout(mlh);
+	if (!layout || !seq || !end)
+		return merr(EINVAL);
+
+	mlo = layout->eld_mlo;
+	if (!gen)
+		gen = READ_ONCE(layout->eld_gen);
+
+	if (mlog_wait_done(layout, gen, off, *seq)) {
+		if (efd)
+			eventfd_signal(efd, 1);
+	} else if (efd) {
+		mwn = kmalloc(sizeof(*mwn), GFP_KERNEL);
+		if (!mwn)
+			return merr(ENOMEM);
+
+		mwn->mwn_efd = efd;
+		mwn->mwn_gen = gen;
+		mwn->mwn_off = off;
+		mwn->mwn_seq = *seq;
+		mwn->mwn_expire = tmo ? jiffies + msecs_to_jiffies(tmo) : 0;
+
+		spin_lock(&mlo->mlo_wlock);
+		list_for_each_entry(cur, &mlo->mlo_wnotify, mwn_link) {
+			if (cur->mwn_efd != efd)
+				continue;
+
+			/* Re-arm the pending notification of this eventfd. */
+			cur->mwn_gen = mwn->mwn_gen;
+			cur->mwn_off = mwn->mwn_off;
+			cur->mwn_seq = mwn->mwn_seq;
+			cur->mwn_expire = mwn->mwn_expire;
+			break;
+		}
+
+		if (&cur->mwn_link != &mlo->mlo_wnotify) {
+			kfree(mwn);
+		} else if (mlo->mlo_wnotifyc >= MLOG_WNOTIFY_MAX) {
+			kfree(mwn);
+			err = merr(EBUSY);
+		} else {
+			eventfd_ctx_get(efd);
+			list_add_tail(&mwn->mwn_link, &mlo->mlo_wnotify);
+			++mlo->mlo_wnotifyc;
+		}
+		spin_unlock(&mlo->mlo_wlock);
+
+		/*
+		 * Catch an advance that raced with the registration, and
+		 * drop the notifications that expired.
+		 */
+		mlog_wnotify_run(layout);
+
+		if (err)
+			return err;
+	} else {
+		if (!tmo)
+			return merr(EAGAIN);
+
+		rc = wait_event_interruptible_timeout(mlo->mlo_wq,
+				mlog_wait_done(layout, gen, off, *seq),
+				msecs_to_jiffies(tmo));
+		if (rc < 0)
+			return merr(EINTR);
+		if (rc == 0)
+			return merr(ETIMEDOUT);
+	}
+
+	if (READ_ONCE(layout->eld_gen) != gen)
+		return merr(ESTALE);
+
+	*seq = READ_ONCE(mlo->mlo_wseq);
+	*end = READ_ONCE(mlo->mlo_wend);
+
+	return 0;
+}
+
 /**
  * mlog_get_props()
  *
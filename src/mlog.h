@@ -42,6 +42,8 @@ struct mlog_fsetparms {
  * @lri_rbidx:  Read buffer page index currently reading from
  * @lri_sidx:   Log block index in lri_rbidx
  * @lri_valid:  1 if iterator is valid; 0 otherwise
+ * @lri_durable: 1 if reads must stop at the last flushed record
+ * @lri_dlen:   Data bytes of the complete records before the iterator
  */
 struct mlog_read_iter {
 	struct ecio_layout_descriptor *lri_layout;
@@ -51,6 +53,23 @@ struct mlog_read_iter {
 	u16   lri_rbidx;
 	u8    lri_sidx;
 	u8    lri_valid;
+	u8    lri_durable;
+	u64   lri_dlen;
+};
+
+/**
+ * struct mlog_ridx_ent - sparse record index entry
+ *
+ * @rie_recno: No. of complete data records preceding this entry
+ * @rie_dlen:  Data bytes of the complete data records preceding this entry
+ * @rie_soff:  LB offset of the log block holding the record start
+ * @rie_roff:  Offset in log block rie_soff of the record descriptor
+ */
+struct mlog_ridx_ent {
+	u64    rie_recno;
+	u64    rie_dlen;
+	off_t  rie_soff;
+	u16    rie_roff;
 };
 
 /**
@@ -69,11 +88,19 @@ struct mlog_read_iter {
  * @lst_pfsetid: Prev. fSetID of the first log block in CFS
  * @lst_cfsetid: Current fSetID of the CFS
  * @lst_cfssoff: Offset within the 1st log block from where CFS starts
+ * @lst_cfsatomic: true, if the CFS holds an MLOG_AF_ATOMIC batch
  * @lst_aoff:    Next byte offset[0, sectsz) to fill in the current log block
  * @lst_abidx:   Index of current filling page in lst_abuf
  * @lst_csem:    enforce compaction semantics if true
  * @lst_cstart:  valid compaction start marker in log?
  * @lst_cend:    valid compaction end marker in log?
+ * @lst_nrec:    No. of complete data records in the log
+ * @lst_cfsnrec: lst_nrec as of the last successful CFS flush
+ * @lst_dlen:    Data bytes of the complete data records in the log
+ * @lst_cfsdlen: lst_dlen as of the last successful CFS flush
+ * @lst_ridx:    Sparse record index, at most one entry per MLOG_NSECMB LBs
+ * @lst_ridxcnt: No. of valid entries in lst_ridx
+ * @lst_ridxmax: Capacity of lst_ridx, 0 if the index couldn't be allocated
  */
 struct mlog_stat {
 	struct mlog_read_iter  lst_citr;
@@ -85,6 +112,7 @@ struct mlog_stat {
 	off_t   lst_asoff;
 	off_t   lst_wsoff;
 	bool    lst_abdirty;
+	bool    lst_cfsatomic;
 	u32     lst_pfsetid;
 	u32     lst_cfsetid;
 	u16     lst_cfssoff;
@@ -93,8 +121,41 @@ struct mlog_stat {
 	u8      lst_csem;
 	u8      lst_cstart;
 	u8      lst_cend;
+	u64     lst_nrec;
+	u64     lst_cfsnrec;
+	u64     lst_dlen;
+	u64     lst_cfsdlen;
+
+	struct mlog_ridx_ent  *lst_ridx;
+	u32                    lst_ridxcnt;
+	u32                    lst_ridxmax;
+};
+
+/**
+ * struct mlog_wnotify - pending tail-follow eventfd notification
+ *
+ * @mwn_link: link on ecio_layout_mlo.mlo_wnotify
+ * @mwn_efd:  eventfd to signal
+ * @mwn_gen:  mlog generation the reader cursor refers to
+ * @mwn_off:  reader cursor; signal once the mlog end is beyond it
+ * @mwn_seq:  if non-zero, also signal once mlo_wseq moves past it
+ * @mwn_expire: jiffies at which the notification is dropped unsignalled,
+ *	0 if it doesn't expire
+ *
+ * An mlog holds at most one notification per eventfd and at most
+ * MLOG_WNOTIFY_MAX notifications overall.
+ */
+struct mlog_wnotify {
+	struct list_head      mwn_link;
+	struct eventfd_ctx   *mwn_efd;
+	u64                   mwn_gen;
+	u64                   mwn_off;
+	u64                   mwn_seq;
+	ulong                 mwn_expire;
 };
 
+#define MLOG_WNOTIFY_MAX    64
+
 #define MLOG_TOTSEC(lstat)  ((lstat)->lst_mfp.mfp_totsec)
 #define MLOG_LPGSZ(lstat)   ((lstat)->lst_mfp.mfp_lpgsz)
 #define MLOG_NLPGMB(lstat)  ((lstat)->lst_mfp.mfp_nlpgmb)
@@ -112,4 +173,11 @@ mlog_append_dmax(
 
 void mlogutil_closeall(struct mpool_descriptor *mp);
 
+/**
+ * mlog_wait_release() - Signal and drop all pending eventfd notifications
+ * of an mlog whose layout is being freed.
+ * @layout:
+ */
+void mlog_wait_release(struct ecio_layout_descriptor *layout);
+
 #endif
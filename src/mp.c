@@ -159,6 +159,7 @@ mpool_dev_sbwrite(
 	sb->osb_parm.odp_zonetot = pd->pdi_parm.dpr_zonetot;
 	mc_pd_prop2mc_parms(&pd->pdi_parm.dpr_prop, &mc_parms);
 	mc_parms2omf_devparm(&mc_parms, &sb->osb_parm);
+	sb->osb_parm.odp_mcord = pd->pdi_mcord;
 
 	if (sbmdc0)
 		sbutil_mdc0_copy(sb, sbmdc0);
@@ -281,6 +282,7 @@ mpool_mdc0_alloc(
 		sb->osb_mdc0dev.odp_devsz = pd->pdi_parm.dpr_devsz;
 		sb->osb_mdc0dev.odp_zonetot = pd->pdi_parm.dpr_zonetot;
 		mc_parms2omf_devparm(&mc->mc_parms, &sb->osb_mdc0dev);
+		sb->osb_mdc0dev.odp_mcord = pd->pdi_mcord;
 	}
 
 	if (!err && !alloc) {
@@ -387,18 +389,41 @@ mpool_desc_pdmc_add(
 
 		if (!check_only)
 			mc_init_class(mc, &mc_parms, &mcsp);
-	} else {
+	} else if (memcmp(&mc->mc_parms, &mc_parms, sizeof(mc_parms))) {
 		mpool_devrpt(devrpt, MPOOL_RC_ERRMSG, -1,
-			     "drive add %s failed, only 1 device allowed per mclass",
-			     pd->pdi_name);
+			     "drive add %s failed, parameters differ from those of mclass %u",
+			     pd->pdi_name, mc_parms.mcp_classp);
+
+		return merr(EINVAL);
+	} else if (mc->mc_pdcnt >= MPOOL_MC_DRIVES_MAX) {
+		mpool_devrpt(devrpt, MPOOL_RC_ERRMSG, -1,
+			     "drive add %s failed, only %u devices allowed per mclass",
+			     pd->pdi_name, MPOOL_MC_DRIVES_MAX);
 
 		return merr(EINVAL);
+	} else {
+		int i;
+
+		for (i = 0; i < mc->mc_pdcnt; i++) {
+			if (mp->pds_pdv[mc->mc_pdv[i]].pdi_mcord !=
+			    pd->pdi_mcord)
+				continue;
+
+			mpool_devrpt(devrpt, MPOOL_RC_ERRMSG, -1,
+				     "drive add %s failed, ordinal %u already used in mclass %u",
+				     pd->pdi_name, pd->pdi_mcord,
+				     mc_parms.mcp_classp);
+
+			return merr(EINVAL);
+		}
 	}
 
 	if (check_only)
 		return 0;
 
-	mc->mc_pdmc = pdh;
+	if (mc->mc_pdmc < 0)
+		mc->mc_pdmc = pdh;
+	mc->mc_pdv[mc->mc_pdcnt++] = pdh;
 
 	return 0;
 }
@@ -794,8 +819,11 @@ mpool_create(
 
 errout:
 
-	if (mp->pds_erase_wq)
+	if (mp->pds_erase_wq) {
+		flush_workqueue(mp->pds_erase_wq);
+		dsched_mpool_stop(mp);
 		destroy_workqueue(mp->pds_erase_wq);
+	}
 
 	/* free up resources */
 	if (active)
@@ -1083,6 +1111,7 @@ mpool_desc_init_sb(
 		uuid_to_idx_insert(&mp->pds_dev2pdh, urb_elem);
 
 		mpool_uuid_copy(&pd->pdi_devid, &sb->osb_parm.odp_devid);
+		pd->pdi_mcord = sb->osb_parm.odp_mcord;
 
 		/*
 		 * add drive in its media class. Create the media class if
@@ -1371,6 +1400,12 @@ mpool_activate(
 
 errout:
 	if (ev(err)) {
+		if (active)
+			pmd_objs_load_stop(mp);
+		if (mp->pds_erase_wq) {
+			flush_workqueue(mp->pds_erase_wq);
+			dsched_mpool_stop(mp);
+		}
 		if (mp->pds_workq)
 			destroy_workqueue(mp->pds_workq);
 		if (mp->pds_erase_wq)
@@ -1400,6 +1435,9 @@ errout:
 		INIT_DELAYED_WORK(&usagew->smapu_wstruct, smap_log_mpool_usage);
 		usagew->smapu_mp = mp;
 		smap_log_mpool_usage(&usagew->smapu_wstruct.work);
+
+		/* Fill the erased zone reserves for mlog allocations. */
+		dsched_mpool_start(mp);
 	}
 
 	return err;
@@ -1408,8 +1446,16 @@ errout:
 merr_t mpool_deactivate(struct mpool_descriptor *mp)
 {
 	pmd_precompact_stop(mp);
+	pmd_objs_load_stop(mp);
 	smap_wait_usage_done(mp);
 
+	/* Discard the zones of deleted mblocks while the smaps are up. */
+	flush_workqueue(mp->pds_erase_wq);
+	dsched_mpool_stop(mp);
+
+	/* All zones not used by an object are back in the smaps. */
+	pmd_mpool_smap_ckpt(mp);
+
 	mutex_lock(&mpool_s_lock);
 	destroy_workqueue(mp->pds_workq);
 	destroy_workqueue(mp->pds_erase_wq);
@@ -1730,9 +1776,11 @@ mpool_drive_add(
 	}
 
 	/*
-	 * Check that the drive can be added in a media class.
+	 * Check that the drive can be added in a media class, with the lowest
+	 * ordinal free in that class.
 	 */
 	down_read(&mp->pds_pdvlock);
+	pd->pdi_mcord = mc_ord_next(mp, pd->pdi_mclass);
 	err = mpool_desc_pdmc_add(mp, 0, mp->pds_pdvcnt, NULL, true, devrpt);
 	up_read(&mp->pds_pdvlock);
 	if (err) {
@@ -2001,7 +2049,11 @@ mpool_get_xprops(struct mpool_descriptor *mp, struct mpool_xprops *xprops)
 			(mc->mc_parms.mcp_zonepg << PAGE_SHIFT) >> 20;
 	}
 
-	for (i = 0; i < mp->pds_pdvcnt; ++i) {
+	/*
+	 * The drive list of xprops only has room for MP_MED_NUMBER drives,
+	 * MPIOC_DEVPROPS_GET enumerates all of them by index.
+	 */
+	for (i = 0; i < mp->pds_pdvcnt && i < MP_MED_NUMBER; ++i) {
 		mc = &mp->pds_mc[mp->pds_pdv[i].pdi_mclass];
 		if (mc->mc_pdmc < 0)
 			continue;
@@ -2015,6 +2067,10 @@ mpool_get_xprops(struct mpool_descriptor *mp, struct mpool_xprops *xprops)
 	up_read(&mp->pds_pdvlock);
 	mutex_unlock(&mpool_s_lock);
 
+	/* A failed background MDC load leaves the mpool unable to allocate. */
+	if (pmd_objs_load_err(mp))
+		ftmax = 1;
+
 	xprops->ppx_params.mp_stat =
 		ftmax ? MPOOL_STAT_FAULTED : MPOOL_STAT_OPTIMAL;
 }
@@ -2046,6 +2102,7 @@ fill_in_devprops(
 	dprop->pdp_mclassp   = mc->mc_parms.mcp_classp;
 	dprop->pdp_status    = mpool_pd_status_get(pd);
 	dprop->pdp_state     = pd->pdi_state;
+	dprop->pdp_index     = pdh;
 
 	err = smap_drive_usage(mp, pdh, dprop);
 	if (err) {
@@ -2060,18 +2117,137 @@ mpool_get_devprops_by_name(
 	char                       *pdname,
 	struct mp_devprops         *dprop)
 {
+	merr_t err = 0;
 	int    i;
 
 	down_read(&mp->pds_pdvlock);
 
-	for (i = 0; i < mp->pds_pdvcnt; i++) {
-		if (!strcmp(pdname, mp->pds_pdv[i].pdi_name))
+	if (!pdname[0]) {
+		/* The xprops drive list is short, so enumerate by index. */
+		i = dprop->pdp_index;
+		if (i < mp->pds_pdvcnt) {
+			strlcpy(pdname, mp->pds_pdv[i].pdi_name, PD_NAMESZ_MAX);
 			fill_in_devprops(mp, i, dprop);
+		} else {
+			err = merr(ENOENT);
+		}
+	} else {
+		for (i = 0; i < mp->pds_pdvcnt; i++) {
+			if (!strcmp(pdname, mp->pds_pdv[i].pdi_name))
+				fill_in_devprops(mp, i, dprop);
+		}
 	}
 
 	up_read(&mp->pds_pdvlock);
 
-	return 0;
+	return err;
+}
+
+merr_t
+mpool_get_devfrag(
+	struct mpool_descriptor    *mp,
+	const char                 *pdname,
+	struct mp_devfrag          *frag)
+{
+	struct media_class *mc;
+	struct mp_devfrag   pdfrag;
+	merr_t              err = merr(ENOENT);
+	bool                found = false;
+	int                 i, j;
+
+	down_read(&mp->pds_pdvlock);
+
+	if (pdname[0]) {
+		for (i = 0; i < mp->pds_pdvcnt; i++) {
+			if (!strcmp(pdname, mp->pds_pdv[i].pdi_name)) {
+				err = smap_drive_frag(mp, i, frag);
+				break;
+			}
+		}
+	} else if (frag->pdf_mclassp < MP_MED_NUMBER) {
+		/*
+		 * Sum over the drives of the class, skipping those whose
+		 * space map can't be read, e.g. unavailable drives.
+		 */
+		mc = &mp->pds_mc[frag->pdf_mclassp];
+		for (i = 0; i < mc->mc_pdcnt; i++) {
+			err = smap_drive_frag(mp, mc->mc_pdv[i], &pdfrag);
+			if (err)
+				continue;
+
+			if (!found) {
+				*frag = pdfrag;
+				found = true;
+				continue;
+			}
+
+			frag->pdf_rgnc += pdfrag.pdf_rgnc;
+			frag->pdf_free += pdfrag.pdf_free;
+			frag->pdf_extc += pdfrag.pdf_extc;
+			frag->pdf_extmax = max_t(u64, frag->pdf_extmax,
+						 pdfrag.pdf_extmax);
+			for (j = 0; j < MP_FRAG_NBKT; j++)
+				frag->pdf_hist[j] += pdfrag.pdf_hist[j];
+		}
+
+		if (found)
+			err = 0;
+	}
+
+	up_read(&mp->pds_pdvlock);
+
+	return err;
+}
+
+merr_t
+mpool_get_devdiscard(
+	struct mpool_descriptor    *mp,
+	const char                 *pdname,
+	struct mp_devdiscard       *stats)
+{
+	struct media_class     *mc;
+	struct mp_devdiscard    pdstats;
+	merr_t                  err = merr(ENOENT);
+	int                     i;
+
+	down_read(&mp->pds_pdvlock);
+
+	if (pdname[0]) {
+		for (i = 0; i < mp->pds_pdvcnt; i++) {
+			if (!strcmp(pdname, mp->pds_pdv[i].pdi_name)) {
+				dsched_drive_stats(mp, i, stats);
+				err = 0;
+				break;
+			}
+		}
+	} else if (stats->pdd_mclassp < MP_MED_NUMBER) {
+		mc = &mp->pds_mc[stats->pdd_mclassp];
+		for (i = 0; i < mc->mc_pdcnt; i++) {
+			if (!i) {
+				dsched_drive_stats(mp, mc->mc_pdv[i], stats);
+				err = 0;
+				continue;
+			}
+
+			dsched_drive_stats(mp, mc->mc_pdv[i], &pdstats);
+
+			stats->pdd_qranges += pdstats.pdd_qranges;
+			stats->pdd_qzones += pdstats.pdd_qzones;
+			stats->pdd_enqueued += pdstats.pdd_enqueued;
+			stats->pdd_merged += pdstats.pdd_merged;
+			stats->pdd_issued += pdstats.pdd_issued;
+			stats->pdd_zones += pdstats.pdd_zones;
+			stats->pdd_deferred += pdstats.pdd_deferred;
+			stats->pdd_errors += pdstats.pdd_errors;
+			stats->pdd_rsvzones += pdstats.pdd_rsvzones;
+			stats->pdd_rsvhits += pdstats.pdd_rsvhits;
+			stats->pdd_rsvmisses += pdstats.pdd_rsvmisses;
+		}
+	}
+
+	up_read(&mp->pds_pdvlock);
+
+	return err;
 }
 
 void
@@ -2218,6 +2394,7 @@ struct mpool_descriptor *mpool_desc_alloc(void)
 		return NULL;
 
 	init_rwsem(&mp->pds_pdvlock);
+	init_waitqueue_head(&mp->pds_erasewq);
 
 	/* mp.pds_pdv[MPOOL_DRIVES_MAX] is a sentinel pointed at by all
 	 * object layout strips representing consumed recon reservations.
@@ -2258,6 +2435,11 @@ struct mpool_descriptor *mpool_desc_alloc(void)
 	for (i = 0; i < MP_MED_NUMBER; i++)
 		mp->pds_mc[i].mc_pdmc = -1;
 
+	for (i = 0; i < MPOOL_DRIVES_MAX; i++) {
+		dsched_init(mp, i);
+		pd_iostat_init(&mp->pds_pdv[i]);
+	}
+
 	return mp;
 }
 
@@ -2300,6 +2482,9 @@ void mpool_desc_free(struct mpool_descriptor *mp)
 			pd_bio_dev_close(&mp->pds_pdv[i].pdi_parm);
 	}
 
+	for (i = 0; i < MPOOL_DRIVES_MAX; i++)
+		pd_iostat_fini(&mp->pds_pdv[i]);
+
 	numa_elmset_destroy(mp->pds_ecio_layout_rwl);
 	kfree(mp);
 }
@@ -2369,6 +2554,7 @@ mpool_desc_unavail_add(
 	pd = &mp->pds_pdv[mp->pds_pdvcnt];
 
 	mpool_uuid_copy(&pd->pdi_devid, &omf_devparm->odp_devid);
+	pd->pdi_mcord = omf_devparm->odp_mcord;
 
 	/*
 	 * Update the PD properties from the metadata record.
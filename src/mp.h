@@ -39,6 +39,8 @@
  * + mp.pds_pdvlock
  * + mp.pdv[d].zmlock[z] (one per drive smap allocation zone)
  * + mp.pdv[d].ds.sda_dalock (one per drive)
+ * + mp.pdv[d].zmag[cpu].zm_lock (one per drive per CPU); never held
+ *   while taking another smap lock
  *   <eol>
  *
  * NOTE: Every user object (mlog or mblock) is associated with exactly one
@@ -53,10 +55,25 @@
 
 /**
  * struct rmbkt - region map bucket
+ * @pdi_rmlock:  protects the region's space map
+ * @pdi_rmroot:  free extents of the region, if pdi_rmbits is NULL
+ * @pdi_rmbits:  bitmap space map, one bit per zone, set if allocated
+ * @pdi_rmbase:  address of the first zone of the region
+ * @pdi_rmnbits: number of zones in the region
+ * @pdi_rmfree:  number of free zones in the region
+ * @pdi_rmextc:  number of free extents in pdi_rmroot
+ * @pdi_rmhist:  pdi_rmhist[i] is the number of extents in pdi_rmroot of
+ *               2^i to 2^(i+1) - 1 zones
  */
 struct rmbkt {
 	struct mutex    pdi_rmlock;
 	struct rb_root  pdi_rmroot;
+	unsigned long  *pdi_rmbits;
+	u64             pdi_rmbase;
+	u32             pdi_rmnbits;
+	u32             pdi_rmfree;
+	u32             pdi_rmextc;
+	u32             pdi_rmhist[MP_FRAG_NBKT];
 } ____cacheline_aligned;
 
 /**
@@ -69,12 +86,19 @@ struct rmbkt {
  * @pdi_rmap:     per allocation zone space maps rbtree array, node:
  *                struct u64_to_u64_rb
  * @pdi_rmlock:   lock protects per zone space maps
+ * @pdi_zmag:     per-CPU zone magazines, NULL if they could not be allocated
+ * @pdi_bulk:     extents staged by smap_insert() during activation, or NULL
+ * @pdi_erasing:  zones of deleted objects queued for erase and not yet freed
+ * @pdi_dsched:   discard scheduler of the zones of deleted mblocks
+ * @pdi_iostat:   per-CPU object I/O counts, NULL if they could not be
+ *                allocated
+ * @pdi_mcord:    ordinal of the drive within its media class
  * @pdi_name:     device name (only the last path name component)
  *
  * Pool drive state, status, and params
  *
  * LOCKING:
- *    devid, mclass : constant; no locking required
+ *    devid, mclass, mcord : constant; no locking required
  *    parm: constant EXCEPT in rare change of status from UNAVAIL; see below
  *    status: usage does not require locking, but MUST get/set via accessors
  *    state: protected by pdvlock in enclosing mpool_descriptor
@@ -91,6 +115,12 @@ struct mpool_dev_info {
 	enum pd_state_omf       pdi_state;
 	struct smap_dev_alloc   pdi_ds;
 	struct rmbkt           *pdi_rmbktv;
+	struct smap_zmag __percpu *pdi_zmag;
+	struct smap_bulk       *pdi_bulk;
+	atomic_t                pdi_erasing;
+	struct dsched           pdi_dsched;
+	struct pd_iostat __percpu *pdi_iostat;
+	u8                      pdi_mcord;
 	struct mpool_uuid       pdi_devid;
 	char                    pdi_name[PD_NAMESZ_MAX];
 };
@@ -132,15 +162,20 @@ struct mpdesc_mdparm {
  * struct pre_compact_ctrl - used to start/stop/control precompaction
  * @pco_dwork:
  * @pco_mp:
- * @pco_nmtoc: next MDC to compact
+ * @pco_nmtoc: MDC most in need of compaction, minus one
+ * @pco_njobs: number of MDC pre-compactions queued or running
+ * @pco_inflight: live bytes being rewritten by those pre-compactions
 
- * Each time pmd_precompact_cb() runs it will consider the next MDC
- * for compaction.
+ * Each time pmd_precompact() runs it ranks all the MDCs by how much they
+ * need compaction and queues the worst ones, within the mp_pcojobs and
+ * mp_pcobudget limits.
  */
 struct pre_compact_ctrl {
 	struct delayed_work	 pco_dwork;
 	struct mpool_descriptor *pco_mp;
 	atomic_t		 pco_nmtoc;
+	atomic_t		 pco_njobs;
+	atomic64_t		 pco_inflight;
 };
 
 /**
@@ -161,6 +196,8 @@ struct pre_compact_ctrl {
  * @pds_node:     for linking this object into an rbtree
  * @pds_params:   Per mpool parameters
  * @pds_workq:    Workqueue per mpool.
+ * @pds_erasewq:  woken up each time an object erase frees its zones
+ * @pds_erasegen: count of object erases that freed their zones
  * @pds_sbmdc0:   Used to store in RAM the MDC0 metadata. Loaded at activate
  *                time, changed when MDC0 is compacted.
  * @pds_ecio_rwl: rw locks used by ecio objects layouts.
@@ -208,6 +245,8 @@ struct mpool_descriptor {
 	struct workqueue_struct    *pds_workq;
 	struct workqueue_struct    *pds_erase_wq;
 	struct workqueue_struct    *pds_precompact_wq;
+	wait_queue_head_t           pds_erasewq;
+	atomic_t                    pds_erasegen;
 
 	struct media_class          pds_mc[MP_MED_NUMBER];
 	struct mpcore_params        pds_params;
@@ -31,6 +31,7 @@
 #include "pd.h"
 #include "pd_bio.h"
 #include "smap.h"
+#include "dsched.h"
 #include "pmd.h"
 #include "mlog.h"
 #include "mclass.h"
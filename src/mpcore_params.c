@@ -13,18 +13,32 @@ void mpcore_params_defaults(struct mpcore_params *params)
 	params->mp_mdcnum          = MPOOL_MDCNUM_DEFAULT;
 	params->mp_mdc0cap         = 0;
 	params->mp_mdcncap         = 0;
-	params->mp_smaprgnc        = MPOOL_SMAP_RGNCNT_DEFAULT;
 	params->mp_smapalign       = MPOOL_SMAP_ZONEALIGN_DEFAULT;
+	params->mp_smapbitmap      = MPOOL_SMAP_BITMAP_DEFAULT;
+	params->mp_smapcpurgn      = MPOOL_SMAP_CPURGN_DEFAULT;
 	params->mp_spare           = MPOOL_SPARES_DEFAULT;
 	params->mp_pcopctfull	   = MPOOL_PCO_PCTFULL;
 	params->mp_pcopctgarbage   = MPOOL_PCO_PCTGARBAGE;
 	params->mp_pconbnoalloc    = MPOOL_PCO_NBNOALLOC;
 	params->mp_pcoperiod       = MPOOL_PCO_PERIOD;
 	params->mp_pcofillbias     = MPOOL_PCO_FILLBIAS;
+	params->mp_pcojobs         = MPOOL_PCO_JOBS;
+	params->mp_pcobudget       = MPOOL_PCO_BUDGET;
 	params->mp_crtmdcpctfull   = MPOOL_CREATE_MDC_PCTFULL;
 	params->mp_crtmdcpctgrbg   = MPOOL_CREATE_MDC_PCTGRBG;
 	params->mp_mpusageperiod   = MPOOL_PD_USAGE_PERIOD;
+	params->mp_dschedperiod    = MPOOL_DSCHED_PERIOD;
+	params->mp_dschedmbps      = MPOOL_DSCHED_MBPS;
+	params->mp_dschediops      = MPOOL_DSCHED_IOPS;
+	params->mp_dschedfgiops    = MPOOL_DSCHED_FGIOPS;
+	params->mp_dscheddefer     = MPOOL_DSCHED_DEFER;
+	params->mp_mlogrsv         = MPOOL_MLOG_RSV_ZONES;
+	params->mp_mlogrsvmclass   = MPOOL_MLOG_RSV_MCLASS;
 
 	params->mp_objloadjobs = clamp_t(int, MPOOL_OBJ_LOAD_JOBS_DEFAULT,
 					 1, num_online_cpus());
+
+	params->mp_smaprgnc = clamp_t(int, num_online_cpus(),
+				      MPOOL_SMAP_RGNCNT_DEFAULT,
+				      MPOOL_SMAP_RGNCNT_MAX);
 }
@@ -27,6 +27,7 @@
 #include <linux/delay.h>
 #include <linux/ctype.h>
 #include <linux/uio.h>
+#include <linux/eventfd.h>
 
 #include <mpool/mpool_ioctl.h>
 
@@ -451,7 +452,8 @@ static void mpool_params_merge_defaults(struct mpool_params *params)
 
 	params->mp_vma_size_max = mpc_vma_size_max;
 
-	params->mp_rsvd1 = 0;
+	params->mp_smapbitmap &= (1u << MP_MED_NUMBER) - 1;
+
 	params->mp_rsvd2 = 0;
 	params->mp_rsvd3 = 0;
 	params->mp_rsvd4 = 0;
@@ -526,6 +528,8 @@ mpool_to_mpcore_params(
 
 	if (mdcnum != 0)
 		mpc_params->mp_mdcnum = mdcnum;
+
+	mpc_params->mp_smapbitmap = params->mp_smapbitmap;
 }
 
 /**
@@ -2309,7 +2313,7 @@ mpioc_mp_create(
 	cfg.mc_captgt = MPOOL_ROOT_LOG_CAP;
 	cfg.mc_ra_pages_max = mp->mp_params.mp_ra_pages_max;
 	cfg.mc_vma_size_max = mp->mp_params.mp_vma_size_max;
-	cfg.mc_rsvd1 = mp->mp_params.mp_rsvd1;
+	cfg.mc_rsvd1 = 0;
 	cfg.mc_rsvd2 = mp->mp_params.mp_rsvd2;
 	cfg.mc_rsvd3 = mp->mp_params.mp_rsvd3;
 	cfg.mc_rsvd4 = mp->mp_params.mp_rsvd4;
@@ -2816,6 +2820,8 @@ mpioc_devprops_get(struct mpc_unit *unit, struct mpioc_devprops *devprops)
 	if (unit->un_mpool) {
 		struct mpool_descriptor *mp = unit->un_mpool->mp_desc;
 
+		devprops->dpr_pdname[sizeof(devprops->dpr_pdname) - 1] = '\0';
+
 		err = mpool_get_devprops_by_name(mp, devprops->dpr_pdname,
 						 &devprops->dpr_devprops);
 	}
@@ -2823,6 +2829,50 @@ mpioc_devprops_get(struct mpc_unit *unit, struct mpioc_devprops *devprops)
 	return ev(err);
 }
 
+/**
+ * mpioc_devfrag_get() - Get the free space fragmentation of a device
+ * @unit:     mpool unit ptr
+ * @devfrag:
+ *
+ * MPIOC_DEVFRAG_GET ioctl handler.
+ */
+static merr_t
+mpioc_devfrag_get(struct mpc_unit *unit, struct mpioc_devfrag *devfrag)
+{
+	struct mpool_descriptor *mp;
+
+	if (!unit->un_mpool)
+		return merr(EINVAL);
+
+	mp = unit->un_mpool->mp_desc;
+	devfrag->dfr_pdname[sizeof(devfrag->dfr_pdname) - 1] = '\0';
+
+	return mpool_get_devfrag(mp, devfrag->dfr_pdname,
+				 &devfrag->dfr_devfrag);
+}
+
+/**
+ * mpioc_devdiscard_get() - Get the discard scheduler stats of a device
+ * @unit:       mpool unit ptr
+ * @devdiscard:
+ *
+ * MPIOC_DEVDISCARD_GET ioctl handler.
+ */
+static merr_t
+mpioc_devdiscard_get(struct mpc_unit *unit, struct mpioc_devdiscard *devdiscard)
+{
+	struct mpool_descriptor *mp;
+
+	if (!unit->un_mpool)
+		return merr(EINVAL);
+
+	mp = unit->un_mpool->mp_desc;
+	devdiscard->dds_pdname[sizeof(devdiscard->dds_pdname) - 1] = '\0';
+
+	return mpool_get_devdiscard(mp, devdiscard->dds_pdname,
+				    &devdiscard->dds_devdiscard);
+}
+
 /**
  * mpioc_proplist_get_itercb() - Get properties iterator callback.
  * @unit:   mpool or dataset unit ptr
@@ -3029,6 +3079,78 @@ mpioc_mb_abcomdel(struct mpc_unit *unit, uint cmd, struct mpioc_mblock_id *mi)
 	return err;
 }
 
+/**
+ * mpioc_mb_txn() - Commit and delete a set of mblocks as one unit.
+ * @unit:   mpool or dataset unit ptr
+ * @mt:     mblock txn parameter block
+ *
+ * MPIOC_MB_TXN ioctl handler.
+ *
+ * Return:  Returns 0 if successful, errno via merr_t otherwise...
+ */
+static merr_t mpioc_mb_txn(struct mpc_unit *unit, struct mpioc_mblock_txn *mt)
+{
+	struct mblock_descriptor  **mbv;
+	struct mpool_descriptor    *mpool;
+
+	merr_t  err = 0;
+	u64    *objidv;
+	u32     n, i, got;
+
+	if (!unit || !mt || !unit->un_mpool)
+		return merr(EINVAL);
+
+	if (mt->mt_cmtc > MPIOC_MB_TXN_MAX || mt->mt_delc > MPIOC_MB_TXN_MAX)
+		return merr(EINVAL);
+
+	n = mt->mt_cmtc + mt->mt_delc;
+	if (n == 0 || n > MPIOC_MB_TXN_MAX)
+		return merr(EINVAL);
+
+	mpool = unit->un_mpool->mp_desc;
+
+	objidv = kcalloc(n, sizeof(*objidv), GFP_KERNEL);
+	mbv = kcalloc(n, sizeof(*mbv), GFP_KERNEL);
+	if (!objidv || !mbv) {
+		err = merr(ENOMEM);
+		goto errout;
+	}
+
+	if (copy_from_user(objidv, mt->mt_cmtv,
+			   mt->mt_cmtc * sizeof(*objidv)) ||
+	    copy_from_user(objidv + mt->mt_cmtc, mt->mt_delv,
+			   mt->mt_delc * sizeof(*objidv))) {
+		err = merr(EFAULT);
+		goto errout;
+	}
+
+	for (got = 0; got < n; got++) {
+		if (!mblock_objid(objidv[got])) {
+			err = merr(EINVAL);
+			break;
+		}
+
+		err = mblock_find_get(mpool, objidv[got], NULL, &mbv[got]);
+		if (ev(err))
+			break;
+	}
+
+	if (!err)
+		err = mblock_txn(mpool, mbv, mt->mt_cmtc,
+				 mbv + mt->mt_cmtc, mt->mt_delc);
+
+	/* A successful delete drops the layout ref */
+	for (i = 0; i < got; i++)
+		if (err || i < mt->mt_cmtc)
+			mblock_put(mpool, mbv[i]);
+
+errout:
+	kfree(mbv);
+	kfree(objidv);
+
+	return err;
+}
+
 /**
  * mpioc_mb_rw() - read/write mblock ioctl handler
  * @unit:   dataset unit ptr
@@ -3334,6 +3456,47 @@ merr_t mpioc_mlog_erase(struct mpc_unit *unit, struct mpioc_mlog_id *mi)
 	return err;
 }
 
+/**
+ * mpioc_mlog_wait() - wait for the end of an mlog to advance
+ * @unit:
+ * @mw:
+ *
+ * Blocks for up to mw_tmo msecs, or if mw_efd is a valid eventfd arms a
+ * one-shot notification on it and returns immediately. An eventfd lets
+ * tail followers multiplex many mlogs with poll()/epoll(). The notification
+ * is dropped unsignalled after mw_tmo msecs if mw_tmo is not 0.
+ */
+static merr_t mpioc_mlog_wait(struct mpc_unit *unit, struct mpioc_mlog_wait *mw)
+{
+	struct mpool_descriptor    *mpool;
+	struct mlog_descriptor     *mlog;
+	struct eventfd_ctx         *efd = NULL;
+	merr_t                      err;
+
+	if (!unit || !unit->un_mpool || !mw || !mlog_objid(mw->mw_objid))
+		return merr(EINVAL);
+
+	mpool = unit->un_mpool->mp_desc;
+
+	if (mw->mw_efd >= 0) {
+		efd = eventfd_ctx_fdget(mw->mw_efd);
+		if (IS_ERR(efd))
+			return merr(EBADF);
+	}
+
+	err = mlog_find_get(mpool, mw->mw_objid, NULL, &mlog);
+	if (!err) {
+		err = mlog_wait_data(mpool, mlog, mw->mw_gen, mw->mw_off,
+				     mw->mw_tmo, efd, &mw->mw_seq, &mw->mw_end);
+		mlog_put(mpool, mlog);
+	}
+
+	if (efd)
+		eventfd_ctx_put(efd);
+
+	return err;
+}
+
 /**
  * mpioc_vma_create() - create an mpctl map
  * @unit:
@@ -3603,6 +3766,8 @@ static long mpc_ioctl(struct file *fp, unsigned int cmd, unsigned long arg)
 		switch (cmd) {
 		case MPIOC_PROP_GET:
 		case MPIOC_DEVPROPS_GET:
+		case MPIOC_DEVFRAG_GET:
+		case MPIOC_DEVDISCARD_GET:
 		case MPIOC_MB_FIND_GET:
 		case MPIOC_MB_GET:
 		case MPIOC_MB_PUT:
@@ -3614,6 +3779,7 @@ static long mpc_ioctl(struct file *fp, unsigned int cmd, unsigned long arg)
 		case MPIOC_MLOG_PUT:
 		case MPIOC_MLOG_READ:
 		case MPIOC_MLOG_PROPS:
+		case MPIOC_MLOG_WAIT:
 		case MPIOC_TEST:
 			break;
 
@@ -3684,6 +3850,14 @@ static long mpc_ioctl(struct file *fp, unsigned int cmd, unsigned long arg)
 		err = mpioc_devprops_get(unit, argp);
 		break;
 
+	case MPIOC_DEVFRAG_GET:
+		err = mpioc_devfrag_get(unit, argp);
+		break;
+
+	case MPIOC_DEVDISCARD_GET:
+		err = mpioc_devdiscard_get(unit, argp);
+		break;
+
 	case MPIOC_MB_ALLOC:
 		err = mpioc_mb_alloc(unit, argp);
 		break;
@@ -3703,6 +3877,10 @@ static long mpc_ioctl(struct file *fp, unsigned int cmd, unsigned long arg)
 		err = mpioc_mb_abcomdel(unit, cmd, argp);
 		break;
 
+	case MPIOC_MB_TXN:
+		err = mpioc_mb_txn(unit, argp);
+		break;
+
 	case MPIOC_MB_PROPS:
 		err = mpioc_mb_props(unit, argp);
 		break;
@@ -3748,6 +3926,10 @@ static long mpc_ioctl(struct file *fp, unsigned int cmd, unsigned long arg)
 		err = mpioc_mlog_erase(unit, argp);
 		break;
 
+	case MPIOC_MLOG_WAIT:
+		err = mpioc_mlog_wait(unit, argp);
+		break;
+
 	case MPIOC_VMA_CREATE:
 		err = mpioc_vma_create(unit, argp);
 		break;
@@ -320,7 +320,8 @@ void omf_dparm_pack_htole(struct omf_devparm_descriptor *dp, char *outbuf)
 	omf_set_podp_devsz(dp_omf, dp->odp_devsz);
 	omf_set_podp_zonetot(dp_omf, dp->odp_zonetot);
 	omf_set_podp_zonepg(dp_omf, dp->odp_zonepg);
-	omf_set_podp_mclassp(dp_omf, dp->odp_mclassp);
+	omf_set_podp_mclassp(dp_omf, dp->odp_mclassp |
+			     (dp->odp_mcord << OMF_MCORD_SHIFT));
 	/* Translate pd_devtype into devtype_omf */
 	omf_set_podp_devtype(dp_omf, dp->odp_devtype);
 	omf_set_podp_sectorsz(dp_omf, dp->odp_sectorsz);
@@ -346,7 +347,8 @@ static merr_t omf_dparm_unpack_letoh_v1(void *out, const char *inbuf)
 	dp->odp_devsz     = omf_podp_devsz(dp_omf);
 	dp->odp_zonetot    = omf_podp_zonetot(dp_omf);
 	dp->odp_zonepg = omf_podp_zonepg(dp_omf);
-	dp->odp_mclassp   = omf_podp_mclassp(dp_omf);
+	dp->odp_mclassp   = omf_podp_mclassp(dp_omf) & OMF_MCLASS_MASK;
+	dp->odp_mcord     = omf_podp_mclassp(dp_omf) >> OMF_MCORD_SHIFT;
 	/* Translate devtype_omf into mp_devtype */
 	dp->odp_devtype	  = omf_podp_devtype(dp_omf);
 	dp->odp_sectorsz  = omf_podp_sectorsz(dp_omf);
@@ -448,6 +450,7 @@ omf_ecio_layout_pack_htole(
 	char                           *outbuf)
 {
 	struct mdcrec_data_ocreate_omf *ocre_omf;
+	const struct mpool_dev_info    *pd;
 
 	int data_rec_sz;
 
@@ -461,8 +464,9 @@ omf_ecio_layout_pack_htole(
 
 	ocre_omf = (struct mdcrec_data_ocreate_omf *)outbuf;
 	omf_set_pdrc_rtype(ocre_omf, rtype);
-	omf_set_pdrc_mclass(ocre_omf,
-			    mp->pds_pdv[ecl->eld_ld.ol_pdh].pdi_mclass);
+	pd = &mp->pds_pdv[ecl->eld_ld.ol_pdh];
+	omf_set_pdrc_mclass(ocre_omf, pd->pdi_mclass |
+			    (pd->pdi_mcord << OMF_MCORD_SHIFT));
 	omf_set_pdrc_objid(ocre_omf, ecl->eld_objid);
 	omf_set_pdrc_gen(ocre_omf, ecl->eld_gen);
 	omf_set_pdrc_mblen(ocre_omf, ecl->eld_mblen);
@@ -510,7 +514,8 @@ static merr_t omf_ecio_layout_unpack_letoh_v1(void *out, const char *inbuf)
 		return err;
 	}
 
-	cdr->u.obj.omd_mclass = omf_pdrc_mclass(ocre_omf);
+	cdr->u.obj.omd_mclass = omf_pdrc_mclass(ocre_omf) & OMF_MCLASS_MASK;
+	cdr->u.obj.omd_mcord  = omf_pdrc_mclass(ocre_omf) >> OMF_MCORD_SHIFT;
 	cdr->u.obj.omd_objid = omf_pdrc_objid(ocre_omf);
 	cdr->u.obj.omd_gen   = omf_pdrc_gen(ocre_omf);
 	cdr->u.obj.omd_mblen = omf_pdrc_mblen(ocre_omf);
@@ -529,6 +534,31 @@ static merr_t omf_ecio_layout_unpack_letoh_v1(void *out, const char *inbuf)
 }
 
 
+/**
+ * omf_mclass_to_pdh() - find the drive designated by an on-media mclass byte
+ * @mp:
+ * @mclass: media class, and the ordinal of the drive in the media class in
+ *          the high bits (OMF_MCORD_SHIFT)
+ * @pdh:    (output) drive handle
+ *
+ * Return: true if the drive is in the mpool
+ */
+static bool
+omf_mclass_to_pdh(const struct mpool_descriptor *mp, u8 mclass, u16 *pdh)
+{
+	int    i;
+
+	for (i = 0; i < mp->pds_pdvcnt; i++) {
+		if (mp->pds_pdv[i].pdi_mclass == (mclass & OMF_MCLASS_MASK) &&
+		    mp->pds_pdv[i].pdi_mcord == (mclass >> OMF_MCORD_SHIFT)) {
+			*pdh = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
 /**
  * omf_ecio_layout_unpack_letoh() - Unpack little-endian mdc obj record and
  *	optional obj layout from inbuf.
@@ -558,7 +588,6 @@ omf_ecio_layout_unpack_letoh(
 	struct ecio_layout_descriptor  *ecl;
 
 	merr_t err;
-	int    i;
 
 	err = omf_unpack_letoh_and_convert(cdr, sizeof(*cdr), inbuf,
 					mdcrec_data_ocreate_table,
@@ -586,19 +615,15 @@ omf_ecio_layout_unpack_letoh(
 
 	ecl->eld_ld.ol_zaddr = cdr->u.obj.omd_old.ol_zaddr;
 
-	for (i = 0; i < mp->pds_pdvcnt; i++) {
-		if (mp->pds_pdv[i].pdi_mclass == cdr->u.obj.omd_mclass) {
-			ecl->eld_ld.ol_pdh = i;
-			break;
-		}
-	}
-
-	if (i >= mp->pds_pdvcnt) {
+	if (!omf_mclass_to_pdh(mp, cdr->u.obj.omd_mclass |
+			       (cdr->u.obj.omd_mcord << OMF_MCORD_SHIFT),
+			       &ecl->eld_ld.ol_pdh)) {
 		ecio_layout_free(ecl);
 
 		err = merr(ENOENT);
-		mp_pr_err("mpool %s, unpacking layout failed, mclass %u not in mpool",
-			  err, mp->pds_name, cdr->u.obj.omd_mclass);
+		mp_pr_err("mpool %s, unpacking layout failed, mclass %u drive %u not in mpool",
+			  err, mp->pds_name, cdr->u.obj.omd_mclass,
+			  cdr->u.obj.omd_mcord);
 		return err;
 	}
 
@@ -1191,6 +1216,392 @@ omf_mdcrec_mpconfig_unpack_letoh(struct omf_mdcrec_data *cdr, const char *inbuf)
 	omf_pdmc_label(cfg_omf, cfg->mc_label, sizeof(cfg->mc_label));
 }
 
+
+/*
+ * mdcrec_osnap
+ */
+
+/**
+ * omf_mdcrec_osnap_pack_htole() - Pack an object table snapshot record
+ * @mp:
+ * @cdr:
+ * @outbuf:
+ *
+ * Return: bytes packed.
+ */
+static u64
+omf_mdcrec_osnap_pack_htole(
+	struct mpool_descriptor    *mp,
+	struct omf_mdcrec_data     *cdr,
+	char                       *outbuf)
+{
+	struct mdcrec_data_osnap_omf   *osnap_omf;
+	const struct mpool_dev_info    *pd;
+
+	osnap_omf = (struct mdcrec_data_osnap_omf *)outbuf;
+	omf_set_pdrn_rtype(osnap_omf, cdr->omd_rtype);
+	pd = &mp->pds_pdv[cdr->u.snap.omd_ld.ol_pdh];
+	omf_set_pdrn_mclass(osnap_omf, pd->pdi_mclass |
+			    (pd->pdi_mcord << OMF_MCORD_SHIFT));
+	omf_layout_pack_htole(&cdr->u.snap.omd_ld,
+			      (char *)&osnap_omf->pdrn_ld);
+	omf_set_pdrn_cnt(osnap_omf, cdr->u.snap.omd_cnt);
+
+	return sizeof(*osnap_omf);
+}
+
+/**
+ * omf_mdcrec_osnap_unpack_letoh() - Unpack an object table snapshot record
+ * @mp:
+ * @cdr:
+ * @inbuf:
+ *
+ * Return: 0 if successful, merr_t (ENOENT) if the drive holding the snapshot
+ *	is not in the mpool
+ */
+static merr_t
+omf_mdcrec_osnap_unpack_letoh(
+	struct mpool_descriptor    *mp,
+	struct omf_mdcrec_data     *cdr,
+	const char                 *inbuf)
+{
+	struct mdcrec_data_osnap_omf   *osnap_omf;
+	merr_t                          err;
+
+	osnap_omf = (struct mdcrec_data_osnap_omf *)inbuf;
+
+	cdr->omd_rtype = omf_pdrn_rtype(osnap_omf);
+	omf_layout_unpack_letoh_v1(&cdr->u.snap.omd_ld,
+				   (char *)&osnap_omf->pdrn_ld);
+	cdr->u.snap.omd_cnt = omf_pdrn_cnt(osnap_omf);
+
+	if (!omf_mclass_to_pdh(mp, omf_pdrn_mclass(osnap_omf),
+			       &cdr->u.snap.omd_ld.ol_pdh)) {
+		err = merr(ENOENT);
+		mp_pr_err("mpool %s, unpacking object snapshot failed, mclass %u drive %u not in mpool",
+			  err, mp->pds_name,
+			  omf_pdrn_mclass(osnap_omf) & OMF_MCLASS_MASK,
+			  omf_pdrn_mclass(osnap_omf) >> OMF_MCORD_SHIFT);
+		return err;
+	}
+
+	return 0;
+}
+
+
+/*
+ * mdcrec_smapckpt
+ */
+
+/**
+ * omf_mdcrec_smapckpt_pack_htole() - Pack a space map checkpoint record
+ * @mp:
+ * @cdr:
+ * @outbuf:
+ *
+ * Return: bytes packed.
+ */
+static u64
+omf_mdcrec_smapckpt_pack_htole(
+	struct mpool_descriptor    *mp,
+	struct omf_mdcrec_data     *cdr,
+	char                       *outbuf)
+{
+	struct mdcrec_data_smapckpt_omf    *smck_omf;
+	const struct mpool_dev_info        *pd;
+
+	smck_omf = (struct mdcrec_data_smapckpt_omf *)outbuf;
+	memset(smck_omf, 0, sizeof(*smck_omf));
+
+	omf_set_pdrf_rtype(smck_omf, cdr->omd_rtype);
+	if (cdr->u.smck.omd_ld.ol_zcnt) {
+		pd = &mp->pds_pdv[cdr->u.smck.omd_ld.ol_pdh];
+		omf_set_pdrf_mclass(smck_omf, pd->pdi_mclass |
+				    (pd->pdi_mcord << OMF_MCORD_SHIFT));
+		omf_layout_pack_htole(&cdr->u.smck.omd_ld,
+				      (char *)&smck_omf->pdrf_ld);
+	}
+	omf_set_pdrf_cnt(smck_omf, cdr->u.smck.omd_cnt);
+	omf_set_pdrf_objcnt(smck_omf, cdr->u.smck.omd_objcnt);
+
+	return sizeof(*smck_omf);
+}
+
+/**
+ * omf_mdcrec_smapckpt_unpack_letoh() - Unpack a space map checkpoint record
+ * @mp:
+ * @cdr:
+ * @inbuf:
+ *
+ * A checkpoint on a drive that is not in the mpool is unpacked as
+ * invalidated, the space maps are then built from the objects alone.
+ */
+static void
+omf_mdcrec_smapckpt_unpack_letoh(
+	struct mpool_descriptor    *mp,
+	struct omf_mdcrec_data     *cdr,
+	const char                 *inbuf)
+{
+	struct mdcrec_data_smapckpt_omf    *smck_omf;
+
+	smck_omf = (struct mdcrec_data_smapckpt_omf *)inbuf;
+
+	cdr->omd_rtype = omf_pdrf_rtype(smck_omf);
+	omf_layout_unpack_letoh_v1(&cdr->u.smck.omd_ld,
+				   (char *)&smck_omf->pdrf_ld);
+	cdr->u.smck.omd_cnt = omf_pdrf_cnt(smck_omf);
+	cdr->u.smck.omd_objcnt = omf_pdrf_objcnt(smck_omf);
+	cdr->u.smck.omd_ld.ol_pdh = 0;
+
+	if (!cdr->u.smck.omd_ld.ol_zcnt)
+		return;
+
+	if (!omf_mclass_to_pdh(mp, omf_pdrf_mclass(smck_omf),
+			       &cdr->u.smck.omd_ld.ol_pdh)) {
+		mp_pr_warn("mpool %s, ignoring space map checkpoint, mclass %u drive %u not in mpool",
+			   mp->pds_name,
+			   omf_pdrf_mclass(smck_omf) & OMF_MCLASS_MASK,
+			   omf_pdrf_mclass(smck_omf) >> OMF_MCORD_SHIFT);
+		memset(&cdr->u.smck, 0, sizeof(cdr->u.smck));
+	}
+}
+
+
+/*
+ * osnap block
+ */
+/**
+ * omf_blk_pack_htole() - pack the header of a snapshot or checkpoint block
+ * @magic:  OMF_OSNAP_MAGIC or OMF_SMAPCKPT_MAGIC
+ * @entsz:  size of an entry of the block
+ * @seq:
+ * @cnt:
+ * @outbuf:
+ */
+static merr_t
+omf_blk_pack_htole(u64 magic, size_t entsz, u32 seq, u32 cnt, char *outbuf)
+{
+	struct osnap_blkhdr_omf    *hdr_omf;
+
+	merr_t err;
+	u8     cksum[4];
+
+	hdr_omf = (struct osnap_blkhdr_omf *)outbuf;
+
+	err = omf_cksum_crc32c_le(outbuf + sizeof(*hdr_omf), cnt * entsz,
+				  cksum);
+	if (ev(err))
+		return err;
+
+	omf_set_pnh_magic(hdr_omf, magic);
+	omf_set_pnh_seq(hdr_omf, seq);
+	omf_set_pnh_cnt(hdr_omf, cnt);
+	omf_set_pnh_cksum(hdr_omf, cksum, 4);
+
+	return 0;
+}
+
+/**
+ * omf_blk_unpack_letoh() - validate a snapshot or checkpoint block
+ * @magic:  OMF_OSNAP_MAGIC or OMF_SMAPCKPT_MAGIC
+ * @entsz:  size of an entry of the block
+ * @entmax: maximum number of entries in the block
+ * @seq:
+ * @inbuf:
+ * @cnt:
+ */
+static merr_t
+omf_blk_unpack_letoh(
+	u64         magic,
+	size_t      entsz,
+	u32         entmax,
+	u32         seq,
+	const char *inbuf,
+	u32        *cnt)
+{
+	struct osnap_blkhdr_omf    *hdr_omf;
+
+	merr_t err;
+	u8     cksum[4];
+	u8     hcksum[4];
+
+	hdr_omf = (struct osnap_blkhdr_omf *)inbuf;
+
+	if (omf_pnh_magic(hdr_omf) != magic ||
+	    omf_pnh_seq(hdr_omf) != seq ||
+	    omf_pnh_cnt(hdr_omf) > entmax)
+		return merr(EBADMSG);
+
+	*cnt = omf_pnh_cnt(hdr_omf);
+
+	err = omf_cksum_crc32c_le(inbuf + sizeof(*hdr_omf), *cnt * entsz,
+				  cksum);
+	if (ev(err))
+		return err;
+
+	omf_pnh_cksum(hdr_omf, hcksum, 4);
+	if (memcmp(cksum, hcksum, 4))
+		return merr(EBADMSG);
+
+	return 0;
+}
+
+merr_t omf_osnap_blk_pack_htole(u32 seq, u32 cnt, char *outbuf)
+{
+	return omf_blk_pack_htole(OMF_OSNAP_MAGIC, sizeof(struct osnap_ent_omf),
+				  seq, cnt, outbuf);
+}
+
+merr_t omf_osnap_blk_unpack_letoh(u32 seq, const char *inbuf, u32 *cnt)
+{
+	return omf_blk_unpack_letoh(OMF_OSNAP_MAGIC,
+				    sizeof(struct osnap_ent_omf),
+				    OMF_OSNAP_BLKENT, seq, inbuf, cnt);
+}
+
+void
+omf_osnap_ent_pack_htole(
+	const struct mpool_descriptor  *mp,
+	struct ecio_layout_descriptor  *layout,
+	u32                             idx,
+	char                           *outbuf)
+{
+	const struct mpool_dev_info    *pd;
+	struct osnap_ent_omf           *ent_omf;
+
+	ent_omf = (struct osnap_ent_omf *)(outbuf +
+					   sizeof(struct osnap_blkhdr_omf));
+	ent_omf += idx;
+
+	pd = &mp->pds_pdv[layout->eld_ld.ol_pdh];
+	omf_set_pne_objid(ent_omf, layout->eld_objid);
+	omf_set_pne_gen(ent_omf, layout->eld_gen);
+	omf_set_pne_mblen(ent_omf, layout->eld_mblen);
+	omf_layout_pack_htole(&layout->eld_ld, (char *)&ent_omf->pne_ld);
+	omf_set_pne_mclass(ent_omf, pd->pdi_mclass |
+			   (pd->pdi_mcord << OMF_MCORD_SHIFT));
+}
+
+merr_t
+omf_osnap_ent_unpack_letoh(
+	struct mpool_descriptor        *mp,
+	u32                             idx,
+	const char                     *inbuf,
+	struct ecio_layout_descriptor **layout)
+{
+	struct ecio_layout_descriptor  *ecl;
+	struct omf_layout_descriptor    ld;
+	struct osnap_ent_omf           *ent_omf;
+
+	merr_t err;
+	u64    objid;
+
+	ent_omf = (struct osnap_ent_omf *)(inbuf +
+					   sizeof(struct osnap_blkhdr_omf));
+	ent_omf += idx;
+
+	objid = omf_pne_objid(ent_omf);
+	if (objid_type(objid) != OMF_OBJ_MBLOCK) {
+		err = merr(EINVAL);
+		mp_pr_err("mpool %s, object snapshot entry 0x%lx not an mblock",
+			  err, mp->pds_name, (ulong)objid);
+		return err;
+	}
+
+	omf_layout_unpack_letoh_v1(&ld, (char *)&ent_omf->pne_ld);
+
+	ecl = ecio_layout_alloc(mp, NULL, objid, omf_pne_gen(ent_omf),
+				omf_pne_mblen(ent_omf), ld.ol_zcnt);
+	if (!ecl) {
+		err = merr(ENOMEM);
+		mp_pr_err("mpool %s, unpacking object snapshot failed, could not allocate layout structure",
+			  err, mp->pds_name);
+		return err;
+	}
+
+	ecl->eld_ld.ol_zaddr = ld.ol_zaddr;
+
+	if (!omf_mclass_to_pdh(mp, omf_pne_mclass(ent_omf),
+			       &ecl->eld_ld.ol_pdh)) {
+		ecio_layout_free(ecl);
+
+		err = merr(ENOENT);
+		mp_pr_err("mpool %s, unpacking object snapshot failed, mblock 0x%lx drive not in mpool",
+			  err, mp->pds_name, (ulong)objid);
+		return err;
+	}
+
+	*layout = ecl;
+
+	return 0;
+}
+
+
+/*
+ * smapckpt block
+ */
+merr_t omf_smapckpt_blk_pack_htole(u32 seq, u32 cnt, char *outbuf)
+{
+	return omf_blk_pack_htole(OMF_SMAPCKPT_MAGIC,
+				  sizeof(struct smapckpt_ent_omf),
+				  seq, cnt, outbuf);
+}
+
+merr_t omf_smapckpt_blk_unpack_letoh(u32 seq, const char *inbuf, u32 *cnt)
+{
+	return omf_blk_unpack_letoh(OMF_SMAPCKPT_MAGIC,
+				    sizeof(struct smapckpt_ent_omf),
+				    OMF_SMAPCKPT_BLKENT, seq, inbuf, cnt);
+}
+
+void
+omf_smapckpt_ent_pack_htole(
+	const struct mpool_descriptor  *mp,
+	u16                             pdh,
+	u64                             zoneaddr,
+	u32                             zonecnt,
+	u32                             idx,
+	char                           *outbuf)
+{
+	const struct mpool_dev_info    *pd;
+	struct smapckpt_ent_omf        *ent_omf;
+
+	ent_omf = (struct smapckpt_ent_omf *)(outbuf +
+					      sizeof(struct osnap_blkhdr_omf));
+	ent_omf += idx;
+
+	pd = &mp->pds_pdv[pdh];
+	omf_set_pse_zaddr(ent_omf, zoneaddr);
+	omf_set_pse_zcnt(ent_omf, zonecnt);
+	omf_set_pse_mclass(ent_omf, pd->pdi_mclass |
+			   (pd->pdi_mcord << OMF_MCORD_SHIFT));
+	memset(ent_omf->pse_pad, 0, sizeof(ent_omf->pse_pad));
+}
+
+merr_t
+omf_smapckpt_ent_unpack_letoh(
+	const struct mpool_descriptor  *mp,
+	u32                             idx,
+	const char                     *inbuf,
+	u16                            *pdh,
+	u64                            *zoneaddr,
+	u32                            *zonecnt)
+{
+	struct smapckpt_ent_omf    *ent_omf;
+
+	ent_omf = (struct smapckpt_ent_omf *)(inbuf +
+					      sizeof(struct osnap_blkhdr_omf));
+	ent_omf += idx;
+
+	if (!omf_mclass_to_pdh(mp, omf_pse_mclass(ent_omf), pdh))
+		return merr(ENOENT);
+
+	*zoneaddr = omf_pse_zaddr(ent_omf);
+	*zonecnt = omf_pse_zcnt(ent_omf);
+
+	return 0;
+}
+
 /**
  * mdcrec_type_objcmn() - Determine if the data record type corresponds to
  *	an object.
@@ -1237,6 +1648,10 @@ omf_mdcrec_pack_htole(
 		return omf_mdcrec_mcspare_pack_htole(cdr, outbuf);
 	else if (rtype == OMF_MDR_MPCONFIG)
 		return omf_mdcrec_mpconfig_pack_htole(cdr, outbuf);
+	else if (rtype == OMF_MDR_OSNAP)
+		return omf_mdcrec_osnap_pack_htole(mp, cdr, outbuf);
+	else if (rtype == OMF_MDR_SMAPCKPT)
+		return omf_mdcrec_smapckpt_pack_htole(mp, cdr, outbuf);
 
 	mp_pr_warn("mpool %s, invalid record type %u in mdc log",
 		   mp->pds_name, rtype);
@@ -1270,6 +1685,11 @@ omf_mdcrec_unpack_letoh(
 	} else if (rtype == OMF_MDR_MPCONFIG) {
 		omf_mdcrec_mpconfig_unpack_letoh(cdr, inbuf);
 		return 0;
+	} else if (rtype == OMF_MDR_OSNAP) {
+		return omf_mdcrec_osnap_unpack_letoh(mp, cdr, inbuf);
+	} else if (rtype == OMF_MDR_SMAPCKPT) {
+		omf_mdcrec_smapckpt_unpack_letoh(mp, cdr, inbuf);
+		return 0;
 	}
 
 	mp_pr_warn("mpool %s, unknown record type %u in mdc log",
@@ -1320,6 +1740,8 @@ omf_logblock_header_pack_htole(
 	omf_set_polh_gen(lbh_omf, lbh->olh_gen);
 	omf_set_polh_pfsetid(lbh_omf, lbh->olh_pfsetid);
 	omf_set_polh_cfsetid(lbh_omf, lbh->olh_cfsetid);
+	omf_set_polh_fsblks(lbh_omf, lbh->olh_fsblks);
+	omf_set_polh_flags(lbh_omf, lbh->olh_flags);
 
 	return 0;
 }
@@ -1338,6 +1760,8 @@ omf_logblock_header_unpack_letoh(
 	lbh->olh_gen     = omf_polh_gen(lbh_omf);
 	lbh->olh_pfsetid = omf_polh_pfsetid(lbh_omf);
 	lbh->olh_cfsetid = omf_polh_cfsetid(lbh_omf);
+	lbh->olh_fsblks  = omf_polh_fsblks(lbh_omf);
+	lbh->olh_flags   = omf_polh_flags(lbh_omf);
 
 	return 0;
 }
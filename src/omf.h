@@ -171,7 +171,8 @@ OMF_SETGET(struct layout_descriptor_omf, pol_zaddr, 64)
  * The fields below uniquely identify the media class of the PD.
  * All drives in a media class must have the same values in the below
  * fields.
- * @podp_mclassp:   enum mp_media_classp
+ * @podp_mclassp:   enum mp_media_classp, and the ordinal of the drive in
+ *                  its media class in the high bits (OMF_MCORD_SHIFT)
  * @podp_devtype:   PD type (enum devtype_omf)
  * @podp_sectorsz:  2^podp_sectorsz = sector size
  * @podp_zonepg: virtual erase block size in PAGE_SIZE units for drive.
@@ -199,6 +200,16 @@ OMF_SETGET(struct devparm_descriptor_omf, podp_devsz, 64)
 OMF_SETGET(struct devparm_descriptor_omf, podp_features, 64)
 #define OMF_DEVPARM_DESC_PACKLEN (sizeof(struct devparm_descriptor_omf))
 
+/*
+ * A media class may span several drives. The ordinal of a drive within its
+ * media class is packed above the media class in podp_mclassp, and the
+ * ordinal of the drive holding an object above the media class in
+ * pdrc_mclass. The first drive of a class has ordinal 0, so the records of
+ * single drive media classes are unchanged.
+ */
+#define OMF_MCLASS_MASK          0x0f
+#define OMF_MCORD_SHIFT          4
+
 
 /*
  * mlog structure:
@@ -282,20 +293,37 @@ OMF_SETGET(struct logrec_descriptor_omf, polr_rtype, 8)
 
 #define OMF_LOGBLOCK_VERS    1
 
+/**
+ * enum logblock_flags_omf -
+ * @OMF_LOGBLOCK_F_ATOMIC: the flush set holds an atomic batch and is
+ *	recovered only if all its polh_fsblks log blocks are found
+ */
+enum logblock_flags_omf {
+	OMF_LOGBLOCK_F_ATOMIC = 0x1,
+};
+
 /**
  * struct logblock_header_omf - for all versions
  * "polh_" = packed omf logblock header
  *
  * @polh_vers:    log block hdr version, offset 0 in all vers
  * @polh_magic:   unique magic per mlog
+ * @polh_fsblks:  no. of log blocks written by the flush of this flush set
+ * @polh_flags:   enum logblock_flags_omf values
  * @polh_pfsetid: flush set ID of the previous log block
  * @polh_cfsetid: flush set ID this log block belongs to
  * @polh_gen:     generation number
+ *
+ * polh_fsblks and polh_flags were carved out of padding that was always
+ * written as zeroes, hence a log block written before they existed reads
+ * as belonging to a non-atomic flush set.
  */
 struct logblock_header_omf {
 	__le16 polh_vers;
 	u8     polh_magic[OMF_UUID_PACKLEN];
-	u8     polh_pad[6];
+	__le16 polh_fsblks;
+	u8     polh_flags;
+	u8     polh_pad[3];
 	__le32 polh_pfsetid;
 	__le32 polh_cfsetid;
 	__le64 polh_gen;
@@ -304,6 +332,8 @@ struct logblock_header_omf {
 /* Define set/get methods for logblock_header_omf */
 OMF_SETGET(struct logblock_header_omf, polh_vers, 16)
 OMF_SETGET_CHBUF(struct logblock_header_omf, polh_magic)
+OMF_SETGET(struct logblock_header_omf, polh_fsblks, 16)
+OMF_SETGET(struct logblock_header_omf, polh_flags, 8)
 OMF_SETGET(struct logblock_header_omf, polh_pfsetid, 32)
 OMF_SETGET(struct logblock_header_omf, polh_cfsetid, 32)
 OMF_SETGET(struct logblock_header_omf, polh_gen, 64)
@@ -330,6 +360,8 @@ OMF_SETGET(struct logblock_header_omf, polh_gen, 64)
  * @OMF_MDR_MCSPARE:  media class spare zones set
  * @OMF_MDR_VERSION:  MDC content version.
  * @OMF_MDR_MPCONFIG:  mpool config record
+ * @OMF_MDR_OSNAP:    object table snapshot, since MDC content version 1.0.0.1
+ * @OMF_MDR_SMAPCKPT: space map checkpoint, since MDC content version 1.0.0.1
  */
 enum mdcrec_type_omf {
 	OMF_MDR_UNDEF       = 0,
@@ -342,7 +374,9 @@ enum mdcrec_type_omf {
 	OMF_MDR_MCSPARE     = 7,
 	OMF_MDR_VERSION     = 8,
 	OMF_MDR_MPCONFIG    = 9,
-	OMF_MDR_MAX         = 10,
+	OMF_MDR_OSNAP       = 10,
+	OMF_MDR_SMAPCKPT    = 11,
+	OMF_MDR_MAX         = 12,
 };
 
 /**
@@ -461,7 +495,8 @@ OMF_SETGET(struct mdcrec_data_mcspare_omf, pdra_spzone, 8)
  * "pdrc_" = packed data record ocreate
  *
  * @pdrc_rtype:     mdrec_type_omf: OMF_MDR_OCREATE or OMF_MDR_OUPDATE
- * @pdrc_mclass:
+ * @pdrc_mclass:    media class, and the ordinal of the drive in the media
+ *                  class in the high bits (OMF_MCORD_SHIFT)
  * @pdrc_uuid:
  * @pdrc_ld:
  * @pdrc_objid:     object identifier
@@ -490,6 +525,161 @@ OMF_SETGET(struct mdcrec_data_ocreate_omf, pdrc_mblen, 64)
 				   OMF_UUID_PACKLEN)
 
 
+/**
+ * struct mdcrec_data_osnap_omf -
+ * "pdrn_" = packed data record object snapshot
+ *
+ * Logged by the compaction of an MDCi i>0 in place of the OCREATE records of
+ * its mblocks, which are written to the snapshot extent instead.
+ *
+ * @pdrn_rtype:  mdrec_type_omf: OMF_MDR_OSNAP
+ * @pdrn_mclass: media class, and the ordinal of the drive in the media
+ *               class in the high bits (OMF_MCORD_SHIFT)
+ * @pdrn_ld:     extent holding the snapshot
+ * @pdrn_cnt:    number of mblocks in the snapshot
+ */
+struct mdcrec_data_osnap_omf {
+	u8                             pdrn_rtype;
+	u8                             pdrn_mclass;
+	u8                             pdrn_pad[2];
+	struct layout_descriptor_omf   pdrn_ld;
+	__le64                         pdrn_cnt;
+} __packed;
+
+/* Define set/get methods for mdcrec_data_osnap_omf */
+OMF_SETGET(struct mdcrec_data_osnap_omf, pdrn_rtype, 8)
+OMF_SETGET(struct mdcrec_data_osnap_omf, pdrn_mclass, 8)
+OMF_SETGET(struct mdcrec_data_osnap_omf, pdrn_cnt, 64)
+#define OMF_MDCREC_OSNAP_PACKLEN (sizeof(struct mdcrec_data_osnap_omf))
+
+/**
+ * struct mdcrec_data_smapckpt_omf -
+ * "pdrf_" = packed data record free space checkpoint
+ *
+ * Logged in MDC0 by a clean deactivation, which writes the free extents of
+ * the space maps to the checkpoint extent. Activation logs it again with a
+ * zero pdrf_cnt and pdrf_ld to invalidate the checkpoint.
+ *
+ * @pdrf_rtype:  mdrec_type_omf: OMF_MDR_SMAPCKPT
+ * @pdrf_mclass: media class, and the ordinal of the drive in the media
+ *               class in the high bits (OMF_MCORD_SHIFT)
+ * @pdrf_ld:     extent holding the checkpoint
+ * @pdrf_cnt:    number of free extents in the checkpoint
+ * @pdrf_objcnt: number of objects of all the MDCs at the checkpoint
+ */
+struct mdcrec_data_smapckpt_omf {
+	u8                             pdrf_rtype;
+	u8                             pdrf_mclass;
+	u8                             pdrf_pad[2];
+	struct layout_descriptor_omf   pdrf_ld;
+	__le64                         pdrf_cnt;
+	__le64                         pdrf_objcnt;
+} __packed;
+
+/* Define set/get methods for mdcrec_data_smapckpt_omf */
+OMF_SETGET(struct mdcrec_data_smapckpt_omf, pdrf_rtype, 8)
+OMF_SETGET(struct mdcrec_data_smapckpt_omf, pdrf_mclass, 8)
+OMF_SETGET(struct mdcrec_data_smapckpt_omf, pdrf_cnt, 64)
+OMF_SETGET(struct mdcrec_data_smapckpt_omf, pdrf_objcnt, 64)
+#define OMF_MDCREC_SMAPCKPT_PACKLEN (sizeof(struct mdcrec_data_smapckpt_omf))
+
+
+/*
+ * Object table snapshot format.
+ *
+ * The snapshot extent is a sequence of OMF_OSNAP_BLKSZ blocks, each made of
+ * a header followed by up to OMF_OSNAP_BLKENT mblock entries.
+ */
+#define OMF_OSNAP_MAGIC   0x706e536c6f6f706dULL  /* ASCII mpoolSnp - no null */
+#define OMF_OSNAP_BLKSZ   4096
+
+/**
+ * struct osnap_blkhdr_omf - object table snapshot block header
+ * "pnh_" = packed snapshot header
+ *
+ * Also the block header of a space map checkpoint.
+ *
+ * @pnh_magic: OMF_OSNAP_MAGIC or OMF_SMAPCKPT_MAGIC
+ * @pnh_seq:   index of the block in the snapshot
+ * @pnh_cnt:   number of entries in the block
+ * @pnh_cksum: crc32c of the entries of the block
+ */
+struct osnap_blkhdr_omf {
+	__le64 pnh_magic;
+	__le32 pnh_seq;
+	__le32 pnh_cnt;
+	u8     pnh_cksum[4];
+	u8     pnh_pad[12];
+} __packed;
+
+OMF_SETGET(struct osnap_blkhdr_omf, pnh_magic, 64)
+OMF_SETGET(struct osnap_blkhdr_omf, pnh_seq, 32)
+OMF_SETGET(struct osnap_blkhdr_omf, pnh_cnt, 32)
+OMF_SETGET_CHBUF(struct osnap_blkhdr_omf, pnh_cksum)
+
+/**
+ * struct osnap_ent_omf - object table snapshot entry, one per mblock
+ * "pne_" = packed snapshot entry
+ *
+ * @pne_objid:  object identifier
+ * @pne_gen:    object generation number
+ * @pne_mblen:  amount of data written in the mblock
+ * @pne_ld:     mblock extent
+ * @pne_mclass: media class, and the ordinal of the drive in the media
+ *              class in the high bits (OMF_MCORD_SHIFT)
+ */
+struct osnap_ent_omf {
+	__le64                         pne_objid;
+	__le64                         pne_gen;
+	__le64                         pne_mblen;
+	struct layout_descriptor_omf   pne_ld;
+	u8                             pne_mclass;
+	u8                             pne_pad[3];
+} __packed;
+
+OMF_SETGET(struct osnap_ent_omf, pne_objid, 64)
+OMF_SETGET(struct osnap_ent_omf, pne_gen, 64)
+OMF_SETGET(struct osnap_ent_omf, pne_mblen, 64)
+OMF_SETGET(struct osnap_ent_omf, pne_mclass, 8)
+
+#define OMF_OSNAP_BLKENT                                          \
+	((OMF_OSNAP_BLKSZ - sizeof(struct osnap_blkhdr_omf)) /    \
+	 sizeof(struct osnap_ent_omf))
+
+
+/*
+ * Space map checkpoint format.
+ *
+ * Same blocks as an object table snapshot, with up to OMF_SMAPCKPT_BLKENT
+ * free extent entries each. The entries of a drive are in address order.
+ */
+#define OMF_SMAPCKPT_MAGIC 0x6b43536c6f6f706dULL /* ASCII mpoolSCk - no null */
+
+/**
+ * struct smapckpt_ent_omf - space map checkpoint entry, one per free extent
+ * "pse_" = packed smap checkpoint entry
+ *
+ * @pse_zaddr:  first zone of the free extent
+ * @pse_zcnt:   number of zones of the free extent
+ * @pse_mclass: media class, and the ordinal of the drive in the media
+ *              class in the high bits (OMF_MCORD_SHIFT)
+ */
+struct smapckpt_ent_omf {
+	__le64 pse_zaddr;
+	__le32 pse_zcnt;
+	u8     pse_mclass;
+	u8     pse_pad[3];
+} __packed;
+
+OMF_SETGET(struct smapckpt_ent_omf, pse_zaddr, 64)
+OMF_SETGET(struct smapckpt_ent_omf, pse_zcnt, 32)
+OMF_SETGET(struct smapckpt_ent_omf, pse_mclass, 8)
+
+#define OMF_SMAPCKPT_BLKENT                                       \
+	((OMF_OSNAP_BLKSZ - sizeof(struct osnap_blkhdr_omf)) /    \
+	 sizeof(struct smapckpt_ent_omf))
+
+
 /**
  * struct mdcrec_data_mpconfig_omf -
  * "pdmc_" = packed data mpool config
@@ -660,6 +850,8 @@ OMF_SETGET_CHBUF(struct sb_descriptor_omf, psb_mdc02devid)
 #define OMF_MDCREC_PACKLEN_MAX max(OMF_MDCREC_OBJCMN_PACKLEN,            \
 				   max(OMF_MDCREC_MCCONFIG_PACKLEN,      \
 				       max(OMF_MDCREC_CLS_SPARE_PACKLEN, \
-					   OMF_MDCREC_MPCONFIG_PACKLEN)))
+					   max(OMF_MDCREC_MPCONFIG_PACKLEN, \
+					       max(OMF_MDCREC_OSNAP_PACKLEN, \
+					   OMF_MDCREC_SMAPCKPT_PACKLEN)))))
 
 #endif /* MPCORE_OMF_H */
@@ -29,6 +29,7 @@ struct omf_layout_descriptor {
  * @odp_devid:     UUID for drive
  * @odp_devsz:     size, in bytes, of the volume/device
  * @odp_zonetot:    total number of virtual erase blocks
+ * @odp_mcord:     ordinal of the drive within its media class
  *
  * The fields below uniquely identify the media class of the PD.
  * All drives in a media class must have the same values in the below fields.
@@ -43,6 +44,7 @@ struct omf_devparm_descriptor {
 	struct mpool_uuid  odp_devid;
 	u64                odp_devsz;
 	u32                odp_zonetot;
+	u8                 odp_mcord;
 
 	u32                odp_zonepg;
 	u8                 odp_mclassp;
@@ -124,6 +126,8 @@ struct omf_logrec_descriptor {
  * @olh_cfsetid: flush set ID this log block
  * @olh_gen:     generation number
  * @olh_vers:    log block format version
+ * @olh_fsblks:  no. of log blocks written by the flush of this flush set
+ * @olh_flags:   enum logblock_flags_omf values
  */
 struct omf_logblock_header {
 	struct mpool_uuid    olh_magic;
@@ -131,6 +135,8 @@ struct omf_logblock_header {
 	u32                olh_cfsetid;
 	u64                olh_gen;
 	u16                olh_vers;
+	u16                olh_fsblks;
+	u8                 olh_flags;
 };
 
 /**
@@ -170,6 +176,18 @@ struct omf_mdccver {
  * @omd_mblen:  Length of written data in object
  * @omd_old:
  * @omd_uuid:
+ * @omd_mclass: media class of the drive holding the object
+ * @omd_mcord:  ordinal of that drive within the media class
+ *
+ * object_snap- OSNAP
+ * @omd_ld:  extent holding the object table snapshot
+ * @omd_cnt: number of mblocks in the snapshot
+ *
+ * smap_ckpt- SMAPCKPT
+ * @omd_ld:     extent holding the space map checkpoint, ol_zcnt is 0 if the
+ *              checkpoint is invalidated
+ * @omd_cnt:    number of free extents in the checkpoint
+ * @omd_objcnt: number of objects of all the MDCs at the checkpoint
  *
  * drive_state-
  * @omd_parm:
@@ -196,8 +214,20 @@ struct omf_mdcrec_data {
 			struct omf_layout_descriptor    omd_old;
 			struct mpool_uuid               omd_uuid;
 			u8                              omd_mclass;
+			u8                              omd_mcord;
 		} obj;
 
+		struct object_snap {
+			struct omf_layout_descriptor    omd_ld;
+			u64                             omd_cnt;
+		} snap;
+
+		struct smap_ckpt {
+			struct omf_layout_descriptor    omd_ld;
+			u64                             omd_cnt;
+			u64                             omd_objcnt;
+		} smck;
+
 		struct drive_state {
 			struct omf_devparm_descriptor  omd_parm;
 			u8                             omd_state;
@@ -405,6 +435,115 @@ omf_mdcrec_unpack_letoh(
 	struct omf_mdcrec_data     *cdr,
 	const char                 *inbuf);
 
+/**
+ * omf_osnap_blk_pack_htole() - pack an object table snapshot block header
+ * @seq:    index of the block in the snapshot
+ * @cnt:    number of entries already packed in the block
+ * @outbuf: OMF_OSNAP_BLKSZ block
+ *
+ * Return: 0 if successful, merr_t otherwise
+ */
+merr_t omf_osnap_blk_pack_htole(u32 seq, u32 cnt, char *outbuf);
+
+/**
+ * omf_osnap_blk_unpack_letoh() - validate an object table snapshot block
+ * @seq:   expected index of the block in the snapshot
+ * @inbuf: OMF_OSNAP_BLKSZ block
+ * @cnt:   (output) number of entries in the block
+ *
+ * Return: 0 if successful, merr_t (EBADMSG) if the block is not valid
+ */
+merr_t omf_osnap_blk_unpack_letoh(u32 seq, const char *inbuf, u32 *cnt);
+
+/**
+ * omf_osnap_ent_pack_htole() - pack an mblock layout in a snapshot block
+ * @mp:
+ * @layout: mblock layout
+ * @idx:    index of the entry in the block
+ * @outbuf: OMF_OSNAP_BLKSZ block
+ */
+void
+omf_osnap_ent_pack_htole(
+	const struct mpool_descriptor  *mp,
+	struct ecio_layout_descriptor  *layout,
+	u32                             idx,
+	char                           *outbuf);
+
+/**
+ * omf_osnap_ent_unpack_letoh() - unpack an mblock layout from a snapshot block
+ * @mp:
+ * @idx:    index of the entry in the block
+ * @inbuf:  OMF_OSNAP_BLKSZ block
+ * @layout: (output) allocated layout
+ *
+ * Return: 0 if successful, merr_t otherwise
+ */
+merr_t
+omf_osnap_ent_unpack_letoh(
+	struct mpool_descriptor        *mp,
+	u32                             idx,
+	const char                     *inbuf,
+	struct ecio_layout_descriptor **layout);
+
+/**
+ * omf_smapckpt_blk_pack_htole() - pack a space map checkpoint block header
+ * @seq:    index of the block in the checkpoint
+ * @cnt:    number of entries already packed in the block
+ * @outbuf: OMF_OSNAP_BLKSZ block
+ *
+ * Return: 0 if successful, merr_t otherwise
+ */
+merr_t omf_smapckpt_blk_pack_htole(u32 seq, u32 cnt, char *outbuf);
+
+/**
+ * omf_smapckpt_blk_unpack_letoh() - validate a space map checkpoint block
+ * @seq:   expected index of the block in the checkpoint
+ * @inbuf: OMF_OSNAP_BLKSZ block
+ * @cnt:   (output) number of entries in the block
+ *
+ * Return: 0 if successful, merr_t (EBADMSG) if the block is not valid
+ */
+merr_t omf_smapckpt_blk_unpack_letoh(u32 seq, const char *inbuf, u32 *cnt);
+
+/**
+ * omf_smapckpt_ent_pack_htole() - pack a free extent in a checkpoint block
+ * @mp:
+ * @pdh:      drive of the free extent
+ * @zoneaddr:
+ * @zonecnt:
+ * @idx:      index of the entry in the block
+ * @outbuf:   OMF_OSNAP_BLKSZ block
+ */
+void
+omf_smapckpt_ent_pack_htole(
+	const struct mpool_descriptor  *mp,
+	u16                             pdh,
+	u64                             zoneaddr,
+	u32                             zonecnt,
+	u32                             idx,
+	char                           *outbuf);
+
+/**
+ * omf_smapckpt_ent_unpack_letoh() - unpack a free extent from a checkpoint
+ *	block
+ * @mp:
+ * @idx:      index of the entry in the block
+ * @inbuf:    OMF_OSNAP_BLKSZ block
+ * @pdh:      (output) drive of the free extent
+ * @zoneaddr: (output)
+ * @zonecnt:  (output)
+ *
+ * Return: 0 if successful, merr_t (ENOENT) if the drive is not in the mpool
+ */
+merr_t
+omf_smapckpt_ent_unpack_letoh(
+	const struct mpool_descriptor  *mp,
+	u32                             idx,
+	const char                     *inbuf,
+	u16                            *pdh,
+	u64                            *zoneaddr,
+	u32                            *zonecnt);
+
 /**
  * omf_logblock_header_cksum_le() - add checksum to log block buffer
  * @mp: struct mpool_descriptor *
@@ -13,6 +13,7 @@
 #include <linux/fs.h>
 #include <linux/blkdev.h>
 #include <linux/blk_types.h>
+#include <linux/percpu.h>
 
 #include "mpcore_defs.h"
 
@@ -39,6 +40,63 @@ merr_t pd_dev_init(struct pd_dev_parm *dparm, struct pd_prop *pd_prop)
 	return 0;
 }
 
+void pd_iostat_init(struct mpool_dev_info *pd)
+{
+	pd->pdi_iostat = alloc_percpu(struct pd_iostat);
+}
+
+void pd_iostat_fini(struct mpool_dev_info *pd)
+{
+	free_percpu(pd->pdi_iostat);
+	pd->pdi_iostat = NULL;
+}
+
+u64 pd_io_issued(struct mpool_dev_info *pd)
+{
+	u64 issued = 0;
+	int cpu;
+
+	if (!pd->pdi_iostat)
+		return 0;
+
+	for_each_possible_cpu(cpu)
+		issued += READ_ONCE(per_cpu_ptr(pd->pdi_iostat,
+						cpu)->pis_issued);
+
+	return issued;
+}
+
+u32 pd_io_inflight(struct mpool_dev_info *pd)
+{
+	long    inflight = 0;
+	int     cpu;
+
+	if (!pd->pdi_iostat)
+		return 0;
+
+	for_each_possible_cpu(cpu) {
+		struct pd_iostat *pis = per_cpu_ptr(pd->pdi_iostat, cpu);
+
+		inflight += READ_ONCE(pis->pis_issued);
+		inflight -= READ_ONCE(pis->pis_done);
+	}
+
+	/* A completion may be counted ahead of its issue. */
+	return max_t(long, inflight, 0);
+}
+
+static inline void pd_io_start(struct mpool_dev_info *pd)
+{
+	if (pd->pdi_iostat)
+		this_cpu_inc(pd->pdi_iostat->pis_issued);
+}
+
+static inline void pd_io_end(struct mpool_dev_info *pd)
+{
+	if (pd->pdi_iostat)
+		this_cpu_inc(pd->pdi_iostat->pis_done);
+}
+
 merr_t
 pd_zone_pwritev(
 	struct mpool_dev_info  *pd,
@@ -49,13 +107,20 @@ pd_zone_pwritev(
 	int                     op_flags)
 {
 	loff_t woff;
+	merr_t err;
 
 	if (mpool_pd_status_get(pd) == PD_STAT_UNAVAIL)
 		return merr(ev(EIO));
 
 	woff = ((u64)pd->pdi_zonepg << PAGE_SHIFT) * zoneaddr + boff;
 
-	return pd_bio_rw(pd, iov, iovcnt, woff, REQ_OP_WRITE, op_flags);
+	pd_io_start(pd);
+
+	err = pd_bio_rw(pd, iov, iovcnt, woff, REQ_OP_WRITE, op_flags);
+
+	pd_io_end(pd);
+
+	return err;
 }
 
 merr_t
@@ -95,13 +160,20 @@ pd_zone_preadv(
 	loff_t                  boff)
 {
 	loff_t roff;
+	merr_t err;
 
 	if (mpool_pd_status_get(pd) == PD_STAT_UNAVAIL)
 		return merr(ev(EIO));
 
 	roff = ((u64)pd->pdi_zonepg << PAGE_SHIFT) * zoneaddr + boff;
 
-	return pd_bio_rw(pd, iov, iovcnt, roff, REQ_OP_READ, 0);
+	pd_io_start(pd);
+
+	err = pd_bio_rw(pd, iov, iovcnt, roff, REQ_OP_READ, 0);
+
+	pd_io_end(pd);
+
+	return err;
 }
 
 void
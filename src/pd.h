@@ -46,6 +46,19 @@ struct pd_dev_parm {
 #define dpr_cmdopt        dpr_prop.pdp_cmdopt
 #define dpr_optiosz       dpr_prop.pdp_optiosz
 
+/**
+ * struct pd_iostat - per-CPU object I/O counts of a drive
+ * @pis_issued: reads and writes issued
+ * @pis_done:   reads and writes completed
+ *
+ * Counted per CPU so that the I/O path doesn't write a cacheline shared by
+ * all CPUs. The in-flight count is the difference of the sums.
+ */
+struct pd_iostat {
+	ulong   pis_issued;
+	ulong   pis_done;
+};
+
 /*
  * From a PD structure, convert a page number into a byte number.
  */
@@ -70,6 +83,34 @@ struct pd_dev_parm {
  */
 merr_t pd_dev_init(struct pd_dev_parm *dparm, struct pd_prop *pd_prop);
 
+/**
+ * pd_iostat_init() - allocate the I/O counts of a drive
+ * @pd:
+ *
+ * The drive's I/O isn't counted if they can't be allocated.
+ */
+void pd_iostat_init(struct mpool_dev_info *pd);
+
+/**
+ * pd_iostat_fini() - free the I/O counts of a drive
+ * @pd:
+ */
+void pd_iostat_fini(struct mpool_dev_info *pd);
+
+/**
+ * pd_io_issued() - number of object reads and writes issued to a drive
+ * @pd:
+ */
+u64 pd_io_issued(struct mpool_dev_info *pd);
+
+/**
+ * pd_io_inflight() - number of object reads and writes in flight on a drive
+ * @pd:
+ *
+ * Sampled without synchronization with the I/O path, so only an estimate.
+ */
+u32 pd_io_inflight(struct mpool_dev_info *pd);
+
 /**
  * pd_bio_dev_open() -
  * @path:
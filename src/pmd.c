@@ -18,6 +18,9 @@
 #include <linux/mutex.h>
 #include <linux/sort.h>
 #include <linux/delay.h>
+#include <linux/vmalloc.h>
+#include <linux/blk_types.h>
+#include <linux/version.h>
 
 #include <mpcore/upgrade.h>
 #include "mpcore_defs.h"
@@ -40,6 +43,108 @@ pmd_write_meta_to_latest_version(
 	bool                        permitted,
 	struct mpool_devrpt        *devrpt);
 
+static merr_t
+pmd_mdc_addrec(
+	struct mpool_descriptor    *mp,
+	u8                          cslot,
+	struct omf_mdcrec_data     *cdr);
+
+static void pmd_idckpt_work(struct work_struct *work);
+static void pmd_precompact_mdc(struct work_struct *work);
+
+#ifdef ECIO_HAVE_RHASHTABLE
+static const struct rhashtable_params pmd_objht_params = {
+	.key_len             = sizeof(u64),
+	.key_offset          = offsetof(struct ecio_layout_descriptor,
+					eld_objid),
+	.head_offset         = offsetof(struct ecio_layout_descriptor,
+					eld_hnode),
+	.automatic_shrinking = true,
+};
+
+/*
+ * Per-MDC object index. It holds the user objects of both the committed
+ * and uncommitted trees so pmd_obj_find_get() can look them up under RCU
+ * instead of walking the rbtrees under mmi_colock and mmi_uncolock. The
+ * rbtrees remain the authoritative, ordered view used by compaction.
+ */
+static merr_t pmd_objht_init(struct pmd_mdc_info *cinfo)
+{
+	int rc;
+
+	rc = rhashtable_init(&cinfo->mmi_objht, &pmd_objht_params);
+	if (rc)
+		return merr(-rc);
+
+	cinfo->mmi_objht_init = true;
+
+	return 0;
+}
+
+static void pmd_objht_fini(struct pmd_mdc_info *cinfo)
+{
+	if (!cinfo->mmi_objht_init)
+		return;
+
+	cinfo->mmi_objht_init = false;
+	rhashtable_destroy(&cinfo->mmi_objht);
+}
+
+static merr_t
+pmd_objht_insert(
+	struct pmd_mdc_info            *cinfo,
+	struct ecio_layout_descriptor  *layout)
+{
+	int rc;
+
+	if (!cinfo->mmi_objht_init ||
+	    !objtype_user(objid_type(layout->eld_objid)))
+		return 0;
+
+	rc = rhashtable_insert_fast(&cinfo->mmi_objht, &layout->eld_hnode,
+				    pmd_objht_params);
+
+	return rc ? merr(-rc) : 0;
+}
+
+static void
+pmd_objht_remove(
+	struct pmd_mdc_info            *cinfo,
+	struct ecio_layout_descriptor  *layout)
+{
+	if (!cinfo->mmi_objht_init ||
+	    !objtype_user(objid_type(layout->eld_objid)))
+		return;
+
+	rhashtable_remove_fast(&cinfo->mmi_objht, &layout->eld_hnode,
+			       pmd_objht_params);
+}
+#else
+static merr_t pmd_objht_init(struct pmd_mdc_info *cinfo)
+{
+	return 0;
+}
+
+static void pmd_objht_fini(struct pmd_mdc_info *cinfo)
+{
+}
+
+static merr_t
+pmd_objht_insert(
+	struct pmd_mdc_info            *cinfo,
+	struct ecio_layout_descriptor  *layout)
+{
+	return 0;
+}
+
+static void
+pmd_objht_remove(
+	struct pmd_mdc_info            *cinfo,
+	struct ecio_layout_descriptor  *layout)
+{
+}
+#endif /* ECIO_HAVE_RHASHTABLE */
+
 static void pmd_mda_init(struct mpool_descriptor *mp)
 {
 	int             sidx = 0;
@@ -52,15 +157,47 @@ static void pmd_mda_init(struct mpool_descriptor *mp)
 	mp->pds_mda.mdi_lslot = 0;
 	mp->pds_mda.mdi_slotvcnt = 0;
 
+	/* All MDCs are loaded unless pmd_objs_load_async() says otherwise. */
+	mp->pds_mda.mdi_loaded = true;
+	mp->pds_mda.mdi_loadstop = false;
+	mp->pds_mda.mdi_loaderr = 0;
+	init_waitqueue_head(&mp->pds_mda.mdi_loadwq);
+	atomic_set(&mp->pds_mda.mdi_loadprog, 1);
+	atomic_set(&mp->pds_mda.mdi_loadjobs, 0);
+	atomic_set(&mp->pds_mda.mdi_ondemand, 0);
+	mp->pds_mda.mdi_olwv = NULL;
+	memset(&mp->pds_mda.mdi_smapckpt, 0, sizeof(mp->pds_mda.mdi_smapckpt));
+
 	for (sidx = 0; sidx < MDC_SLOTS; sidx++) {
 		mutex_init(&mp->pds_mda.mdi_slotv[sidx].mmi_compactlock);
 		mutex_init(&mp->pds_mda.mdi_slotv[sidx].mmi_uqlock);
 		init_rwsem(&mp->pds_mda.mdi_slotv[sidx].mmi_colock);
 		mutex_init(&mp->pds_mda.mdi_slotv[sidx].mmi_uncolock);
-		mutex_init(&mp->pds_mda.mdi_slotv[sidx].mmi_reflock);
-		mp->pds_mda.mdi_slotv[sidx].mmi_luniq = 0;
+		mp->pds_mda.mdi_slotv[sidx].mmi_objht_init = false;
+		mutex_init(&mp->pds_mda.mdi_slotv[sidx].mmi_loadlock);
+		mp->pds_mda.mdi_slotv[sidx].mmi_loaded = true;
+		mp->pds_mda.mdi_slotv[sidx].mmi_loaderr = 0;
+		mutex_init(&mp->pds_mda.mdi_slotv[sidx].mmi_txnlock);
+		spin_lock_init(&mp->pds_mda.mdi_slotv[sidx].mmi_gclock);
+		INIT_LIST_HEAD(&mp->pds_mda.mdi_slotv[sidx].mmi_gcq);
+		mp->pds_mda.mdi_slotv[sidx].mmi_gcleader = false;
+		init_waitqueue_head(&mp->pds_mda.mdi_slotv[sidx].mmi_gcwq);
+		atomic64_set(&mp->pds_mda.mdi_slotv[sidx].mmi_luniq, 0);
+		atomic64_set(&mp->pds_mda.mdi_slotv[sidx].mmi_ckptmax,
+			     OBJID_UNIQ_DELTA - 1);
+		INIT_WORK(&mp->pds_mda.mdi_slotv[sidx].mmi_ckptw.ckw_work,
+			  pmd_idckpt_work);
+		mp->pds_mda.mdi_slotv[sidx].mmi_ckptw.ckw_mp = mp;
+		mp->pds_mda.mdi_slotv[sidx].mmi_ckptw.ckw_cslot = sidx;
+		INIT_WORK(&mp->pds_mda.mdi_slotv[sidx].mmi_pcow.pcw_work,
+			  pmd_precompact_mdc);
+		mp->pds_mda.mdi_slotv[sidx].mmi_pcow.pcw_mp = mp;
+		mp->pds_mda.mdi_slotv[sidx].mmi_pcow.pcw_len = 0;
+		mp->pds_mda.mdi_slotv[sidx].mmi_pcow.pcw_cslot = sidx;
 		mp->pds_mda.mdi_slotv[sidx].mmi_recbuf = NULL;
 		mp->pds_mda.mdi_slotv[sidx].mmi_obj = RB_ROOT;
+		memset(&mp->pds_mda.mdi_slotv[sidx].mmi_osnap, 0,
+		       sizeof(mp->pds_mda.mdi_slotv[sidx].mmi_osnap));
 		mp->pds_mda.mdi_slotv[sidx].mmi_uncobj = RB_ROOT;
 		mp->pds_mda.mdi_slotv[sidx].mmi_lckpt =
 			objid_make(0, OMF_OBJ_UNDEF, sidx);
@@ -80,7 +217,7 @@ static void pmd_mda_init(struct mpool_descriptor *mp)
 		mutex_init(&mp->pds_mda.mdi_slotv[sidx].mmi_stats_lock);
 
 	}
-	mp->pds_mda.mdi_slotv[1].mmi_luniq = UROOT_OBJID_MAX;
+	atomic64_set(&mp->pds_mda.mdi_slotv[1].mmi_luniq, UROOT_OBJID_MAX);
 
 	mp->pds_mda.mdi_sel.mds_tbl_idx.counter = 0;
 }
@@ -223,6 +360,15 @@ pmd_cmp_drv_mdc0(
 
 	pd->pdi_state = pdrec->u.dev.omd_state;
 
+	if (pd->pdi_mcord != pdrec->u.dev.omd_parm.odp_mcord) {
+		mpool_devrpt(devrpt, MPOOL_RC_PARM, pdh, NULL);
+
+		mp_pr_warn("mpool %s, mismatch between MDC0 drive list record and drive ordinal in mclass for %s, %u %u",
+			   mp->pds_name, pd->pdi_name, pd->pdi_mcord,
+			   pdrec->u.dev.omd_parm.odp_mcord);
+		return merr(EINVAL);
+	}
+
 	mc_pd_prop2mc_parms(&(pd->pdi_parm.dpr_prop), &mcp_pd);
 	mc_omf_devparm2mc_parms(&(pdrec->u.dev.omd_parm), &mcp_mdc0list);
 
@@ -392,6 +538,9 @@ pmd_props_load(struct mpool_descriptor *mp, struct mpool_devrpt *devrpt)
 
 		} else if (cdr.omd_rtype == OMF_MDR_MPCONFIG) {
 			mp->pds_cfg = cdr.u.omd_cfg;
+		} else if (cdr.omd_rtype == OMF_MDR_SMAPCKPT) {
+			/* The last one wins, it may invalidate the previous. */
+			mp->pds_mda.mdi_smapckpt = cdr.u.smck;
 		}
 	}
 
@@ -710,11 +859,12 @@ static merr_t pmd_mdc0_validate(struct mpool_descriptor *mp, int activation)
 			 * failures; single-threaded; don't need slotvlock
 			 * or uqlock to adjust mda
 			 */
-			cinfo->mmi_luniq = mdcmax - 1;
+			atomic64_set(&cinfo->mmi_luniq, mdcmax - 1);
 			mp->pds_mda.mdi_slotvcnt = mdcmax;
 			mp_pr_warn("mpool %s, MDC0 activation, mdc alloc recovery: uniq %llu slotvcnt %d",
 				   mp->pds_name,
-				   (unsigned long long)cinfo->mmi_luniq,
+				   (unsigned long long)
+				   atomic64_read(&cinfo->mmi_luniq),
 				   mp->pds_mda.mdi_slotvcnt);
 		} else {
 			/* mdc alloc cannot tolerate clean-up failures */
@@ -806,6 +956,259 @@ pmd_update_mdc_stats(
 	return err;
 }
 
+/**
+ * pmd_objs_load_append() - append a layout to the tail of an MDC's object tree
+ * @root:
+ * @tail: rightmost layout of @root, NULL if @root is empty
+ * @layout: layout whose objid is greater than that of @tail
+ *
+ * Compaction logs the committed objects of an MDC in ascending objid order,
+ * so the records of a compacted MDC are a sorted object table. Each one
+ * becomes the new rightmost node, which is linked without a tree descent.
+ */
+static void
+pmd_objs_load_append(
+	struct rb_root                 *root,
+	struct ecio_layout_descriptor  *tail,
+	struct ecio_layout_descriptor  *layout)
+{
+	if (tail)
+		rb_link_node(&layout->eld_nodemdc, &tail->eld_nodemdc,
+			     &tail->eld_nodemdc.rb_right);
+	else
+		rb_link_node(&layout->eld_nodemdc, NULL, &root->rb_node);
+
+	rb_insert_color(&layout->eld_nodemdc, root);
+}
+
+static void pmd_osnap_buf_free(struct iovec *iov)
+{
+	int    i;
+
+	for (i = 0; i < PMD_OSNAP_IOPG; i++)
+		free_page((unsigned long)iov[i].iov_base);
+
+	kfree(iov);
+}
+
+/**
+ * pmd_osnap_buf_alloc() - allocate the I/O buffer of an object snapshot
+ *
+ * Return: PMD_OSNAP_IOPG iovecs of one page each, NULL if out of memory
+ */
+static struct iovec *pmd_osnap_buf_alloc(void)
+{
+	struct iovec   *iov;
+	int             i;
+
+	iov = kcalloc(PMD_OSNAP_IOPG, sizeof(*iov), GFP_KERNEL);
+	if (ev(!iov))
+		return NULL;
+
+	for (i = 0; i < PMD_OSNAP_IOPG; i++) {
+		iov[i].iov_base = (void *)__get_free_page(GFP_KERNEL);
+		if (ev(!iov[i].iov_base)) {
+			pmd_osnap_buf_free(iov);
+			return NULL;
+		}
+	}
+
+	return iov;
+}
+
+/**
+ * pmd_osnap_blk() - address of a snapshot block in the I/O buffer
+ * @iov: I/O buffer
+ * @blk: index of the block in the buffer
+ */
+static char *pmd_osnap_blk(struct iovec *iov, u32 blk)
+{
+	const u32 bpp = PAGE_SIZE / OMF_OSNAP_BLKSZ;
+
+	return (char *)iov[blk / bpp].iov_base + (blk % bpp) * OMF_OSNAP_BLKSZ;
+}
+
+/**
+ * pmd_osnap_io() - read or write the first blocks of a snapshot I/O buffer
+ * @pd:
+ * @iov:   I/O buffer
+ * @nblk:  number of blocks to transfer
+ * @ld:    snapshot extent
+ * @boff:  (in/out) byte offset of the transfer in the snapshot extent
+ * @write:
+ */
+static merr_t
+pmd_osnap_io(
+	struct mpool_dev_info          *pd,
+	struct iovec                   *iov,
+	u32                             nblk,
+	struct omf_layout_descriptor   *ld,
+	loff_t                         *boff,
+	bool                            write)
+{
+	merr_t  err;
+	size_t  len;
+	int     i;
+
+	len = (size_t)nblk * OMF_OSNAP_BLKSZ;
+	if (ev(*boff + len > ((u64)pd->pdi_zonepg << PAGE_SHIFT) * ld->ol_zcnt))
+		return merr(EINVAL);
+
+	for (i = 0; len > 0; i++) {
+		iov[i].iov_len = min_t(size_t, len, PAGE_SIZE);
+		len -= iov[i].iov_len;
+	}
+
+	if (write)
+		err = pd_zone_pwritev(pd, iov, i, ld->ol_zaddr, *boff, REQ_FUA);
+	else
+		err = pd_zone_preadv(pd, iov, i, ld->ol_zaddr, *boff);
+	if (ev(err))
+		return err;
+
+	*boff += (loff_t)nblk * OMF_OSNAP_BLKSZ;
+
+	return 0;
+}
+
+/**
+ * pmd_osnap_load() - bulk load the mblocks of an object table snapshot
+ * @mp:
+ * @cslot:  MDC number
+ * @snap:   snapshot record
+ * @tail:   (in/out) rightmost layout of the sorted run, see pmd_objs_load()
+ * @sorted: (in/out) true while the layouts loaded form a sorted run
+ *
+ * The snapshot is read PMD_OSNAP_IOPG pages at a time. Each block must carry
+ * its index in the snapshot and a valid checksum, and the blocks must hold
+ * the number of mblocks the record announces. The snapshot extent is staged
+ * with those of the objects.
+ */
+static merr_t
+pmd_osnap_load(
+	struct mpool_descriptor        *mp,
+	u8                              cslot,
+	struct object_snap             *snap,
+	struct ecio_layout_descriptor **tail,
+	bool                           *sorted)
+{
+	struct ecio_layout_descriptor  *layout;
+	struct ecio_layout_descriptor  *found;
+	struct mpool_dev_info          *pd;
+	struct pmd_mdc_info            *cinfo;
+	struct iovec                   *iov;
+	char                           *blk;
+	merr_t                          err = 0;
+	loff_t                          boff = 0;
+	u64                             left;
+	u32                             bmax, nblk, seq, cnt, b, i;
+
+	cinfo = &mp->pds_mda.mdi_slotv[cslot];
+	pd = &mp->pds_pdv[snap->omd_ld.ol_pdh];
+
+	iov = pmd_osnap_buf_alloc();
+	if (!iov)
+		return merr(ENOMEM);
+
+	bmax = PMD_OSNAP_IOPG * (PAGE_SIZE / OMF_OSNAP_BLKSZ);
+	left = snap->omd_cnt;
+	seq = 0;
+
+	while (left > 0 && !err) {
+		nblk = min_t(u64, bmax, DIV_ROUND_UP(left, OMF_OSNAP_BLKENT));
+
+		err = pmd_osnap_io(pd, iov, nblk, &snap->omd_ld, &boff, false);
+		if (ev(err))
+			break;
+
+		for (b = 0; b < nblk && !err; b++, seq++) {
+			blk = pmd_osnap_blk(iov, b);
+
+			err = omf_osnap_blk_unpack_letoh(seq, blk, &cnt);
+			if (!err && cnt > left)
+				err = merr(EBADMSG);
+			if (ev(err)) {
+				mp_pr_err("mpool %s, MDC%u object snapshot block %u invalid",
+					  err, mp->pds_name, cslot, seq);
+				break;
+			}
+
+			for (i = 0; i < cnt; i++) {
+				err = omf_osnap_ent_unpack_letoh(mp, i, blk,
+								 &layout);
+				if (ev(err))
+					break;
+
+				layout->eld_state = ECIO_LYT_COMMITTED;
+
+				if (objid_slot(layout->eld_objid) != cslot) {
+					ecio_layout_free(layout);
+					err = merr(EBADSLT);
+					break;
+				}
+
+				if (*tail && layout->eld_objid <=
+				    (*tail)->eld_objid)
+					*sorted = false;
+
+				if (*sorted) {
+					pmd_objs_load_append(&cinfo->mmi_obj,
+							     *tail, layout);
+					*tail = layout;
+				} else {
+					found = objid_to_layout_insert_mdc(
+						&cinfo->mmi_obj, layout);
+					if (found) {
+						ecio_layout_free(layout);
+						err = merr(EEXIST);
+						break;
+					}
+				}
+
+				atomic_inc(&cinfo->mmi_pco_cnt.pcc_cr);
+				atomic_inc(&cinfo->mmi_pco_cnt.pcc_cobj);
+			}
+
+			left -= cnt;
+		}
+	}
+
+	pmd_osnap_buf_free(iov);
+
+	if (ev(err))
+		return err;
+
+	err = smap_insert(mp, snap->omd_ld.ol_pdh, snap->omd_ld.ol_zaddr,
+			  snap->omd_ld.ol_zcnt);
+	if (ev(err))
+		return err;
+
+	cinfo->mmi_osnap = snap->omd_ld;
+
+	mp_pr_debug("mpool %s, MDC%u loaded %lu mblocks from its object snapshot",
+		    0, mp->pds_name, cslot, (ulong)snap->omd_cnt);
+
+	return 0;
+}
+
+/**
+ * pmd_objs_load() - load the object table of an MDC
+ * @mp:
+ * @cslot: MDC number
+ * @devrpt:
+ *
+ * The compaction of a user MDC with PMD_OSNAP_MIN mblocks or more writes them
+ * to an object table snapshot, referenced by an OSNAP record, instead of
+ * logging an OCREATE record for each. The snapshot is read in large blocks
+ * and bulk loaded, see pmd_osnap_load(). The OCREATE records of the other
+ * objects, and the records appended after the compaction, are replayed from
+ * the MDC.
+ *
+ * Compaction writes the objects in ascending objid order, so the snapshot and
+ * the OCREATE records that follow it form a sorted run. Their layouts are
+ * linked to the object tree without a descent and their extents are staged
+ * for the bulk build of the space maps, see smap_mpool_bulk_start().
+ */
 static merr_t
 pmd_objs_load(
 	struct mpool_descriptor    *mp,
@@ -815,6 +1218,7 @@ pmd_objs_load(
 	u64                         argv[2] = { 0 };
 	struct omf_mdcrec_data      cdr;
 	struct pmd_mdc_info        *cinfo;
+	struct ecio_layout_descriptor  *tail;
 	struct rb_root             *cobj;
 	struct rb_node             *node;
 	const char                 *msg;
@@ -822,6 +1226,8 @@ pmd_objs_load(
 	size_t                      recbufsz;
 	char                       *recbuf;
 	u64                         mdcmax;
+	u32                         nsorted;
+	bool                        sorted;
 
 	/* note: single threaded here so don't need any locks */
 
@@ -846,6 +1252,13 @@ pmd_objs_load(
 			goto errout;
 		}
 
+		/* destroyed in pmd_mda_free() */
+		err = pmd_objht_init(cinfo);
+		if (ev(err)) {
+			msg = "MDC object index init failed";
+			goto errout;
+		}
+
 		err = mp_mdc_open(mp, logid1, logid2, MDC_OF_SKIP_SER,
 				  &cinfo->mmi_mdc);
 		if (ev(err)) {
@@ -867,6 +1280,17 @@ pmd_objs_load(
 	recbuf = cinfo->mmi_recbuf;
 	cobj = &cinfo->mmi_obj;
 
+	/*
+	 * tail tracks the rightmost layout while the records seen so far form
+	 * a sorted run of OCREATEs, as written by compaction. MDC0 already
+	 * holds the layouts of its own mlogs, which have the lowest objids.
+	 */
+	node = rb_last(cobj);
+	tail = node ? rb_entry(node, struct ecio_layout_descriptor,
+			       eld_nodemdc) : NULL;
+	sorted = true;
+	nsorted = 0;
+
 	while (true) {
 		struct ecio_layout_descriptor  *layout;
 		struct ecio_layout_descriptor  *found;
@@ -926,6 +1350,21 @@ pmd_objs_load(
 			break;
 		}
 
+		if (cdr.omd_rtype == OMF_MDR_OSNAP) {
+			if (cinfo->mmi_osnap.ol_zcnt)
+				err = merr(EEXIST);
+			else
+				err = pmd_osnap_load(mp, cslot, &cdr.u.snap,
+						     &tail, &sorted);
+			if (ev(err)) {
+				msg = "object snapshot load failed";
+				cdr.u.obj.omd_objid = 0;
+				cdr.u.obj.omd_gen = 0;
+				break;
+			}
+			continue;
+		}
+
 		objid = cdr.u.obj.omd_objid;
 
 		if (objid_slot(objid) != cslot) {
@@ -938,6 +1377,20 @@ pmd_objs_load(
 			layout = cdr.u.obj.omd_layout;
 			layout->eld_state = ECIO_LYT_COMMITTED;
 
+			if (tail && objid <= tail->eld_objid)
+				sorted = false;
+
+			if (sorted) {
+				pmd_objs_load_append(cobj, tail, layout);
+				tail = layout;
+				nsorted++;
+
+				atomic_inc(&cinfo->mmi_pco_cnt.pcc_cr);
+				atomic_inc(&cinfo->mmi_pco_cnt.pcc_cobj);
+
+				continue;
+			}
+
 			found = objid_to_layout_insert_mdc(cobj, layout);
 			if (found) {
 				msg = "OCREATE duplicate object ID";
@@ -953,6 +1406,8 @@ pmd_objs_load(
 		}
 
 		if (cdr.omd_rtype == OMF_MDR_ODELETE) {
+			sorted = false;
+
 			found = objid_to_layout_search_mdc(cobj, objid);
 			if (!found) {
 				msg = "ODELETE object not found";
@@ -1015,6 +1470,8 @@ pmd_objs_load(
 		}
 
 		if (cdr.omd_rtype == OMF_MDR_OUPDATE) {
+			sorted = false;
+
 			layout = cdr.u.obj.omd_layout;
 
 			found = objid_to_layout_search_mdc(cobj, objid);
@@ -1067,6 +1524,12 @@ pmd_objs_load(
 			break;
 		}
 
+		err = pmd_objht_insert(cinfo, layout);
+		if (ev(err)) {
+			msg = "object index insert failed";
+			break;
+		}
+
 		err = pmd_update_mdc_stats(mp, layout, cinfo, PMD_OBJ_LOAD);
 		if (err) {
 			msg = "alloc per-mdc space usage stats failed";
@@ -1087,9 +1550,12 @@ pmd_objs_load(
 	cdr.u.obj.omd_objid = 0;
 	cdr.u.obj.omd_gen = 0;
 
+	mp_pr_debug("mpool %s, MDC%u loaded %u objects from its sorted run",
+		    0, mp->pds_name, cslot, nsorted);
+
 	if (!cslot) {
 		/* mdc0: finish initializing mda */
-		cinfo->mmi_luniq = mdcmax;
+		atomic64_set(&cinfo->mmi_luniq, mdcmax);
 		mp->pds_mda.mdi_slotvcnt = mdcmax + 1;
 		mp->pds_mda.mdi_slotvcnt_shift = 0;
 		if (mdcmax > 1)
@@ -1110,8 +1576,10 @@ pmd_objs_load(
 		 * will be checkpointed; supports realloc of
 		 * uncommitted objects after a crash
 		 */
-		cinfo->mmi_luniq = objid_uniq(cinfo->mmi_lckpt) +
-			OBJID_UNIQ_DELTA - 1;
+		atomic64_set(&cinfo->mmi_luniq, objid_uniq(cinfo->mmi_lckpt) +
+			     OBJID_UNIQ_DELTA - 1);
+		atomic64_set(&cinfo->mmi_ckptmax,
+			     atomic64_read(&cinfo->mmi_luniq));
 	}
 
 errout:
@@ -1172,7 +1640,12 @@ void pmd_mda_free(struct mpool_descriptor *mp)
 
 			ecio_layout_free(layout);
 		}
+
+		pmd_objht_fini(cinfo);
 	}
+
+	kfree(mp->pds_mda.mdi_olwv);
+	mp->pds_mda.mdi_olwv = NULL;
 }
 
 /**
@@ -1268,59 +1741,500 @@ pmd_objs_load_parallel(struct mpool_descriptor *mp, struct mpool_devrpt *devrpt)
 	return err;
 }
 
-merr_t
-pmd_mpool_activate(
-	struct mpool_descriptor        *mp,
-	struct ecio_layout_descriptor  *mdc01,
-	struct ecio_layout_descriptor  *mdc02,
-	int                             create,
-	struct mpool_devrpt            *devrpt,
-	u32                             flags)
+/**
+ * pmd_mdc_load() - load the objects of a user MDC unless already loaded
+ * @mp:
+ * @cslot:
+ * @devrpt:
+ * @ondemand: the load is on behalf of an object lookup
+ *
+ * Used when the mpool was activated with MP_FLAGS_LAZY_LOAD. Whoever gets
+ * to a slot first, the background load or a lookup, loads it; the other
+ * waits on mmi_loadlock and returns the same result.
+ */
+static merr_t
+pmd_mdc_load(
+	struct mpool_descriptor    *mp,
+	u8                          cslot,
+	struct mpool_devrpt        *devrpt,
+	bool                        ondemand)
 {
-	merr_t  err;
+	struct pmd_mdc_info    *cinfo;
+	merr_t                  err;
 
-	mp_pr_debug("mdc01: %lu mdc02: %lu",
-		    0, (ulong)mdc01->eld_objid,
-		    (ulong)mdc02->eld_objid);
+	cinfo = &mp->pds_mda.mdi_slotv[cslot];
 
-	/* activation is intense; serialize it when have multiple mpools */
-	mutex_lock(&pmd_s_lock);
+	pmd_mdc_lock(&cinfo->mmi_loadlock, cslot);
+	if (!cinfo->mmi_loaded) {
+		cinfo->mmi_loaderr = pmd_objs_load(mp, cslot, devrpt);
 
-	/* init metadata array for mpool */
-	pmd_mda_init(mp);
+		/* Publish the MDC's objects before mmi_loaded. */
+		smp_wmb();
+		WRITE_ONCE(cinfo->mmi_loaded, true);
 
-	/* initialize mdc0 for mpool */
-	err = pmd_mdc0_init(mp, mdc01, mdc02);
-	if (ev(err)) {
-		/*
-		 * pmd_mda_free() will dealloc mdc01/2 on subsequent
-		 * activation failures
-		 */
-		ecio_layout_free(mdc01);
-		ecio_layout_free(mdc02);
-		goto exit;
+		if (ondemand)
+			atomic_inc(&mp->pds_mda.mdi_ondemand);
 	}
+	err = cinfo->mmi_loaderr;
+	pmd_mdc_unlock(&cinfo->mmi_loadlock);
 
-	/* load mpool properties from mdc0 including drive list and states */
-	if (!create) {
-		err = pmd_props_load(mp, devrpt);
-		if (ev(err))
-			goto exit;
-	}
+	return err;
+}
 
-	/*
-	 * initialize smaps for all drives in mpool (now that list
-	 * is finalized)
-	 */
-	err = smap_mpool_init(mp);
-	if (ev(err))
-		goto exit;
+/**
+ * pmd_mdc_load_wait() - make sure the objects of an MDC are loaded
+ * @mp:
+ * @cslot:
+ *
+ * Loads the MDC on demand if the background load did not get to it yet.
+ */
+static merr_t pmd_mdc_load_wait(struct mpool_descriptor *mp, u8 cslot)
+{
+	struct pmd_mdc_info    *cinfo;
+	struct mpool_devrpt     devrpt;
+
+	cinfo = &mp->pds_mda.mdi_slotv[cslot];
+
+	if (READ_ONCE(cinfo->mmi_loaded)) {
+		smp_rmb();
+		return cinfo->mmi_loaderr;
+	}
+
+	mpool_devrpt_init(&devrpt);
+
+	return pmd_mdc_load(mp, cslot, &devrpt, true);
+}
+
+/**
+ * pmd_mda_load_wait() - wait for the objects of all MDCs to be loaded
+ * @mp:
+ *
+ * Each MDC load adds its objects' extents to the space maps, so space can
+ * only be allocated once all MDCs are loaded.
+ */
+static merr_t pmd_mda_load_wait(struct mpool_descriptor *mp)
+{
+	struct pmd_mda_info *mda = &mp->pds_mda;
+
+	wait_event(mda->mdi_loadwq, READ_ONCE(mda->mdi_loaded));
+	smp_rmb();
+
+	return mda->mdi_loaderr;
+}
+
+/**
+ * pmd_objs_load_done() - complete the background load of MDC 1~N
+ * @mp:
+ *
+ * Run by the last background load worker. Upgrades the metadata on media
+ * if need be, as done by an eager activate, then releases the allocators
+ * waiting in pmd_mda_load_wait().
+ */
+static void pmd_objs_load_done(struct mpool_descriptor *mp)
+{
+	struct pmd_mda_info    *mda = &mp->pds_mda;
+	struct mpool_devrpt     devrpt;
+	merr_t                  err;
+
+	mpool_devrpt_init(&devrpt);
+
+	err = mda->mdi_loaderr;
+	if (!err && READ_ONCE(mda->mdi_loadstop))
+		err = merr(ECANCELED);
+
+	if (!err) {
+		mutex_lock(&pmd_s_lock);
+		err = pmd_write_meta_to_latest_version(mp, true, &devrpt);
+		mutex_unlock(&pmd_s_lock);
+		if (ev(err))
+			mp_pr_err("mpool %s, failed to compact MDCs (because of metadata conversion)",
+				  err, mp->pds_name);
+	}
+
+	if (err && merr_errno(err) != ECANCELED)
+		mp_pr_err("mpool %s, failed to load user MDCs, mpool is faulted and object allocation fails until it is activated again",
+			  err, mp->pds_name);
+	else if (!err)
+		mp_pr_info("mpool %s, loaded %u user MDCs in %u ms, %d on demand",
+			   mp->pds_name, mda->mdi_slotvcnt - 1,
+			   jiffies_to_msecs(jiffies - mda->mdi_loadstart),
+			   atomic_read(&mda->mdi_ondemand));
+
+	mda->mdi_loaderr = err;
+	smp_wmb();
+	WRITE_ONCE(mda->mdi_loaded, true);
+
+	wake_up_all(&mda->mdi_loadwq);
+}
+
+/**
+ * pmd_objs_load_async_worker() -
+ * @ws:
+ *
+ * Background counterpart of pmd_objs_load_worker(). It also stops on
+ * pmd_objs_load_stop(), and the last worker to exit completes the load.
+ */
+static void pmd_objs_load_async_worker(struct work_struct *ws)
+{
+	struct pmd_obj_load_work       *olw;
+	struct mpool_descriptor        *mp;
+	int                             sidx;
+	merr_t                          err;
+
+	olw = container_of(ws, struct pmd_obj_load_work, olw_work);
+	mp = olw->olw_mp;
+
+	while (!READ_ONCE(mp->pds_mda.mdi_loadstop)) {
+		if (*olw->olw_err)
+			break; /* Stop, another worker hit an error */
+
+		sidx = atomic_fetch_add(1, olw->olw_progress);
+		if (sidx >= mp->pds_mda.mdi_slotvcnt)
+			break; /* No more MDCs to load */
+
+		err = pmd_mdc_load(mp, sidx, &olw->olw_devrpt, false);
+		if (ev(err)) {
+			mp_pr_err("mpool %s, loading MDC%d in the background failed, rcode %u",
+				  err, mp->pds_name, sidx,
+				  olw->olw_devrpt.mdr_rcode);
+			*olw->olw_err = err;
+			break;
+		}
+	}
+
+	if (atomic_dec_and_test(&mp->pds_mda.mdi_loadjobs))
+		pmd_objs_load_done(mp);
+}
+
+/**
+ * pmd_objs_load_async() - load MDC 1~N in the background
+ * @mp:
+ *
+ * Same job split as pmd_objs_load_parallel(), but the activate does not
+ * wait for it. Lookups load the MDC they need on demand and allocations
+ * wait for the whole load.
+ */
+static merr_t pmd_objs_load_async(struct mpool_descriptor *mp)
+{
+	struct pmd_mda_info        *mda = &mp->pds_mda;
+	struct pmd_obj_load_work   *olwv;
+	uint                        njobs, i;
+
+	if (mda->mdi_slotvcnt < 2)
+		return 0; /* No user MDCs allocated */
+
+	njobs = mp->pds_params.mp_objloadjobs;
+	njobs = clamp_t(uint, njobs, 1, mda->mdi_slotvcnt - 1);
+
+	/* freed in pmd_mda_free() */
+	olwv = kcalloc(njobs, sizeof(*olwv), GFP_KERNEL);
+	if (!olwv)
+		return merr(ENOMEM);
+
+	for (i = 1; i < mda->mdi_slotvcnt; i++)
+		mda->mdi_slotv[i].mmi_loaded = false;
+
+	mda->mdi_olwv = olwv;
+	mda->mdi_loaded = false;
+	atomic_set(&mda->mdi_loadprog, 1);
+	atomic_set(&mda->mdi_loadjobs, njobs);
+
+	for (i = 0; i < njobs; i++) {
+		INIT_WORK(&olwv[i].olw_work, pmd_objs_load_async_worker);
+		olwv[i].olw_progress = &mda->mdi_loadprog;
+		olwv[i].olw_err = &mda->mdi_loaderr;
+		olwv[i].olw_mp = mp;
+		mpool_devrpt_init(&olwv[i].olw_devrpt);
+		queue_work(mp->pds_workq, &olwv[i].olw_work);
+	}
+
+	return 0;
+}
+
+void pmd_objs_load_stop(struct mpool_descriptor *mp)
+{
+	WRITE_ONCE(mp->pds_mda.mdi_loadstop, true);
+}
+
+merr_t pmd_objs_load_err(struct mpool_descriptor *mp)
+{
+	struct pmd_mda_info *mda = &mp->pds_mda;
+
+	if (!READ_ONCE(mda->mdi_loaded))
+		return 0;
+
+	smp_rmb();
+
+	return mda->mdi_loaderr;
+}
+
+/**
+ * pmd_objs_count() - number of objects of all the MDCs
+ * @mp:
+ */
+static u64 pmd_objs_count(struct mpool_descriptor *mp)
+{
+	struct pmd_mdc_info    *cinfo;
+	u64                     cnt = 0;
+	int                     sidx;
+
+	for (sidx = 0; sidx < mp->pds_mda.mdi_slotvcnt; sidx++) {
+		cinfo = &mp->pds_mda.mdi_slotv[sidx];
+		cnt += atomic_read(&cinfo->mmi_pco_cnt.pcc_cobj);
+	}
+
+	return cnt;
+}
+
+/**
+ * pmd_smap_ckpt_claim() - take over the space map checkpoint found in MDC0
+ * @mp:
+ *
+ * The checkpoint extent is staged as used until the space maps are built.
+ * A record invalidating the checkpoint is logged before anything can change
+ * the space maps, so that only this activation uses it.
+ */
+static merr_t pmd_smap_ckpt_claim(struct mpool_descriptor *mp)
+{
+	struct smap_ckpt       *smck = &mp->pds_mda.mdi_smapckpt;
+	struct omf_mdcrec_data  cdr = { };
+	merr_t                  err;
+
+	if (!smck->omd_ld.ol_zcnt)
+		return 0;
+
+	err = merr(EINVAL);
+	if (smck->omd_ld.ol_zcnt <= U16_MAX)
+		err = smap_insert(mp, smck->omd_ld.ol_pdh,
+				  smck->omd_ld.ol_zaddr, smck->omd_ld.ol_zcnt);
+	if (ev(err)) {
+		mp_pr_warn("mpool %s, ignoring space map checkpoint, invalid extent",
+			   mp->pds_name);
+		memset(smck, 0, sizeof(*smck));
+	}
+
+	cdr.omd_rtype = OMF_MDR_SMAPCKPT;
+	err = pmd_mdc_addrec(mp, 0, &cdr);
+	if (ev(err))
+		mp_pr_err("mpool %s, invalidating the space map checkpoint failed",
+			  err, mp->pds_name);
+
+	return err;
+}
+
+/**
+ * pmd_smap_ckpt_load() - stage the free extents of the space map checkpoint
+ * @mp:
+ *
+ * Only if the MDCs hold as many objects as at the checkpoint. The blocks are
+ * validated as those of an object table snapshot. The checkpoint is dropped
+ * on the first invalid one, the space maps are then carved from the staged
+ * object extents alone.
+ */
+static void pmd_smap_ckpt_load(struct mpool_descriptor *mp)
+{
+	struct smap_ckpt       *smck = &mp->pds_mda.mdi_smapckpt;
+	struct mpool_dev_info  *pd;
+	struct iovec           *iov;
+	char                   *blk;
+	merr_t                  err = 0;
+	loff_t                  boff = 0;
+	u64                     left, zaddr, objcnt;
+	u32                     bmax, nblk, seq, cnt, b, i, zcnt;
+	u16                     pdh;
+
+	if (!smck->omd_ld.ol_zcnt)
+		return;
+
+	objcnt = pmd_objs_count(mp);
+	if (objcnt != smck->omd_objcnt) {
+		mp_pr_info("mpool %s, space map checkpoint of %lu objects ignored, %lu objects loaded",
+			   mp->pds_name, (ulong)smck->omd_objcnt,
+			   (ulong)objcnt);
+		return;
+	}
+
+	pd = &mp->pds_pdv[smck->omd_ld.ol_pdh];
+
+	iov = pmd_osnap_buf_alloc();
+	if (!iov)
+		return;
+
+	bmax = PMD_OSNAP_IOPG * (PAGE_SIZE / OMF_OSNAP_BLKSZ);
+	left = smck->omd_cnt;
+	seq = 0;
+
+	while (left > 0 && !err) {
+		nblk = min_t(u64, bmax,
+			     DIV_ROUND_UP(left, OMF_SMAPCKPT_BLKENT));
+
+		err = pmd_osnap_io(pd, iov, nblk, &smck->omd_ld, &boff, false);
+		if (ev(err))
+			break;
+
+		for (b = 0; b < nblk && !err; b++, seq++) {
+			blk = pmd_osnap_blk(iov, b);
+
+			err = omf_smapckpt_blk_unpack_letoh(seq, blk, &cnt);
+			if (!err && cnt > left)
+				err = merr(EBADMSG);
+			if (ev(err))
+				break;
+
+			for (i = 0; i < cnt && !err; i++) {
+				err = omf_smapckpt_ent_unpack_letoh(mp, i, blk,
+								    &pdh,
+								    &zaddr,
+								    &zcnt);
+				if (!ev(err))
+					err = smap_mpool_bulk_ckpt(mp, pdh,
+								   zaddr, zcnt);
+			}
+
+			left -= cnt;
+		}
+	}
+
+	pmd_osnap_buf_free(iov);
+
+	if (err) {
+		smap_mpool_bulk_ckpt_drop(mp);
+		mp_pr_warn("mpool %s, space map checkpoint block %u invalid, building the space maps from the objects",
+			   mp->pds_name, seq);
+		return;
+	}
+
+	mp_pr_debug("mpool %s, loaded %lu free extents from the space map checkpoint",
+		    0, mp->pds_name, (ulong)smck->omd_cnt);
+}
+
+/*
+ * The orphan MDC mlogs deleted by pmd_mdc0_validate() are freed by the erase
+ * workqueue. Wait for them so that their staged extents are dropped before
+ * the staging arrays go away. The space map checkpoint extent is released
+ * once the space maps are built.
+ */
+static merr_t pmd_smap_bulk_end(struct mpool_descriptor *mp)
+{
+	struct omf_layout_descriptor   *ld;
+	merr_t                          err;
+
+	flush_workqueue(mp->pds_erase_wq);
+
+	err = smap_mpool_bulk_end(mp);
+	if (ev(err))
+		return err;
+
+	ld = &mp->pds_mda.mdi_smapckpt.omd_ld;
+	if (ld->ol_zcnt) {
+		err = smap_free(mp, ld->ol_pdh, ld->ol_zaddr, ld->ol_zcnt);
+		if (err) {
+			/* smap_free() should never fail */
+			mp_pr_err("mpool %s, releasing drive %s space for space map checkpoint failed",
+				  err, mp->pds_name,
+				  mp->pds_pdv[ld->ol_pdh].pdi_name);
+		}
+		memset(&mp->pds_mda.mdi_smapckpt, 0,
+		       sizeof(mp->pds_mda.mdi_smapckpt));
+	}
+
+	return err;
+}
+
+merr_t
+pmd_mpool_activate(
+	struct mpool_descriptor        *mp,
+	struct ecio_layout_descriptor  *mdc01,
+	struct ecio_layout_descriptor  *mdc02,
+	int                             create,
+	struct mpool_devrpt            *devrpt,
+	u32                             flags)
+{
+	unsigned long   mdc0time;
+	merr_t          err;
+	bool            lazy;
+
+	mp_pr_debug("mdc01: %lu mdc02: %lu",
+		    0, (ulong)mdc01->eld_objid,
+		    (ulong)mdc02->eld_objid);
+
+	/* activation is intense; serialize it when have multiple mpools */
+	mutex_lock(&pmd_s_lock);
+
+	/* init metadata array for mpool */
+	pmd_mda_init(mp);
+	mp->pds_mda.mdi_loadstart = jiffies;
+
+	/* initialize mdc0 for mpool */
+	err = pmd_mdc0_init(mp, mdc01, mdc02);
+	if (ev(err)) {
+		/*
+		 * pmd_mda_free() will dealloc mdc01/2 on subsequent
+		 * activation failures
+		 */
+		ecio_layout_free(mdc01);
+		ecio_layout_free(mdc02);
+		goto exit;
+	}
+
+	/* load mpool properties from mdc0 including drive list and states */
+	if (!create) {
+		err = pmd_props_load(mp, devrpt);
+		if (ev(err))
+			goto exit;
+	}
+
+	/*
+	 * initialize smaps for all drives in mpool (now that list
+	 * is finalized)
+	 */
+	err = smap_mpool_init(mp);
+	if (ev(err))
+		goto exit;
+
+	/* stage the objects' extents, the smaps are built once loaded */
+	smap_mpool_bulk_start(mp);
 
 	/* load mdc layouts from mdc0 and finalize mda initialization */
 	err = pmd_objs_load(mp, 0, devrpt);
 	if (ev(err))
 		goto exit;
 
+	if (!create) {
+		err = pmd_smap_ckpt_claim(mp);
+		if (ev(err))
+			goto exit;
+	}
+
+	mdc0time = jiffies - mp->pds_mda.mdi_loadstart;
+
+	/*
+	 * A lazy activate loads the user MDCs in the background. It is not
+	 * used if MDC0 needs a metadata upgrade since the upgrade must be
+	 * done before the mpool is usable. Nor is the space map checkpoint,
+	 * which can only be verified once all the objects are loaded.
+	 */
+	lazy = !create && (flags & (1 << MP_FLAGS_LAZY_LOAD)) &&
+		upg_ver_cmp(&mp->pds_mda.mdi_slotv[0].mmi_mdccver, "==",
+			    upg_mdccver_latest());
+	if (lazy) {
+		/*
+		 * Objects may be deleted while the user MDCs are loading, so
+		 * their extents must go into the smaps as they are loaded.
+		 */
+		err = pmd_smap_bulk_end(mp);
+		if (ev(err))
+			goto exit;
+
+		err = pmd_objs_load_async(mp);
+		if (ev(err)) {
+			mp_pr_err("mpool %s, failed to start loading user MDCs",
+				  err, mp->pds_name);
+			goto exit;
+		}
+		goto timing;
+	}
+
 	/* load user object layouts from all other mdc */
 	err = pmd_objs_load_parallel(mp, devrpt);
 	if (ev(err)) {
@@ -1329,6 +2243,15 @@ pmd_mpool_activate(
 		goto exit;
 	}
 
+	pmd_smap_ckpt_load(mp);
+
+	err = pmd_smap_bulk_end(mp);
+	if (ev(err)) {
+		mp_pr_err("mpool %s, failed to build space maps",
+			  err, mp->pds_name);
+		goto exit;
+	}
+
 	/*
 	 * If the format of the mpool metadata read from media during activate
 	 * is not the latest, it is time to write the metadata on media with
@@ -1342,6 +2265,14 @@ pmd_mpool_activate(
 			goto exit;
 		}
 	}
+
+timing:
+	if (!create)
+		mp_pr_info("mpool %s, MDC0 loaded in %u ms, activated in %u ms%s",
+			   mp->pds_name, jiffies_to_msecs(mdc0time),
+			   jiffies_to_msecs(jiffies -
+					    mp->pds_mda.mdi_loadstart),
+			   lazy ? ", loading user MDCs in background" : "");
 exit:
 	if (err) {
 		/* activation failed; cleanup */
@@ -1349,119 +2280,478 @@ exit:
 		smap_mpool_free(mp);
 	}
 
-	mutex_unlock(&pmd_s_lock);
-	return err;
+	mutex_unlock(&pmd_s_lock);
+	return err;
+}
+
+void pmd_mpool_deactivate(struct mpool_descriptor *mp)
+{
+	/* deactivation is intense; serialize it when have multiple mpools */
+	mutex_lock(&pmd_s_lock);
+
+	/* close all open user (non-mdc) mlogs */
+	mlogutil_closeall(mp);
+
+	pmd_mda_free(mp);
+	smap_mpool_free(mp);
+
+	mutex_unlock(&pmd_s_lock);
+}
+
+merr_t
+pmd_obj_alloc(
+	struct mpool_descriptor        *mp,
+	enum obj_type_omf               otype,
+	struct pmd_obj_capacity        *ocap,
+	enum mp_media_classp            mclassp,
+	struct ecio_layout_descriptor **olayout)
+{
+	return pmd_obj_alloc_cmn(mp, 0, otype, ocap, mclassp, 0, olayout);
+}
+
+merr_t
+pmd_obj_realloc(
+	struct mpool_descriptor        *mp,
+	u64                             objid,
+	struct pmd_obj_capacity        *ocap,
+	enum mp_media_classp            mclassp,
+	struct ecio_layout_descriptor **olayout)
+{
+	merr_t err;
+
+	if (!pmd_objid_isuser(objid)) {
+		*olayout = NULL;
+		err = merr(EINVAL);
+		mp_pr_err("mpool %s, re-allocation of an object is only authorized for an application object",
+			  err, mp->pds_name);
+		return err;
+	}
+
+	return pmd_obj_alloc_cmn(mp, objid, objid_type(objid),
+				 ocap, mclassp, 1, olayout);
+}
+
+u64 pmd_objid_to_uhandle(u64 objid)
+{
+	return omf_objid_to_uhandle(objid);
+}
+
+u64 pmd_uhandle_to_objid(u64 uhandle)
+{
+	return omf_uhandle_to_objid(uhandle);
+}
+
+void pmd_mdc_lock(struct mutex *lock, u8 slot)
+{
+	mutex_lock_nested(lock, slot > 0 ? PMD_MDC_NORMAL : PMD_MDC_ZERO);
+}
+
+void pmd_mdc_unlock(struct mutex *lock)
+{
+	mutex_unlock(lock);
+}
+
+/*
+ * Nesting levels for pmd_mdc_info rwsem.
+ */
+
+static void pmd_mdc_wrlock(struct rw_semaphore *sem, u8 slot)
+{
+	down_write_nested(sem, slot > 0 ? PMD_MDC_NORMAL : PMD_MDC_ZERO);
+}
+
+static void pmd_mdc_wrunlock(struct rw_semaphore *sem)
+{
+	up_write(sem);
+}
+
+merr_t
+pmd_mdc_append(
+	struct mpool_descriptor    *mp,
+	u8                          cslot,
+	struct omf_mdcrec_data     *cdr,
+	int                         sync)
+{
+	merr_t                  err;
+	struct pmd_mdc_info    *cinfo = &mp->pds_mda.mdi_slotv[cslot];
+	s64                     plen;
+
+	plen = omf_mdcrec_pack_htole(mp, cdr, cinfo->mmi_recbuf);
+	if (plen < 0) {
+		mp_pr_warn("mpool %s, MDC%u append failed",
+			   mp->pds_name, cslot);
+		return plen;
+	}
+
+	err = mp_mdc_append(cinfo->mmi_mdc, cinfo->mmi_recbuf, plen, sync);
+	ev(err);
+
+	return err;
+}
+
+/**
+ * pmd_osnap_free() - release the extent of an object table snapshot
+ * @mp:
+ * @ld: snapshot extent, ol_zcnt is 0 if there is none
+ */
+static void
+pmd_osnap_free(
+	struct mpool_descriptor        *mp,
+	struct omf_layout_descriptor   *ld)
+{
+	merr_t  err;
+
+	if (!ld->ol_zcnt)
+		return;
+
+	err = smap_free(mp, ld->ol_pdh, ld->ol_zaddr, ld->ol_zcnt);
+	if (err) {
+		/* smap_free() should never fail */
+		mp_pr_err("mpool %s, releasing drive %s space for object snapshot failed",
+			  err, mp->pds_name, mp->pds_pdv[ld->ol_pdh].pdi_name);
+	}
+
+	ld->ol_zcnt = 0;
+}
+
+/**
+ * pmd_osnap_write() - write the mblocks of an MDCi i>0 to an object table
+ *	snapshot.
+ * @mp:
+ * @cslot:
+ * @snap: (output) snapshot record, omd_ld.ol_zcnt is 0 if none was written
+ *
+ * The snapshot is only written if the MDC holds PMD_OSNAP_MIN mblocks or more
+ * and all the MDCs are loaded. It is allocated on the drive of the first mlog
+ * of the MDC, in the media class of the MDCs, and written PMD_OSNAP_IOPG pages
+ * at a time.
+ */
+static merr_t
+pmd_osnap_write(
+	struct mpool_descriptor    *mp,
+	u8                          cslot,
+	struct object_snap         *snap)
+{
+	struct ecio_layout_descriptor  *layout;
+	struct mpool_dev_info          *pd;
+	struct pmd_mdc_info            *cinfo;
+	struct rb_node                 *node;
+	struct iovec                   *iov;
+	char                           *blk;
+	merr_t                          err = 0;
+	loff_t                          boff = 0;
+	u64                             cnt, len, zcnt, zaddr;
+	u32                             bmax, nblk, seq, ecnt;
+	u16                             pdh;
+
+	cinfo = &mp->pds_mda.mdi_slotv[cslot];
+	memset(snap, 0, sizeof(*snap));
+
+	cnt = 0;
+	for (node = rb_first(&cinfo->mmi_obj); node; node = rb_next(node)) {
+		layout = rb_entry(node, struct ecio_layout_descriptor,
+				  eld_nodemdc);
+		if (pmd_objid_type(layout->eld_objid) == OMF_OBJ_MBLOCK)
+			cnt++;
+	}
+
+	if (cnt < PMD_OSNAP_MIN)
+		return 0;
+
+	/*
+	 * Space allocation needs the space maps of all MDCs, which a lazy
+	 * activate may still be loading.
+	 */
+	if (!READ_ONCE(mp->pds_mda.mdi_loaded) || pmd_objs_load_err(mp))
+		return 0;
+
+	layout = (struct ecio_layout_descriptor *)cinfo->mmi_mdc->mdc_logh1;
+	pdh = layout->eld_ld.ol_pdh;
+	pd = &mp->pds_pdv[pdh];
+
+	len = DIV_ROUND_UP(cnt, OMF_OSNAP_BLKENT) * OMF_OSNAP_BLKSZ;
+	zcnt = DIV_ROUND_UP(len, (u64)pd->pdi_zonepg << PAGE_SHIFT);
+
+	iov = pmd_osnap_buf_alloc();
+	if (!iov)
+		return merr(ENOMEM);
+
+	err = smap_alloc(mp, pdh, zcnt, SMAP_SPC_USABLE_ONLY, &zaddr, 1);
+	if (ev(err)) {
+		pmd_osnap_buf_free(iov);
+		return err;
+	}
+
+	snap->omd_ld.ol_zaddr = zaddr;
+	snap->omd_ld.ol_zcnt = zcnt;
+	snap->omd_ld.ol_pdh = pdh;
+	snap->omd_cnt = cnt;
+
+	bmax = PMD_OSNAP_IOPG * (PAGE_SIZE / OMF_OSNAP_BLKSZ);
+	nblk = 0;
+	seq = 0;
+	ecnt = 0;
+
+	for (node = rb_first(&cinfo->mmi_obj); node; node = rb_next(node)) {
+		layout = rb_entry(node, struct ecio_layout_descriptor,
+				  eld_nodemdc);
+		if (pmd_objid_type(layout->eld_objid) != OMF_OBJ_MBLOCK)
+			continue;
+
+		if (ecnt == OMF_OSNAP_BLKENT) {
+			blk = pmd_osnap_blk(iov, nblk++);
+			err = omf_osnap_blk_pack_htole(seq++, ecnt, blk);
+			if (ev(err))
+				break;
+
+			ecnt = 0;
+
+			if (nblk == bmax) {
+				err = pmd_osnap_io(pd, iov, nblk, &snap->omd_ld,
+						   &boff, true);
+				if (ev(err))
+					break;
+
+				nblk = 0;
+			}
+		}
+
+		blk = pmd_osnap_blk(iov, nblk);
+		if (ecnt == 0)
+			memset(blk, 0, OMF_OSNAP_BLKSZ);
+
+		omf_osnap_ent_pack_htole(mp, layout, ecnt++, blk);
+	}
+
+	if (!err) {
+		blk = pmd_osnap_blk(iov, nblk++);
+		err = omf_osnap_blk_pack_htole(seq, ecnt, blk);
+		if (!ev(err))
+			err = pmd_osnap_io(pd, iov, nblk, &snap->omd_ld,
+					   &boff, true);
+	}
+
+	pmd_osnap_buf_free(iov);
+
+	if (ev(err)) {
+		pmd_osnap_free(mp, &snap->omd_ld);
+		memset(snap, 0, sizeof(*snap));
+		return err;
+	}
+
+	mp_pr_debug("mpool %s, MDC%u wrote %lu mblocks to an object snapshot of %lu zones",
+		    0, mp->pds_name, cslot, (ulong)cnt, (ulong)zcnt);
+
+	return 0;
+}
+
+/**
+ * struct pmd_smapckpt_wr - state of a space map checkpoint being written
+ * @scw_mp:
+ * @scw_pd:   drive holding the checkpoint
+ * @scw_ld:   checkpoint extent
+ * @scw_iov:  I/O buffer, NULL while only counting the free extents
+ * @scw_boff: byte offset of the next write in the checkpoint extent
+ * @scw_cnt:  number of free extents counted or packed
+ * @scw_max:  number of free extents the checkpoint extent can hold
+ * @scw_nblk: number of full blocks in the I/O buffer
+ * @scw_seq:  index in the checkpoint of the block being packed
+ * @scw_ecnt: number of entries in the block being packed
+ */
+struct pmd_smapckpt_wr {
+	struct mpool_descriptor        *scw_mp;
+	struct mpool_dev_info          *scw_pd;
+	struct omf_layout_descriptor   *scw_ld;
+	struct iovec                   *scw_iov;
+	loff_t                          scw_boff;
+	u64                             scw_cnt;
+	u64                             scw_max;
+	u32                             scw_nblk;
+	u32                             scw_seq;
+	u32                             scw_ecnt;
+};
+
+/*
+ * smap_drive_walk() callback packing a free extent in the checkpoint, the
+ * I/O buffer is written each time it is full.
+ */
+static merr_t pmd_smapckpt_ent(void *arg, u16 pdh, u64 zoneaddr, u32 zonecnt)
+{
+	struct pmd_smapckpt_wr *w = arg;
+	char                   *blk;
+	merr_t                  err;
+	u32                     bmax;
+
+	if (!w->scw_iov) {
+		w->scw_cnt++;
+		return 0;
+	}
+
+	/* More free extents than counted, there is no room for them. */
+	if (w->scw_cnt == w->scw_max)
+		return merr(EFBIG);
+
+	if (w->scw_ecnt == OMF_SMAPCKPT_BLKENT) {
+		blk = pmd_osnap_blk(w->scw_iov, w->scw_nblk++);
+		err = omf_smapckpt_blk_pack_htole(w->scw_seq++, w->scw_ecnt,
+						  blk);
+		if (ev(err))
+			return err;
+
+		w->scw_ecnt = 0;
+
+		bmax = PMD_OSNAP_IOPG * (PAGE_SIZE / OMF_OSNAP_BLKSZ);
+		if (w->scw_nblk == bmax) {
+			err = pmd_osnap_io(w->scw_pd, w->scw_iov, w->scw_nblk,
+					   w->scw_ld, &w->scw_boff, true);
+			if (ev(err))
+				return err;
+
+			w->scw_nblk = 0;
+		}
+	}
+
+	blk = pmd_osnap_blk(w->scw_iov, w->scw_nblk);
+	if (w->scw_ecnt == 0)
+		memset(blk, 0, OMF_OSNAP_BLKSZ);
+
+	omf_smapckpt_ent_pack_htole(w->scw_mp, pdh, zoneaddr, zonecnt,
+				    w->scw_ecnt++, blk);
+	w->scw_cnt++;
+
+	return 0;
 }
 
-void pmd_mpool_deactivate(struct mpool_descriptor *mp)
+/**
+ * pmd_smapckpt_walk() - walk the free extents of all drives
+ * @mp:
+ * @w:
+ */
+static merr_t
+pmd_smapckpt_walk(struct mpool_descriptor *mp, struct pmd_smapckpt_wr *w)
 {
-	/* deactivation is intense; serialize it when have multiple mpools */
-	mutex_lock(&pmd_s_lock);
-
-	/* close all open user (non-mdc) mlogs */
-	mlogutil_closeall(mp);
+	merr_t  err = 0;
+	u16     pdh;
 
-	pmd_mda_free(mp);
-	smap_mpool_free(mp);
+	for (pdh = 0; pdh < mp->pds_pdvcnt && !err; pdh++)
+		err = smap_drive_walk(mp, pdh, pmd_smapckpt_ent, w);
 
-	mutex_unlock(&pmd_s_lock);
+	return err;
 }
 
-merr_t
-pmd_obj_alloc(
-	struct mpool_descriptor        *mp,
-	enum obj_type_omf               otype,
-	struct pmd_obj_capacity        *ocap,
-	enum mp_media_classp            mclassp,
-	struct ecio_layout_descriptor **olayout)
+/**
+ * See pmd.h.
+ *
+ * The checkpoint is allocated on the drive of the first mlog of MDC0, and
+ * written PMD_OSNAP_IOPG pages at a time in the blocks of an object table
+ * snapshot. Its own extent is accounted as used, as it is staged by the next
+ * activation until the space maps are built.
+ */
+void pmd_mpool_smap_ckpt(struct mpool_descriptor *mp)
 {
-	return pmd_obj_alloc_cmn(mp, 0, otype, ocap, mclassp, 0, olayout);
-}
+	struct ecio_layout_descriptor  *layout;
+	struct omf_mdcrec_data          cdr = { };
+	struct omf_layout_descriptor    ld = { };
+	struct pmd_smapckpt_wr          w = { };
+	struct pmd_mdc_info            *cinfo;
+	struct mpool_dev_info          *pd;
+	merr_t                          err;
+	u64                             objcnt, len, zcnt, zaddr;
+	u16                             pdh;
 
-merr_t
-pmd_obj_realloc(
-	struct mpool_descriptor        *mp,
-	u64                             objid,
-	struct pmd_obj_capacity        *ocap,
-	enum mp_media_classp            mclassp,
-	struct ecio_layout_descriptor **olayout)
-{
-	merr_t err;
+	/* The space maps are incomplete until all the MDCs are loaded. */
+	if (!READ_ONCE(mp->pds_mda.mdi_loaded) || pmd_objs_load_err(mp))
+		return;
 
-	if (!pmd_objid_isuser(objid)) {
-		*olayout = NULL;
-		err = merr(EINVAL);
-		mp_pr_err("mpool %s, re-allocation of an object is only authorized for an application object",
-			  err, mp->pds_name);
-		return err;
-	}
+	objcnt = pmd_objs_count(mp);
+	if (objcnt < PMD_SMAPCKPT_MIN)
+		return;
 
-	return pmd_obj_alloc_cmn(mp, objid, objid_type(objid),
-				 ocap, mclassp, 1, olayout);
-}
+	mutex_lock(&pmd_s_lock);
 
-u64 pmd_objid_to_uhandle(u64 objid)
-{
-	return omf_objid_to_uhandle(objid);
-}
+	cinfo = &mp->pds_mda.mdi_slotv[0];
+	layout = (struct ecio_layout_descriptor *)cinfo->mmi_mdc->mdc_logh1;
+	pdh = layout->eld_ld.ol_pdh;
+	pd = &mp->pds_pdv[pdh];
 
-u64 pmd_uhandle_to_objid(u64 uhandle)
-{
-	return omf_uhandle_to_objid(uhandle);
-}
+	w.scw_mp = mp;
+	w.scw_pd = pd;
+	w.scw_ld = &ld;
 
-void pmd_mdc_lock(struct mutex *lock, u8 slot)
-{
-	mutex_lock_nested(lock, slot > 0 ? PMD_MDC_NORMAL : PMD_MDC_ZERO);
-}
+	err = pmd_smapckpt_walk(mp, &w);
+	if (ev(err))
+		goto errout;
 
-void pmd_mdc_unlock(struct mutex *lock)
-{
-	mutex_unlock(lock);
-}
+	/* Allocating the checkpoint may split one free extent. */
+	w.scw_max = w.scw_cnt + 1;
+	w.scw_cnt = 0;
 
-/*
- * Nesting levels for pmd_mdc_info rwsem.
- */
+	len = DIV_ROUND_UP(w.scw_max, OMF_SMAPCKPT_BLKENT) * OMF_OSNAP_BLKSZ;
+	zcnt = DIV_ROUND_UP(len, (u64)pd->pdi_zonepg << PAGE_SHIFT);
+	if (zcnt > U16_MAX) {
+		err = merr(EFBIG);
+		goto errout;
+	}
 
-static void pmd_mdc_wrlock(struct rw_semaphore *sem, u8 slot)
-{
-	down_write_nested(sem, slot > 0 ? PMD_MDC_NORMAL : PMD_MDC_ZERO);
-}
+	w.scw_iov = pmd_osnap_buf_alloc();
+	if (!w.scw_iov) {
+		err = merr(ENOMEM);
+		goto errout;
+	}
 
-static void pmd_mdc_wrunlock(struct rw_semaphore *sem)
-{
-	up_write(sem);
-}
+	err = smap_alloc(mp, pdh, zcnt, SMAP_SPC_USABLE_ONLY, &zaddr, 1);
+	if (ev(err))
+		goto errout;
 
-merr_t
-pmd_mdc_append(
-	struct mpool_descriptor    *mp,
-	u8                          cslot,
-	struct omf_mdcrec_data     *cdr,
-	int                         sync)
-{
-	merr_t                  err;
-	struct pmd_mdc_info    *cinfo = &mp->pds_mda.mdi_slotv[cslot];
-	s64                     plen;
+	ld.ol_zaddr = zaddr;
+	ld.ol_zcnt = zcnt;
+	ld.ol_pdh = pdh;
 
-	plen = omf_mdcrec_pack_htole(mp, cdr, cinfo->mmi_recbuf);
-	if (plen < 0) {
-		mp_pr_warn("mpool %s, MDC%u append failed",
-			   mp->pds_name, cslot);
-		return plen;
+	err = pmd_smapckpt_walk(mp, &w);
+	if (!ev(err)) {
+		char *blk = pmd_osnap_blk(w.scw_iov, w.scw_nblk++);
+
+		err = omf_smapckpt_blk_pack_htole(w.scw_seq, w.scw_ecnt, blk);
+		if (!ev(err))
+			err = pmd_osnap_io(pd, w.scw_iov, w.scw_nblk, &ld,
+					   &w.scw_boff, true);
 	}
+	if (ev(err))
+		goto errout;
 
-	err = mp_mdc_append(cinfo->mmi_mdc, cinfo->mmi_recbuf, plen, sync);
-	ev(err);
+	cdr.omd_rtype = OMF_MDR_SMAPCKPT;
+	cdr.u.smck.omd_ld = ld;
+	cdr.u.smck.omd_cnt = w.scw_cnt;
+	cdr.u.smck.omd_objcnt = objcnt;
 
-	return err;
+	PMD_MDC0_COMPACTLOCK(mp);
+	err = pmd_mdc_addrec(mp, 0, &cdr);
+	PMD_MDC0_COMPACTUNLOCK(mp);
+	if (ev(err))
+		goto errout;
+
+	mp_pr_debug("mpool %s, checkpointed %lu free extents in %lu zones",
+		    0, mp->pds_name, (ulong)w.scw_cnt, (ulong)zcnt);
+
+errout:
+	if (err) {
+		pmd_osnap_free(mp, &ld);
+		mp_pr_warn("mpool %s, space map checkpoint not written",
+			   mp->pds_name);
+	}
+
+	if (w.scw_iov)
+		pmd_osnap_buf_free(w.scw_iov);
+
+	mutex_unlock(&pmd_s_lock);
 }
 
 /**
  * pmd_log_all_mdc_cobjs() - write in the new active mlog the object records.
  * @mp:
  * @cslot:
+ * @osnap: true if the mblocks were written to an object table snapshot, only
+ *	the other objects are then logged
  * @compacted: output
  * @total: output
  */
@@ -1469,6 +2759,7 @@ static merr_t
 pmd_log_all_mdc_cobjs(
 	struct mpool_descriptor    *mp,
 	u8                          cslot,
+	bool                        osnap,
 	u32                        *compacted,
 	u32                        *total)
 {
@@ -1477,29 +2768,92 @@ pmd_log_all_mdc_cobjs(
 	struct ecio_layout_descriptor  *layout;
 	struct omf_mdcrec_data          cdr;
 	struct rb_node                 *node;
+	struct mlog_rec                *recv, rec;
+	struct iovec                   *iovv, iov;
+	char                           *pbuf;
+	size_t                          off;
+	s64                             plen;
+	u32                             bmax, n;
+
+	/*
+	 * The records are packed back to back in pbuf and appended
+	 * PMD_COMPACT_BATCH at a time, taking the mlog lock and checking its
+	 * state once per batch. Without memory, go one record at a time.
+	 */
+	bmax = PMD_COMPACT_BATCH;
+	pbuf = kmalloc(bmax * OMF_MDCREC_PACKLEN_MAX, GFP_KERNEL);
+	recv = kcalloc(bmax, sizeof(*recv), GFP_KERNEL);
+	iovv = kcalloc(bmax, sizeof(*iovv), GFP_KERNEL);
+	if (!pbuf || !recv || !iovv) {
+		kfree(pbuf);
+		kfree(recv);
+		kfree(iovv);
+
+		bmax = 1;
+		pbuf = cinfo->mmi_recbuf;
+		recv = &rec;
+		iovv = &iov;
+	}
+
+	node = rb_first(&cinfo->mmi_obj);
+
+	while (node && !err) {
+		off = 0;
+
+		for (n = 0; node && n < bmax;
+		     node = rb_next(node), ++(*total)) {
+			layout = rb_entry(node, struct ecio_layout_descriptor,
+					  eld_nodemdc);
+			if (objid_mdc0log(layout->eld_objid))
+				continue;
+
+			if (osnap && pmd_objid_type(layout->eld_objid) ==
+			    OMF_OBJ_MBLOCK)
+				continue;
 
-	for (node = rb_first(&cinfo->mmi_obj); node; node = rb_next(node)) {
-		layout = rb_entry(node, struct ecio_layout_descriptor,
-				  eld_nodemdc);
-		if (!objid_mdc0log(layout->eld_objid)) {
 			cdr.omd_rtype = OMF_MDR_OCREATE;
 			cdr.u.obj.omd_layout = layout;
-			err = pmd_mdc_append(mp, cslot, &cdr, 0);
-			if (err) {
-				mp_pr_err("mpool %s, MDC%u log committed object failed, objid 0x%lx",
+
+			plen = omf_mdcrec_pack_htole(mp, &cdr, pbuf + off);
+			if (plen < 0) {
+				err = merr(-plen);
+				mp_pr_err("mpool %s, MDC%u pack committed object failed, objid 0x%lx",
 					  err, mp->pds_name, cslot,
 					  (ulong)layout->eld_objid);
 				break;
 			}
 
-			++(*compacted);
+			iovv[n].iov_base = pbuf + off;
+			iovv[n].iov_len  = plen;
+			recv[n].mr_iov   = &iovv[n];
+			recv[n].mr_len   = plen;
+
+			off += plen;
+			n++;
 		}
-		++(*total);
+
+		if (err || !n)
+			break;
+
+		err = mp_mdc_append_batch(cinfo->mmi_mdc, recv, n, 0);
+		if (err) {
+			mp_pr_err("mpool %s, MDC%u log committed objects failed, %u records",
+				  err, mp->pds_name, cslot, n);
+			break;
+		}
+
+		*compacted += n;
 	}
 
 	for (; node; node = rb_next(node))
 		++(*total);
 
+	if (bmax > 1) {
+		kfree(pbuf);
+		kfree(recv);
+		kfree(iovv);
+	}
+
 	return err;
 }
 
@@ -1556,8 +2910,16 @@ static merr_t pmd_log_mdc0_cobjs(struct mpool_descriptor *mp)
  *	MDCi records that are particular to MDCi (not used by MDC0).
  * @mp:
  * @cslot:
+ * @snap: (output) object table snapshot written, omd_ld.ol_zcnt is 0 if none
+ *
+ * If the object table snapshot cannot be written the mblocks are logged as
+ * OCREATE records, as for a small MDC.
  */
-static merr_t pmd_log_non_mdc0_cobjs(struct mpool_descriptor *mp, u8 cslot)
+static merr_t
+pmd_log_non_mdc0_cobjs(
+	struct mpool_descriptor    *mp,
+	u8                          cslot,
+	struct object_snap         *snap)
 {
 	struct omf_mdcrec_data  cdr;
 	struct pmd_mdc_info    *cinfo;
@@ -1572,6 +2934,22 @@ static merr_t pmd_log_non_mdc0_cobjs(struct mpool_descriptor *mp, u8 cslot)
 	cdr.omd_rtype = OMF_MDR_OIDCKPT;
 	cdr.u.obj.omd_objid = cinfo->mmi_lckpt;
 	err = pmd_mdc_append(mp, cslot, &cdr, 0);
+	if (ev(err))
+		return err;
+
+	err = pmd_osnap_write(mp, cslot, snap);
+	if (err) {
+		mp_pr_warn("mpool %s, MDC%u object snapshot not written, logging its mblocks",
+			   mp->pds_name, cslot);
+		return 0;
+	}
+
+	if (!snap->omd_ld.ol_zcnt)
+		return 0;
+
+	cdr.omd_rtype = OMF_MDR_OSNAP;
+	cdr.u.snap = *snap;
+	err = pmd_mdc_append(mp, cslot, &cdr, 0);
 	ev(err);
 
 	return err;
@@ -1616,6 +2994,10 @@ static void pmd_pre_compact_reset(struct pmd_mdc_info *cinfo, u32 compacted)
  *	instead of pmd_mdc_addrec() to avoid trigerring nested compaction of
  *	a same MDCi.
  *	The sync/flush is done by append of cend, no need to sync before that.
+ *
+ * An MDC whose load failed is never compacted: its object tree only holds
+ * the objects replayed before the failure, and compacting it would drop
+ * the others from the media.
  */
 static merr_t pmd_mdc_compact(struct mpool_descriptor *mp, u8 cslot)
 {
@@ -1625,9 +3007,22 @@ static merr_t pmd_mdc_compact(struct mpool_descriptor *mp, u8 cslot)
 	int                     retry = 0;
 	merr_t                  err = 0;
 
+	if (ev(READ_ONCE(cinfo->mmi_loaderr))) {
+		err = merr(EROFS);
+		mp_pr_rl("mpool %s, MDC%u not compacted, its load failed",
+			 err, mp->pds_name, cslot);
+		return err;
+	}
+
 	for (retry = 0; retry < MPOOL_MDC_COMPACT_RETRY_DEFAULT; retry++) {
+		unsigned long start = jiffies;
+		struct omf_mdcrec_data vcdr;
+		struct object_snap snap;
 		u32 compacted = 0;
 		u32 total = 0;
+		u32 ms;
+
+		memset(&snap, 0, sizeof(snap));
 
 		if (err) {
 			err = mp_mdc_open(mp, logid1, logid2,
@@ -1648,7 +3043,11 @@ static merr_t pmd_mdc_compact(struct mpool_descriptor *mp, u8 cslot)
 			continue;
 
 		if (upg_ver_cmp2(upg_mdccver_latest(), ">=", 1, 0, 0, 1)) {
-			err = pmd_mdc_addrec_version(mp, cslot);
+			/* No sync, and no nested compaction on EFBIG. */
+			vcdr.omd_rtype = OMF_MDR_VERSION;
+			upg_mdccver_latest2(&vcdr.u.omd_version);
+
+			err = pmd_mdc_append(mp, cslot, &vcdr, 0);
 			if (ev(err)) {
 				mp_mdc_close(cinfo->mmi_mdc);
 				continue;
@@ -1656,13 +3055,17 @@ static merr_t pmd_mdc_compact(struct mpool_descriptor *mp, u8 cslot)
 		}
 
 		if (cslot)
-			err = pmd_log_non_mdc0_cobjs(mp, cslot);
+			err = pmd_log_non_mdc0_cobjs(mp, cslot, &snap);
 		else
 			err = pmd_log_mdc0_cobjs(mp);
-		if (ev(err))
+		if (ev(err)) {
+			pmd_osnap_free(mp, &snap.omd_ld);
 			continue;
+		}
 
-		err = pmd_log_all_mdc_cobjs(mp, cslot, &compacted, &total);
+		err = pmd_log_all_mdc_cobjs(mp, cslot, snap.omd_ld.ol_zcnt > 0,
+					    &compacted, &total);
+		compacted += snap.omd_cnt;
 
 		mp_pr_debug("mpool %s, MDC%u compacted %u of %u objects: retry=%d",
 			    err, mp->pds_name, cslot, compacted, total, retry);
@@ -1676,6 +3079,13 @@ static merr_t pmd_mdc_compact(struct mpool_descriptor *mp, u8 cslot)
 			 */
 			err = mp_mdc_cend(cinfo->mmi_mdc);
 		if (!ev(err)) {
+			/*
+			 * The previous snapshot is no longer referenced by
+			 * the active mlog.
+			 */
+			pmd_osnap_free(mp, &cinfo->mmi_osnap);
+			cinfo->mmi_osnap = snap.omd_ld;
+
 			if (cslot) {
 				/*
 				 * MDCi i>0 compacted successfully
@@ -1684,6 +3094,12 @@ static merr_t pmd_mdc_compact(struct mpool_descriptor *mp, u8 cslot)
 				pmd_pre_compact_reset(cinfo, compacted);
 			}
 
+			ms = jiffies_to_msecs(jiffies - start);
+			mp_pr_debug("mpool %s, MDC%u compacted %u records in %u ms, %lu records/s",
+				    err, mp->pds_name, cslot, compacted, ms,
+				    (ulong)compacted * 1000 /
+				    max_t(u32, ms, 1));
+
 			mp_pr_debug("mpool %s, MDC%u end: mlog1 gen %lu mlog2 gen %lu",
 				    err, mp->pds_name, cslot,
 				    (ulong)
@@ -1694,50 +3110,283 @@ static merr_t pmd_mdc_compact(struct mpool_descriptor *mp, u8 cslot)
 				     cinfo->mmi_mdc->mdc_logh2)->eld_gen);
 			break;
 		}
+
+		pmd_osnap_free(mp, &snap.omd_ld);
+	}
+
+	if (err)
+		mp_pr_crit("mpool %s, MDC%u compaction failed",
+			   err, mp->pds_name, cslot);
+
+	return err;
+}
+
+static merr_t
+pmd_mdc_addrec(
+	struct mpool_descriptor    *mp,
+	u8                          cslot,
+	struct omf_mdcrec_data     *cdr)
+{
+	merr_t err;
+
+	err = pmd_mdc_append(mp, cslot, cdr, 1);
+
+	if (merr_errno(err) == EFBIG) {
+		err = pmd_mdc_compact(mp, cslot);
+		if (!ev(err))
+			err = pmd_mdc_append(mp, cslot, cdr, 1);
+	}
+
+	if (err)
+		mp_pr_rl("mpool %s, MDC%u append failed%s",
+			 err, mp->pds_name, cslot,
+			 (merr_errno(err) == EFBIG) ?
+			 " post compaction" : "");
+
+	return err;
+}
+
+/**
+ * struct pmd_gcreq - object commit queued for group commit
+ * @gcr_link:   link on pmd_mdc_info.mmi_gcq
+ * @gcr_layout: object to commit
+ * @gcr_err:    commit status, valid once gcr_done is set
+ * @gcr_done:   set by the leader once the commit was processed
+ */
+struct pmd_gcreq {
+	struct list_head                gcr_link;
+	struct ecio_layout_descriptor  *gcr_layout;
+	merr_t                          gcr_err;
+	bool                            gcr_done;
+};
+
+/**
+ * pmd_obj_commit_done() - make an object whose create record is durable
+ *	visible as committed
+ * @mp:
+ * @cinfo:
+ * @cslot:
+ * @layout:
+ *
+ * Caller must hold the MDC compact lock.
+ */
+static merr_t
+pmd_obj_commit_done(
+	struct mpool_descriptor        *mp,
+	struct pmd_mdc_info            *cinfo,
+	u8                              cslot,
+	struct ecio_layout_descriptor  *layout)
+{
+	struct ecio_layout_descriptor *found;
+	merr_t                         err = 0;
+
+	/* Lockless mblock readers must see the final layout once committed */
+	smp_wmb();
+	layout->eld_state |= ECIO_LYT_COMMITTED;
+
+	pmd_mdc_lock(&cinfo->mmi_uncolock, cslot);
+	found =	objid_to_layout_search_mdc(&cinfo->mmi_uncobj,
+					   layout->eld_objid);
+	if (found)
+		rb_erase(&found->eld_nodemdc, &cinfo->mmi_uncobj);
+	pmd_mdc_unlock(&cinfo->mmi_uncolock);
+
+	pmd_mdc_wrlock(&cinfo->mmi_colock, cslot);
+	found = objid_to_layout_insert_mdc(&cinfo->mmi_obj, layout);
+	pmd_mdc_wrunlock(&cinfo->mmi_colock);
+
+	if (found) {
+		err = merr(EEXIST);
+
+		/*
+		 * if objid exists in committed object list this is a
+		 * SERIOUS bug; need to log a warning message; should
+		 * never happen. Note in this case we are stuck because
+		 * we just logged a second create for an existing
+		 * object.  If mdc compaction runs before a restart this
+		 * extraneous create record will be eliminated,
+		 * otherwise pmd_objs_load() will see the conflict and
+		 * fail the next mpool activation.  We could make
+		 * pmd_objs_load() tolerate this but for now it is
+		 * better to get an activation failure so that
+		 * it's obvious this bug occurred. Best we can do is put
+		 * the layout back in the uncommitted object list so the
+		 * caller can abort after getting the commit failure.
+		 */
+		mp_pr_crit("mpool %s, obj 0x%lx collided during commit",
+			   err, mp->pds_name, (ulong)layout->eld_objid);
+
+		/* Put the object back in the uncommited objects tree */
+		pmd_mdc_lock(&cinfo->mmi_uncolock, cslot);
+		objid_to_layout_insert_mdc(&cinfo->mmi_uncobj, layout);
+
+		pmd_mdc_unlock(&cinfo->mmi_uncolock);
+	} else {
+		atomic_inc(&cinfo->mmi_pco_cnt.pcc_cr);
+		atomic_inc(&cinfo->mmi_pco_cnt.pcc_cobj);
 	}
 
-	if (err)
-		mp_pr_crit("mpool %s, MDC%u compaction failed",
-			   err, mp->pds_name, cslot);
-
 	return err;
 }
 
-static merr_t
-pmd_mdc_addrec(
+/**
+ * pmd_obj_commit_batch() - log the create records of a batch of commits
+ *	with a single sync and complete them
+ * @mp:
+ * @cinfo:
+ * @cslot:
+ * @batch: list of struct pmd_gcreq
+ *
+ * Caller must hold the MDC compact lock. The layouts in the batch are
+ * write-locked by their committers, which wait for gcr_done.
+ *
+ * The create records are appended without sync and then flushed with a
+ * single sync, so no object is made visible before its create record
+ * is durable. If the MDC fills up, it is compacted and the whole batch
+ * is logged again: compaction only carries over committed objects, so
+ * the records of the batch already appended to the previous active mlog
+ * are dropped.
+ *
+ * If an append fails partway through the batch, the records appended
+ * before it would become durable with the next sync of the MDC anyway, so
+ * they are synced and their commits completed; only the commits from the
+ * failed record on fail, and their committers may abort them. If that sync
+ * fails too, the records appended may still reach the media later: their
+ * objects are made committed all the same, so that their zones are never
+ * freed by an abort, but the sync error is reported to their committers.
+ * A committer retrying the commit then succeeds.
+ */
+static void
+pmd_obj_commit_batch(
 	struct mpool_descriptor    *mp,
+	struct pmd_mdc_info        *cinfo,
 	u8                          cslot,
-	struct omf_mdcrec_data     *cdr)
+	struct list_head           *batch)
 {
-	merr_t err;
+	struct omf_mdcrec_data  cdr;
+	struct pmd_gcreq       *req, *next;
+	bool                    compacted = false;
+	merr_t                  err, serr;
+	u32                     logged;
 
-	err = pmd_mdc_append(mp, cslot, cdr, 1);
+again:
+	err = 0;
+	logged = 0;
 
-	if (merr_errno(err) == EFBIG) {
-		err = pmd_mdc_compact(mp, cslot);
-		if (!ev(err))
-			err = pmd_mdc_append(mp, cslot, cdr, 1);
+	list_for_each_entry(req, batch, gcr_link) {
+		cdr.omd_rtype = OMF_MDR_OCREATE;
+		cdr.u.obj.omd_layout = req->gcr_layout;
+
+		err = pmd_mdc_append(mp, cslot, &cdr, 0);
+		if (merr_errno(err) == EFBIG && !compacted) {
+			compacted = true;
+
+			err = pmd_mdc_compact(mp, cslot);
+			if (!ev(err))
+				goto again;
+		}
+		if (err) {
+			mp_pr_rl("mpool %s, MDC%u append failed%s, %u records logged",
+				 err, mp->pds_name, cslot,
+				 (merr_errno(err) == EFBIG) ?
+				 " post compaction" : "", logged);
+			break;
+		}
+
+		++logged;
 	}
 
-	if (err)
-		mp_pr_rl("mpool %s, MDC%u append failed%s",
-			 err, mp->pds_name, cslot,
-			 (merr_errno(err) == EFBIG) ?
-			 " post compaction" : "");
+	serr = 0;
+	if (logged > 0) {
+		serr = mp_mdc_sync(cinfo->mmi_mdc);
+		if (serr)
+			mp_pr_rl("mpool %s, MDC%u sync of %u records failed",
+				 serr, mp->pds_name, cslot, logged);
+	}
 
-	return err;
+	list_for_each_entry_safe(req, next, batch, gcr_link) {
+		merr_t rerr;
+
+		if (logged > 0) {
+			--logged;
+			rerr = pmd_obj_commit_done(mp, cinfo, cslot,
+						   req->gcr_layout);
+			if (!rerr)
+				rerr = serr;
+		} else {
+			rerr = err;
+		}
+
+		spin_lock(&cinfo->mmi_gclock);
+		list_del(&req->gcr_link);
+		req->gcr_err  = rerr;
+		req->gcr_done = true;
+		spin_unlock(&cinfo->mmi_gclock);
+	}
 }
 
+/**
+ * pmd_obj_commit_group() - log an object create record through group commit
+ * @mp:
+ * @cinfo:
+ * @cslot:
+ * @layout: object to commit, write-locked by the caller
+ *
+ * The first committer to find no leader active becomes the leader: it takes
+ * the MDC compact lock and logs all the commits queued so far, its own
+ * included, with a single sync. Commits arriving in the meantime queue up
+ * and are logged together by the next leader, elected among them once the
+ * current one is done.
+ */
 static merr_t
-pmd_log_create(
+pmd_obj_commit_group(
 	struct mpool_descriptor        *mp,
+	struct pmd_mdc_info            *cinfo,
+	u8                              cslot,
 	struct ecio_layout_descriptor  *layout)
 {
-	struct omf_mdcrec_data  cdr;
+	struct pmd_gcreq    req;
+	LIST_HEAD(batch);
+
+	req.gcr_layout = layout;
+	req.gcr_err    = 0;
+	req.gcr_done   = false;
+
+	spin_lock(&cinfo->mmi_gclock);
+	list_add_tail(&req.gcr_link, &cinfo->mmi_gcq);
+
+	while (!req.gcr_done && cinfo->mmi_gcleader) {
+		spin_unlock(&cinfo->mmi_gclock);
+		wait_event(cinfo->mmi_gcwq, READ_ONCE(req.gcr_done) ||
+			   !READ_ONCE(cinfo->mmi_gcleader));
+		spin_lock(&cinfo->mmi_gclock);
+	}
+
+	if (req.gcr_done) {
+		spin_unlock(&cinfo->mmi_gclock);
+		return req.gcr_err;
+	}
+
+	cinfo->mmi_gcleader = true;
+	spin_unlock(&cinfo->mmi_gclock);
+
+	pmd_mdc_lock(&cinfo->mmi_compactlock, cslot);
+
+	spin_lock(&cinfo->mmi_gclock);
+	list_splice_init(&cinfo->mmi_gcq, &batch);
+	spin_unlock(&cinfo->mmi_gclock);
+
+	pmd_obj_commit_batch(mp, cinfo, cslot, &batch);
+
+	pmd_mdc_unlock(&cinfo->mmi_compactlock);
 
-	cdr.omd_rtype = OMF_MDR_OCREATE;
-	cdr.u.obj.omd_layout = layout;
-	return pmd_mdc_addrec(mp, objid_slot(layout->eld_objid), &cdr);
+	spin_lock(&cinfo->mmi_gclock);
+	cinfo->mmi_gcleader = false;
+	spin_unlock(&cinfo->mmi_gclock);
+
+	wake_up_all(&cinfo->mmi_gcwq);
+
+	return req.gcr_err;
 }
 
 merr_t
@@ -1747,8 +3396,8 @@ pmd_obj_commit(
 {
 	struct pmd_mdc_info           *cinfo;
 	merr_t                         err;
+	bool                           committed;
 	u8                             cslot;
-	struct ecio_layout_descriptor *found;
 
 	pmd_obj_wrlock(mp, layout);
 	if (!objtype_user(objid_type(layout->eld_objid))) {
@@ -1770,65 +3419,25 @@ pmd_obj_commit(
 	 * must log create before marking object committed to guarantee it will
 	 * exist after a crash; must hold cinfo.compactclock while log create,
 	 * update layout.state, and add to list of committed objects to prevent
-	 * a race with mdc compaction
+	 * a race with mdc compaction; concurrent commits to the same mdc share
+	 * the sync of their create records through group commit
 	 */
 	cslot = objid_slot(layout->eld_objid);
 	cinfo = &mp->pds_mda.mdi_slotv[cslot];
 
-	pmd_mdc_lock(&cinfo->mmi_compactlock, cslot);
-
-	err = pmd_log_create(mp, layout);
-	if (!ev(err)) {
-
-		layout->eld_state |= ECIO_LYT_COMMITTED;
-
-		pmd_mdc_lock(&cinfo->mmi_uncolock, cslot);
-		found =	objid_to_layout_search_mdc(&cinfo->mmi_uncobj,
-						   layout->eld_objid);
-		if (found)
-			rb_erase(&found->eld_nodemdc, &cinfo->mmi_uncobj);
-		pmd_mdc_unlock(&cinfo->mmi_uncolock);
-
-		pmd_mdc_wrlock(&cinfo->mmi_colock, cslot);
-		found = objid_to_layout_insert_mdc(&cinfo->mmi_obj, layout);
-		pmd_mdc_wrunlock(&cinfo->mmi_colock);
-
-		if (found) {
-			err = merr(EEXIST);
-
-			/*
-			 * if objid exists in committed object list this is a
-			 * SERIOUS bug; need to log a warning message; should
-			 * never happen. Note in this case we are stuck because
-			 * we just logged a second create for an existing
-			 * object.  If mdc compaction runs before a restart this
-			 * extraneous create record will be eliminated,
-			 * otherwise pmd_objs_load() will see the conflict and
-			 * fail the next mpool activation.  We could make
-			 * pmd_objs_load() tolerate this but for now it is
-			 * better to get an activation failure so that
-			 * it's obvious this bug occurred. Best we can do is put
-			 * the layout back in the uncommitted object list so the
-			 * caller can abort after getting the commit failure.
-			 */
-			mp_pr_crit("mpool %s, obj 0x%lx collided during commit",
-				   err, mp->pds_name, (ulong)layout->eld_objid);
-
-			/* Put the object back in the uncommited objects tree */
-			pmd_mdc_lock(&cinfo->mmi_uncolock, cslot);
-			objid_to_layout_insert_mdc(&cinfo->mmi_uncobj, layout);
+	err = pmd_obj_commit_group(mp, cinfo, cslot, layout);
+	ev(err);
 
-			pmd_mdc_unlock(&cinfo->mmi_uncolock);
-		} else {
-			atomic_inc(&cinfo->mmi_pco_cnt.pcc_cr);
-			atomic_inc(&cinfo->mmi_pco_cnt.pcc_cobj);
-		}
-	}
+	/*
+	 * A failed group sync still leaves the object committed, and a retry
+	 * returns early, so account for it whenever it ends up committed.
+	 */
+	committed = (layout->eld_state & ECIO_LYT_COMMITTED) &&
+		merr_errno(err) != EEXIST;
 
-	pmd_mdc_unlock(&cinfo->mmi_compactlock);
 	pmd_obj_wrunlock(mp, layout);
 
-	if (!err)
+	if (committed)
 		pmd_update_mdc_stats(mp, layout, cinfo, PMD_OBJ_COMMIT);
 
 	return err;
@@ -1841,11 +3450,16 @@ static void pmd_obj_erase_cb(struct work_struct *work)
 	struct ecio_err_report          erpt;
 	enum obj_type_omf               otype;
 	struct pmd_obj_erase_work      *oef;
+	u32                             zcnt;
+	u16                             pdh;
 
 	oef = container_of(work, struct pmd_obj_erase_work, oef_wqstruct);
 	mp = oef->oef_mp;
 	layout = oef->oef_layout;
 
+	pdh = layout->eld_ld.ol_pdh;
+	zcnt = layout->eld_ld.ol_zcnt;
+
 	otype = pmd_objid_type(layout->eld_objid);
 	if (otype == OMF_OBJ_MLOG)
 		/* discard is advisory and no need to check the result */
@@ -1857,6 +3471,11 @@ static void pmd_obj_erase_cb(struct work_struct *work)
 		kmem_cache_free(oef->oef_cache, oef);
 
 	pmd_layout_free(mp, layout);
+
+	/* Let the allocators waiting for the zones retry. */
+	atomic_sub(zcnt, &mp->pds_pdv[pdh].pdi_erasing);
+	atomic_inc(&mp->pds_erasegen);
+	wake_up_all(&mp->pds_erasewq);
 }
 
 static void
@@ -1866,6 +3485,22 @@ pmd_obj_erase_start(
 {
 	struct pmd_obj_erase_work   oefbuf, *oef;
 	bool                        async = true;
+	u16                         pdh;
+
+	pdh = layout->eld_ld.ol_pdh;
+	atomic_add(layout->eld_ld.ol_zcnt, &mp->pds_pdv[pdh].pdi_erasing);
+
+	/*
+	 * mblock zones are discarded, and freed, by the drive's discard
+	 * scheduler. mlogs are erased right away as they must read back as
+	 * erased when reused.
+	 */
+	if (pmd_objid_type(layout->eld_objid) == OMF_OBJ_MBLOCK &&
+	    !dsched_enqueue(mp, pdh, layout->eld_ld.ol_zaddr,
+			    layout->eld_ld.ol_zcnt)) {
+		ecio_layout_free(layout);
+		return;
+	}
 
 	oef = kmem_cache_zalloc(pmd_obj_erase_work_cache, GFP_KERNEL);
 	if (!oef) {
@@ -1885,6 +3520,43 @@ pmd_obj_erase_start(
 		flush_work(&oef->oef_wqstruct);
 }
 
+/**
+ * pmd_obj_kill() - mark an object logically deleted
+ * @layout:
+ *
+ * Succeeds only if the caller's ref and the creation ref are the only refs
+ * left, in which case the count is replaced by ECIO_REF_DEAD so that any
+ * further get or put fails.
+ *
+ * Return: EINVAL if already deleted, EBUSY if other refs are held.
+ */
+static merr_t pmd_obj_kill(struct ecio_layout_descriptor *layout)
+{
+	long    cur, old;
+
+	cur = atomic_long_read(&layout->eld_refcnt);
+	do {
+		if (cur & ECIO_REF_DEAD)
+			return merr(EINVAL);
+		if (cur > 2)
+			return merr(EBUSY);
+
+		old = cur;
+		cur = atomic_long_cmpxchg(&layout->eld_refcnt, old,
+					  ECIO_REF_DEAD);
+	} while (cur != old);
+
+	return 0;
+}
+
+/*
+ * Undo pmd_obj_kill(); no get or put can change a dead refcnt meanwhile.
+ */
+static void pmd_obj_revive(struct ecio_layout_descriptor *layout)
+{
+	atomic_long_set(&layout->eld_refcnt, 2);
+}
+
 merr_t
 pmd_obj_abort(
 	struct mpool_descriptor        *mp,
@@ -1912,32 +3584,27 @@ pmd_obj_abort(
 	cslot = objid_slot(layout->eld_objid);
 	cinfo = &mp->pds_mda.mdi_slotv[cslot];
 
-	pmd_mdc_lock(&cinfo->mmi_reflock, cslot);
-	if (layout->eld_isdel || layout->eld_refcnt > 2) {
-		int rc = layout->eld_isdel ? EINVAL : EBUSY;
-
-		pmd_mdc_unlock(&cinfo->mmi_reflock);
+	err = pmd_obj_kill(layout);
+	if (err) {
 		pmd_obj_wrunlock(mp, layout);
 
-		err = merr(rc);
 		mp_pr_rl("mpool %s, abort failed objid %lx, state 0x%x, refcnt %ld, isdel %d",
 			 err, mp->pds_name, (ulong)layout->eld_objid,
-			 layout->eld_state,
-			 layout->eld_refcnt, layout->eld_isdel);
+			 layout->eld_state, ecio_layout_refcnt(layout),
+			 ecio_layout_isdel(layout));
 
 		return err;
 	}
 
-	layout->eld_refcnt = 0;
-	layout->eld_isdel = true;
 	layout->eld_state |= ECIO_LYT_REMOVED;
-	pmd_mdc_unlock(&cinfo->mmi_reflock);
 
 	pmd_mdc_lock(&cinfo->mmi_uncolock, cslot);
 	found = objid_to_layout_search_mdc(&cinfo->mmi_uncobj,
 					   layout->eld_objid);
-	if (found)
+	if (found) {
 		rb_erase(&found->eld_nodemdc, &cinfo->mmi_uncobj);
+		pmd_objht_remove(cinfo, found);
+	}
 	pmd_mdc_unlock(&cinfo->mmi_uncolock);
 
 	pmd_obj_wrunlock(mp, layout);
@@ -2008,77 +3675,315 @@ pmd_obj_delete_impl(
 	 */
 	pmd_mdc_lock(&cinfo->mmi_compactlock, cslot);
 
-	pmd_mdc_lock(&cinfo->mmi_reflock, cslot);
-	if (layout->eld_isdel || layout->eld_refcnt > 2) {
-		int rc = layout->eld_isdel ? EINVAL : EBUSY;
-
-		pmd_mdc_unlock(&cinfo->mmi_reflock);
+	err = pmd_obj_kill(layout);
+	if (err) {
 		pmd_mdc_unlock(&cinfo->mmi_compactlock);
 		pmd_obj_wrunlock(mp, layout);
 
-		err = merr(rc);
 		mp_pr_rl("mpool %s, delete failed objid %lx, state 0x%x, refcnt %ld, isdel %d, type (%s)",
 			 err, mp->pds_name, (ulong)objid,
-			 layout->eld_state,
-			 layout->eld_refcnt, layout->eld_isdel,
+			 layout->eld_state, ecio_layout_refcnt(layout),
+			 ecio_layout_isdel(layout),
 			 is_mblock ? "mblock" : "mlog");
 
 		return err;
 	}
 
-	layout->eld_refcnt = 0;
-	layout->eld_isdel = true;
 	layout->eld_state |= ECIO_LYT_REMOVED;
-	pmd_mdc_unlock(&cinfo->mmi_reflock);
 
 	err = pmd_log_delete(mp, objid);
 	if (!ev(err)) {
 		pmd_mdc_wrlock(&cinfo->mmi_colock, cslot);
 		found = objid_to_layout_search_mdc(&cinfo->mmi_obj, objid);
-		if (found)
+		if (found) {
 			rb_erase(&found->eld_nodemdc, &cinfo->mmi_obj);
+			pmd_objht_remove(cinfo, found);
+		}
 		pmd_mdc_wrunlock(&cinfo->mmi_colock);
 	} else {
 		/* It is legal to delete the object,
 		 * but we failed to put an object delete message into the log
 		 */
-		pmd_mdc_lock(&cinfo->mmi_reflock, cslot);
-		layout->eld_refcnt = 2;
-		layout->eld_isdel = false;
 		layout->eld_state &= ~ECIO_LYT_REMOVED;
-		pmd_mdc_unlock(&cinfo->mmi_reflock);
+		pmd_obj_revive(layout);
+	}
+
+	pmd_mdc_unlock(&cinfo->mmi_compactlock);
+	pmd_obj_wrunlock(mp, layout);
+
+	if (found) {
+		atomic_dec(&cinfo->mmi_pco_cnt.pcc_cobj);
+		pmd_update_mdc_stats(mp, layout, cinfo, PMD_OBJ_DELETE);
+	}
+
+	if (ev(err)) {
+		mp_pr_err("mpool %s, objid 0x%lx, pmd_log_del failed",
+			  err, mp->pds_name, (ulong)objid);
+		return err;
+	}
+
+	atomic_inc(&cinfo->mmi_pco_cnt.pcc_del);
+
+	pmd_obj_erase_start(mp, layout);
+
+	return 0;
+}
+
+merr_t
+pmd_obj_delete(
+	struct mpool_descriptor        *mp,
+	struct ecio_layout_descriptor  *layout)
+{
+	return pmd_obj_delete_impl(mp, layout, 0);
+}
+
+
+static int pmd_ptr_cmp(const void *a, const void *b)
+{
+	uintptr_t x = *(const uintptr_t *)a;
+	uintptr_t y = *(const uintptr_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Layouts lock rwsems from a lock pool, the same rwsem may back several
+ * objects of a transaction. They're taken in address order under the MDC
+ * transaction lock, which tells lockdep they don't nest.
+ */
+static void
+pmd_obj_txn_wrlock(struct rw_semaphore *sem, struct pmd_mdc_info *cinfo)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 11, 0)
+	down_write_nest_lock(sem, &cinfo->mmi_txnlock);
+#else
+	down_write(sem);
+#endif
+}
+
+merr_t
+pmd_obj_txn(
+	struct mpool_descriptor        *mp,
+	struct ecio_layout_descriptor **cmtv,
+	u32                             cmtc,
+	struct ecio_layout_descriptor **delv,
+	u32                             delc)
+{
+	struct ecio_layout_descriptor **objv, *layout, *found;
+	struct rw_semaphore           **lockv;
+	struct pmd_mdc_info            *cinfo;
+	struct omf_mdcrec_data          cdr;
+	struct mlog_rec                *recv;
+	struct iovec                   *iovv;
+
+	merr_t  err = 0;
+	merr_t  cerr;
+	char   *wbuf, *pbuf;
+	bool    compacted = false;
+	s64     plen;
+	u32     n, nlock, ndel, i;
+	u8      cslot;
+
+	n = cmtc + delc;
+	if (!n)
+		return 0;
+
+	if ((cmtc && !cmtv) || (delc && !delv) || n < cmtc)
+		return merr(EINVAL);
+
+	cslot = objid_slot((cmtc ? cmtv[0] : delv[0])->eld_objid);
+	cinfo = &mp->pds_mda.mdi_slotv[cslot];
+
+	wbuf = vmalloc(n * (sizeof(*objv) + sizeof(*lockv) + sizeof(*recv) +
+			    sizeof(*iovv) + OMF_MDCREC_PACKLEN_MAX));
+	if (!wbuf)
+		return merr(ENOMEM);
+
+	objv  = (void *)wbuf;
+	lockv = (void *)(objv + n);
+	recv  = (void *)(lockv + n);
+	iovv  = (void *)(recv + n);
+	pbuf  = (void *)(iovv + n);
+
+	for (i = 0; i < n; i++) {
+		layout = i < cmtc ? cmtv[i] : delv[i - cmtc];
+
+		if (!objtype_user(objid_type(layout->eld_objid))) {
+			err = merr(EINVAL);
+			mp_pr_err("mpool %s, wrong object type, txn failed, objid 0x%lx",
+				  err, mp->pds_name, (ulong)layout->eld_objid);
+			goto errout;
+		}
+
+		if (objid_slot(layout->eld_objid) != cslot) {
+			err = merr(EXDEV);
+			mp_pr_rl("mpool %s, txn objects span MDC%u and MDC%u",
+				 err, mp->pds_name, cslot,
+				 objid_slot(layout->eld_objid));
+			goto errout;
+		}
+
+		objv[i] = layout;
+	}
+
+	sort(objv, n, sizeof(*objv), pmd_ptr_cmp, NULL);
+
+	for (i = 1; i < n; i++) {
+		if (objv[i] == objv[i - 1]) {
+			err = merr(EINVAL);
+			mp_pr_err("mpool %s, objid 0x%lx appears twice in txn",
+				  err, mp->pds_name, (ulong)objv[i]->eld_objid);
+			goto errout;
+		}
+	}
+
+	for (i = 0; i < n; i++)
+		lockv[i] = objv[i]->eld_rwlock;
+
+	sort(lockv, n, sizeof(*lockv), pmd_ptr_cmp, NULL);
+
+	for (nlock = 0, i = 0; i < n; i++)
+		if (!nlock || lockv[i] != lockv[nlock - 1])
+			lockv[nlock++] = lockv[i];
+
+	mutex_lock(&cinfo->mmi_txnlock);
+	for (i = 0; i < nlock; i++)
+		pmd_obj_txn_wrlock(lockv[i], cinfo);
+
+	for (i = 0; i < n && !err; i++) {
+		layout = i < cmtc ? cmtv[i] : delv[i - cmtc];
+
+		if (i < cmtc && (layout->eld_state & ECIO_LYT_COMMITTED))
+			err = merr(EALREADY);
+		else if (i >= cmtc &&
+			 (!(layout->eld_state & ECIO_LYT_COMMITTED) ||
+			  (layout->eld_state & ECIO_LYT_REMOVED)))
+			err = merr(EINVAL);
+
+		if (err)
+			mp_pr_rl("mpool %s, txn %s failed objid 0x%lx state 0x%x",
+				 err, mp->pds_name,
+				 i < cmtc ? "commit" : "delete",
+				 (ulong)layout->eld_objid, layout->eld_state);
+	}
+
+	if (err)
+		goto unlock;
+
+	/*
+	 * Same as pmd_obj_commit() and pmd_obj_delete_impl(), except that all
+	 * the records are logged in one flush set with a single sync.
+	 */
+	pmd_mdc_lock(&cinfo->mmi_compactlock, cslot);
+
+	for (ndel = 0; ndel < delc; ndel++) {
+		layout = delv[ndel];
+
+		err = pmd_obj_kill(layout);
+		if (err) {
+			mp_pr_rl("mpool %s, txn delete failed objid %lx, refcnt %ld, isdel %d",
+				 err, mp->pds_name, (ulong)layout->eld_objid,
+				 ecio_layout_refcnt(layout),
+				 ecio_layout_isdel(layout));
+			break;
+		}
+
+		layout->eld_state |= ECIO_LYT_REMOVED;
+	}
+
+	for (i = 0; i < n && !err; i++) {
+		if (i < cmtc) {
+			cdr.omd_rtype = OMF_MDR_OCREATE;
+			cdr.u.obj.omd_layout = cmtv[i];
+		} else {
+			cdr.omd_rtype = OMF_MDR_ODELETE;
+			cdr.u.obj.omd_objid = delv[i - cmtc]->eld_objid;
+		}
+
+		plen = omf_mdcrec_pack_htole(mp, &cdr,
+					     pbuf + i * OMF_MDCREC_PACKLEN_MAX);
+		if (plen < 0)
+			err = merr(EINVAL);
+
+		recv[i].mr_len = plen;
+	}
+
+	while (!err) {
+		for (i = 0; i < n; i++) {
+			iovv[i].iov_base = pbuf + i * OMF_MDCREC_PACKLEN_MAX;
+			iovv[i].iov_len  = recv[i].mr_len;
+			recv[i].mr_iov   = &iovv[i];
+		}
+
+		err = mp_mdc_append_batch(cinfo->mmi_mdc, recv, n,
+					  MLOG_AF_SYNC | MLOG_AF_ATOMIC);
+		if (merr_errno(err) != EFBIG || compacted)
+			break;
+
+		/* Compaction drops what was appended, log the txn again. */
+		compacted = true;
+
+		err = pmd_mdc_compact(mp, cslot);
+		ev(err);
+	}
+
+	if (!err) {
+		for (i = 0; i < cmtc; i++) {
+			cerr = pmd_obj_commit_done(mp, cinfo, cslot, cmtv[i]);
+			if (cerr && !err)
+				err = cerr;
+		}
+
+		pmd_mdc_wrlock(&cinfo->mmi_colock, cslot);
+		for (i = 0; i < delc; i++) {
+			found = objid_to_layout_search_mdc(&cinfo->mmi_obj,
+							   delv[i]->eld_objid);
+			if (found) {
+				rb_erase(&found->eld_nodemdc, &cinfo->mmi_obj);
+				pmd_objht_remove(cinfo, found);
+			}
+		}
+		pmd_mdc_wrunlock(&cinfo->mmi_colock);
+	} else {
+		mp_pr_rl("mpool %s, MDC%u txn of %u commits %u deletes failed",
+			 err, mp->pds_name, cslot, cmtc, delc);
+
+		for (i = 0; i < ndel; i++) {
+			layout = delv[i];
+			layout->eld_state &= ~ECIO_LYT_REMOVED;
+			pmd_obj_revive(layout);
+		}
+		ndel = 0;
 	}
 
 	pmd_mdc_unlock(&cinfo->mmi_compactlock);
-	pmd_obj_wrunlock(mp, layout);
-
-	if (found) {
-		atomic_dec(&cinfo->mmi_pco_cnt.pcc_cobj);
-		pmd_update_mdc_stats(mp, layout, cinfo, PMD_OBJ_DELETE);
-	}
 
-	if (ev(err)) {
-		mp_pr_err("mpool %s, objid 0x%lx, pmd_log_del failed",
-			  err, mp->pds_name, (ulong)objid);
-		return err;
-	}
+unlock:
+	for (i = nlock; i > 0; i--)
+		up_write(lockv[i - 1]);
+	mutex_unlock(&cinfo->mmi_txnlock);
 
-	atomic_inc(&cinfo->mmi_pco_cnt.pcc_del);
+	if (!err || merr_errno(err) == EEXIST) {
+		for (i = 0; i < cmtc; i++)
+			if (cmtv[i]->eld_state & ECIO_LYT_COMMITTED)
+				pmd_update_mdc_stats(mp, cmtv[i], cinfo,
+						     PMD_OBJ_COMMIT);
 
-	pmd_obj_erase_start(mp, layout);
+		for (i = 0; i < delc; i++) {
+			atomic_dec(&cinfo->mmi_pco_cnt.pcc_cobj);
+			pmd_update_mdc_stats(mp, delv[i], cinfo,
+					     PMD_OBJ_DELETE);
+			atomic_inc(&cinfo->mmi_pco_cnt.pcc_del);
+			pmd_obj_erase_start(mp, delv[i]);
+		}
+	}
 
-	return 0;
-}
+errout:
+	vfree(wbuf);
 
-merr_t
-pmd_obj_delete(
-	struct mpool_descriptor        *mp,
-	struct ecio_layout_descriptor  *layout)
-{
-	return pmd_obj_delete_impl(mp, layout, 0);
+	return err;
 }
 
-
 merr_t pmd_log_erase(struct mpool_descriptor *mp, u64 objid, u64 gen)
 {
 	struct omf_mdcrec_data  cdr;
@@ -2137,6 +4042,7 @@ pmd_mdc0_meta_update(
 	sb->osb_parm.odp_zonetot = pd->pdi_parm.dpr_zonetot;
 	mc_pd_prop2mc_parms(&pd->pdi_parm.dpr_prop, &mc_parms);
 	mc_parms2omf_devparm(&mc_parms, &sb->osb_parm);
+	sb->osb_parm.odp_mcord = pd->pdi_mcord;
 
 	sbutil_mdc0_copy(sb, &mp->pds_sbmdc0);
 
@@ -2241,20 +4147,18 @@ pmd_obj_get(
 	struct mpool_descriptor        *mp,
 	struct ecio_layout_descriptor  *layout)
 {
-	struct pmd_mdc_info    *cinfo;
-	int                     rc;
-	u8                      cslot;
+	long    cur, old;
 
-	cslot = objid_slot(layout->eld_objid);
-	cinfo = &mp->pds_mda.mdi_slotv[cslot];
+	cur = atomic_long_read(&layout->eld_refcnt);
+	do {
+		if (cur & ECIO_REF_DEAD)
+			return merr(ENOSPC);
 
-	pmd_mdc_lock(&cinfo->mmi_reflock, cslot);
-	rc = layout->eld_isdel ? ENOSPC : 0;
-	if (!rc)
-		layout->eld_refcnt++;
-	pmd_mdc_unlock(&cinfo->mmi_reflock);
+		old = cur;
+		cur = atomic_long_cmpxchg(&layout->eld_refcnt, old, old + 1);
+	} while (cur != old);
 
-	return rc ? merr(rc) : 0;
+	return 0;
 }
 
 void
@@ -2262,24 +4166,14 @@ pmd_obj_put(
 	struct mpool_descriptor       *mp,
 	struct ecio_layout_descriptor *layout)
 {
-	struct pmd_mdc_info    *cinfo;
-	bool                    put;
-	u8                      cslot;
-	merr_t                  err;
+	merr_t  err;
+	long    cur, old;
 
 	assert(layout);
 	if (!layout)
 		return;
 
-	cslot = objid_slot(layout->eld_objid);
-	cinfo = &mp->pds_mda.mdi_slotv[cslot];
-
-	pmd_obj_rdlock(mp, layout);
-
-	if (!objtype_user(objid_type(layout->eld_objid)) ||
-	    (layout->eld_state & ECIO_LYT_REMOVED)) {
-		pmd_obj_rdunlock(mp, layout);
-
+	if (!objtype_user(objid_type(layout->eld_objid))) {
 		err = merr(EINVAL);
 		mp_pr_rl("mpool %s, invalid state, objid 0x%lx state 0x%x",
 			 err, mp->pds_name,
@@ -2288,21 +4182,22 @@ pmd_obj_put(
 		return;
 	}
 
-	pmd_mdc_lock(&cinfo->mmi_reflock, cslot);
-	put = layout->eld_refcnt > 1 && !layout->eld_isdel;
-	if (put)
-		layout->eld_refcnt--;
-	pmd_mdc_unlock(&cinfo->mmi_reflock);
-
-	pmd_obj_rdunlock(mp, layout);
+	/* The creation ref is only dropped by abort or delete */
+	cur = atomic_long_read(&layout->eld_refcnt);
+	do {
+		if ((cur & ECIO_REF_DEAD) || cur <= 1)
+			break;
 
-	if (put)
-		return;
+		old = cur;
+		cur = atomic_long_cmpxchg(&layout->eld_refcnt, old, old - 1);
+		if (cur == old)
+			return;
+	} while (true);
 
 	err = merr(EINVAL);
 	mp_pr_rl("mpool %s, put failed: objid %lx refcnt %ld isdel %d",
 		 err, mp->pds_name, (ulong)layout->eld_objid,
-		 layout->eld_refcnt, layout->eld_isdel);
+		 cur & ~ECIO_REF_DEAD, !!(cur & ECIO_REF_DEAD));
 }
 
 struct ecio_layout_descriptor *
@@ -2320,8 +4215,25 @@ pmd_obj_find_get(
 
 	cslot = objid_slot(objid);
 	cinfo = &mp->pds_mda.mdi_slotv[cslot];
-	err = 0;
 
+	err = pmd_mdc_load_wait(mp, cslot);
+	if (ev(err))
+		return NULL;
+
+#ifdef ECIO_HAVE_RHASHTABLE
+	if (!cinfo->mmi_objht_init)
+		return NULL;
+
+	/* The layout cannot be freed before rcu_read_unlock(), and
+	 * pmd_obj_get() fails if it was removed (isdel) in the meantime.
+	 */
+	rcu_read_lock();
+	found = rhashtable_lookup_fast(&cinfo->mmi_objht, &objid,
+				       pmd_objht_params);
+	if (found)
+		err = pmd_obj_get(mp, found);
+	rcu_read_unlock();
+#else
 	pmd_mdc_rdlock(&cinfo->mmi_colock, cslot);
 	found = objid_to_layout_search_mdc(&cinfo->mmi_obj, objid);
 	if (found)
@@ -2338,6 +4250,7 @@ pmd_obj_find_get(
 			err = pmd_obj_get(mp, found);
 		pmd_mdc_unlock(&cinfo->mmi_uncolock);
 	}
+#endif
 
 	return err ? NULL : found;
 }
@@ -2414,6 +4327,11 @@ pmd_mdc_alloc(
 	struct ecio_layout_descriptor *layout2 = NULL;
 	const char              *msg = "(no detail)";
 
+	/* New MDCs are only created once all existing ones are loaded. */
+	err = pmd_mda_load_wait(mp);
+	if (ev(err))
+		return err;
+
 	/*
 	 * serialize to prevent gap in mdc slot space in event of failure
 	 */
@@ -2440,7 +4358,7 @@ pmd_mdc_alloc(
 	cinfo = &mp->pds_mda.mdi_slotv[0];
 
 	pmd_mdc_lock(&cinfo->mmi_uqlock, 0);
-	mdcslot = cinfo->mmi_luniq;
+	mdcslot = atomic64_read(&cinfo->mmi_luniq);
 	pmd_mdc_unlock(&cinfo->mmi_uqlock);
 
 	if (mdcslot >= MDC_SLOTS - 1) {
@@ -2467,6 +4385,17 @@ pmd_mdc_alloc(
 			   (ulong)OMF_MDCREC_PACKLEN_MAX);
 		return merr(ENOMEM);
 	}
+
+	err = pmd_objht_init(cinew);
+	if (ev(err)) {
+		kfree(cinew->mmi_recbuf);
+		cinew->mmi_recbuf = NULL;
+		mutex_unlock(&pmd_s_lock);
+
+		mp_pr_warn("mpool %s, MDC%lu object index init failed",
+			   mp->pds_name, (ulong)mdcslot);
+		return err;
+	}
 	cinew->mmi_credit.ci_slot = mdcslot;
 
 	mclassp = MP_MED_CAPACITY;
@@ -2601,7 +4530,7 @@ pmd_mdc_alloc(
 	pmd_mdc_lock(&cinfo->mmi_uqlock, 0);
 
 	spin_lock(&mp->pds_mda.mdi_slotvlock);
-	cinfo->mmi_luniq = mdcslot;
+	atomic64_set(&cinfo->mmi_luniq, mdcslot);
 	mp->pds_mda.mdi_slotvcnt = mdcslot + 1;
 	mp->pds_mda.mdi_slotvcnt_shift = 0;
 	if (mdcslot > 1)
@@ -2613,6 +4542,7 @@ pmd_mdc_alloc(
 
 exit:
 	if (err) {
+		pmd_objht_fini(cinew);
 		kfree(cinew->mmi_recbuf);
 		cinew->mmi_recbuf = NULL;
 	}
@@ -2663,7 +4593,7 @@ pmd_mdc_cap(
 	cinfo = &mp->pds_mda.mdi_slotv[0];
 
 	pmd_mdc_lock(&cinfo->mmi_uqlock, 0);
-	*mdcmax = cinfo->mmi_luniq;
+	*mdcmax = atomic64_read(&cinfo->mmi_luniq);
 	pmd_mdc_unlock(&cinfo->mmi_uqlock);
 
 	/*  taking compactlock to freeze all object layout metadata in mdc0 */
@@ -2712,6 +4642,7 @@ pmd_prop_mcconfig(
 	mpool_uuid_copy(&cdr.u.dev.omd_parm.odp_devid, &pd->pdi_devid);
 	mc_pd_prop2mc_parms(&pd->pdi_parm.dpr_prop, &mc_parms);
 	mc_parms2omf_devparm(&mc_parms, &cdr.u.dev.omd_parm);
+	cdr.u.dev.omd_parm.odp_mcord = pd->pdi_mcord;
 	cdr.u.dev.omd_parm.odp_zonetot = pd->pdi_parm.dpr_zonetot;
 	cdr.u.dev.omd_parm.odp_devsz = pd->pdi_parm.dpr_devsz;
 
@@ -2828,6 +4759,60 @@ pmd_layout_calculate(
 	*zcnt = 1 + ((ocap->moc_captgt - 1) / (zonepg << PAGE_SHIFT));
 }
 
+/**
+ * pmd_layout_pdv() - rank the drives of a media class for an allocation
+ * @mp:
+ * @mc:  media class
+ * @pdv: (output) drives to allocate from, most preferred first
+ *
+ * A drive is ranked by its free usable zones divided by one plus the object
+ * reads and writes in flight on it. Allocations thus spread over the drives
+ * of the class in proportion to their free space, and away from the busy
+ * drives. UNAVAIL drives are skipped.
+ *
+ * Return: number of drives in pdv
+ */
+static int
+pmd_layout_pdv(
+	struct mpool_descriptor    *mp,
+	struct media_class         *mc,
+	u16                        *pdv)
+{
+	u32     rankv[MPOOL_MC_DRIVES_MAX];
+	int     i, j, n;
+
+	if (mc->mc_pdcnt == 1) {
+		pdv[0] = mc->mc_pdmc;
+		return 1;
+	}
+
+	for (n = i = 0; i < mc->mc_pdcnt; i++) {
+		struct mpool_dev_info  *pd;
+
+		u32     rank;
+		u16     pdh;
+
+		pdh = mc->mc_pdv[i];
+		pd = &mp->pds_pdv[pdh];
+
+		if (mpool_pd_status_get(pd) == PD_STAT_UNAVAIL)
+			continue;
+
+		rank = smap_drive_fusable(mp, pdh);
+		rank /= pd_io_inflight(pd) + 1;
+
+		for (j = n++; j > 0 && rankv[j - 1] < rank; j--) {
+			rankv[j] = rankv[j - 1];
+			pdv[j] = pdv[j - 1];
+		}
+
+		rankv[j] = rank;
+		pdv[j] = pdh;
+	}
+
+	return n;
+}
+
 /**
  * pmd_layout_alloc() -
  * @mp:
@@ -2836,6 +4821,9 @@ pmd_layout_calculate(
  * @layoutp:
  * @mc:		media class
  * @zcnt:
+ *
+ * The zones are allocated from the drives of the media class in the order
+ * given by pmd_layout_pdv(), falling back to the next drive on ENOSPC.
  */
 static merr_t
 pmd_layout_alloc(
@@ -2849,10 +4837,12 @@ pmd_layout_alloc(
 	enum smap_space_type            spctype;
 	struct mc_smap_parms            mcsp;
 
+	u16     pdv[MPOOL_MC_DRIVES_MAX];
 	u64     zoneaddr;
 	u64     align;
-	u8      pdh;
+	u16     pdh = 0;
 	merr_t  err;
+	int     pdc, i;
 
 	spctype = SMAP_SPC_USABLE_ONLY;
 	if (ocap->moc_spare)
@@ -2868,10 +4858,28 @@ pmd_layout_alloc(
 	align = min_t(u64, zcnt, mcsp.mcsp_align);
 	align = roundup_pow_of_two(align);
 
-	pdh = mc->mc_pdmc;
-	err = smap_alloc(mp, pdh, zcnt, spctype, &zoneaddr, align);
-	if (ev(err))
-		return err;
+	pdc = pmd_layout_pdv(mp, mc, pdv);
+	if (ev(pdc == 0))
+		return merr(ENODEV);
+
+	for (i = 0; i < pdc; i++) {
+		pdh = pdv[i];
+
+		/* mlogs are served first from the drive's erased zones. */
+		if (pmd_objid_type(layout->eld_objid) == OMF_OBJ_MLOG &&
+		    spctype == SMAP_SPC_USABLE_ONLY &&
+		    !dsched_rsv_get(mp, pdh, zcnt, &zoneaddr)) {
+			layout->eld_state |= ECIO_LYT_ERASED;
+			break;
+		}
+
+		err = smap_alloc(mp, pdh, zcnt, spctype, &zoneaddr, align);
+		if (!err)
+			break;
+
+		if (ev(merr_errno(err) != ENOSPC || i == pdc - 1))
+			return err;
+	}
 
 	layout->eld_ld.ol_pdh = pdh;
 	layout->eld_ld.ol_zaddr = zoneaddr;
@@ -2879,13 +4887,86 @@ pmd_layout_alloc(
 	return 0;
 }
 
-static merr_t pmd_log_idckpt(struct mpool_descriptor *mp, u64 objid)
+/**
+ * pmd_log_idckpt() - log an objid checkpoint covering a uniquifier
+ * @mp:
+ * @cslot: MDC slot
+ * @uniq:  uniquifier that must be covered by the checkpoint
+ *
+ * A checkpoint for uniquifier U guarantees that no objid with a uniquifier
+ * in [U, U + OBJID_UNIQ_DELTA) is reissued after a crash. Checkpoints are
+ * aligned on OBJID_UNIQ_DELTA and must be strictly increasing.
+ *
+ * Locking: the caller holds the MDC's mmi_uqlock.
+ */
+static merr_t pmd_log_idckpt(struct mpool_descriptor *mp, u8 cslot, u64 uniq)
 {
 	struct omf_mdcrec_data  cdr;
+	struct pmd_mdc_info    *cinfo;
+
+	merr_t  err;
+	u64     ckuniq;
+
+	cinfo = &mp->pds_mda.mdi_slotv[cslot];
+
+	ckuniq = uniq & ~((u64)OBJID_UNIQ_DELTA - 1);
+	if (ckuniq <= objid_uniq(cinfo->mmi_lckpt))
+		ckuniq = objid_uniq(cinfo->mmi_lckpt) + OBJID_UNIQ_DELTA;
 
 	cdr.omd_rtype = OMF_MDR_OIDCKPT;
-	cdr.u.obj.omd_objid = objid;
-	return pmd_mdc_addrec(mp, objid_slot(objid), &cdr);
+	cdr.u.obj.omd_objid = objid_make(ckuniq, OMF_OBJ_UNDEF, cslot);
+
+	/* Must hold cinfo.compactlock while log checkpoint to mdc
+	 * to prevent a race with mdc compaction.
+	 */
+	pmd_mdc_lock(&cinfo->mmi_compactlock, cslot);
+	err = pmd_mdc_addrec(mp, cslot, &cdr);
+	if (!err) {
+		cinfo->mmi_lckpt = cdr.u.obj.omd_objid;
+		atomic64_set(&cinfo->mmi_ckptmax,
+			     ckuniq + OBJID_UNIQ_DELTA - 1);
+	}
+	pmd_mdc_unlock(&cinfo->mmi_compactlock);
+
+	return err;
+}
+
+/**
+ * pmd_idckpt_work() - checkpoint the next objid range of an MDC
+ * @work:
+ *
+ * Queued by pmd_alloc_idgen() when the checkpointed range of an MDC drops
+ * below OBJID_UNIQ_LOWAT, so that allocators do not wait on the MDC sync.
+ */
+static void pmd_idckpt_work(struct work_struct *work)
+{
+	struct pmd_idckpt_work     *ckw;
+	struct pmd_mdc_info        *cinfo;
+	struct mpool_descriptor    *mp;
+
+	merr_t  err = 0;
+	u64     luniq, ckptmax;
+
+	ckw = container_of(work, struct pmd_idckpt_work, ckw_work);
+	mp = ckw->ckw_mp;
+	cinfo = &mp->pds_mda.mdi_slotv[ckw->ckw_cslot];
+
+	pmd_mdc_lock(&cinfo->mmi_uqlock, ckw->ckw_cslot);
+	luniq = atomic64_read(&cinfo->mmi_luniq);
+	ckptmax = atomic64_read(&cinfo->mmi_ckptmax);
+
+	/*
+	 * Refill unless the range was already refilled meanwhile, possibly
+	 * by an allocator that overran it.
+	 */
+	if (luniq + OBJID_UNIQ_LOWAT > ckptmax)
+		err = pmd_log_idckpt(mp, ckw->ckw_cslot,
+				     max_t(u64, luniq, ckptmax) + 1);
+	pmd_mdc_unlock(&cinfo->mmi_uqlock);
+
+	if (ev(err))
+		mp_pr_rl("mpool %s, MDC%u objid checkpoint refill failed",
+			 err, mp->pds_name, ckw->ckw_cslot);
 }
 
 /**
@@ -2906,6 +4987,11 @@ static merr_t pmd_log_idckpt(struct mpool_descriptor *mp, u64 objid)
  * deficit in objects of the MDCs avoided during the burst, is never recovered.
  * The bias in the round robin allows to recover. After a while all MDCs ends
  * up again with about the same number of objects.
+ *
+ * An objid must be checkpointed before it is assigned to an object to
+ * guarantee it will not be reissued after a crash. The next range is
+ * checkpointed ahead of time by pmd_idckpt_work(), so an allocation only
+ * waits on the MDC if it overruns the checkpointed range.
  */
 static merr_t
 pmd_alloc_idgen(
@@ -2916,6 +5002,7 @@ pmd_alloc_idgen(
 	struct pmd_mdc_info    *cinfo = NULL;
 
 	merr_t  err = 0;
+	u64     uniq, ckptmax;
 	u8      cslot;
 	u32     tidx;
 
@@ -2934,24 +5021,23 @@ pmd_alloc_idgen(
 	cslot = mp->pds_mda.mdi_sel.mds_tbl[tidx];
 	cinfo = &mp->pds_mda.mdi_slotv[cslot];
 
-	pmd_mdc_lock(&cinfo->mmi_uqlock, cslot);
-	*objid = objid_make(cinfo->mmi_luniq + 1, otype, cslot);
-	if (objid_ckpt(*objid)) {
+	uniq = atomic64_inc_return(&cinfo->mmi_luniq);
+	*objid = objid_make(uniq, otype, cslot);
 
-		/* Must checkpoint objid before assigning it to an object
-		 * to guarantee it will not reissue objid after a crash.
-		 * Must hold cinfo.compactlock while log checkpoint to mdc
-		 * to prevent a race with mdc compaction.
-		 */
-		pmd_mdc_lock(&cinfo->mmi_compactlock, cslot);
-		err = pmd_log_idckpt(mp, *objid);
-		if (!err)
-			cinfo->mmi_lckpt = *objid;
-		pmd_mdc_unlock(&cinfo->mmi_compactlock);
+	ckptmax = atomic64_read(&cinfo->mmi_ckptmax);
+	if (likely(uniq + OBJID_UNIQ_LOWAT <= ckptmax))
+		return 0;
+
+	if (uniq <= ckptmax) {
+		/* Running low, refill in the background */
+		queue_work(mp->pds_workq, &cinfo->mmi_ckptw.ckw_work);
+		return 0;
 	}
 
-	if (!err)
-		cinfo->mmi_luniq = cinfo->mmi_luniq + 1;
+	/* Overran the checkpointed range, checkpoint synchronously */
+	pmd_mdc_lock(&cinfo->mmi_uqlock, cslot);
+	if (uniq > atomic64_read(&cinfo->mmi_ckptmax))
+		err = pmd_log_idckpt(mp, cslot, uniq);
 	pmd_mdc_unlock(&cinfo->mmi_uqlock);
 
 	if (ev(err)) {
@@ -2991,15 +5077,14 @@ pmd_realloc_idvalidate(struct mpool_descriptor *mp, u64 objid)
 			  cslot, mp->pds_mda.mdi_slotvcnt, (ulong)objid);
 	} else {
 		cinfo = &mp->pds_mda.mdi_slotv[cslot];
-		pmd_mdc_lock(&cinfo->mmi_uqlock, cslot);
-		if (uniq > cinfo->mmi_luniq)
+		if (uniq > atomic64_read(&cinfo->mmi_luniq))
 			err = merr(EINVAL);
-		pmd_mdc_unlock(&cinfo->mmi_uqlock);
 
 		if (err) {
 			mp_pr_err("mpool %s, can't re-allocate an object, its unique id %lu is too big %lu 0x%lx",
 				  err, mp->pds_name, (ulong)uniq,
-				  (ulong)cinfo->mmi_luniq, (ulong)objid);
+				  (ulong)atomic64_read(&cinfo->mmi_luniq),
+				  (ulong)objid);
 		}
 	}
 	return err;
@@ -3043,6 +5128,83 @@ pmd_alloc_argcheck(
 	return 0;
 }
 
+/**
+ * pmd_obj_alloc_rsv_release() - release the erased zone reserves of a class
+ * @mp:
+ * @mc:    media class the allocation failed on
+ * @pdcnt: drives of the media class at the time of the allocation
+ *
+ * Return: true if zones were released, the allocation should be retried
+ */
+static bool
+pmd_obj_alloc_rsv_release(
+	struct mpool_descriptor    *mp,
+	struct media_class         *mc,
+	u8                          pdcnt)
+{
+	bool    released = false;
+	int     i;
+
+	for (i = 0; i < pdcnt; i++)
+		released |= dsched_rsv_release(mp, mc->mc_pdv[i]);
+
+	return released;
+}
+
+/**
+ * pmd_obj_alloc_wait() - wait for erased objects to free their zones
+ * @mp:
+ * @mc:       media class the allocation failed on
+ * @pdcnt:    drives of the media class at the time of the allocation
+ * @err:      error of the failed allocation
+ * @gen:      pds_erasegen sampled before the allocation
+ * @deadline: in jiffies, stop waiting by then
+ *
+ * An object delete frees its zones only once the object is erased by
+ * mperasewq, or discarded by the drive's discard scheduler. Wait for an
+ * erase to complete if some are pending on a drive of the media class, the
+ * allocation may succeed then.
+ *
+ * Return: true if the allocation should be retried
+ */
+static bool
+pmd_obj_alloc_wait(
+	struct mpool_descriptor    *mp,
+	struct media_class         *mc,
+	u8                          pdcnt,
+	merr_t                      err,
+	int                         gen,
+	unsigned long               deadline)
+{
+	bool    erasing = false;
+	long    tmo;
+	int     i;
+
+	if (merr_errno(err) != ENOSPC)
+		return false;
+
+	tmo = (long)(deadline - jiffies);
+	if (tmo <= 0)
+		return false;
+
+	/* Don't wait for the queued discards to be paced out. */
+	for (i = 0; i < pdcnt; i++) {
+		u16 pdh = mc->mc_pdv[i];
+
+		if (atomic_read(&mp->pds_pdv[pdh].pdi_erasing)) {
+			dsched_kick(mp, pdh);
+			erasing = true;
+		}
+	}
+
+	if (!erasing)
+		return false;
+
+	return wait_event_timeout(mp->pds_erasewq,
+				  atomic_read(&mp->pds_erasegen) != gen,
+				  tmo) > 0;
+}
+
 merr_t
 pmd_obj_alloc_cmn(
 	struct mpool_descriptor        *mp,
@@ -3056,11 +5218,13 @@ pmd_obj_alloc_cmn(
 	u64                     zcnt = 0;
 	struct pmd_mdc_info    *cinfo = NULL;
 	merr_t                  err;
-	int                     retries, flush;
+	unsigned long           deadline;
 	bool                    beffort, fallback;
 	u8                      cslot;
 	struct media_class     *mc;
 	struct mpool_uuid       uuid;
+	int                     gen;
+	u8                      pdcnt;
 
 	*layout = NULL;
 
@@ -3068,6 +5232,11 @@ pmd_obj_alloc_cmn(
 	if (ev(err))
 		return err;
 
+	/* Space allocation needs the space maps of all MDCs. */
+	err = pmd_mda_load_wait(mp);
+	if (ev(err))
+		return err;
+
 	if (!objid) {
 		/*
 		 * alloc: generate objid, checkpoint as needed to
@@ -3087,15 +5256,15 @@ pmd_obj_alloc_cmn(
 	mclassp = mpool_mc_first_get(mclassp);
 
 	/*
-	 * Retry from 1 to 2ms if fallback is requested, and if no fallback,
-	 * retry from 128 to 256ms with a flush every 1/8th of the retries.
-	 * This is a workaround for the async mblock trim problem.
+	 * Wait up to 2ms for erases to free space if fallback is requested,
+	 * and if no fallback, up to 256ms.
 	 */
 	fallback = (beffort && (mclassp < MP_MED_NUMBER - 1));
-	retries  = fallback ? 8 : 1024;
-	flush    = fallback ? 0 : retries >> 3;
+	deadline = jiffies + msecs_to_jiffies(fallback ? 2 : 256);
 
 retry:
+	gen = atomic_read(&mp->pds_erasegen);
+
 	down_read(&mp->pds_pdvlock);
 
 	do {
@@ -3133,26 +5302,23 @@ retry:
 		if (!err)
 			break;
 
+		pdcnt = mc->mc_pdcnt;
 		up_read(&mp->pds_pdvlock);
 
 		ecio_layout_free(*layout);
 		*layout = NULL;
 
-		/* TODO: Retry only if mperasewq is busy... */
-		if (retries-- > 0) {
-			usleep_range(128, 256);
-
-			if (flush && (retries % flush == 0))
-				flush_workqueue(mp->pds_erase_wq);
+		/* Give the erased zones kept for mlogs back to the smap. */
+		if (merr_errno(err) == ENOSPC &&
+		    pmd_obj_alloc_rsv_release(mp, mc, pdcnt))
+			goto retry;
 
+		if (pmd_obj_alloc_wait(mp, mc, pdcnt, err, gen, deadline))
 			goto retry;
-		}
 
 		if (beffort && ++mclassp < MP_MED_NUMBER) {
-			if (mclassp == MP_MED_NUMBER - 1) {
-				retries = 1024;
-				flush = retries >> 3;
-			}
+			if (mclassp == MP_MED_NUMBER - 1)
+				deadline = jiffies + msecs_to_jiffies(256);
 			goto retry;
 		}
 
@@ -3205,8 +5371,14 @@ retry:
 		struct ecio_layout_descriptor *dup;
 
 		dup = objid_to_layout_insert_mdc(&cinfo->mmi_uncobj, *layout);
-		if (dup)
+		if (dup) {
 			err = merr(EEXIST);
+		} else {
+			err = pmd_objht_insert(cinfo, *layout);
+			if (ev(err))
+				rb_erase(&(*layout)->eld_nodemdc,
+					 &cinfo->mmi_uncobj);
+		}
 	}
 	pmd_mdc_unlock(&cinfo->mmi_uncolock);
 
@@ -3674,19 +5846,26 @@ void pmd_mdc_alloc_set(struct mpool_descriptor *mp)
  *	need compaction of not.
  * @mp:
  * @cslot:
+ * @msgbuf:
+ * @msgsz:
+ * @livelen: if not NULL, set to the estimated bytes of live records
  *
  * The MDCi needs compaction if the active mlog is above some threshold and
  * if there is enough garbage (that can be eliminated by the compaction).
  *
+ * Returns the priority of the compaction, the sum of the fill and garbage
+ * percentages of the active mlog, or 0 if no compaction is needed.
+ *
  * Locking: not lock need to be held when calling this function.
  *	as a result of not holding lock the result may be off if a compaction
  *	of MDCi (with i = cslot) is taking place at the same time.
  */
-static bool pmd_need_compact(
+static u32 pmd_need_compact(
 	struct mpool_descriptor    *mp,
 	u8                          cslot,
 	char                       *msgbuf,
-	size_t                      msgsz)
+	size_t                      msgsz,
+	u64                        *livelen)
 {
 	struct pre_compact_ctrs    *pco_cnt;
 	struct pmd_mdc_info        *cinfo;
@@ -3701,7 +5880,7 @@ static bool pmd_need_compact(
 
 	cap = atomic64_read(&pco_cnt->pcc_cap);
 	if (cap == 0)
-		return false; /* MDC closed for now. */
+		return 0; /* MDC closed for now. */
 
 	len = atomic64_read(&pco_cnt->pcc_len);
 	rec = atomic_read(&pco_cnt->pcc_cr) +
@@ -3712,7 +5891,7 @@ static bool pmd_need_compact(
 
 	pct = (len * 100) / cap;
 	if (pct < mp->pds_params.mp_pcopctfull)
-		return false; /* Active mlog not filled enough */
+		return 0; /* Active mlog not filled enough */
 
 	if (rec > cobj) {
 		garbage = (rec - cobj) * 100;
@@ -3728,7 +5907,7 @@ static bool pmd_need_compact(
 	}
 
 	if (garbage < mp->pds_params.mp_pcopctgarbage)
-		return false; /* Insufficient garbage to compact */
+		return 0; /* Insufficient garbage to compact */
 
 	if (msgbuf)
 		snprintf(msgbuf, msgsz,
@@ -3736,67 +5915,161 @@ static bool pmd_need_compact(
 			 (ulong)len, (ulong)cap, pct, (ulong)rec,
 			 (ulong)cobj, garbage);
 
-	return true;
+	if (livelen)
+		*livelen = (len * (100 - garbage)) / 100;
+
+	return pct + garbage;
+}
+
+/**
+ * pmd_precompact_mdc() - precompact one mpool MDC
+ * @work:
+ *
+ * Queued by pmd_precompact(). Several of them, for different MDCs, may run
+ * in parallel.
+ */
+static void pmd_precompact_mdc(struct work_struct *work)
+{
+	struct pre_compact_ctrl    *pco;
+	struct mpool_descriptor    *mp;
+	struct pmd_mdc_info        *cinfo;
+	struct pmd_pco_work        *pcw;
+
+	char    msgbuf[128];
+	bool    compact;
+	u8      cslot;
+
+	pcw = container_of(work, struct pmd_pco_work, pcw_work);
+	mp = pcw->pcw_mp;
+	cslot = pcw->pcw_cslot;
+	cinfo = &mp->pds_mda.mdi_slotv[cslot];
+	pco = &mp->pds_pco;
+
+	/* Check a second time while we hold the compact lock
+	 * to avoid doing a useless compaction.
+	 */
+	pmd_mdc_lock(&cinfo->mmi_compactlock, cslot);
+	compact = pmd_need_compact(mp, cslot, msgbuf, sizeof(msgbuf), NULL);
+	if (compact)
+		pmd_mdc_compact(mp, cslot);
+	pmd_mdc_unlock(&cinfo->mmi_compactlock);
+
+	if (compact)
+		mp_pr_info("mpool %s, MDC%u %s",
+			   mp->pds_name, cslot, msgbuf);
+
+	atomic64_sub(pcw->pcw_len, &pco->pco_inflight);
+	WRITE_ONCE(pcw->pcw_len, 0);
+	atomic_dec(&pco->pco_njobs);
 }
 
 /**
- * pmd_precompact() - precompact an mpool MDC
+ * pmd_precompact() - precompact the mpool MDCs
  * @work:
  *
  * The goal of this thread is to minimize the application objects commit time.
  * This thread pre compacts the MDC1/255. As a consequence MDC1/255 compaction
  * does not occurs in the context of an application object commit.
+ *
+ * Every period all the MDCs are ranked by pmd_need_compact() and the worst
+ * ones are queued first, up to mp_pcojobs in parallel and as long as their
+ * live records fit in mp_pcobudget.
  */
 static void pmd_precompact(struct work_struct *work)
 {
 	struct pre_compact_ctrl    *pco;
 	struct mpool_descriptor    *mp;
 	struct pmd_mdc_info        *cinfo;
+	struct pmd_pco_work        *pcw;
 
-	char    msgbuf[128];
-	uint    nmtoc, delay;
-	bool    compact;
-	u8      cslot;
+	DECLARE_BITMAP(skip, MDC_SLOTS);
+
+	uint    delay, njobs, cslot, bestslot;
+	u32     prio, best;
+	u64     len, bestlen;
+	bool    first;
 
 	pco = container_of(work, typeof(*pco), pco_dwork.work);
 	mp = pco->pco_mp;
 
-	nmtoc = atomic_fetch_add(1, &pco->pco_nmtoc);
+	/*
+	 * Wait for a lazy activate to finish loading MDC1/255, and leave
+	 * the MDCs alone if that load failed.
+	 */
+	if (!READ_ONCE(mp->pds_mda.mdi_loaded) || pmd_objs_load_err(mp))
+		goto requeue;
 
-	/* Only compact MDC1/255 not MDC0. */
-	cslot = (nmtoc % (mp->pds_mda.mdi_slotvcnt - 1)) + 1;
+	njobs = clamp_t(uint, mp->pds_params.mp_pcojobs, 1, MDC_SLOTS - 1);
+	bitmap_zero(skip, MDC_SLOTS);
+	first = true;
 
-	/* Check if the next mpool mdc to compact needs compaction.
+	/* Check which mpool MDCs need compaction, the worst first.
 	 *
 	 * Note that this check is done without taking any lock.
 	 * This is safe because the mpool MDCs don't go away as long as
 	 * the mpool is activated. The mpool can't deactivate before
 	 * this thread exit.
 	 */
-	compact = pmd_need_compact(mp, cslot, NULL, 0);
-	if (compact) {
-		cinfo = &mp->pds_mda.mdi_slotv[cslot];
+	while (atomic_read(&pco->pco_njobs) < njobs) {
+		best = 0;
+		bestslot = 0;
+		bestlen = 0;
+
+		/* Only compact MDC1/255 not MDC0. */
+		for (cslot = 1; cslot < mp->pds_mda.mdi_slotvcnt; cslot++) {
+			if (test_bit(cslot, skip))
+				continue;
 
-		/* Check a second time while we hold the compact lock
-		 * to avoid doing a useless compaction.
-		 */
-		pmd_mdc_lock(&cinfo->mmi_compactlock, cslot);
-		compact = pmd_need_compact(mp, cslot, msgbuf, sizeof(msgbuf));
-		if (compact)
-			pmd_mdc_compact(mp, cslot);
-		pmd_mdc_unlock(&cinfo->mmi_compactlock);
+			/* Already queued or running, or failed to load */
+			cinfo = &mp->pds_mda.mdi_slotv[cslot];
+			if (READ_ONCE(cinfo->mmi_pcow.pcw_len) ||
+			    READ_ONCE(cinfo->mmi_loaderr)) {
+				__set_bit(cslot, skip);
+				continue;
+			}
+
+			prio = pmd_need_compact(mp, cslot, NULL, 0, &len);
+			if (prio > best) {
+				best = prio;
+				bestslot = cslot;
+				bestlen = len;
+			}
+		}
+
+		if (!bestslot)
+			break;
 
-		if (compact)
-			mp_pr_info("mpool %s, MDC%u %s",
-				   mp->pds_name, cslot, msgbuf);
+		__set_bit(bestslot, skip);
+
+		if (atomic_read(&pco->pco_njobs) > 0 &&
+		    atomic64_read(&pco->pco_inflight) + bestlen >
+		    mp->pds_params.mp_pcobudget)
+			break;
+
+		/* Keep new allocations away from the worst MDC. */
+		if (first)
+			atomic_set(&pco->pco_nmtoc, bestslot - 1);
+		first = false;
+
+		pcw = &mp->pds_mda.mdi_slotv[bestslot].mmi_pcow;
+		pcw->pcw_len = max_t(u64, bestlen, 1);
+
+		atomic64_add(pcw->pcw_len, &pco->pco_inflight);
+		atomic_inc(&pco->pco_njobs);
+		queue_work(mp->pds_workq, &pcw->pcw_work);
 	}
 
+	/* No MDC needs compaction, rotate the MDCs kept from allocation. */
+	if (first)
+		atomic_inc(&pco->pco_nmtoc);
+
 	/* If running low on MDC space create new MDCs */
 	if (pmd_mdc_needed(mp))
 		pmd_mdc_alloc_set(mp);
 
 	pmd_update_credit(mp);
 
+requeue:
 	delay = clamp_t(uint, mp->pds_params.mp_pcoperiod, 1, 3600);
 
 	queue_delayed_work(mp->pds_workq, &pco->pco_dwork,
@@ -3810,6 +6083,8 @@ void pmd_precompact_start(struct mpool_descriptor *mp)
 	pco = &mp->pds_pco;
 	pco->pco_mp = mp;
 	atomic_set(&pco->pco_nmtoc, 0);
+	atomic_set(&pco->pco_njobs, 0);
+	atomic64_set(&pco->pco_inflight, 0);
 
 	INIT_DELAYED_WORK(&pco->pco_dwork, pmd_precompact);
 	queue_delayed_work(mp->pds_workq, &pco->pco_dwork, 1);
@@ -3817,7 +6092,13 @@ void pmd_precompact_start(struct mpool_descriptor *mp)
 
 void pmd_precompact_stop(struct mpool_descriptor *mp)
 {
+	uint cslot;
+
 	cancel_delayed_work_sync(&mp->pds_pco.pco_dwork);
+
+	/* Wait for the MDC pre-compactions queued by pmd_precompact(). */
+	for (cslot = 1; cslot < mp->pds_mda.mdi_slotvcnt; cslot++)
+		flush_work(&mp->pds_mda.mdi_slotv[cslot].mmi_pcow.pcw_work);
 }
 
 /*
@@ -213,14 +213,48 @@ struct pmd_mdc_stats {
 	u32    pms_mlog_cnt;
 };
 
+/**
+ * struct pmd_idckpt_work - objid checkpoint refill work item
+ * @ckw_work:  work struct, queued on pds_workq
+ * @ckw_mp:    mpool descriptor
+ * @ckw_cslot: MDC slot to refill
+ */
+struct pmd_idckpt_work {
+	struct work_struct          ckw_work;
+	struct mpool_descriptor    *ckw_mp;
+	u8                          ckw_cslot;
+};
+
+/**
+ * struct pmd_pco_work - MDC pre-compaction work item
+ * @pcw_work:  work struct, queued on pds_workq
+ * @pcw_mp:    mpool descriptor
+ * @pcw_len:   bytes charged to pco_inflight, 0 if not queued
+ * @pcw_cslot: MDC slot to compact
+ */
+struct pmd_pco_work {
+	struct work_struct          pcw_work;
+	struct mpool_descriptor    *pcw_mp;
+	u64                         pcw_len;
+	u8                          pcw_cslot;
+};
+
 /**
  * struct pmd_mdc_info - Metadata container (mdc) info.
  * @mmi_compactlock:    compaction lock
  * @mmi_uqlock:         uniquifier lock
  * @mmi_colock:         committed objid index lock
  * @mmi_uncolock:       uncommitted objid index lock
- * @mmi_reflock :       ref count lock for all obj in mdc
+ * @mmi_objht:          RCU-readable index of both committed and uncommitted
+ *                      objects, keyed by objid
+ * @mmi_objht_init:     true once mmi_objht has been initialized
+ * @mmi_loadlock:       serializes the load of the MDC's objects
+ * @mmi_loaded:         true once the MDC's objects are loaded
+ * @mmi_loaderr:        result of loading the MDC's objects
  * @mmi_luniq:          uniquifier of last object assigned to container
+ * @mmi_ckptmax:        highest uniquifier covered by a durable objid
+ *                      checkpoint
+ * @mmi_ckptw:          objid checkpoint refill work
  * @mmi_mdc:            MDC implementing container
  * @mmi_recbuf:         buffer for (un)packing log records
  * @mmi_lckpt:          last objid checkpointed
@@ -234,19 +268,32 @@ struct pmd_mdc_stats {
  * @mmi_stats:          per-MDC usage stats
  * @mmi_stats_lock:     lock for protecting mmi_stats
  * @mmi_pco_cnt:        counters used by the pre compaction of MDC1/255.
+ * @mmi_pcow:           pre-compaction work
  * @mmi_mdccver:        version of the mdc content on media when the mpool
  *			was activated. That may not be the current version
  *			on media if a MDC metadata conversion took place
  *			during activate.
  * @mmi_credit          MDC credit info
+ * @mmi_osnap:          extent of the object table snapshot referenced by the
+ *                      active mlog, ol_zcnt is 0 if there is none
+ * @mmi_txnlock:        serializes multi-object transactions
+ * @mmi_gclock:         group commit lock
+ * @mmi_gcq:            object commits waiting to be logged by the group
+ *                      commit leader
+ * @mmi_gcleader:       true while a group commit leader is logging commits
+ * @mmi_gcwq:           group commit followers wait here
  *
  * LOCKING:
- * + mmi_luniq: protected by uqlock
- * + mmi_mdc, recbuf, lckpt: protected by compactlock
+ * + mmi_luniq: atomic; only set under uqlock for mdc0
+ * + mmi_lckpt, mmi_ckptmax: updated under uqlock and compactlock
+ * + mmi_mdc, recbuf, lckpt, osnap: protected by compactlock
  * + mmi_obj: protected by colock
  * + mmi_uncobj: protected by uncolock
+ * + mmi_objht: updates are serialized internally; lookups hold
+ *   rcu_read_lock() and take the ref before dropping it
  * + mmi_stats: protected by mmi_stats_lock
  * + mmi_pco_counters: updates serialized by mmi_compactlock
+ * + mmi_gcq, mmi_gcleader: protected by mmi_gclock
  *
  * NOTE:
  *  + for mdc0 mmi_luniq is the slot # of the last mdc created
@@ -268,7 +315,6 @@ struct pmd_mdc_stats {
  */
 struct pmd_mdc_info {
 	struct mutex            mmi_compactlock;
-	struct mutex            mmi_reflock;
 
 	struct rw_semaphore     mmi_colock;
 	struct rb_root          mmi_obj;
@@ -279,19 +325,41 @@ struct pmd_mdc_info {
 
 	____cacheline_aligned
 	struct mutex            mmi_uqlock;
-	u64                     mmi_luniq;
+	atomic64_t              mmi_luniq;
+	atomic64_t              mmi_ckptmax;
 	u64                     mmi_lckpt;
 	struct mp_mdc          *mmi_mdc;
 	char                   *mmi_recbuf;
 
 	struct omf_mdccver      mmi_mdccver;
 	struct credit_info      mmi_credit;
+	struct omf_layout_descriptor mmi_osnap;
 
 	____cacheline_aligned
 	struct mutex            mmi_stats_lock;
 	struct pmd_mdc_stats    mmi_stats;
 
 	struct pre_compact_ctrs mmi_pco_cnt;
+	struct pmd_pco_work     mmi_pcow;
+
+	____cacheline_aligned
+	struct mutex            mmi_txnlock;
+	spinlock_t              mmi_gclock;
+	struct list_head        mmi_gcq;
+	bool                    mmi_gcleader;
+	wait_queue_head_t       mmi_gcwq;
+
+	struct pmd_idckpt_work  mmi_ckptw;
+
+#ifdef ECIO_HAVE_RHASHTABLE
+	____cacheline_aligned
+	struct rhashtable       mmi_objht;
+#endif
+	bool                    mmi_objht_init;
+
+	struct mutex            mmi_loadlock;
+	bool                    mmi_loaded;
+	merr_t                  mmi_loaderr;
 };
 
 /**
@@ -325,9 +393,22 @@ struct pmd_mdc_selector {
  * @mdi_slotvcnt:    number of active slotv entries
  * @mdi_slotv:       per mdc info
  * @mdi_sel:         MDC allocation selector
+ * @mdi_loaded:      true once all MDCs are loaded; allocations wait on it
+ * @mdi_loadstop:    set on deactivate to stop the background MDC load
+ * @mdi_loaderr:     first error of the background MDC load
+ * @mdi_loadwq:      waiters for mdi_loaded
+ * @mdi_loadstart:   jiffies at activate start, for instrumentation
+ * @mdi_loadprog:    next MDC for the background load workers
+ * @mdi_loadjobs:    number of running background load workers
+ * @mdi_ondemand:    number of MDCs loaded on demand
+ * @mdi_olwv:        background load work items
+ * @mdi_smapckpt:    space map checkpoint found in MDC0 at activation, its
+ *	omd_ld.ol_zcnt is 0 if none; only used during activation
  *
  * LOCKING:
  *  + mdi_lslot, mdi_slotvcnt, mdi_slotvcnt_shift: protected by mdi_slotvlock
+ *  + mdi_loaded, mdi_loaderr: written once by the last background load
+ *    worker, then mdi_loadwq is woken
  *
  * NOTE:
  *  + mdi_slotvcnt only ever increases so mdi_slotv[x], x < mdi_slotvcnt, is
@@ -343,6 +424,17 @@ struct pmd_mda_info {
 
 	struct pmd_mdc_info     mdi_slotv[MDC_SLOTS];
 	struct pmd_mdc_selector mdi_sel;
+
+	bool                    mdi_loaded;
+	bool                    mdi_loadstop;
+	merr_t                  mdi_loaderr;
+	wait_queue_head_t       mdi_loadwq;
+	unsigned long           mdi_loadstart;
+	atomic_t                mdi_loadprog;
+	atomic_t                mdi_loadjobs;
+	atomic_t                mdi_ondemand;
+	struct pmd_obj_load_work *mdi_olwv;
+	struct smap_ckpt        mdi_smapckpt;
 };
 
 /**
@@ -384,6 +476,32 @@ struct pmd_obj_load_work {
 #define OBJID_UNIQ_POW2 8
 #define OBJID_UNIQ_DELTA (1 << OBJID_UNIQ_POW2)
 
+/*
+ * objid uniquifier low watermark; once fewer uniquifiers than this remain in
+ * the checkpointed range the next range is checkpointed asynchronously
+ */
+#define OBJID_UNIQ_LOWAT (OBJID_UNIQ_DELTA / 4)
+
+/*
+ * Number of committed object records that MDC compaction packs into one
+ * buffer and appends with a single mp_mdc_append_batch() call.
+ */
+#define PMD_COMPACT_BATCH 128
+
+/*
+ * Minimum number of mblocks for which the compaction of an MDCi i>0 writes
+ * them to an object table snapshot instead of logging an OCREATE record for
+ * each. The snapshot is written and read PMD_OSNAP_IOPG pages at a time.
+ */
+#define PMD_OSNAP_MIN     1024
+#define PMD_OSNAP_IOPG    32
+
+/*
+ * Minimum number of objects in the MDCs for which a clean deactivation
+ * checkpoints the free extents of the space maps, see pmd_mpool_smap_ckpt().
+ */
+#define PMD_SMAPCKPT_MIN  1024
+
 static inline bool objtype_user(enum obj_type_omf otype)
 {
 	return (otype == OMF_OBJ_MBLOCK || otype == OMF_OBJ_MLOG);
@@ -485,6 +603,19 @@ pmd_mpool_activate(
  */
 void pmd_mpool_deactivate(struct mpool_descriptor *mp);
 
+/**
+ * pmd_mpool_smap_ckpt() - checkpoint the space maps of mpool mp
+ * @mp:
+ *
+ * Called by a clean deactivation, once all the objects freed are released
+ * to the space maps and before pmd_mpool_deactivate(). Writes the free
+ * extents of all drives next to MDC0 and logs their location in MDC0, so
+ * that the next activation builds the space maps from them. Nothing is
+ * written if the MDCs are not all loaded or hold less than PMD_SMAPCKPT_MIN
+ * objects; a failure only costs the next activation its shortcut.
+ */
+void pmd_mpool_smap_ckpt(struct mpool_descriptor *mp);
+
 /**
  * pmd_obj_alloc() - Allocate an object.
  * @mp:
@@ -582,6 +713,33 @@ pmd_obj_delete(
 	struct mpool_descriptor        *mp,
 	struct ecio_layout_descriptor  *layout);
 
+/**
+ * pmd_obj_txn() - Commit and delete a set of objects as one unit.
+ * @mp:
+ * @cmtv: uncommitted objects to commit
+ * @cmtc: number of objects in cmtv
+ * @delv: committed objects to delete
+ * @delc: number of objects in delv
+ *
+ * The create and delete records are logged in a single atomic flush set of
+ * the objects' MDC with a single sync. Replay drops an atomic flush set of
+ * which not all log blocks reached the media, so after a crash either all
+ * or none of the commits and deletes took effect. All the objects must
+ * belong to the same MDC. Caller MUST NOT hold pmd_obj_*lock() on any of
+ * the layouts; if successful the layouts in delv are invalid.
+ *
+ * Return: %0 if successful, merr_t otherwise
+ * EXDEV if the objects don't all belong to the same MDC
+ * E2BIG if the records don't fit in a flush set
+ */
+merr_t
+pmd_obj_txn(
+	struct mpool_descriptor        *mp,
+	struct ecio_layout_descriptor **cmtv,
+	u32                             cmtc,
+	struct ecio_layout_descriptor **delv,
+	u32                             delc);
+
 /**
  * pmd_obj_erase() -
  * @mp:
@@ -875,6 +1033,27 @@ void pmd_precompact_start(struct mpool_descriptor *mp);
  */
 void pmd_precompact_stop(struct mpool_descriptor *mp);
 
+/**
+ * pmd_objs_load_stop() - stop the background load of MDC1/255
+ * @mp:
+ *
+ * Only needed for an mpool activated with MP_FLAGS_LAZY_LOAD. The load
+ * workers stop at the next MDC; the caller then drains pds_workq.
+ */
+void pmd_objs_load_stop(struct mpool_descriptor *mp);
+
+/**
+ * pmd_objs_load_err() - result of the background load of MDC1/255
+ * @mp:
+ *
+ * Once the background load of an mpool activated with MP_FLAGS_LAZY_LOAD
+ * failed, the mpool is faulted: object and MDC allocation fail with this
+ * error until the mpool is deactivated and activated again.
+ *
+ * Return: 0 if the load succeeded, is still running, or wasn't needed
+ */
+merr_t pmd_objs_load_err(struct mpool_descriptor *mp);
+
 /*
  * pmd_precompact_alsz() - Inform MDC1/255 pre-compacting about the active
  *	mlog of an mpool MDCi 0<i<=255.
@@ -611,6 +611,7 @@ void sbutil_mdc0_clear(struct omf_sb_descriptor *sb)
 	sb->osb_mdc0dev.odp_zonetot = 0;
 	sb->osb_mdc0dev.odp_zonepg = 0;
 	sb->osb_mdc0dev.odp_mclassp = 0;
+	sb->osb_mdc0dev.odp_mcord = 0;
 	sb->osb_mdc0dev.odp_devtype = 0;
 	sb->osb_mdc0dev.odp_sectorsz = 0;
 	sb->osb_mdc0dev.odp_features = 0;
@@ -658,6 +659,7 @@ sbutil_mdc0_copy(
 	tgtsb->osb_mdc0dev.odp_zonetot  = srcsb->osb_mdc0dev.odp_zonetot;
 	tgtsb->osb_mdc0dev.odp_zonepg   = srcsb->osb_mdc0dev.odp_zonepg;
 	tgtsb->osb_mdc0dev.odp_mclassp  = srcsb->osb_mdc0dev.odp_mclassp;
+	tgtsb->osb_mdc0dev.odp_mcord    = srcsb->osb_mdc0dev.odp_mcord;
 	tgtsb->osb_mdc0dev.odp_devtype  = srcsb->osb_mdc0dev.odp_devtype;
 	tgtsb->osb_mdc0dev.odp_sectorsz = srcsb->osb_mdc0dev.odp_sectorsz;
 	tgtsb->osb_mdc0dev.odp_features = srcsb->osb_mdc0dev.odp_features;
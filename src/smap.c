@@ -9,10 +9,841 @@
  */
 
 #include <linux/log2.h>
+#include <linux/sort.h>
 #include <linux/delay.h>
+#include <linux/bitmap.h>
+#include <linux/vmalloc.h>
+#include <linux/rbtree_augmented.h>
 
 #include "mpcore_defs.h"
 
+/*
+ * Free extent trees.
+ *
+ * Each region's free extents are kept in an rbtree keyed by zone address
+ * (utu_key) whose nodes are augmented with the largest extent length
+ * (utu_value) in their subtree (utu_max). That lets smap_alloc() skip any
+ * subtree without an extent big enough for the request. All insertions
+ * into and removals from these trees must go through smap_rb_insert() and
+ * smap_rb_erase() to keep utu_max, and the region's free zone count and
+ * extent size histogram, up to date.
+ */
+
+static inline u64 smap_rb_max(struct rb_node *node)
+{
+	if (!node)
+		return 0;
+
+	return rb_entry(node, struct u64_to_u64_rb, utu_node)->utu_max;
+}
+
+static inline u64 smap_rb_compute_max(struct u64_to_u64_rb *elem)
+{
+	u64 max = elem->utu_value;
+
+	max = max_t(u64, max, smap_rb_max(elem->utu_node.rb_left));
+	max = max_t(u64, max, smap_rb_max(elem->utu_node.rb_right));
+
+	return max;
+}
+
+static void smap_rb_propagate(struct rb_node *node, struct rb_node *stop)
+{
+	struct u64_to_u64_rb *elem;
+	u64                   max;
+
+	while (node != stop) {
+		elem = rb_entry(node, struct u64_to_u64_rb, utu_node);
+
+		max = smap_rb_compute_max(elem);
+		if (elem->utu_max == max)
+			break;
+
+		elem->utu_max = max;
+		node = rb_parent(&elem->utu_node);
+	}
+}
+
+static void smap_rb_copy(struct rb_node *old, struct rb_node *new)
+{
+	rb_entry(new, struct u64_to_u64_rb, utu_node)->utu_max =
+		rb_entry(old, struct u64_to_u64_rb, utu_node)->utu_max;
+}
+
+static void smap_rb_rotate(struct rb_node *old, struct rb_node *new)
+{
+	struct u64_to_u64_rb *oelem;
+
+	oelem = rb_entry(old, struct u64_to_u64_rb, utu_node);
+
+	rb_entry(new, struct u64_to_u64_rb, utu_node)->utu_max = oelem->utu_max;
+	oelem->utu_max = smap_rb_compute_max(oelem);
+}
+
+static const struct rb_augment_callbacks smap_rb_augment = {
+	.propagate = smap_rb_propagate,
+	.copy      = smap_rb_copy,
+	.rotate    = smap_rb_rotate,
+};
+
+static inline uint smap_hist_bkt(u64 zonecnt)
+{
+	return min_t(uint, ilog2(zonecnt), MP_FRAG_NBKT - 1);
+}
+
+static void smap_rb_account(struct rmbkt *rb, u64 zonecnt, bool add)
+{
+	uint bkt = smap_hist_bkt(zonecnt);
+
+	if (add) {
+		rb->pdi_rmfree += zonecnt;
+		rb->pdi_rmextc++;
+		rb->pdi_rmhist[bkt]++;
+	} else {
+		rb->pdi_rmfree -= zonecnt;
+		rb->pdi_rmextc--;
+		rb->pdi_rmhist[bkt]--;
+	}
+}
+
+/**
+ * smap_rb_insert() - insert a free extent in a region's tree
+ * @rb:
+ * @data:
+ *
+ * Return: true on success else false, as u64_to_u64_insert().
+ */
+static bool smap_rb_insert(struct rmbkt *rb, struct u64_to_u64_rb *data)
+{
+	struct rb_root     *root = &rb->pdi_rmroot;
+	struct rb_node    **new = &(root->rb_node), *parent = NULL;
+
+	data->utu_max = data->utu_value;
+
+	while (*new) {
+		struct u64_to_u64_rb *this =
+			rb_entry(*new, struct u64_to_u64_rb, utu_node);
+
+		if (data->utu_key == this->utu_key)
+			break;
+
+		parent = *new;
+		if (this->utu_max < data->utu_value)
+			this->utu_max = data->utu_value;
+
+		if (data->utu_key < this->utu_key)
+			new = &((*new)->rb_left);
+		else
+			new = &((*new)->rb_right);
+	}
+
+	if (*new) {
+		/* Undo the utu_max updates made on the way down. */
+		smap_rb_propagate(parent, NULL);
+		return false;
+	}
+
+	rb_link_node(&data->utu_node, parent, new);
+	rb_insert_augmented(&data->utu_node, root, &smap_rb_augment);
+	smap_rb_account(rb, data->utu_value, true);
+
+	return true;
+}
+
+static void smap_rb_erase(struct rmbkt *rb, struct u64_to_u64_rb *elem)
+{
+	smap_rb_account(rb, elem->utu_value, false);
+	rb_erase_augmented(&elem->utu_node, &rb->pdi_rmroot, &smap_rb_augment);
+}
+
+/**
+ * smap_rb_first_fit() - find the lowest free extent fitting an allocation
+ * @root:
+ * @zonecnt: number of zones to allocate
+ * @align:   required alignment of the first zone, a power of 2
+ * @ualen:   set to the number of zones skipped to align the allocation
+ *
+ * Only subtrees whose utu_max is at least zonecnt are visited, so without
+ * alignment constraint the search is O(log n). Misaligned extents that turn
+ * out too short only cost a walk to the next candidate subtree.
+ */
+static struct u64_to_u64_rb *
+smap_rb_first_fit(struct rb_root *root, u64 zonecnt, u64 align, u64 *ualen)
+{
+	struct u64_to_u64_rb   *elem;
+	struct rb_node         *node, *parent;
+	bool                    up = false;
+
+	if (smap_rb_max(root->rb_node) < zonecnt)
+		return NULL;
+
+	node = root->rb_node;
+
+	while (node) {
+		/* Lower addresses first. */
+		if (!up && smap_rb_max(node->rb_left) >= zonecnt) {
+			node = node->rb_left;
+			continue;
+		}
+
+		elem = rb_entry(node, struct u64_to_u64_rb, utu_node);
+		if (elem->utu_value >= zonecnt) {
+			*ualen = ALIGN(elem->utu_key, align) - elem->utu_key;
+			if (*ualen + zonecnt <= elem->utu_value)
+				return elem;
+		}
+
+		if (smap_rb_max(node->rb_right) >= zonecnt) {
+			node = node->rb_right;
+			up = false;
+			continue;
+		}
+
+		/* Climb to the next node in address order. */
+		while ((parent = rb_parent(node)) && node == parent->rb_right)
+			node = parent;
+
+		node = parent;
+		up = true;
+	}
+
+	return NULL;
+}
+
+/*
+ * Bitmap space maps.
+ *
+ * The regions of the media classes with mcsp_bitmap set track their zones
+ * in a bitmap instead of an extent tree, one bit per zone, set if the zone
+ * is allocated. It costs a fixed bit per zone whatever the fragmentation,
+ * needs no allocation to split or merge free space, and is built with one
+ * vzalloc() per region. Free runs are found a word at a time by
+ * find_next_zero_bit() and find_next_bit().
+ */
+
+/**
+ * smap_bm_first_fit() - find the lowest free run fitting an allocation
+ * @rb:
+ * @zonecnt:  number of zones to allocate
+ * @align:    required alignment of the first zone, a power of 2
+ * @zoneaddr: set to the first zone of the run
+ *
+ * Return: true if a run was found
+ */
+static bool
+smap_bm_first_fit(struct rmbkt *rb, u64 zonecnt, u64 align, u64 *zoneaddr)
+{
+	ulong   start = 0;
+	ulong   next;
+	u64     end;
+
+	if (rb->pdi_rmfree < zonecnt)
+		return false;
+
+	while (1) {
+		start = find_next_zero_bit(rb->pdi_rmbits, rb->pdi_rmnbits,
+					   start);
+		start = ALIGN(rb->pdi_rmbase + start, align) - rb->pdi_rmbase;
+
+		end = start + zonecnt;
+		if (end > rb->pdi_rmnbits)
+			return false;
+
+		/* Skip past the first allocated zone within the run, if any. */
+		next = find_next_bit(rb->pdi_rmbits, end, start);
+		if (next >= end)
+			break;
+
+		start = next + 1;
+	}
+
+	*zoneaddr = rb->pdi_rmbase + start;
+
+	return true;
+}
+
+/**
+ * smap_free_acct() - account for zones freed to a space map
+ * @pd:
+ * @zonecnt:
+ *
+ * Freed space goes to spare first then usable.
+ */
+static void smap_free_acct(struct mpool_dev_info *pd, u32 zonecnt)
+{
+	spin_lock(&pd->pdi_ds.sda_dalock);
+	if (pd->pdi_ds.sda_sact > 0) {
+		if (pd->pdi_ds.sda_sact > zonecnt) {
+			pd->pdi_ds.sda_sact -= zonecnt;
+			zonecnt = 0;
+		} else {
+			zonecnt -= pd->pdi_ds.sda_sact;
+			pd->pdi_ds.sda_sact = 0;
+		}
+	}
+
+	pd->pdi_ds.sda_uact -= zonecnt;
+	spin_unlock(&pd->pdi_ds.sda_dalock);
+}
+
+/*
+ * Bitmap flavor of smap_insert_byrgn().
+ */
+static merr_t
+smap_bm_insert_byrgn(
+	struct mpool_dev_info  *pd,
+	u32                     rgn,
+	u64                     zoneaddr,
+	u32                     zonecnt)
+{
+	struct rmbkt   *rb = &pd->pdi_rmbktv[rgn];
+	merr_t          err = 0;
+	ulong           off, end;
+
+	mutex_lock(&rb->pdi_rmlock);
+
+	off = zoneaddr - rb->pdi_rmbase;
+	end = off + zonecnt;
+
+	if (zoneaddr < rb->pdi_rmbase || end > rb->pdi_rmnbits ||
+	    find_next_bit(rb->pdi_rmbits, end, off) < end) {
+		err = merr(EINVAL);
+		goto errout;
+	}
+
+	bitmap_set(rb->pdi_rmbits, off, zonecnt);
+	rb->pdi_rmfree -= zonecnt;
+
+	/* Insert consumes usable only; possible for uact > utgt. */
+	spin_lock(&pd->pdi_ds.sda_dalock);
+	pd->pdi_ds.sda_uact = pd->pdi_ds.sda_uact + zonecnt;
+	spin_unlock(&pd->pdi_ds.sda_dalock);
+
+errout:
+	mutex_unlock(&rb->pdi_rmlock);
+
+	if (err)
+		mp_pr_err("smap pd %s: requested range not free, rgn %u zoneaddr %lu zonecnt %u",
+			  err, pd->pdi_name, rgn, (ulong)zoneaddr, zonecnt);
+
+	return err;
+}
+
+/*
+ * Bitmap flavor of smap_free_byrgn().
+ */
+static merr_t
+smap_bm_free_byrgn(
+	struct mpool_dev_info  *pd,
+	u32                     rgn,
+	u64                     zoneaddr,
+	u32                     zonecnt)
+{
+	struct rmbkt   *rb = &pd->pdi_rmbktv[rgn];
+	merr_t          err = 0;
+	ulong           off, end;
+
+	mutex_lock(&rb->pdi_rmlock);
+
+	off = zoneaddr - rb->pdi_rmbase;
+	end = off + zonecnt;
+
+	if (zoneaddr < rb->pdi_rmbase || end > rb->pdi_rmnbits ||
+	    find_next_zero_bit(rb->pdi_rmbits, end, off) < end) {
+		err = merr(ev(EINVAL));
+		goto unlock;
+	}
+
+	bitmap_clear(rb->pdi_rmbits, off, zonecnt);
+	rb->pdi_rmfree += zonecnt;
+
+	smap_free_acct(pd, zonecnt);
+
+unlock:
+	mutex_unlock(&rb->pdi_rmlock);
+
+	if (err)
+		mp_pr_err("smap pd %s: range not allocated, free byrgn failed, rgn %u zoneaddr %lu zonecnt %u",
+			  err, pd->pdi_name, rgn, (ulong)zoneaddr, zonecnt);
+
+	return err;
+}
+
+
+/*
+ * Bulk build.
+ *
+ * Activation used to carve each loaded object out of the space maps with
+ * a tree search and split per object. Instead smap_insert() stages the
+ * extents while the MDCs load, and smap_mpool_bulk_end() sorts them and
+ * produces each region's free extents in address order. These are linked
+ * as the rightmost node of a new tree, without descent or augmentation,
+ * and utu_max is computed once the tree is complete.
+ */
+
+static void smap_bulk_free(struct smap_bulk *bulk)
+{
+	if (!bulk)
+		return;
+
+	vfree(bulk->smb_freev);
+	vfree(bulk->smb_extv);
+	kfree(bulk);
+}
+
+/*
+ * Appends an extent to an array of staged extents, which doubles when full.
+ */
+static merr_t
+smap_bext_push(
+	struct smap_bext  **extvp,
+	u64                *cnt,
+	u64                *max,
+	u64                 zoneaddr,
+	u32                 zonecnt)
+{
+	struct smap_bext   *extv;
+	u64                 newmax;
+
+	if (*cnt == *max) {
+		newmax = *max ? 2 * *max : SMAP_BULK_INIT;
+
+		extv = vmalloc(newmax * sizeof(*extv));
+		if (!extv)
+			return merr(ENOMEM);
+
+		if (*extvp)
+			memcpy(extv, *extvp, *cnt * sizeof(*extv));
+		vfree(*extvp);
+
+		*extvp = extv;
+		*max = newmax;
+	}
+
+	(*extvp)[*cnt].sbe_zaddr = zoneaddr;
+	(*extvp)[*cnt].sbe_zcnt = zonecnt;
+	(*cnt)++;
+
+	return 0;
+}
+
+static merr_t smap_bulk_add(struct smap_bulk *bulk, u64 zoneaddr, u32 zonecnt)
+{
+	merr_t err;
+
+	mutex_lock(&bulk->smb_lock);
+	err = smap_bext_push(&bulk->smb_extv, &bulk->smb_cnt, &bulk->smb_max,
+			     zoneaddr, zonecnt);
+	mutex_unlock(&bulk->smb_lock);
+
+	return err;
+}
+
+/*
+ * Removes a staged extent freed before the bulk build, e.g. an orphan MDC
+ * mlog deleted by pmd_mdc0_validate(). Staged extents are not charged to
+ * sda_uact yet, so there is nothing to account.
+ */
+static bool smap_bulk_del(struct smap_bulk *bulk, u64 zoneaddr, u32 zonecnt)
+{
+	struct smap_bext   *ext;
+	bool                found = false;
+	u64                 i;
+
+	mutex_lock(&bulk->smb_lock);
+
+	for (i = bulk->smb_cnt; i > 0; i--) {
+		ext = &bulk->smb_extv[i - 1];
+
+		if (ext->sbe_zaddr == zoneaddr && ext->sbe_zcnt == zonecnt) {
+			*ext = bulk->smb_extv[--bulk->smb_cnt];
+			found = true;
+			break;
+		}
+	}
+
+	mutex_unlock(&bulk->smb_lock);
+
+	return found;
+}
+
+static int smap_bext_cmp(const void *a, const void *b)
+{
+	const struct smap_bext *lhs = a;
+	const struct smap_bext *rhs = b;
+
+	if (lhs->sbe_zaddr < rhs->sbe_zaddr)
+		return -1;
+
+	return lhs->sbe_zaddr > rhs->sbe_zaddr;
+}
+
+static u64 smap_rb_build_max(struct rmbkt *rb, struct rb_node *node)
+{
+	struct u64_to_u64_rb   *elem;
+	u64                     max;
+
+	if (!node)
+		return 0;
+
+	elem = rb_entry(node, struct u64_to_u64_rb, utu_node);
+	smap_rb_account(rb, elem->utu_value, true);
+
+	max = smap_rb_build_max(rb, node->rb_left);
+	max = max_t(u64, max, elem->utu_value);
+	max = max_t(u64, max, smap_rb_build_max(rb, node->rb_right));
+	elem->utu_max = max;
+
+	return max;
+}
+
+static void smap_rb_free_all(struct rb_node *node)
+{
+	if (!node)
+		return;
+
+	smap_rb_free_all(node->rb_left);
+	smap_rb_free_all(node->rb_right);
+	kmem_cache_free(u64_to_u64_rb_cache,
+			rb_entry(node, struct u64_to_u64_rb, utu_node));
+}
+
+static merr_t
+smap_bulk_append(
+	struct rb_root     *root,
+	struct rb_node    **tail,
+	u64                 zoneaddr,
+	u64                 zonecnt)
+{
+	struct u64_to_u64_rb *elem;
+
+	elem = kmem_cache_alloc(u64_to_u64_rb_cache, GFP_KERNEL);
+	if (!elem)
+		return merr(ENOMEM);
+
+	elem->utu_key = zoneaddr;
+	elem->utu_value = zonecnt;
+
+	if (*tail)
+		rb_link_node(&elem->utu_node, *tail, &(*tail)->rb_right);
+	else
+		rb_link_node(&elem->utu_node, NULL, &root->rb_node);
+
+	rb_insert_color(&elem->utu_node, root);
+	*tail = &elem->utu_node;
+
+	return 0;
+}
+
+/**
+ * smap_bulk_build_rgn() - carve sorted extents from a region's space map
+ * @pd:
+ * @rgn:
+ * @extv: extents of @rgn sorted by address
+ * @n:    number of extents in @extv
+ *
+ * On failure the extent tree or bitmap of the region is left unchanged.
+ */
+static merr_t
+smap_bulk_build_rgn(
+	struct mpool_dev_info  *pd,
+	u32                     rgn,
+	struct smap_bext       *extv,
+	u64                     n)
+{
+	struct rmbkt           *rb = &pd->pdi_rmbktv[rgn];
+	struct u64_to_u64_rb   *elem;
+	struct rb_node         *node, *tail = NULL;
+	struct rb_root          root = RB_ROOT;
+	struct smap_bext       *ext = extv;
+	merr_t                  err = 0;
+	u64                     zones = 0;
+	u64                     pos, fend;
+	ulong                   off, end;
+	u64                     i = 0;
+
+	mutex_lock(&rb->pdi_rmlock);
+
+	if (rb->pdi_rmbits) {
+		/* Check all the extents first, so that none is set on error. */
+		for (pos = 0; i < n; i++, ext++) {
+			off = ext->sbe_zaddr - rb->pdi_rmbase;
+			end = off + ext->sbe_zcnt;
+
+			if (ext->sbe_zaddr < rb->pdi_rmbase + pos ||
+			    end > rb->pdi_rmnbits ||
+			    find_next_bit(rb->pdi_rmbits, end, off) < end) {
+				err = merr(EINVAL);
+				goto acct;
+			}
+
+			pos = end;
+		}
+
+		for (ext = extv; ext < extv + n; ext++) {
+			bitmap_set(rb->pdi_rmbits, ext->sbe_zaddr -
+				   rb->pdi_rmbase, ext->sbe_zcnt);
+			rb->pdi_rmfree -= ext->sbe_zcnt;
+			zones += ext->sbe_zcnt;
+		}
+		goto acct;
+	}
+
+	for (node = rb_first(&rb->pdi_rmroot); node; node = rb_next(node)) {
+		elem = rb_entry(node, struct u64_to_u64_rb, utu_node);
+		pos  = elem->utu_key;
+		fend = elem->utu_key + elem->utu_value;
+
+		for (; i < n && ext->sbe_zaddr < fend; i++, ext++) {
+			if (ext->sbe_zaddr < pos ||
+			    ext->sbe_zaddr + ext->sbe_zcnt > fend) {
+				err = merr(EINVAL);
+				goto errout;
+			}
+
+			if (ext->sbe_zaddr > pos) {
+				err = smap_bulk_append(&root, &tail, pos,
+						       ext->sbe_zaddr - pos);
+				if (err)
+					goto errout;
+			}
+
+			pos = ext->sbe_zaddr + ext->sbe_zcnt;
+			zones += ext->sbe_zcnt;
+		}
+
+		if (pos < fend) {
+			err = smap_bulk_append(&root, &tail, pos, fend - pos);
+			if (err)
+				goto errout;
+		}
+	}
+
+	/* Staged extents left over are not within any free extent. */
+	if (i < n) {
+		err = merr(EINVAL);
+		goto errout;
+	}
+
+	rb->pdi_rmfree = 0;
+	rb->pdi_rmextc = 0;
+	memset(rb->pdi_rmhist, 0, sizeof(rb->pdi_rmhist));
+	smap_rb_build_max(rb, root.rb_node);
+
+	/* Free the old tree on success, else the new one. */
+	swap(rb->pdi_rmroot, root);
+
+errout:
+	smap_rb_free_all(root.rb_node);
+
+	if (err)
+		zones = 0;
+
+acct:
+	/* Insert consumes usable only; possible for uact > utgt. */
+	spin_lock(&pd->pdi_ds.sda_dalock);
+	pd->pdi_ds.sda_uact += zones;
+	spin_unlock(&pd->pdi_ds.sda_dalock);
+
+	mutex_unlock(&rb->pdi_rmlock);
+
+	if (err)
+		mp_pr_err("smap pd %s: bulk build failed, rgn %u extent %lu of %lu",
+			  err, pd->pdi_name, rgn, (ulong)i, (ulong)n);
+
+	return err;
+}
+
+/**
+ * smap_bulk_ckpt_rgn() - rebuild a region's space map from checkpointed
+ *	free extents
+ * @pd:
+ * @rgn:
+ * @freev: free extents of @rgn sorted by address
+ * @n:     number of extents in @freev
+ * @zones: number of zones of the extents staged in @rgn
+ *
+ * The free extents must account for the free zones of the region less the
+ * staged ones, and lie within the free extents of the region. Otherwise,
+ * or on failure, the extent tree or bitmap of the region is left unchanged.
+ *
+ * Return: 0 if successful, merr_t with the following errno values on
+ * failure:
+ * EINVAL if the free extents do not match the region, it must be carved
+ * ENOMEM if there is no memory available
+ */
+static merr_t
+smap_bulk_ckpt_rgn(
+	struct mpool_dev_info  *pd,
+	u32                     rgn,
+	struct smap_bext       *freev,
+	u64                     n,
+	u64                     zones)
+{
+	struct rmbkt           *rb = &pd->pdi_rmbktv[rgn];
+	struct u64_to_u64_rb   *elem = NULL;
+	struct rb_node         *node, *tail = NULL;
+	struct rb_root          root = RB_ROOT;
+	struct smap_bext       *ext;
+	merr_t                  err = 0;
+	u64                     fzones = 0;
+	u64                     pos, fend;
+	ulong                   off, end;
+
+	mutex_lock(&rb->pdi_rmlock);
+
+	for (ext = freev; ext < freev + n; ext++)
+		fzones += ext->sbe_zcnt;
+
+	if (fzones + zones != rb->pdi_rmfree) {
+		err = merr(EINVAL);
+		goto unlock;
+	}
+
+	if (rb->pdi_rmbits) {
+		for (pos = 0, ext = freev; ext < freev + n; ext++) {
+			off = ext->sbe_zaddr - rb->pdi_rmbase;
+			end = off + ext->sbe_zcnt;
+
+			if (ext->sbe_zaddr < rb->pdi_rmbase + pos ||
+			    end > rb->pdi_rmnbits ||
+			    find_next_bit(rb->pdi_rmbits, end, off) < end) {
+				err = merr(EINVAL);
+				goto unlock;
+			}
+
+			pos = end;
+		}
+
+		bitmap_fill(rb->pdi_rmbits, rb->pdi_rmnbits);
+		for (ext = freev; ext < freev + n; ext++)
+			bitmap_clear(rb->pdi_rmbits, ext->sbe_zaddr -
+				     rb->pdi_rmbase, ext->sbe_zcnt);
+		rb->pdi_rmfree = fzones;
+		goto acct;
+	}
+
+	node = rb_first(&rb->pdi_rmroot);
+	pos = 0;
+
+	for (ext = freev; ext < freev + n; ext++) {
+		for (; node; node = rb_next(node)) {
+			elem = rb_entry(node, struct u64_to_u64_rb, utu_node);
+			if (ext->sbe_zaddr < elem->utu_key + elem->utu_value)
+				break;
+		}
+
+		if (!node) {
+			err = merr(EINVAL);
+			goto errout;
+		}
+
+		fend = elem->utu_key + elem->utu_value;
+		if (ext->sbe_zaddr < max_t(u64, pos, elem->utu_key) ||
+		    ext->sbe_zaddr + ext->sbe_zcnt > fend) {
+			err = merr(EINVAL);
+			goto errout;
+		}
+
+		err = smap_bulk_append(&root, &tail, ext->sbe_zaddr,
+				       ext->sbe_zcnt);
+		if (err)
+			goto errout;
+
+		pos = ext->sbe_zaddr + ext->sbe_zcnt;
+	}
+
+	rb->pdi_rmfree = 0;
+	rb->pdi_rmextc = 0;
+	memset(rb->pdi_rmhist, 0, sizeof(rb->pdi_rmhist));
+	smap_rb_build_max(rb, root.rb_node);
+
+	/* Free the old tree on success, else the new one. */
+	swap(rb->pdi_rmroot, root);
+
+errout:
+	smap_rb_free_all(root.rb_node);
+
+	if (err)
+		goto unlock;
+
+acct:
+	/* Insert consumes usable only; possible for uact > utgt. */
+	spin_lock(&pd->pdi_ds.sda_dalock);
+	pd->pdi_ds.sda_uact += zones;
+	spin_unlock(&pd->pdi_ds.sda_dalock);
+
+unlock:
+	mutex_unlock(&rb->pdi_rmlock);
+
+	return err;
+}
+
+/**
+ * smap_bulk_ckpt_build() - rebuild the regions of a drive from its
+ *	checkpointed free extents
+ * @mp:
+ * @pd:
+ * @bulk:
+ * @rgnc:  number of regions of the drive
+ * @carve: (output) bitmap of the regions left to carve
+ *
+ * Return: 0 if successful, merr_t (ENOMEM) otherwise
+ */
+static merr_t
+smap_bulk_ckpt_build(
+	struct mpool_descriptor    *mp,
+	struct mpool_dev_info      *pd,
+	struct smap_bulk           *bulk,
+	u32                         rgnc,
+	ulong                      *carve)
+{
+	struct smap_bext   *freev = bulk->smb_freev;
+	struct rmbkt       *rb;
+	merr_t              err = 0;
+	u64                *zonev;
+	u64                 i, j, rend;
+	u32                 rgn;
+
+	bitmap_fill(carve, rgnc);
+
+	if (!bulk->smb_fcnt)
+		return 0;
+
+	/* Without memory to count the staged zones, carve all the regions. */
+	zonev = kcalloc(rgnc, sizeof(*zonev), GFP_KERNEL);
+	if (ev(!zonev))
+		return 0;
+
+	for (i = 0; i < bulk->smb_cnt; i++)
+		zonev[smap_addr2rgn(mp, pd, bulk->smb_extv[i].sbe_zaddr)] +=
+			bulk->smb_extv[i].sbe_zcnt;
+
+	for (rgn = 0, i = 0; rgn < rgnc; rgn++, i = j) {
+		rb = &pd->pdi_rmbktv[rgn];
+		rend = rb->pdi_rmbase + rb->pdi_rmnbits;
+
+		for (j = i; j < bulk->smb_fcnt; j++)
+			if (freev[j].sbe_zaddr >= rend)
+				break;
+
+		err = smap_bulk_ckpt_rgn(pd, rgn, &freev[i], j - i, zonev[rgn]);
+		if (!err) {
+			clear_bit(rgn, carve);
+		} else if (merr_errno(err) == EINVAL) {
+			mp_pr_debug("smap(%s, %s): rgn %u does not match its checkpoint",
+				    0, mp->pds_name, pd->pdi_name, rgn);
+			err = 0;
+		} else {
+			break;
+		}
+	}
+
+	kfree(zonev);
+
+	return err;
+}
+
 
 /*
  * smap API functions
@@ -58,8 +889,179 @@ void smap_mpool_free(struct mpool_descriptor *mp)
 {
 	u64 pdh = 0;
 
-	for (pdh = 0; pdh < mp->pds_pdvcnt; pdh++)
-		smap_drive_free(mp, pdh);
+	for (pdh = 0; pdh < mp->pds_pdvcnt; pdh++)
+		smap_drive_free(mp, pdh);
+}
+
+/**
+ * See smap.h.
+ */
+void smap_mpool_bulk_start(struct mpool_descriptor *mp)
+{
+	struct smap_bulk   *bulk;
+	u64                 pdh;
+
+	for (pdh = 0; pdh < mp->pds_pdvcnt; pdh++) {
+		bulk = kzalloc(sizeof(*bulk), GFP_KERNEL);
+		if (!bulk)
+			continue;
+
+		bulk->smb_extv = vmalloc(SMAP_BULK_INIT *
+					 sizeof(*bulk->smb_extv));
+		if (!bulk->smb_extv) {
+			kfree(bulk);
+			continue;
+		}
+
+		mutex_init(&bulk->smb_lock);
+		bulk->smb_max = SMAP_BULK_INIT;
+
+		mp->pds_pdv[pdh].pdi_bulk = bulk;
+	}
+}
+
+/**
+ * See smap.h.
+ */
+merr_t
+smap_mpool_bulk_ckpt(
+	struct mpool_descriptor    *mp,
+	u16                         pdh,
+	u64                         zoneaddr,
+	u32                         zonecnt)
+{
+	struct mpool_dev_info  *pd = &mp->pds_pdv[pdh];
+	struct smap_bulk       *bulk = pd->pdi_bulk;
+	struct smap_bext       *last;
+	merr_t                  err = 0;
+	u32                     rstart, rend, rgn;
+	u64                     raddr, rcnt;
+
+	/* The drive's space map is not bulk built, nothing to rebuild. */
+	if (!bulk)
+		return 0;
+
+	if (!zonecnt || zoneaddr + zonecnt > pd->pdi_parm.dpr_zonetot)
+		return merr(EINVAL);
+
+	if (bulk->smb_fcnt) {
+		last = &bulk->smb_freev[bulk->smb_fcnt - 1];
+		if (zoneaddr < last->sbe_zaddr + last->sbe_zcnt)
+			return merr(EINVAL);
+	}
+
+	/* The region count may have changed since the checkpoint. */
+	rstart = smap_addr2rgn(mp, pd, zoneaddr);
+	rend = smap_addr2rgn(mp, pd, zoneaddr + zonecnt - 1);
+
+	for (rgn = rstart; rgn <= rend && !err; rgn++) {
+		raddr = max_t(u64, zoneaddr, pd->pdi_rmbktv[rgn].pdi_rmbase);
+		rcnt = min_t(u64, zoneaddr + zonecnt,
+			     pd->pdi_rmbktv[rgn].pdi_rmbase +
+			     pd->pdi_rmbktv[rgn].pdi_rmnbits) - raddr;
+
+		err = smap_bext_push(&bulk->smb_freev, &bulk->smb_fcnt,
+				     &bulk->smb_fmax, raddr, rcnt);
+	}
+
+	return err;
+}
+
+/**
+ * See smap.h.
+ */
+void smap_mpool_bulk_ckpt_drop(struct mpool_descriptor *mp)
+{
+	struct smap_bulk   *bulk;
+	u64                 pdh;
+
+	for (pdh = 0; pdh < mp->pds_pdvcnt; pdh++) {
+		bulk = mp->pds_pdv[pdh].pdi_bulk;
+		if (!bulk)
+			continue;
+
+		vfree(bulk->smb_freev);
+		bulk->smb_freev = NULL;
+		bulk->smb_fcnt = 0;
+		bulk->smb_fmax = 0;
+	}
+}
+
+/**
+ * See smap.h.
+ */
+merr_t smap_mpool_bulk_end(struct mpool_descriptor *mp)
+{
+	struct mpool_dev_info  *pd;
+	struct smap_bulk       *bulk;
+	struct smap_bext       *extv;
+	struct mc_smap_parms    mcsp;
+	unsigned long           start;
+	merr_t                  err = 0;
+	u64                     pdh, i, j;
+	u64                     rend;
+	u32                     rgn, nrgn;
+
+	DECLARE_BITMAP(carve, U8_MAX + 1);
+
+	for (pdh = 0; pdh < mp->pds_pdvcnt; pdh++) {
+		pd = &mp->pds_pdv[pdh];
+		bulk = pd->pdi_bulk;
+		if (!bulk)
+			continue;
+
+		pd->pdi_bulk = NULL;
+
+		if (err) {
+			smap_bulk_free(bulk);
+			continue;
+		}
+
+		start = jiffies;
+		extv = bulk->smb_extv;
+
+		mc_smap_parms_get(mp, pd->pdi_mclass, &mcsp);
+
+		err = smap_bulk_ckpt_build(mp, pd, bulk, mcsp.mcsp_rgnc, carve);
+		if (err) {
+			smap_bulk_free(bulk);
+			continue;
+		}
+
+		nrgn = bitmap_weight(carve, mcsp.mcsp_rgnc);
+		if (nrgn)
+			sort(extv, bulk->smb_cnt, sizeof(*extv), smap_bext_cmp,
+			     NULL);
+
+		/* Staged extents never cross regions, see smap_insert(). */
+		for (i = 0; i < bulk->smb_cnt && nrgn; i = j) {
+			rgn = smap_addr2rgn(mp, pd, extv[i].sbe_zaddr);
+			rend = pd->pdi_rmbktv[rgn].pdi_rmbase +
+				pd->pdi_rmbktv[rgn].pdi_rmnbits;
+
+			for (j = i + 1; j < bulk->smb_cnt; j++)
+				if (extv[j].sbe_zaddr >= rend)
+					break;
+
+			if (!test_bit(rgn, carve))
+				continue;
+
+			err = smap_bulk_build_rgn(pd, rgn, &extv[i], j - i);
+			if (err)
+				break;
+		}
+
+		if (!err)
+			mp_pr_debug("smap(%s, %s): %lu extents built in %u ms, %u of %u regions from checkpoint",
+				    0, mp->pds_name, pd->pdi_name,
+				    (ulong)bulk->smb_cnt,
+				    jiffies_to_msecs(jiffies - start),
+				    mcsp.mcsp_rgnc - nrgn, mcsp.mcsp_rgnc);
+
+		smap_bulk_free(bulk);
+	}
+
+	return err;
 }
 
 /**
@@ -87,7 +1089,7 @@ smap_drive_spares(
 	struct mpool_dev_info *pd = NULL;
 	struct media_class    *mc;
 	merr_t                 err;
-	u8                     i;
+	u8                     i, j;
 
 	if (!mclassp_valid(mclassp) || spzone > 100) {
 		err = merr(EINVAL);
@@ -96,34 +1098,35 @@ smap_drive_spares(
 		return err;
 	}
 
-	/* Loop on all classes matching mclassp. */
+	/* Loop on all drives of the classes matching mclassp. */
 	for (i = 0; i < MP_MED_NUMBER; i++) {
 		mc = &mp->pds_mc[i];
 		if (mc->mc_parms.mcp_classp != mclassp || mc->mc_pdmc < 0)
 			continue;
 
-		pd = &mp->pds_pdv[mc->mc_pdmc];
-
-		spin_lock(&pd->pdi_ds.sda_dalock);
-		/*
-		 * adjust utgt but not uact; possible for uact > utgt
-		 * due to spzone change
-		 */
-		pd->pdi_ds.sda_utgt =
-			(pd->pdi_ds.sda_zoneeff * (100 - spzone)) / 100;
-		/*
-		 * adjust stgt and sact maintaining invariant that
-		 * sact <= stgt
-		 */
-		pd->pdi_ds.sda_stgt =
-			pd->pdi_ds.sda_zoneeff - pd->pdi_ds.sda_utgt;
-		if (pd->pdi_ds.sda_sact > pd->pdi_ds.sda_stgt) {
-			pd->pdi_ds.sda_uact +=
-				(pd->pdi_ds.sda_sact - pd->pdi_ds.sda_stgt);
-			pd->pdi_ds.sda_sact = pd->pdi_ds.sda_stgt;
+		for (j = 0; j < mc->mc_pdcnt; j++) {
+			pd = &mp->pds_pdv[mc->mc_pdv[j]];
+
+			spin_lock(&pd->pdi_ds.sda_dalock);
+			/*
+			 * adjust utgt but not uact; possible for uact > utgt
+			 * due to spzone change
+			 */
+			pd->pdi_ds.sda_utgt =
+				(pd->pdi_ds.sda_zoneeff * (100 - spzone)) / 100;
+			/*
+			 * adjust stgt and sact maintaining invariant that
+			 * sact <= stgt
+			 */
+			pd->pdi_ds.sda_stgt =
+				pd->pdi_ds.sda_zoneeff - pd->pdi_ds.sda_utgt;
+			if (pd->pdi_ds.sda_sact > pd->pdi_ds.sda_stgt) {
+				pd->pdi_ds.sda_uact += pd->pdi_ds.sda_sact -
+					pd->pdi_ds.sda_stgt;
+				pd->pdi_ds.sda_sact = pd->pdi_ds.sda_stgt;
+			}
+			spin_unlock(&pd->pdi_ds.sda_dalock);
 		}
-		spin_unlock(&pd->pdi_ds.sda_dalock);
-
 	}
 	return 0;
 }
@@ -208,6 +1211,93 @@ smap_drive_usage(
 	return 0;
 }
 
+/**
+ * See smap.h.
+ */
+u32 smap_drive_fusable(struct mpool_descriptor *mp, u16 pdh)
+{
+	struct mpool_dev_info  *pd = &mp->pds_pdv[pdh];
+	u32                     fusable = 0;
+
+	spin_lock(&pd->pdi_ds.sda_dalock);
+	if (pd->pdi_ds.sda_utgt > pd->pdi_ds.sda_uact)
+		fusable = pd->pdi_ds.sda_utgt - pd->pdi_ds.sda_uact;
+	spin_unlock(&pd->pdi_ds.sda_dalock);
+
+	return fusable;
+}
+
+/**
+ * See smap.h.
+ */
+merr_t
+smap_drive_frag(
+	struct mpool_descriptor    *mp,
+	u16                         pdh,
+	struct mp_devfrag          *frag)
+{
+	struct mpool_dev_info  *pd = &mp->pds_pdv[pdh];
+	struct media_class     *mc;
+	struct mc_smap_parms    mcsp;
+	struct rmbkt           *rb;
+	merr_t                  err;
+	ulong                   start, end;
+	u32                     rgn, i;
+	u64                     len;
+
+	mc = &mp->pds_mc[pd->pdi_mclass];
+	err = mc_smap_parms_get(mp, mc->mc_parms.mcp_classp, &mcsp);
+	if (ev(err))
+		return err;
+
+	if (!pd->pdi_rmbktv)
+		return merr(EINVAL);
+
+	memset(frag, 0, sizeof(*frag));
+	frag->pdf_mclassp = mc->mc_parms.mcp_classp;
+	frag->pdf_rgnc = mcsp.mcsp_rgnc;
+	frag->pdf_zonesz = (u64)pd->pdi_zonepg << PAGE_SHIFT;
+
+	for (rgn = 0; rgn < mcsp.mcsp_rgnc; rgn++) {
+		rb = &pd->pdi_rmbktv[rgn];
+
+		mutex_lock(&rb->pdi_rmlock);
+		frag->pdf_free += rb->pdi_rmfree;
+
+		if (!rb->pdi_rmbits) {
+			len = smap_rb_max(rb->pdi_rmroot.rb_node);
+
+			frag->pdf_extc += rb->pdi_rmextc;
+			frag->pdf_extmax = max_t(u64, frag->pdf_extmax, len);
+			for (i = 0; i < MP_FRAG_NBKT; i++)
+				frag->pdf_hist[i] += rb->pdi_rmhist[i];
+
+			mutex_unlock(&rb->pdi_rmlock);
+			continue;
+		}
+
+		/* Bitmaps have no extents to count, scan their free runs. */
+		end = 0;
+		while (1) {
+			start = find_next_zero_bit(rb->pdi_rmbits,
+						   rb->pdi_rmnbits, end);
+			if (start >= rb->pdi_rmnbits)
+				break;
+
+			end = find_next_bit(rb->pdi_rmbits, rb->pdi_rmnbits,
+					    start);
+			len = end - start;
+
+			frag->pdf_extc++;
+			frag->pdf_extmax = max_t(u64, frag->pdf_extmax, len);
+			frag->pdf_hist[smap_hist_bkt(len)]++;
+		}
+		mutex_unlock(&rb->pdi_rmlock);
+	}
+
+	return 0;
+}
+
 /**
  * See smap.h.
  */
@@ -258,6 +1348,13 @@ void smap_drive_free(struct mpool_descriptor *mp, u16 pdh)
 	struct rb_node        *node = NULL;
 	struct u64_to_u64_rb  *urb_elem = NULL;
 
+	/* The zones in the magazines go away with the space maps. */
+	free_percpu(pd->pdi_zmag);
+	pd->pdi_zmag = NULL;
+
+	smap_bulk_free(pd->pdi_bulk);
+	pd->pdi_bulk = NULL;
+
 	if (pd->pdi_rmbktv) {
 		struct media_class     *mc;
 		struct mc_smap_parms    mcsp;
@@ -266,13 +1363,15 @@ void smap_drive_free(struct mpool_descriptor *mp, u16 pdh)
 		(void)mc_smap_parms_get(mp, mc->mc_parms.mcp_classp, &mcsp);
 
 		for (rgn = 0; rgn < mcsp.mcsp_rgnc; rgn++) {
+			vfree(pd->pdi_rmbktv[rgn].pdi_rmbits);
+
 			rmap = &pd->pdi_rmbktv[rgn].pdi_rmroot;
 			node = rb_first(rmap);
 			while (node) {
 				urb_elem = rb_entry(node, struct u64_to_u64_rb,
 						    utu_node);
 				node = rb_next(node);
-				rb_erase(&urb_elem->utu_node, rmap);
+				smap_rb_erase(&pd->pdi_rmbktv[rgn], urb_elem);
 				kmem_cache_free(u64_to_u64_rb_cache, urb_elem);
 			}
 		}
@@ -334,7 +1433,10 @@ smap_insert(struct mpool_descriptor *mp, u16 pdh, u64 zoneaddr, u32 zonecnt)
 		else
 			rcnt = zonecnt - zoneadded;
 
-		err = smap_insert_byrgn(pd, rgn, raddr, rcnt);
+		if (pd->pdi_bulk)
+			err = smap_bulk_add(pd->pdi_bulk, raddr, rcnt);
+		else
+			err = smap_insert_byrgn(pd, rgn, raddr, rcnt);
 		if (err) {
 			mp_pr_err("smap(%s, %s): insert byrgn failed, rgn %d raddr %lu rcnt %lu",
 				  err, mp->pds_name, pd->pdi_name, rgn,
@@ -417,11 +1519,8 @@ smap_alloccheck(
 	return alloced;
 }
 
-/**
- * See smap.h.
- */
-merr_t
-smap_alloc(
+static merr_t
+smap_alloc_cmn(
 	struct mpool_descriptor *mp,
 	u16                      pdh,
 	u64                      zonecnt,
@@ -431,6 +1530,7 @@ smap_alloc(
 {
 	struct mpool_dev_info *pd;
 	struct smap_dev_alloc *ds;
+	struct rmbkt          *rb = NULL;
 	struct mutex          *rmlock = NULL;
 	struct rb_root        *rmap = NULL;
 	struct u64_to_u64_rb  *elem = NULL;
@@ -461,49 +1561,49 @@ smap_alloc(
 	rgnc = mcsp.mcsp_rgnc;
 
 	/*
-	 * We do not update the last rgn alloced beyond this point as it
-	 * would incur search penalty if all the regions except one are highly
-	 * fragmented, i.e., the last alloc rgn would never change in
-	 * this case.
+	 * Start from the CPU's home region so that CPUs allocating in
+	 * parallel don't contend for the same region locks, and only
+	 * spill to the next regions when it is full.
+	 *
+	 * Otherwise rotate the starting region. We do not update the last rgn
+	 * alloced beyond this point as it would incur search penalty if all
+	 * the regions except one are highly fragmented, i.e., the last alloc
+	 * rgn would never change in this case.
 	 */
-	spin_lock(&ds->sda_dalock);
-	ds->sda_rgnalloc = (ds->sda_rgnalloc + 1) % rgnc;
-	rgn = ds->sda_rgnalloc;
-	spin_unlock(&ds->sda_dalock);
+	if (mp->pds_params.mp_smapcpurgn) {
+		rgn = raw_smp_processor_id() % rgnc;
+	} else {
+		spin_lock(&ds->sda_dalock);
+		ds->sda_rgnalloc = (ds->sda_rgnalloc + 1) % rgnc;
+		rgn = ds->sda_rgnalloc;
+		spin_unlock(&ds->sda_dalock);
+	}
 
 	rgnleft = rgnc;
 
 	/* Search per-rgn space maps for contiguous region. */
 	while (rgnleft--) {
-		struct rb_node        *node;
-
-		rmlock = &pd->pdi_rmbktv[rgn].pdi_rmlock;
-		rmap = &pd->pdi_rmbktv[rgn].pdi_rmroot;
+		rb = &pd->pdi_rmbktv[rgn];
+		rmlock = &rb->pdi_rmlock;
+		rmap = &rb->pdi_rmroot;
 
 		mutex_lock(rmlock);
 
-		for (node = rb_first(rmap); node; node = rb_next(node)) {
-			elem  = rb_entry(node, struct u64_to_u64_rb, utu_node);
-			fsoff = elem->utu_key;
-			fslen = elem->utu_value;
-
-			if (zonecnt > fslen)
-				continue;
-
-			if (IS_ALIGNED(fsoff, align)) {
-				ualen = 0;
+		if (rb->pdi_rmbits) {
+			if (smap_bm_first_fit(rb, zonecnt, align, &fsoff))
 				break;
-			}
-
-			ualen = ALIGN(fsoff, align) - fsoff;
-			if (ualen + zonecnt > fslen)
-				continue;
 
-			break;
+			mutex_unlock(rmlock);
+			rgn = (rgn + 1) % rgnc;
+			continue;
 		}
 
-		if (node)
+		elem = smap_rb_first_fit(rmap, zonecnt, align, &ualen);
+		if (elem) {
+			fsoff = elem->utu_key;
+			fslen = elem->utu_value;
 			break;
+		}
 
 		mutex_unlock(rmlock);
 
@@ -520,17 +1620,26 @@ smap_alloc(
 		return merr(ENOSPC);
 	}
 
+	if (rb->pdi_rmbits) {
+		bitmap_set(rb->pdi_rmbits, fsoff - rb->pdi_rmbase, zonecnt);
+		rb->pdi_rmfree -= zonecnt;
+		mutex_unlock(rmlock);
+
+		*zoneaddr = fsoff;
+		return 0;
+	}
+
 	fsoff = fsoff + ualen;
 	fslen = fslen - ualen;
 
 	*zoneaddr = fsoff;
-	rb_erase(&elem->utu_node, rmap);
+	smap_rb_erase(rb, elem);
 
 	if (zonecnt < fslen) {
 		/* Re-use elem */
 		elem->utu_key   = fsoff + zonecnt;
 		elem->utu_value = fslen - zonecnt;
-		u64_to_u64_insert(rmap, elem);
+		smap_rb_insert(rb, elem);
 		elem = NULL;
 	}
 
@@ -546,7 +1655,7 @@ smap_alloc(
 
 		elem->utu_key   = fsoff - ualen;
 		elem->utu_value = ualen;
-		u64_to_u64_insert(rmap, elem);
+		smap_rb_insert(rb, elem);
 		elem = NULL;
 	}
 
@@ -558,11 +1667,8 @@ smap_alloc(
 	return 0;
 }
 
-/**
- * See smap.h.
- */
-merr_t
-smap_free(struct mpool_descriptor *mp, u16 pdh, u64 zoneaddr, u16 zonecnt)
+static merr_t
+smap_free_cmn(struct mpool_descriptor *mp, u16 pdh, u64 zoneaddr, u16 zonecnt)
 {
 	merr_t                 err      = 0;
 	struct mpool_dev_info *pd       = NULL;
@@ -610,7 +1716,8 @@ smap_free(struct mpool_descriptor *mp, u16 pdh, u64 zoneaddr, u16 zonecnt)
 		else
 			rcnt = zonecnt - zonefreed;
 
-		err = smap_free_byrgn(pd, rgn, raddr, rcnt);
+		if (!pd->pdi_bulk || !smap_bulk_del(pd->pdi_bulk, raddr, rcnt))
+			err = smap_free_byrgn(pd, rgn, raddr, rcnt);
 		if (err) {
 			mp_pr_err("smap(%s, %s): free byrgn failed, rgn %d raddr %lu, rcnt %lu",
 				  err, mp->pds_name, pd->pdi_name, rgn,
@@ -623,6 +1730,260 @@ smap_free(struct mpool_descriptor *mp, u16 pdh, u64 zoneaddr, u16 zonecnt)
 	return err;
 }
 
+/*
+ * Zone magazines.
+ *
+ * A magazine's zones are allocated in the space map and charged to sda_uact
+ * like any other allocation, so smap_alloccheck() needs no change. They are
+ * left out of the used zones reported by smap_calc_znstats().
+ */
+
+static u32 smap_zmag_count(struct mpool_dev_info *pd)
+{
+	u32 cnt = 0;
+	int cpu;
+
+	if (!pd->pdi_zmag)
+		return 0;
+
+	for_each_possible_cpu(cpu)
+		cnt += READ_ONCE(per_cpu_ptr(pd->pdi_zmag, cpu)->zm_cnt);
+
+	return cnt;
+}
+
+/**
+ * smap_zmag_alloc() - allocate a single zone from the CPU's magazine
+ * @mp:
+ * @pdh:
+ * @zoneaddr:
+ *
+ * An empty magazine is refilled with SMAP_ZMAG_BATCH contiguous zones, the
+ * first of which is returned.
+ */
+static merr_t
+smap_zmag_alloc(struct mpool_descriptor *mp, u16 pdh, u64 *zoneaddr)
+{
+	struct mpool_dev_info  *pd = &mp->pds_pdv[pdh];
+	struct smap_zmag       *zm;
+	merr_t                  err;
+	u64                     addr;
+	u32                     i;
+
+	zm = get_cpu_ptr(pd->pdi_zmag);
+	spin_lock(&zm->zm_lock);
+	if (zm->zm_cnt) {
+		*zoneaddr = zm->zm_zonev[--zm->zm_cnt];
+		spin_unlock(&zm->zm_lock);
+		put_cpu_ptr(pd->pdi_zmag);
+		return 0;
+	}
+	spin_unlock(&zm->zm_lock);
+	put_cpu_ptr(pd->pdi_zmag);
+
+	err = smap_alloc_cmn(mp, pdh, SMAP_ZMAG_BATCH, SMAP_SPC_USABLE_ONLY,
+			     &addr, 1);
+	if (err)
+		return err;
+
+	*zoneaddr = addr;
+
+	/* Push the highest zones first so they are popped in address order. */
+	zm = get_cpu_ptr(pd->pdi_zmag);
+	spin_lock(&zm->zm_lock);
+	for (i = 1; i < SMAP_ZMAG_BATCH && zm->zm_cnt < SMAP_ZMAG_SZ; i++)
+		zm->zm_zonev[zm->zm_cnt++] = addr + SMAP_ZMAG_BATCH - i;
+	spin_unlock(&zm->zm_lock);
+	put_cpu_ptr(pd->pdi_zmag);
+
+	/* The magazine was refilled by another task meanwhile. */
+	if (i < SMAP_ZMAG_BATCH)
+		(void)smap_free_cmn(mp, pdh, addr + 1, SMAP_ZMAG_BATCH - i);
+
+	return 0;
+}
+
+/**
+ * smap_zmag_free() - free a single zone to the CPU's magazine
+ * @mp:
+ * @pdh:
+ * @zoneaddr:
+ *
+ * A full magazine first releases half of its zones to the space map.
+ *
+ * Return: false if the zone must be freed to the space map instead
+ */
+static bool smap_zmag_free(struct mpool_descriptor *mp, u16 pdh, u64 zoneaddr)
+{
+	struct mpool_dev_info  *pd = &mp->pds_pdv[pdh];
+	struct smap_zmag       *zm;
+	u64                     zonev[SMAP_ZMAG_SZ / 2];
+	u32                     i, n = 0;
+
+	/* Freed space goes to spare first, see smap_free_byrgn(). */
+	if (READ_ONCE(pd->pdi_ds.sda_sact))
+		return false;
+
+	zm = get_cpu_ptr(pd->pdi_zmag);
+	spin_lock(&zm->zm_lock);
+	if (zm->zm_cnt == SMAP_ZMAG_SZ) {
+		n = SMAP_ZMAG_SZ / 2;
+		zm->zm_cnt -= n;
+		memcpy(zonev, &zm->zm_zonev[zm->zm_cnt], n * sizeof(zonev[0]));
+	}
+	zm->zm_zonev[zm->zm_cnt++] = zoneaddr;
+	spin_unlock(&zm->zm_lock);
+	put_cpu_ptr(pd->pdi_zmag);
+
+	for (i = 0; i < n; i++)
+		(void)smap_free_cmn(mp, pdh, zonev[i], 1);
+
+	return true;
+}
+
+/**
+ * smap_zmag_drain() - release the zones of all magazines of a drive
+ * @mp:
+ * @pdh:
+ *
+ * Return: number of zones released to the space map
+ */
+static u32 smap_zmag_drain(struct mpool_descriptor *mp, u16 pdh)
+{
+	struct mpool_dev_info  *pd = &mp->pds_pdv[pdh];
+	struct smap_zmag       *zm;
+	u64                     zonev[SMAP_ZMAG_SZ];
+	u32                     i, n, cnt = 0;
+	int                     cpu;
+
+	if (!pd->pdi_zmag)
+		return 0;
+
+	for_each_possible_cpu(cpu) {
+		zm = per_cpu_ptr(pd->pdi_zmag, cpu);
+
+		spin_lock(&zm->zm_lock);
+		n = zm->zm_cnt;
+		memcpy(zonev, zm->zm_zonev, n * sizeof(zonev[0]));
+		zm->zm_cnt = 0;
+		spin_unlock(&zm->zm_lock);
+
+		for (i = 0; i < n; i++)
+			(void)smap_free_cmn(mp, pdh, zonev[i], 1);
+
+		cnt += n;
+	}
+
+	return cnt;
+}
+
+/**
+ * See smap.h.
+ */
+merr_t
+smap_alloc(
+	struct mpool_descriptor *mp,
+	u16                      pdh,
+	u64                      zonecnt,
+	enum smap_space_type     sapolicy,
+	u64                     *zoneaddr,
+	u64                      align)
+{
+	merr_t err;
+
+	if (zonecnt == 1 && sapolicy == SMAP_SPC_USABLE_ONLY &&
+	    mp->pds_pdv[pdh].pdi_zmag) {
+		err = smap_zmag_alloc(mp, pdh, zoneaddr);
+		if (!err)
+			return 0;
+	}
+
+	err = smap_alloc_cmn(mp, pdh, zonecnt, sapolicy, zoneaddr, align);
+	if (merr_errno(err) == ENOSPC && smap_zmag_drain(mp, pdh))
+		err = smap_alloc_cmn(mp, pdh, zonecnt, sapolicy, zoneaddr,
+				     align);
+
+	return err;
+}
+
+/**
+ * See smap.h.
+ */
+merr_t
+smap_free(struct mpool_descriptor *mp, u16 pdh, u64 zoneaddr, u16 zonecnt)
+{
+	struct mpool_dev_info *pd = &mp->pds_pdv[pdh];
+
+	if (zonecnt == 1 && pd->pdi_zmag &&
+	    zoneaddr < pd->pdi_parm.dpr_zonetot &&
+	    smap_zmag_free(mp, pdh, zoneaddr))
+		return 0;
+
+	return smap_free_cmn(mp, pdh, zoneaddr, zonecnt);
+}
+
+/**
+ * See smap.h.
+ */
+merr_t
+smap_drive_walk(
+	struct mpool_descriptor    *mp,
+	u16                         pdh,
+	merr_t                    (*func)(void *arg, u16 pdh, u64 zoneaddr,
+					  u32 zonecnt),
+	void                       *arg)
+{
+	struct mpool_dev_info  *pd = &mp->pds_pdv[pdh];
+	struct u64_to_u64_rb   *elem;
+	struct mc_smap_parms    mcsp;
+	struct rb_node         *node;
+	struct rmbkt           *rb;
+	merr_t                  err = 0;
+	ulong                   start, end;
+	u32                     rgn;
+
+	if (!pd->pdi_rmbktv)
+		return merr(EINVAL);
+
+	mc_smap_parms_get(mp, pd->pdi_mclass, &mcsp);
+
+	(void)smap_zmag_drain(mp, pdh);
+
+	for (rgn = 0; rgn < mcsp.mcsp_rgnc && !err; rgn++) {
+		rb = &pd->pdi_rmbktv[rgn];
+
+		mutex_lock(&rb->pdi_rmlock);
+		if (!rb->pdi_rmbits) {
+			for (node = rb_first(&rb->pdi_rmroot); node && !err;
+			     node = rb_next(node)) {
+				elem = rb_entry(node, struct u64_to_u64_rb,
+						utu_node);
+				err = func(arg, pdh, elem->utu_key,
+					   elem->utu_value);
+			}
+
+			mutex_unlock(&rb->pdi_rmlock);
+			continue;
+		}
+
+		end = 0;
+		while (!err) {
+			start = find_next_zero_bit(rb->pdi_rmbits,
+						   rb->pdi_rmnbits, end);
+			if (start >= rb->pdi_rmnbits)
+				break;
+
+			end = find_next_bit(rb->pdi_rmbits, rb->pdi_rmnbits,
+					    start);
+			err = func(arg, pdh, rb->pdi_rmbase + start,
+				   end - start);
+		}
+		mutex_unlock(&rb->pdi_rmlock);
+	}
+
+	return err;
+}
+
 /*
  * smap internal functions
  */
@@ -666,18 +2027,40 @@ smap_drive_alloc(
 
 	/* define all space on all channels as being free (drive empty) */
 	for (rgn = 0; rgn < rgnc; rgn++) {
-		mutex_init(&pd->pdi_rmbktv[rgn].pdi_rmlock);
+		struct rmbkt *rb = &pd->pdi_rmbktv[rgn];
+		size_t        sz;
+
+		mutex_init(&rb->pdi_rmlock);
+
+		rb->pdi_rmbase = rgn * rgnsz;
+		if (rgn < rgnc - 1)
+			rb->pdi_rmnbits = rgnsz;
+		else
+			rb->pdi_rmnbits = pd->pdi_parm.dpr_zonetot -
+					  (rgn * rgnsz);
+
+		urb_elem = NULL;
+		if (mcsp->mcsp_bitmap) {
+			sz = BITS_TO_LONGS(rb->pdi_rmnbits) * sizeof(ulong);
+			rb->pdi_rmbits = vzalloc(sz);
+			rb->pdi_rmfree = rb->pdi_rmnbits;
+		} else {
+			urb_elem = kmem_cache_alloc(u64_to_u64_rb_cache,
+						    GFP_KERNEL);
+		}
 
-		urb_elem = kmem_cache_alloc(u64_to_u64_rb_cache, GFP_KERNEL);
-		if (!urb_elem) {
+		if (!urb_elem && !rb->pdi_rmbits) {
 			struct rb_root *rmroot;
 
 			for (rgn2 = 0; rgn2 < rgn; rgn2++) {
+				vfree(pd->pdi_rmbktv[rgn2].pdi_rmbits);
+
 				rmroot = &pd->pdi_rmbktv[rgn2].pdi_rmroot;
 
 				found_ue = u64_to_u64_search(rmroot, 0);
 				if (found_ue) {
-					rb_erase(&found_ue->utu_node, rmroot);
+					smap_rb_erase(&pd->pdi_rmbktv[rgn2],
+						      found_ue);
 					kmem_cache_free(u64_to_u64_rb_cache,
 							found_ue);
 				}
@@ -687,18 +2070,17 @@ smap_drive_alloc(
 			pd->pdi_rmbktv = NULL;
 
 			err = merr(ENOMEM);
-			mp_pr_err("smap(%s, %s): rb node alloc failed, rgn %u",
+			mp_pr_err("smap(%s, %s): rgn map alloc failed, rgn %u",
 				  err, mp->pds_name, pd->pdi_name, rgn);
 			return err;
 		}
 
-		urb_elem->utu_key = rgn * rgnsz;
-		if (rgn < rgnc - 1)
-			urb_elem->utu_value = rgnsz;
-		else
-			urb_elem->utu_value = pd->pdi_parm.dpr_zonetot -
-					      (rgn * rgnsz);
-		u64_to_u64_insert(&pd->pdi_rmbktv[rgn].pdi_rmroot, urb_elem);
+		if (!urb_elem)
+			continue;
+
+		urb_elem->utu_key = rb->pdi_rmbase;
+		urb_elem->utu_value = rb->pdi_rmnbits;
+		smap_rb_insert(rb, urb_elem);
 	}
 
 	spin_lock_init(&pd->pdi_ds.sda_dalock);
@@ -712,6 +2094,19 @@ smap_drive_alloc(
 	pd->pdi_ds.sda_stgt = pd->pdi_ds.sda_zoneeff - pd->pdi_ds.sda_utgt;
 	pd->pdi_ds.sda_sact = 0;
 
+	/* Without zone magazines all allocations go to the space map. */
+	pd->pdi_zmag = alloc_percpu(struct smap_zmag);
+	if (pd->pdi_zmag) {
+		int cpu;
+
+		for_each_possible_cpu(cpu) {
+			struct smap_zmag *zm = per_cpu_ptr(pd->pdi_zmag, cpu);
+
+			spin_lock_init(&zm->zm_lock);
+			zm->zm_cnt = 0;
+		}
+	}
+
 	return 0;
 }
 
@@ -743,22 +2138,12 @@ merr_t smap_drive_sballoc(struct mpool_descriptor *mp, u16 pdh)
 	return err;
 }
 
-void
-smap_mclass_usage(
-	struct mpool_descriptor    *mp,
-	u8                          mclass,
-	struct mp_usage            *usage)
+static void
+smap_drive_usage_add(struct mpool_dev_info *pd, struct mp_usage *usage)
 {
-	struct media_class         *mc;
 	struct smap_dev_znstats     zones;
-	struct mpool_dev_info      *pd;
 	u32                         zonepg = 0;
 
-	mc = &mp->pds_mc[mclass];
-	if (mc->mc_pdmc < 0)
-		return;
-
-	pd = &mp->pds_pdv[mc->mc_pdmc];
 	zonepg = pd->pdi_zonepg;
 
 	spin_lock(&pd->pdi_ds.sda_dalock);
@@ -773,6 +2158,23 @@ smap_mclass_usage(
 	usage->mpu_fusable += ((zones.sdv_fusable * zonepg) << PAGE_SHIFT);
 }
 
+void
+smap_mclass_usage(
+	struct mpool_descriptor    *mp,
+	u8                          mclass,
+	struct mp_usage            *usage)
+{
+	struct media_class *mc;
+	int                 i;
+
+	mc = &mp->pds_mc[mclass];
+	if (mc->mc_pdmc < 0)
+		return;
+
+	for (i = 0; i < mc->mc_pdcnt; i++)
+		smap_drive_usage_add(&mp->pds_pdv[mc->mc_pdv[i]], usage);
+}
+
 /*
  * Add entry to space map in rgn starting at virtual erase block zoneaddr
  * and continuing for zonecnt blocks.
@@ -788,12 +2190,16 @@ smap_insert_byrgn(
 {
 	const char             *msg __maybe_unused;
 	struct u64_to_u64_rb   *elem = NULL;
+	struct rmbkt           *rb = &pd->pdi_rmbktv[rgn];
 	struct rb_root         *rmap;
 	struct rb_node         *node;
 	merr_t                  err;
 	u64                     fsoff;
 	u64                     fslen;
 
+	if (pd->pdi_rmbktv[rgn].pdi_rmbits)
+		return smap_bm_insert_byrgn(pd, rgn, zoneaddr, zonecnt);
+
 	fsoff = fslen = 0;
 	err = 0;
 	msg = NULL;
@@ -843,12 +2249,12 @@ smap_insert_byrgn(
 		goto errout;
 	}
 
-	rb_erase(&elem->utu_node, rmap);
+	smap_rb_erase(rb, elem);
 
 	if (zoneaddr > fsoff) {
 		elem->utu_key = fsoff;
 		elem->utu_value = zoneaddr - fsoff;
-		u64_to_u64_insert(rmap, elem);
+		smap_rb_insert(rb, elem);
 		elem = NULL;
 	}
 	if (zoneaddr + zonecnt < fsoff + fslen) {
@@ -863,7 +2269,7 @@ smap_insert_byrgn(
 
 		elem->utu_key = zoneaddr + zonecnt;
 		elem->utu_value = (fsoff + fslen) - (zoneaddr + zonecnt);
-		u64_to_u64_insert(rmap, elem);
+		smap_rb_insert(rb, elem);
 		elem = NULL;
 	}
 
@@ -909,12 +2315,16 @@ smap_free_byrgn(struct mpool_dev_info *pd, u32 rgn, u64 zoneaddr, u32 zonecnt)
 	const char             *msg __maybe_unused;
 	struct u64_to_u64_rb   *left, *right;
 	struct u64_to_u64_rb   *new, *old;
+	struct rmbkt           *rb = &pd->pdi_rmbktv[rgn];
 	struct rb_root         *rmap;
 	struct rb_node         *node;
 
 	u32     orig_zonecnt = zonecnt;
 	merr_t  err = 0;
 
+	if (pd->pdi_rmbktv[rgn].pdi_rmbits)
+		return smap_bm_free_byrgn(pd, rgn, zoneaddr, zonecnt);
+
 	new = old = left = right = NULL;
 	msg = NULL;
 
@@ -949,7 +2359,7 @@ smap_free_byrgn(struct mpool_dev_info *pd, u32 rgn, u64 zoneaddr, u32 zonecnt)
 	if (right) {
 		if (zoneaddr + zonecnt == right->utu_key) {
 			zonecnt += right->utu_value;
-			rb_erase(&right->utu_node, rmap);
+			smap_rb_erase(rb, right);
 
 			new = right;  /* re-use right node */
 		}
@@ -961,7 +2371,7 @@ smap_free_byrgn(struct mpool_dev_info *pd, u32 rgn, u64 zoneaddr, u32 zonecnt)
 		if (left->utu_key + left->utu_value == zoneaddr) {
 			zoneaddr = left->utu_key;
 			zonecnt += left->utu_value;
-			rb_erase(&left->utu_node, rmap);
+			smap_rb_erase(rb, left);
 
 			old = new;  /* free new/left outside the critsec */
 			new = left; /* re-use left node */
@@ -989,30 +2399,14 @@ smap_free_byrgn(struct mpool_dev_info *pd, u32 rgn, u64 zoneaddr, u32 zonecnt)
 	new->utu_key = zoneaddr;
 	new->utu_value = zonecnt;
 
-	if (!u64_to_u64_insert(rmap, new)) {
+	if (!smap_rb_insert(rb, new)) {
 		kmem_cache_free(u64_to_u64_rb_cache, new);
 		msg = "chunk insert failed";
 		err = merr(EBUG);
 		goto unlock;
 	}
 
-	/* Freed space goes to spare first then usable.
-	 */
-	zonecnt = orig_zonecnt;
-
-	spin_lock(&pd->pdi_ds.sda_dalock);
-	if (pd->pdi_ds.sda_sact > 0) {
-		if (pd->pdi_ds.sda_sact > zonecnt) {
-			pd->pdi_ds.sda_sact -= zonecnt;
-			zonecnt = 0;
-		} else {
-			zonecnt -= pd->pdi_ds.sda_sact;
-			pd->pdi_ds.sda_sact = 0;
-		}
-	}
-
-	pd->pdi_ds.sda_uact -= zonecnt;
-	spin_unlock(&pd->pdi_ds.sda_dalock);
+	smap_free_acct(pd, orig_zonecnt);
 
 unlock:
 	mutex_unlock(&pd->pdi_rmbktv[rgn].pdi_rmlock);
@@ -1034,19 +2428,24 @@ unlock:
 void
 smap_calc_znstats(struct mpool_dev_info *pd, struct smap_dev_znstats *zones)
 {
+	u32 uact;
+
+	/* Zones sitting in the magazines are not used by any object. */
+	uact = pd->pdi_ds.sda_uact;
+	uact -= min_t(u32, uact, smap_zmag_count(pd));
+
 	zones->sdv_total = pd->pdi_parm.dpr_zonetot;
 	zones->sdv_avail = pd->pdi_ds.sda_zoneeff;
 	zones->sdv_usable = pd->pdi_ds.sda_utgt;
 
-	if (pd->pdi_ds.sda_utgt > pd->pdi_ds.sda_uact)
-		zones->sdv_fusable = pd->pdi_ds.sda_utgt -
-				    pd->pdi_ds.sda_uact;
+	if (pd->pdi_ds.sda_utgt > uact)
+		zones->sdv_fusable = pd->pdi_ds.sda_utgt - uact;
 	else
 		zones->sdv_fusable = 0;
 
 	zones->sdv_spare = pd->pdi_ds.sda_stgt;
 	zones->sdv_fspare = pd->pdi_ds.sda_stgt - pd->pdi_ds.sda_sact;
-	zones->sdv_used = pd->pdi_ds.sda_uact;
+	zones->sdv_used = uact;
 }
 
 u32
@@ -9,6 +9,7 @@
 /* Forward Decls */
 struct mp_usage;
 struct mp_devprops;
+struct mp_devfrag;
 struct mpool_dev_info;
 struct mc_smap_parms;
 
@@ -53,7 +54,7 @@ static inline int saptype_valid(enum smap_space_type saptype)
  * @sda_dalock:
  * @sda_rgnsz:    number of zones per rgn, excepting last
  * @sda_rgnladdr: address of first zone in last rgn
- * @sda_rgnalloc: rgn last alloced from
+ * @sda_rgnalloc: rgn last alloced from, unless mp_smapcpurgn is set
  * @sda_zoneeff:    total zones (zonetot) minus bad zones
  * @sda_utgt:      target max usable zones to allocate
  * @sda_uact:      actual usable zones allocated
@@ -88,6 +89,68 @@ struct smap_dev_alloc {
 	u32        sda_sact;
 };
 
+/*
+ * Per-CPU zone magazines. Single-zone usable-space allocations are served
+ * from, and their frees returned to, a per-CPU magazine refilled with
+ * SMAP_ZMAG_BATCH contiguous zones at a time from the space map.
+ */
+#define SMAP_ZMAG_SZ       16
+#define SMAP_ZMAG_BATCH     8
+
+/**
+ * struct smap_zmag - per-CPU magazine of reserved zones
+ * @zm_lock:  taken by the owning CPU, only contended when draining
+ * @zm_cnt:   number of zones in zm_zonev
+ * @zm_zonev: addresses of single zones allocated in the space map and
+ *            charged to sda_uact, but not used by any object
+ */
+struct smap_zmag {
+	spinlock_t zm_lock;
+	u32        zm_cnt;
+	u64        zm_zonev[SMAP_ZMAG_SZ];
+};
+
+/*
+ * Activation bulk build. The extents inserted while loading the MDCs are
+ * staged per drive and carved from the space maps in one sorted pass.
+ *
+ * A clean deactivation checkpoints the free extents of the space maps to
+ * media. The next activation stages them as well, and a region whose
+ * checkpointed free extents match the zones left by the staged extents is
+ * rebuilt from them instead, without sorting or carving.
+ */
+#define SMAP_BULK_INIT     (64 * 1024)
+
+/**
+ * struct smap_bext - staged extent
+ * @sbe_zaddr: first zone of the extent
+ * @sbe_zcnt:  number of zones, the extent is within a single region
+ */
+struct smap_bext {
+	u64    sbe_zaddr;
+	u32    sbe_zcnt;
+};
+
+/**
+ * struct smap_bulk - extents staged for the bulk build of a drive smap
+ * @smb_lock:  serializes the MDC load jobs
+ * @smb_extv:  vmalloc'ed array of staged extents
+ * @smb_cnt:   number of extents in smb_extv
+ * @smb_max:   capacity of smb_extv
+ * @smb_freev: vmalloc'ed array of checkpointed free extents, in address order
+ * @smb_fcnt:  number of extents in smb_freev
+ * @smb_fmax:  capacity of smb_freev
+ */
+struct smap_bulk {
+	struct mutex        smb_lock;
+	struct smap_bext   *smb_extv;
+	u64                 smb_cnt;
+	u64                 smb_max;
+	struct smap_bext   *smb_freev;
+	u64                 smb_fcnt;
+	u64                 smb_fmax;
+};
+
 struct smap_dev_znstats {
 	u64    sdv_total;
 	u64    sdv_avail;
@@ -161,6 +224,73 @@ merr_t smap_mpool_init(struct mpool_descriptor *mp);
  */
 void smap_mpool_free(struct mpool_descriptor *mp);
 
+/**
+ * smap_mpool_bulk_start() - stage the inserts of an mpool activation
+ * @mp: struct mpool_descriptor *
+ *
+ * Must follow smap_mpool_init(). From then on smap_insert() only records
+ * the extents, until smap_mpool_bulk_end(), and smap_free() of a staged
+ * extent drops it. A drive whose staging array cannot be allocated keeps
+ * inserting into its space map directly.
+ *
+ * Return: void
+ */
+void smap_mpool_bulk_start(struct mpool_descriptor *mp);
+
+/**
+ * smap_mpool_bulk_ckpt() - stage a free extent of a space map checkpoint
+ * @mp:       struct mpool_descriptor *
+ * @pdh:      drive handle
+ * @zoneaddr: first zone of the free extent
+ * @zonecnt:  number of zones of the free extent
+ *
+ * Between smap_mpool_bulk_start() and smap_mpool_bulk_end(), records a free
+ * extent read from the checkpoint written by smap_drive_walk() at the last
+ * clean deactivation. The free extents of a drive must be staged in address
+ * order. Caller must ensure no other thread stages checkpoint extents.
+ *
+ * Return: 0 if successful, merr_t with the following errno values on
+ * failure:
+ * EINVAL if the extent is out of the drive or out of order
+ * ENOMEM if there is no memory available
+ */
+merr_t
+smap_mpool_bulk_ckpt(
+	struct mpool_descriptor    *mp,
+	u16                         pdh,
+	u64                         zoneaddr,
+	u32                         zonecnt);
+
+/**
+ * smap_mpool_bulk_ckpt_drop() - drop the staged checkpoint extents
+ * @mp: struct mpool_descriptor *
+ *
+ * For a checkpoint that turns out not to be valid while being read, the
+ * space maps are then built from the staged object extents alone.
+ */
+void smap_mpool_bulk_ckpt_drop(struct mpool_descriptor *mp);
+
+/**
+ * smap_mpool_bulk_end() - carve the staged extents from the space maps
+ * @mp: struct mpool_descriptor *
+ *
+ * A region for which free extents were staged by smap_mpool_bulk_ckpt() is
+ * rebuilt from them if they account for exactly the zones that the staged
+ * extents leave free, and lie within the free extents of the region.
+ *
+ * Otherwise, sorts the extents staged on each drive, then rebuilds each
+ * region's free extent tree left to right, or sets its bitmap, in a single
+ * pass. The old free extents and the staged extents are checked against
+ * each other the same way smap_insert() would; caller must ensure no other
+ * thread can access the space maps.
+ *
+ * Return: 0 if successful; merr_t with the following errno values on
+ * failure:
+ * EINVAL if a staged extent is not free, e.g. claimed by two objects
+ * ENOMEM if there is no memory available
+ */
+merr_t smap_mpool_bulk_end(struct mpool_descriptor *mp);
+
 /**
  * smap_mpool_usage() - present stats of smap usage
  * @mp: struct mpool_descriptor *
@@ -236,6 +366,61 @@ smap_drive_usage(
 	u16                         pdh,
 	struct mp_devprops         *dprop);
 
+/**
+ * smap_drive_fusable() - Get the free usable zones of a drive
+ * @mp:  struct mpool_descriptor *
+ * @pdh: drive number within the mpool_descriptor
+ *
+ * Unlike smap_drive_usage(), zones sitting in the per-CPU magazines are
+ * counted as used, so that the count is cheap enough to be taken on each
+ * allocation to balance the allocations across the drives of a media class.
+ *
+ * Return: number of free usable zones
+ */
+u32 smap_drive_fusable(struct mpool_descriptor *mp, u16 pdh);
+
+/**
+ * smap_drive_frag() - Report the free space fragmentation of a drive
+ * @mp:    struct mpool_descriptor *
+ * @pdh:   drive number within the mpool_descriptor
+ * @frag:  struct mp_devfrag *, structure to fill in
+ *
+ * Extent trees maintain their extent count and size histogram as they are
+ * updated, bitmaps are scanned. The regions are locked one at a time, so
+ * the report is not a snapshot of the whole drive. Caller must hold
+ * mp.pdvlock.
+ *
+ * Return: 0 if successful, merr_t otherwise
+ */
+merr_t
+smap_drive_frag(
+	struct mpool_descriptor    *mp,
+	u16                         pdh,
+	struct mp_devfrag          *frag);
+
+/**
+ * smap_drive_walk() - report the free extents of a drive
+ * @mp:   struct mpool_descriptor *
+ * @pdh:  drive number within the mpool_descriptor
+ * @func: called for each free extent in address order, the walk stops at
+ *        its first error
+ * @arg:  passed to @func
+ *
+ * Releases the zones of the drive's magazines first, so that the free
+ * extents reported are all the zones not used by an object. Used to
+ * checkpoint the space maps, see smap_mpool_bulk_ckpt(); caller must ensure
+ * no other thread can allocate or free on the drive.
+ *
+ * Return: 0 if successful, merr_t returned by @func otherwise
+ */
+merr_t
+smap_drive_walk(
+	struct mpool_descriptor    *mp,
+	u16                         pdh,
+	merr_t                    (*func)(void *arg, u16 pdh, u64 zoneaddr,
+					  u32 zonecnt),
+	void                       *arg);
+
 /**
  * smap_drive_init() - Initialize a specific drive within a mpool_descriptor
  * @mp:    struct mpool_descriptor *
@@ -294,6 +479,9 @@ smap_insert(struct mpool_descriptor *mp, u16 pdh, u64 zoneaddr, u32 zonecnt);
  * Attempt to allocate zonecnt contiguous virtual erase blocks on drive pdh
  * in accordance with space allocation policy sapolicy.
  *
+ * A single zone of usable space is taken from the CPU's zone magazine. The
+ * magazines are drained back to the space map before failing with ENOSPC.
+ *
  * Return: 0 if succcessful; merr_t otherwise
  */
 merr_t
@@ -315,6 +503,9 @@ smap_alloc(
  * Free currently allocated space starting at virtual erase block zoneaddr
  * and continuing for zonecnt blocks.
  *
+ * A single zone goes to the CPU's zone magazine unless spare space is in
+ * use, since freed zones must first go back to spare.
+ *
  * Return: 0 if successful, merr_t otherwise
  */
 merr_t
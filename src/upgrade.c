@@ -21,7 +21,7 @@
 #define MDCCVER_MAJOR 1
 #define MDCCVER_MINOR 0
 #define MDCCVER_PATCH 0
-#define MDCCVER_DEV   0
+#define MDCCVER_DEV   1
 
 /**
  * struct mdccver_info - mpool MDC content version and its information.
@@ -52,6 +52,14 @@ uint8_t mdccver_1_0_0_0_types[] = {
 	OMF_MDR_OERASE, OMF_MDR_MCCONFIG, OMF_MDR_MCSPARE, OMF_MDR_VERSION,
 	OMF_MDR_MPCONFIG};
 
+/*
+ * mpool MDC types used when MDC content is written at version 1.0.0.1.
+ */
+uint8_t mdccver_1_0_0_1_types[] = {
+	OMF_MDR_OCREATE, OMF_MDR_OUPDATE, OMF_MDR_ODELETE, OMF_MDR_OIDCKPT,
+	OMF_MDR_OERASE, OMF_MDR_MCCONFIG, OMF_MDR_MCSPARE, OMF_MDR_VERSION,
+	OMF_MDR_MPCONFIG, OMF_MDR_OSNAP, OMF_MDR_SMAPCKPT};
+
 
 /*
  * mdccver_info mdcc_ver[] - table of versions of mpool MDCs content.
@@ -78,9 +86,12 @@ uint8_t mdccver_1_0_0_0_types[] = {
  *   A third entry is added in the table with its vco_mdccver being 2.0.0.0.
  */
 struct mdccver_info mdcc_ver[] = {
-	{{ {MDCCVER_MAJOR, MDCCVER_MINOR, MDCCVER_PATCH, MDCCVER_DEV} },
+	{{ {1, 0, 0, 0} },
 	mdccver_1_0_0_0_types, sizeof(mdccver_1_0_0_0_types),
 	"Initial mpool MDCs content"},
+	{{ {MDCCVER_MAJOR, MDCCVER_MINOR, MDCCVER_PATCH, MDCCVER_DEV} },
+	mdccver_1_0_0_1_types, sizeof(mdccver_1_0_0_1_types),
+	"Object table snapshot of the user MDCs, space map checkpoint"},
 };
 
 #define _STR(x) #x